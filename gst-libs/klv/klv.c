@@ -39,23 +39,40 @@
 #include "config.h"
 #endif
 
+#include <string.h>
+
 #include <gst/tag/tag.h>
 #include "klv.h"
 
 /* We hide the implementation details, so that we have the option to implement
- * different/more efficient storage in future (unfortunately we can't put the
- * data inline with the meta allocation though since it's registered as fixed
- * size, although that could probably be fixed in a backwards compatible way).
- * GBytes means effectively two allocations, one for the GBytes, one for the
- * data. Plus one for the KLV meta struct.
+ * different/more efficient storage in future.
+ *
+ * Small packets (which is most of them, e.g. a typical MISB ST 0601 local set
+ * is well below 256 bytes) are stored inline right after the meta struct, so
+ * that attaching KLV data only costs the one allocation the buffer makes for
+ * the meta itself. Larger packets fall back to a GBytes, which means two more
+ * allocations, one for the GBytes and one for the data. Data that is added as
+ * GBytes by the caller is always kept as GBytes, since we can just take a ref.
+ * Data that already lives in a GstMemory (e.g. chunk data next to the image
+ * in a capture buffer) is referenced in place, with the memory kept mapped for
+ * the lifetime of the meta.
  *
  * For now we also assume that KLV data is always self-contained and one single
  * chunk of data, but in future we may have use cases where we might want to
  * relax that requirement. */
+#define GST_KLV_META_INLINE_SIZE 256
+
 typedef struct
 {
   GstKLVMeta klv_meta;
+  const guint8 *data;
+  gsize size;
+  /* backing storage, one of bytes, memory or inline_data, bytes may also be
+   * created lazily for the others if someone asks for a GBytes */
   GBytes *bytes;
+  GstMemory *memory;
+  GstMapInfo map;
+  guint8 inline_data[GST_KLV_META_INLINE_SIZE];
 } GstKLVMetaImpl;
 
 GType
@@ -76,7 +93,10 @@ gst_klv_meta_init (GstMeta * meta, gpointer params, GstBuffer * buffer)
 {
   GstKLVMetaImpl *impl = (GstKLVMetaImpl *) meta;
 
+  impl->data = NULL;
+  impl->size = 0;
   impl->bytes = NULL;
+  impl->memory = NULL;
   return TRUE;
 }
 
@@ -87,6 +107,11 @@ gst_klv_meta_clear (GstMeta * meta, GstBuffer * buffer)
 
   if (impl->bytes != NULL)
     g_bytes_unref (impl->bytes);
+
+  if (impl->memory != NULL) {
+    gst_memory_unmap (impl->memory, &impl->map);
+    gst_memory_unref (impl->memory);
+  }
 }
 
 static gboolean
@@ -99,7 +124,14 @@ gst_klv_meta_transform (GstBuffer * dest, GstMeta * meta,
   smeta = (GstKLVMetaImpl *) meta;
 
   if (GST_META_TRANSFORM_IS_COPY (type)) {
-    dmeta = gst_buffer_add_klv_meta_from_bytes (dest, smeta->bytes);
+    if (smeta->memory != NULL)
+      dmeta = gst_buffer_add_klv_meta_from_memory (dest, smeta->memory,
+          smeta->data - smeta->map.data, smeta->size);
+    else if (smeta->bytes != NULL)
+      dmeta = gst_buffer_add_klv_meta_from_bytes (dest, smeta->bytes);
+    else
+      dmeta = gst_buffer_add_klv_meta_from_data (dest, smeta->data,
+          smeta->size);
     if (!dmeta)
       return FALSE;
   } else {
@@ -126,31 +158,82 @@ gst_klv_meta_get_info (void)
 
 /* Add KLV meta data to a buffer */
 
+/* KLV coding shall use and only use a fixed 16-byte SMPTE-administered
+ * Universal Label, according to SMPTE 298M as Key (Rec. ITU R-BT.1653-1) */
+static gboolean
+gst_klv_meta_data_is_valid (const guint8 * data, gsize size)
+{
+  if (size < 16 || GST_READ_UINT32_BE (data) != 0x060E2B34) {
+    GST_ERROR ("Trying to attach a invalid KLV meta data to buffer");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static GstKLVMetaImpl *
+gst_buffer_add_klv_meta_impl (GstBuffer * buffer, gsize size)
+{
+  GST_TRACE ("Adding %u bytes of KLV data to buffer %p", (guint) size, buffer);
+
+  return (GstKLVMetaImpl *) gst_buffer_add_meta (buffer, GST_KLV_META_INFO,
+      NULL);
+}
+
 static GstKLVMeta *
 gst_buffer_add_klv_meta_internal (GstBuffer * buffer, GBytes * bytes)
 {
   GstKLVMetaImpl *impl;
-  GstKLVMeta *meta;
   gconstpointer data;
   gsize size;
 
-  /* KLV coding shall use and only use a fixed 16-byte SMPTE-administered
-   * Universal Label, according to SMPTE 298M as Key (Rec. ITU R-BT.1653-1) */
   data = g_bytes_get_data (bytes, &size);
-  if (size < 16 || GST_READ_UINT32_BE (data) != 0x060E2B34) {
-    GST_ERROR ("Trying to attach a invalid KLV meta data to buffer");
+  if (!gst_klv_meta_data_is_valid (data, size)) {
     g_bytes_unref (bytes);
     return NULL;
   }
 
-  meta = (GstKLVMeta *) gst_buffer_add_meta (buffer, GST_KLV_META_INFO, NULL);
+  impl = gst_buffer_add_klv_meta_impl (buffer, size);
+  impl->bytes = bytes;
+  impl->data = data;
+  impl->size = size;
 
-  GST_TRACE ("Adding %u bytes of KLV data to buffer %p", (guint) size, buffer);
+  return (GstKLVMeta *) impl;
+}
 
-  impl = (GstKLVMetaImpl *) meta;
-  impl->bytes = bytes;
+/* Copies data inline if it's small enough, otherwise falls back to GBytes.
+ * If @free_func is set, ownership of @data is transferred. */
+static GstKLVMeta *
+gst_buffer_add_klv_meta_internal_data (GstBuffer * buffer, guint8 * data,
+    gsize size, GDestroyNotify free_func)
+{
+  GstKLVMetaImpl *impl;
+
+  if (size > GST_KLV_META_INLINE_SIZE) {
+    GBytes *bytes;
+
+    if (free_func != NULL)
+      bytes = g_bytes_new_with_free_func (data, size, free_func, data);
+    else
+      bytes = g_bytes_new (data, size);
+
+    return gst_buffer_add_klv_meta_internal (buffer, bytes);
+  }
 
-  return meta;
+  if (!gst_klv_meta_data_is_valid (data, size)) {
+    if (free_func != NULL)
+      free_func (data);
+    return NULL;
+  }
+
+  impl = gst_buffer_add_klv_meta_impl (buffer, size);
+  memcpy (impl->inline_data, data, size);
+  impl->data = impl->inline_data;
+  impl->size = size;
+
+  if (free_func != NULL)
+    free_func (data);
+
+  return (GstKLVMeta *) impl;
 }
 
 /**
@@ -161,7 +244,9 @@ gst_buffer_add_klv_meta_internal (GstBuffer * buffer, GBytes * bytes)
  * @size: size of @data in bytes
  *
  * Attaches #GstKLVMeta metadata to @buffer with the given parameters,
- * Does not take ownership of @data.
+ * Does not take ownership of @data. Small packets are copied into storage
+ * that is allocated together with the meta, so no additional allocation is
+ * made for them.
  *
  * Returns: (transfer none): the #GstKLVMeta on @buffer.
  *
@@ -174,7 +259,8 @@ gst_buffer_add_klv_meta_from_data (GstBuffer * buffer, const guint8 * data,
   g_return_val_if_fail (buffer != NULL, NULL);
   g_return_val_if_fail (data != NULL && size > 16, NULL);
 
-  return gst_buffer_add_klv_meta_internal (buffer, g_bytes_new (data, size));
+  return gst_buffer_add_klv_meta_internal_data (buffer, (guint8 *) data, size,
+      NULL);
 }
 
 /**
@@ -198,8 +284,7 @@ gst_buffer_add_klv_meta_take_data (GstBuffer * buffer, guint8 * data,
   g_return_val_if_fail (buffer != NULL, NULL);
   g_return_val_if_fail (data != NULL && size > 16, NULL);
 
-  return gst_buffer_add_klv_meta_internal (buffer, g_bytes_new_take (data,
-          size));
+  return gst_buffer_add_klv_meta_internal_data (buffer, data, size, g_free);
 }
 
 /**
@@ -244,6 +329,65 @@ gst_buffer_add_klv_meta_take_bytes (GstBuffer * buffer, GBytes * bytes)
   return gst_buffer_add_klv_meta_internal (buffer, bytes);
 }
 
+/**
+ * gst_buffer_add_klv_meta_from_memory:
+ * @buffer: a #GstBuffer
+ * @memory: (transfer none): a #GstMemory containing KLV data
+ * @offset: offset of the KLV data in @memory, relative to its current offset
+ * @size: size of the KLV data in bytes
+ *
+ * Attaches #GstKLVMeta metadata to @buffer that references @size bytes of
+ * KLV data at @offset in @memory, without copying it, so data that is
+ * already present in (e.g. capture or ancillary) memory can be attached for
+ * free. gst_klv_meta_get_data() will return a pointer into @memory.
+ *
+ * @memory stays mapped for reading and referenced for as long as the meta
+ * exists, and copies of the meta made when the buffer is copied share it.
+ * Memory that has to go back to a pool is held until the last such meta is
+ * gone, e.g. with pleorasrc, whose sub-memories share the PvBuffer, a copied
+ * meta keeps that PvBuffer from returning to the acquisition pool.
+ *
+ * Returns: (transfer none): the #GstKLVMeta on @buffer.
+ *
+ * Since: 1.16
+ */
+GstKLVMeta *
+gst_buffer_add_klv_meta_from_memory (GstBuffer * buffer, GstMemory * memory,
+    gsize offset, gsize size)
+{
+  GstKLVMetaImpl *impl;
+  GstMapInfo map;
+
+  g_return_val_if_fail (buffer != NULL, NULL);
+  g_return_val_if_fail (memory != NULL, NULL);
+  g_return_val_if_fail (size > 16, NULL);
+
+  if (!gst_memory_map (memory, &map, GST_MAP_READ)) {
+    GST_ERROR ("Failed to map memory %p containing KLV data", memory);
+    return NULL;
+  }
+
+  if (offset + size > map.size) {
+    GST_ERROR ("KLV data (offset %" G_GSIZE_FORMAT ", size %" G_GSIZE_FORMAT
+        ") exceeds memory size %" G_GSIZE_FORMAT, offset, size, map.size);
+    gst_memory_unmap (memory, &map);
+    return NULL;
+  }
+
+  if (!gst_klv_meta_data_is_valid (map.data + offset, size)) {
+    gst_memory_unmap (memory, &map);
+    return NULL;
+  }
+
+  impl = gst_buffer_add_klv_meta_impl (buffer, size);
+  impl->memory = gst_memory_ref (memory);
+  impl->map = map;
+  impl->data = map.data + offset;
+  impl->size = size;
+
+  return (GstKLVMeta *) impl;
+}
+
 /* Get KLV meta data from a buffer */
 
 /**
@@ -279,13 +423,54 @@ gst_klv_meta_get_data (GstKLVMeta * klv_meta, gsize * size)
 
   impl = (GstKLVMetaImpl *) klv_meta;
 
-  return g_bytes_get_data (impl->bytes, size);
+  *size = impl->size;
+  return impl->data;
+}
+
+typedef struct
+{
+  GstMemory *memory;
+  GstMapInfo map;
+} GstKLVMemoryBytes;
+
+static void
+gst_klv_memory_bytes_free (gpointer data)
+{
+  GstKLVMemoryBytes *mb = data;
+
+  gst_memory_unmap (mb->memory, &mb->map);
+  gst_memory_unref (mb->memory);
+  g_free (mb);
+}
+
+/* Wraps a region of @memory in a GBytes that keeps its own mapping, so that it
+ * stays valid even if it outlives the meta. */
+static GBytes *
+gst_klv_meta_bytes_new_from_memory (GstMemory * memory, gsize offset,
+    gsize size)
+{
+  GstKLVMemoryBytes *mb;
+
+  mb = g_new (GstKLVMemoryBytes, 1);
+  if (!gst_memory_map (memory, &mb->map, GST_MAP_READ)) {
+    g_free (mb);
+    return NULL;
+  }
+  mb->memory = gst_memory_ref (memory);
+
+  return g_bytes_new_with_free_func (mb->map.data + offset, size,
+      gst_klv_memory_bytes_free, mb);
 }
 
 /**
  * gst_klv_meta_get_bytes:
  * @klv_meta: a #GstKLVMeta
  *
+ * If the data is stored inline, a #GBytes holding a copy of it is created on
+ * the first call, and if it references a #GstMemory, a #GBytes wrapping that
+ * memory is created, so prefer gst_klv_meta_get_data() where possible. This
+ * is safe to call from several threads on a meta shared read-only.
+ *
  * Returns: (transfer none): the KLV data as a #GBytes
  *
  * Since: 1.16
@@ -294,12 +479,864 @@ GBytes *
 gst_klv_meta_get_bytes (GstKLVMeta * klv_meta)
 {
   GstKLVMetaImpl *impl;
+  GBytes *bytes;
 
   g_return_val_if_fail (klv_meta != NULL, NULL);
 
   impl = (GstKLVMetaImpl *) klv_meta;
 
-  return impl->bytes;
+  bytes = g_atomic_pointer_get (&impl->bytes);
+  if (bytes != NULL)
+    return bytes;
+
+  if (impl->memory != NULL)
+    bytes = gst_klv_meta_bytes_new_from_memory (impl->memory,
+        impl->data - impl->map.data, impl->size);
+  else if (impl->data != NULL)
+    bytes = g_bytes_new (impl->data, impl->size);
+
+  if (bytes == NULL)
+    return NULL;
+
+  /* the meta may be shared read-only between threads, the first caller to
+   * publish its GBytes wins and the others use that one */
+  if (!g_atomic_pointer_compare_and_exchange (&impl->bytes, NULL, bytes)) {
+    g_bytes_unref (bytes);
+    bytes = g_atomic_pointer_get (&impl->bytes);
+  }
+
+  return bytes;
+}
+
+/* Parse KLV data without copying */
+
+/**
+ * gst_klv_parse_ber_length:
+ * @data: (array length=size): data starting with a BER encoded length
+ * @size: size of @data in bytes
+ * @length: (out): the decoded length
+ * @consumed: (out): number of bytes used by the encoded length
+ *
+ * Decodes a BER short or long form length as used for KLV lengths. The
+ * indefinite form is not allowed in KLV and is treated as an error.
+ *
+ * Returns: %TRUE if a complete length could be decoded
+ */
+gboolean
+gst_klv_parse_ber_length (const guint8 * data, gsize size, gsize * length,
+    guint * consumed)
+{
+  guint i, n;
+  guint64 len;
+
+  g_return_val_if_fail (length != NULL && consumed != NULL, FALSE);
+
+  if (size < 1)
+    return FALSE;
+
+  /* short form */
+  if (data[0] < 0x80) {
+    *length = data[0];
+    *consumed = 1;
+    return TRUE;
+  }
+
+  /* long form, first byte is the number of length bytes that follow */
+  n = data[0] & 0x7f;
+  if (n == 0 || n > 8 || n >= size)
+    return FALSE;
+
+  len = 0;
+  for (i = 1; i <= n; i++)
+    len = (len << 8) | data[i];
+
+  if (len > G_MAXSIZE)
+    return FALSE;
+
+  *length = (gsize) len;
+  *consumed = n + 1;
+  return TRUE;
+}
+
+/**
+ * gst_klv_parse_ber_oid:
+ * @data: (array length=size): data starting with a BER-OID encoded tag
+ * @size: size of @data in bytes
+ * @tag: (out): the decoded tag
+ * @consumed: (out): number of bytes used by the encoded tag
+ *
+ * Decodes a BER-OID encoded local set tag, where each byte contributes seven
+ * bits and the top bit marks that another byte follows. Any 32-bit tag, as
+ * written by gst_klv_encode_ber_oid() in up to five bytes, can be decoded.
+ *
+ * Returns: %TRUE if a complete tag could be decoded, %FALSE if @data is
+ *     truncated or the tag doesn't fit in 32 bits
+ */
+gboolean
+gst_klv_parse_ber_oid (const guint8 * data, gsize size, guint * tag,
+    guint * consumed)
+{
+  guint i, val = 0;
+
+  g_return_val_if_fail (tag != NULL && consumed != NULL, FALSE);
+
+  /* five bytes hold 35 bits, tags larger than 32 bits are not supported */
+  for (i = 0; i < size && i < 5; i++) {
+    if (val > G_MAXUINT32 >> 7)
+      return FALSE;
+
+    val = (val << 7) | (data[i] & 0x7f);
+    if (!(data[i] & 0x80)) {
+      *tag = val;
+      *consumed = i + 1;
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/**
+ * gst_klv_reader_init:
+ * @reader: a #GstKLVReader
+ * @data: (array length=size): KLV data, a sequence of packets or the value of
+ *     a local set
+ * @size: size of @data in bytes
+ *
+ * Initializes @reader to parse @data from the start. @data must stay valid for
+ * as long as the reader or anything returned by it is used.
+ */
+void
+gst_klv_reader_init (GstKLVReader * reader, const guint8 * data, gsize size)
+{
+  g_return_if_fail (reader != NULL);
+
+  reader->data = data;
+  reader->size = size;
+  reader->pos = 0;
+}
+
+/**
+ * gst_klv_reader_next_packet:
+ * @reader: a #GstKLVReader
+ * @key: (out) (optional): the 16-byte Universal Label key of the packet
+ * @value: (out) (optional): the value of the packet
+ * @length: (out) (optional): length of @value in bytes
+ *
+ * Reads the next KLV packet with a 16-byte Universal Label key. For a local
+ * set the returned value can then be walked with another #GstKLVReader and
+ * gst_klv_reader_next_item().
+ *
+ * Returns: %TRUE if a complete packet was read, %FALSE at the end of the data
+ *     or if the data is truncated or invalid
+ */
+gboolean
+gst_klv_reader_next_packet (GstKLVReader * reader, const guint8 ** key,
+    const guint8 ** value, gsize * length)
+{
+  const guint8 *data;
+  gsize avail, len;
+  guint n;
+
+  g_return_val_if_fail (reader != NULL, FALSE);
+
+  data = reader->data + reader->pos;
+  avail = reader->size - reader->pos;
+
+  if (avail < 17 || GST_READ_UINT32_BE (data) != 0x060E2B34)
+    return FALSE;
+
+  if (!gst_klv_parse_ber_length (data + 16, avail - 16, &len, &n))
+    return FALSE;
+
+  if (len > avail - 16 - n)
+    return FALSE;
+
+  if (key)
+    *key = data;
+  if (value)
+    *value = data + 16 + n;
+  if (length)
+    *length = len;
+
+  reader->pos += 16 + n + len;
+  return TRUE;
+}
+
+/**
+ * gst_klv_reader_next_item:
+ * @reader: a #GstKLVReader initialized with the value of a local set
+ * @tag: (out) (optional): the local set tag
+ * @value: (out) (optional): the value of the item
+ * @length: (out) (optional): length of @value in bytes
+ *
+ * Reads the next tag/length/value triple of a local set, with the tag BER-OID
+ * encoded and the length BER encoded, as used by e.g. MISB ST 0601.
+ *
+ * Returns: %TRUE if a complete item was read, %FALSE at the end of the data
+ *     or if the data is truncated or invalid
+ */
+gboolean
+gst_klv_reader_next_item (GstKLVReader * reader, guint * tag,
+    const guint8 ** value, gsize * length)
+{
+  const guint8 *data;
+  gsize avail, len;
+  guint t, n_tag, n_len;
+
+  g_return_val_if_fail (reader != NULL, FALSE);
+
+  data = reader->data + reader->pos;
+  avail = reader->size - reader->pos;
+
+  if (!gst_klv_parse_ber_oid (data, avail, &t, &n_tag))
+    return FALSE;
+
+  if (!gst_klv_parse_ber_length (data + n_tag, avail - n_tag, &len, &n_len))
+    return FALSE;
+
+  if (len > avail - n_tag - n_len)
+    return FALSE;
+
+  if (tag)
+    *tag = t;
+  if (value)
+    *value = data + n_tag + n_len;
+  if (length)
+    *length = len;
+
+  reader->pos += n_tag + n_len + len;
+  return TRUE;
+}
+
+/**
+ * gst_klv_local_set_find:
+ * @data: (array length=size): the value of a local set
+ * @size: size of @data in bytes
+ * @tag: the tag to look for
+ * @value: (out) (optional): the value of the item
+ * @length: (out) (optional): length of @value in bytes
+ *
+ * Looks up the first item with @tag in a local set, without copying.
+ *
+ * Returns: %TRUE if the tag was found
+ */
+gboolean
+gst_klv_local_set_find (const guint8 * data, gsize size, guint tag,
+    const guint8 ** value, gsize * length)
+{
+  GstKLVReader reader;
+  const guint8 *v;
+  gsize len;
+  guint t;
+
+  gst_klv_reader_init (&reader, data, size);
+  while (gst_klv_reader_next_item (&reader, &t, &v, &len)) {
+    if (t == tag) {
+      if (value)
+        *value = v;
+      if (length)
+        *length = len;
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/* Build KLV local sets from a template */
+
+/**
+ * gst_klv_encode_ber_length:
+ * @length: the length to encode
+ * @data: (out caller-allocates) (array fixed-size=9) (nullable): where to
+ *     write the encoded length, or %NULL to only compute its size
+ *
+ * Encodes @length in BER short form if it is below 128, and in BER long form
+ * with the minimal number of bytes otherwise.
+ *
+ * Returns: the number of bytes used by the encoded length
+ */
+guint
+gst_klv_encode_ber_length (gsize length, guint8 * data)
+{
+  guint i, n = 0;
+  guint64 len = length;
+
+  if (length < 0x80) {
+    if (data)
+      data[0] = (guint8) length;
+    return 1;
+  }
+
+  while (len > 0) {
+    len >>= 8;
+    n++;
+  }
+
+  if (data) {
+    data[0] = 0x80 | n;
+    for (i = 0; i < n; i++)
+      data[n - i] = (guint8) (((guint64) length) >> (8 * i));
+  }
+
+  return n + 1;
+}
+
+/**
+ * gst_klv_encode_ber_oid:
+ * @tag: the local set tag to encode
+ * @data: (out caller-allocates) (array fixed-size=5) (nullable): where to
+ *     write the encoded tag, or %NULL to only compute its size
+ *
+ * Encodes a local set tag in BER-OID form.
+ *
+ * Returns: the number of bytes used by the encoded tag
+ */
+guint
+gst_klv_encode_ber_oid (guint tag, guint8 * data)
+{
+  guint i, n = 1;
+
+  while (n < 5 && (tag >> (7 * n)) != 0)
+    n++;
+
+  if (data) {
+    for (i = 0; i < n; i++) {
+      data[i] = (tag >> (7 * (n - 1 - i))) & 0x7f;
+      if (i < n - 1)
+        data[i] |= 0x80;
+    }
+  }
+
+  return n;
+}
+
+typedef struct
+{
+  /* offset of the value relative to the start of the local set */
+  gsize offset;
+  gsize length;
+} GstKLVBuilderItem;
+
+struct _GstKLVBuilder
+{
+  /* key + BER length + local set items */
+  GByteArray *data;
+  guint header_size;
+  GArray *items;
+};
+
+/**
+ * gst_klv_builder_new:
+ * @key: (array fixed-size=16): the 16-byte Universal Label key of the set
+ *
+ * Creates a builder for a KLV local set. Items are added once with
+ * gst_klv_builder_add_item(), which serializes them into a template with the
+ * packet length computed in BER short or long form as needed. For every packet
+ * only the changing values are then patched in place with
+ * gst_klv_builder_set_item() or gst_klv_builder_set_item_uint(), without
+ * re-serializing the set.
+ *
+ * Returns: (transfer full): a new #GstKLVBuilder, free with
+ *     gst_klv_builder_free()
+ */
+GstKLVBuilder *
+gst_klv_builder_new (const guint8 * key)
+{
+  GstKLVBuilder *builder;
+
+  g_return_val_if_fail (key != NULL, NULL);
+  g_return_val_if_fail (GST_READ_UINT32_BE (key) == 0x060E2B34, NULL);
+
+  builder = g_new0 (GstKLVBuilder, 1);
+  builder->data = g_byte_array_sized_new (128);
+  g_byte_array_append (builder->data, key, 16);
+  /* empty local set, short form length */
+  g_byte_array_append (builder->data, (const guint8 *) "\0", 1);
+  builder->header_size = 17;
+  builder->items = g_array_new (FALSE, FALSE, sizeof (GstKLVBuilderItem));
+
+  return builder;
+}
+
+/**
+ * gst_klv_builder_free:
+ * @builder: (transfer full): a #GstKLVBuilder
+ *
+ * Frees @builder.
+ */
+void
+gst_klv_builder_free (GstKLVBuilder * builder)
+{
+  g_return_if_fail (builder != NULL);
+
+  g_byte_array_unref (builder->data);
+  g_array_unref (builder->items);
+  g_free (builder);
+}
+
+/**
+ * gst_klv_builder_add_item:
+ * @builder: a #GstKLVBuilder
+ * @tag: the local set tag
+ * @value: (array length=length) (nullable): initial value of the item, or
+ *     %NULL to fill it with zeroes
+ * @length: length of the value in bytes, which is fixed from now on
+ *
+ * Appends an item to the local set layout. This may move the data of all
+ * previously added items, so it should be done once up front.
+ *
+ * Returns: the index of the new item, to be used for patching its value
+ */
+gint
+gst_klv_builder_add_item (GstKLVBuilder * builder, guint tag,
+    const guint8 * value, gsize length)
+{
+  GstKLVBuilderItem item;
+  guint8 header[16];
+  guint n_tag, n_len, header_size;
+  gsize set_size, old_len;
+
+  g_return_val_if_fail (builder != NULL, -1);
+
+  n_tag = gst_klv_encode_ber_oid (tag, header);
+  n_len = gst_klv_encode_ber_length (length, header + n_tag);
+
+  /* grow the set and re-encode the set length, which might need more bytes */
+  set_size = builder->data->len - builder->header_size + n_tag + n_len +
+      length;
+  header_size = 16 + gst_klv_encode_ber_length (set_size, NULL);
+
+  old_len = builder->data->len;
+  g_byte_array_set_size (builder->data, header_size + set_size);
+  if (header_size != builder->header_size) {
+    memmove (builder->data->data + header_size,
+        builder->data->data + builder->header_size,
+        old_len - builder->header_size);
+  }
+  gst_klv_encode_ber_length (set_size, builder->data->data + 16);
+
+  item.offset = old_len - builder->header_size + n_tag + n_len;
+  item.length = length;
+
+  memcpy (builder->data->data + header_size + item.offset - n_tag - n_len,
+      header, n_tag + n_len);
+  if (value)
+    memcpy (builder->data->data + header_size + item.offset, value, length);
+  else
+    memset (builder->data->data + header_size + item.offset, 0, length);
+
+  builder->header_size = header_size;
+  g_array_append_val (builder->items, item);
+
+  return builder->items->len - 1;
+}
+
+/**
+ * gst_klv_builder_get_item_data:
+ * @builder: a #GstKLVBuilder
+ * @item: index of the item as returned by gst_klv_builder_add_item()
+ * @length: (out) (optional): length of the item value in bytes
+ *
+ * Returns a pointer to the value of @item in the template, so it can be
+ * written in place. The pointer is invalidated by adding more items.
+ *
+ * Returns: (transfer none): the value of @item, or %NULL if @item is invalid
+ */
+guint8 *
+gst_klv_builder_get_item_data (GstKLVBuilder * builder, gint item,
+    gsize * length)
+{
+  GstKLVBuilderItem *it;
+
+  g_return_val_if_fail (builder != NULL, NULL);
+  g_return_val_if_fail (item >= 0 && item < (gint) builder->items->len, NULL);
+
+  it = &g_array_index (builder->items, GstKLVBuilderItem, item);
+  if (length)
+    *length = it->length;
+
+  return builder->data->data + builder->header_size + it->offset;
+}
+
+/**
+ * gst_klv_builder_set_item:
+ * @builder: a #GstKLVBuilder
+ * @item: index of the item as returned by gst_klv_builder_add_item()
+ * @value: (array length=length): new value of the item
+ * @length: length of @value, must match the length the item was added with
+ *
+ * Overwrites the value of @item in the template.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+gst_klv_builder_set_item (GstKLVBuilder * builder, gint item,
+    const guint8 * value, gsize length)
+{
+  guint8 *data;
+  gsize item_length;
+
+  data = gst_klv_builder_get_item_data (builder, item, &item_length);
+  g_return_val_if_fail (data != NULL, FALSE);
+  g_return_val_if_fail (length == item_length, FALSE);
+
+  memcpy (data, value, length);
+  return TRUE;
+}
+
+/**
+ * gst_klv_builder_set_item_uint:
+ * @builder: a #GstKLVBuilder
+ * @item: index of the item as returned by gst_klv_builder_add_item()
+ * @value: new value of the item
+ *
+ * Overwrites the value of @item in the template with @value in big-endian
+ * byte order, truncated to the length of the item (1 to 8 bytes). Signed
+ * values can be passed cast to #guint64.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+gst_klv_builder_set_item_uint (GstKLVBuilder * builder, gint item,
+    guint64 value)
+{
+  guint8 *data;
+  gsize i, length;
+
+  data = gst_klv_builder_get_item_data (builder, item, &length);
+  g_return_val_if_fail (data != NULL, FALSE);
+  g_return_val_if_fail (length >= 1 && length <= 8, FALSE);
+
+  for (i = 0; i < length; i++)
+    data[length - 1 - i] = (guint8) (value >> (8 * i));
+
+  return TRUE;
+}
+
+/**
+ * gst_klv_builder_get_data:
+ * @builder: a #GstKLVBuilder
+ * @size: (out): size of the returned data in bytes
+ *
+ * Returns: (transfer none): the complete KLV packet in its current state
+ */
+const guint8 *
+gst_klv_builder_get_data (GstKLVBuilder * builder, gsize * size)
+{
+  g_return_val_if_fail (builder != NULL, NULL);
+  g_return_val_if_fail (size != NULL, NULL);
+
+  *size = builder->data->len;
+  return builder->data->data;
+}
+
+/**
+ * gst_buffer_add_klv_meta_from_builder:
+ * @buffer: a #GstBuffer
+ * @builder: a #GstKLVBuilder
+ *
+ * Attaches the current state of the packet in @builder to @buffer. The data
+ * is copied, so @builder can be patched for the next packet right away.
+ *
+ * Returns: (transfer none): the #GstKLVMeta on @buffer.
+ */
+GstKLVMeta *
+gst_buffer_add_klv_meta_from_builder (GstBuffer * buffer,
+    GstKLVBuilder * builder)
+{
+  g_return_val_if_fail (builder != NULL, NULL);
+
+  return gst_buffer_add_klv_meta_from_data (buffer, builder->data->data,
+      builder->data->len);
+}
+
+/* CRC-16-CCITT */
+
+#define CRC16_CCITT_POLY 0x1021
+
+/* crc16_tables[k][n] is the CRC of byte n followed by k zero bytes, so eight
+ * bytes can be folded into the CRC with eight independent lookups
+ * (slice-by-8) instead of a dependent lookup per byte */
+static guint16 crc16_tables[8][256];
+
+static gpointer
+gst_klv_crc16_init_tables (gpointer data)
+{
+  guint i, j, k;
+
+  for (i = 0; i < 256; i++) {
+    guint16 crc = i << 8;
+
+    for (j = 0; j < 8; j++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ CRC16_CCITT_POLY : crc << 1;
+    crc16_tables[0][i] = crc;
+  }
+
+  for (k = 1; k < 8; k++) {
+    for (i = 0; i < 256; i++) {
+      guint16 crc = crc16_tables[k - 1][i];
+
+      crc16_tables[k][i] = (crc << 8) ^ crc16_tables[0][crc >> 8];
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * gst_klv_crc16_ccitt_update:
+ * @crc: the CRC of the preceding data, or 0xFFFF to start
+ * @data: (array length=size): data to add to the CRC
+ * @size: size of @data in bytes
+ *
+ * Continues a CRC-16-CCITT (polynomial 0x1021, not reflected, no final XOR)
+ * over @data.
+ *
+ * Returns: the updated CRC
+ */
+guint16
+gst_klv_crc16_ccitt_update (guint16 crc, const guint8 * data, gsize size)
+{
+  static GOnce once = G_ONCE_INIT;
+  const guint16 (*t)[256] = (const guint16 (*)[256]) crc16_tables;
+
+  g_return_val_if_fail (data != NULL || size == 0, crc);
+
+  g_once (&once, gst_klv_crc16_init_tables, NULL);
+
+  while (size >= 8) {
+    crc = t[7][data[0] ^ (crc >> 8)] ^ t[6][data[1] ^ (crc & 0xff)] ^
+        t[5][data[2]] ^ t[4][data[3]] ^ t[3][data[4]] ^ t[2][data[5]] ^
+        t[1][data[6]] ^ t[0][data[7]];
+    data += 8;
+    size -= 8;
+  }
+
+  while (size--)
+    crc = (crc << 8) ^ t[0][(crc >> 8) ^ *data++];
+
+  return crc;
+}
+
+/**
+ * gst_klv_crc16_ccitt:
+ * @data: (array length=size): data to compute the CRC of
+ * @size: size of @data in bytes
+ *
+ * Computes the CRC-16-CCITT of @data with an initial value of 0xFFFF. Note
+ * that MISB ST 0601 packets use a 16-bit sum instead, see
+ * gst_klv_st0601_checksum().
+ *
+ * Returns: the CRC of @data
+ */
+guint16
+gst_klv_crc16_ccitt (const guint8 * data, gsize size)
+{
+  return gst_klv_crc16_ccitt_update (0xffff, data, size);
+}
+
+/* Reuse of unchanged payloads */
+
+typedef struct
+{
+  GBytes *bytes;
+  guint16 hash;
+} GstKLVPayloadCacheEntry;
+
+struct _GstKLVPayloadCache
+{
+  GstKLVPayloadCacheEntry *entries;
+  guint n_entries;
+  guint next;
+
+  guint64 hits;
+  guint64 lookups;
+  guint64 inlined;
+};
+
+/**
+ * gst_klv_payload_cache_new:
+ * @n_entries: number of recent payloads to remember
+ *
+ * Creates a cache of recently attached KLV payloads. Static local sets, e.g.
+ * with the platform designation or mission id, are often byte-identical from
+ * frame to frame. Attaching them through the cache with
+ * gst_buffer_add_klv_meta_from_cache() adds a ref to the #GBytes of an
+ * identical earlier payload instead of allocating and copying a new one.
+ *
+ * Payloads are matched by a CRC-16 of the data and the size, and confirmed by
+ * comparing the data. Only payloads larger than 256 bytes are worth sharing,
+ * smaller ones are stored inline with the meta without a separate allocation.
+ *
+ * Returns: (transfer full): a new #GstKLVPayloadCache, free with
+ *     gst_klv_payload_cache_free()
+ */
+GstKLVPayloadCache *
+gst_klv_payload_cache_new (guint n_entries)
+{
+  GstKLVPayloadCache *cache;
+
+  g_return_val_if_fail (n_entries > 0, NULL);
+
+  cache = g_new0 (GstKLVPayloadCache, 1);
+  cache->entries = g_new0 (GstKLVPayloadCacheEntry, n_entries);
+  cache->n_entries = n_entries;
+
+  return cache;
+}
+
+/**
+ * gst_klv_payload_cache_free:
+ * @cache: (transfer full): a #GstKLVPayloadCache
+ *
+ * Frees @cache and drops its refs to the remembered payloads.
+ */
+void
+gst_klv_payload_cache_free (GstKLVPayloadCache * cache)
+{
+  g_return_if_fail (cache != NULL);
+
+  gst_klv_payload_cache_clear (cache);
+  g_free (cache->entries);
+  g_free (cache);
+}
+
+/**
+ * gst_klv_payload_cache_clear:
+ * @cache: a #GstKLVPayloadCache
+ *
+ * Forgets all remembered payloads and resets the statistics.
+ */
+void
+gst_klv_payload_cache_clear (GstKLVPayloadCache * cache)
+{
+  guint i;
+
+  g_return_if_fail (cache != NULL);
+
+  for (i = 0; i < cache->n_entries; i++) {
+    if (cache->entries[i].bytes)
+      g_bytes_unref (cache->entries[i].bytes);
+    cache->entries[i].bytes = NULL;
+  }
+  cache->next = 0;
+  cache->hits = 0;
+  cache->lookups = 0;
+  cache->inlined = 0;
+}
+
+static GBytes *
+gst_klv_payload_cache_find (GstKLVPayloadCache * cache, guint16 hash,
+    const guint8 * data, gsize size)
+{
+  guint i;
+
+  cache->lookups++;
+
+  for (i = 0; i < cache->n_entries; i++) {
+    GstKLVPayloadCacheEntry *entry = &cache->entries[i];
+    gconstpointer entry_data;
+    gsize entry_size;
+
+    if (entry->bytes == NULL || entry->hash != hash)
+      continue;
+
+    entry_data = g_bytes_get_data (entry->bytes, &entry_size);
+    if (entry_size == size && memcmp (entry_data, data, size) == 0) {
+      cache->hits++;
+      return entry->bytes;
+    }
+  }
+
+  return NULL;
+}
+
+static void
+gst_klv_payload_cache_insert (GstKLVPayloadCache * cache, guint16 hash,
+    GBytes * bytes)
+{
+  GstKLVPayloadCacheEntry *entry = &cache->entries[cache->next];
+
+  if (entry->bytes)
+    g_bytes_unref (entry->bytes);
+  entry->bytes = g_bytes_ref (bytes);
+  entry->hash = hash;
+
+  cache->next = (cache->next + 1) % cache->n_entries;
+}
+
+/**
+ * gst_klv_payload_cache_get_stats:
+ * @cache: a #GstKLVPayloadCache
+ * @hits: (out) (optional): number of lookups that found an identical payload
+ * @lookups: (out) (optional): total number of lookups
+ * @inlined: (out) (optional): number of payloads stored inline without a
+ *     lookup
+ *
+ * Returns the statistics since @cache was created or last cleared. Neither
+ * hits nor inlined payloads allocate a copy, so together they show how many
+ * allocations @cache saved.
+ */
+void
+gst_klv_payload_cache_get_stats (GstKLVPayloadCache * cache, guint64 * hits,
+    guint64 * lookups, guint64 * inlined)
+{
+  g_return_if_fail (cache != NULL);
+
+  if (hits)
+    *hits = cache->hits;
+  if (lookups)
+    *lookups = cache->lookups;
+  if (inlined)
+    *inlined = cache->inlined;
+}
+
+/**
+ * gst_buffer_add_klv_meta_from_cache:
+ * @buffer: a #GstBuffer
+ * @cache: a #GstKLVPayloadCache
+ * @data: (array length=size): KLV data with 16-byte KLV Universal Label prefix
+ * @size: size of @data in bytes
+ *
+ * Attaches #GstKLVMeta metadata to @buffer. If an identical payload was
+ * attached through @cache recently, only a ref to its #GBytes is added,
+ * otherwise @data is copied into a new #GBytes that is remembered in @cache.
+ *
+ * Payloads of up to 256 bytes are copied inline as with
+ * gst_buffer_add_klv_meta_from_data(), which needs no allocation of its own,
+ * and bypass the lookup. They are counted separately in the statistics.
+ *
+ * Returns: (transfer none): the #GstKLVMeta on @buffer.
+ */
+GstKLVMeta *
+gst_buffer_add_klv_meta_from_cache (GstBuffer * buffer,
+    GstKLVPayloadCache * cache, const guint8 * data, gsize size)
+{
+  GBytes *bytes;
+  guint16 hash;
+
+  g_return_val_if_fail (buffer != NULL, NULL);
+  g_return_val_if_fail (cache != NULL, NULL);
+  g_return_val_if_fail (data != NULL && size > 16, NULL);
+
+  /* sharing a GBytes costs more than copying into the meta */
+  if (size <= GST_KLV_META_INLINE_SIZE) {
+    cache->inlined++;
+    return gst_buffer_add_klv_meta_from_data (buffer, data, size);
+  }
+
+  hash = gst_klv_crc16_ccitt (data, size);
+
+  bytes = gst_klv_payload_cache_find (cache, hash, data, size);
+  if (bytes)
+    return gst_buffer_add_klv_meta_from_bytes (buffer, bytes);
+
+  bytes = g_bytes_new (data, size);
+  gst_klv_payload_cache_insert (cache, hash, bytes);
+
+  return gst_buffer_add_klv_meta_take_bytes (buffer, bytes);
 }
 
 /* Boxed type, so bindings can use the API */
@@ -311,7 +1348,24 @@ gst_klv_meta_copy_boxed (gpointer boxed)
   GstKLVMetaImpl *copy;
 
   copy = g_new (GstKLVMetaImpl, 1);
-  copy->bytes = impl->bytes ? g_bytes_ref (impl->bytes) : NULL;
+  copy->klv_meta = impl->klv_meta;
+  copy->size = impl->size;
+  copy->memory = NULL;
+  if (impl->memory != NULL) {
+    copy->bytes = gst_klv_meta_bytes_new_from_memory (impl->memory,
+        impl->data - impl->map.data, impl->size);
+    /* if the memory can't be mapped again, copy from our own mapping */
+    if (copy->bytes == NULL)
+      copy->bytes = g_bytes_new (impl->data, impl->size);
+    copy->data = g_bytes_get_data (copy->bytes, NULL);
+  } else if (impl->bytes != NULL) {
+    copy->bytes = g_bytes_ref (impl->bytes);
+    copy->data = g_bytes_get_data (copy->bytes, NULL);
+  } else {
+    copy->bytes = NULL;
+    memcpy (copy->inline_data, impl->inline_data, impl->size);
+    copy->data = impl->data ? copy->inline_data : NULL;
+  }
   return copy;
 }
 
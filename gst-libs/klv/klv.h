@@ -84,6 +84,9 @@ GstKLVMeta        * gst_buffer_add_klv_meta_from_bytes (GstBuffer * buffer, GByt
 GST_TAG_API
 GstKLVMeta        * gst_buffer_add_klv_meta_take_bytes (GstBuffer * buffer, GBytes * bytes);
 
+GST_TAG_API
+GstKLVMeta        * gst_buffer_add_klv_meta_from_memory (GstBuffer * buffer, GstMemory * memory, gsize offset, gsize size);
+
 /* Get KLV meta data from a buffer */
 
 GST_TAG_API
@@ -95,6 +98,115 @@ const guint8      * gst_klv_meta_get_data (GstKLVMeta * klv_meta, gsize * size);
 GST_TAG_API
 GBytes            * gst_klv_meta_get_bytes (GstKLVMeta * klv_meta);
 
+/* Parse KLV data without copying */
+
+/**
+ * GstKLVReader:
+ * @data: (array length=size): data to parse
+ * @size: size of @data in bytes
+ * @pos: current position in @data
+ *
+ * A cursor for walking KLV packets or local set items in place. It never
+ * allocates and all returned pointers point into @data.
+ */
+typedef struct {
+  const guint8 *data;
+  gsize size;
+  gsize pos;
+} GstKLVReader;
+
+GST_TAG_API
+void                gst_klv_reader_init (GstKLVReader * reader, const guint8 * data, gsize size);
+
+GST_TAG_API
+gboolean            gst_klv_reader_next_packet (GstKLVReader * reader, const guint8 ** key, const guint8 ** value, gsize * length);
+
+GST_TAG_API
+gboolean            gst_klv_reader_next_item (GstKLVReader * reader, guint * tag, const guint8 ** value, gsize * length);
+
+GST_TAG_API
+gboolean            gst_klv_parse_ber_length (const guint8 * data, gsize size, gsize * length, guint * consumed);
+
+GST_TAG_API
+gboolean            gst_klv_parse_ber_oid (const guint8 * data, gsize size, guint * tag, guint * consumed);
+
+GST_TAG_API
+gboolean            gst_klv_local_set_find (const guint8 * data, gsize size, guint tag, const guint8 ** value, gsize * length);
+
+/* Build KLV local sets from a template */
+
+GST_TAG_API
+guint               gst_klv_encode_ber_length (gsize length, guint8 * data);
+
+GST_TAG_API
+guint               gst_klv_encode_ber_oid (guint tag, guint8 * data);
+
+/**
+ * GstKLVBuilder:
+ *
+ * An opaque structure holding a serialized KLV local set whose layout is
+ * defined once, so that only the values that change need to be written for
+ * each packet.
+ */
+typedef struct _GstKLVBuilder GstKLVBuilder;
+
+GST_TAG_API
+GstKLVBuilder     * gst_klv_builder_new (const guint8 * key);
+
+GST_TAG_API
+void                gst_klv_builder_free (GstKLVBuilder * builder);
+
+GST_TAG_API
+gint                gst_klv_builder_add_item (GstKLVBuilder * builder, guint tag, const guint8 * value, gsize length);
+
+GST_TAG_API
+guint8            * gst_klv_builder_get_item_data (GstKLVBuilder * builder, gint item, gsize * length);
+
+GST_TAG_API
+gboolean            gst_klv_builder_set_item (GstKLVBuilder * builder, gint item, const guint8 * value, gsize length);
+
+GST_TAG_API
+gboolean            gst_klv_builder_set_item_uint (GstKLVBuilder * builder, gint item, guint64 value);
+
+GST_TAG_API
+const guint8      * gst_klv_builder_get_data (GstKLVBuilder * builder, gsize * size);
+
+GST_TAG_API
+GstKLVMeta        * gst_buffer_add_klv_meta_from_builder (GstBuffer * buffer, GstKLVBuilder * builder);
+
+/* Checksums */
+
+GST_TAG_API
+guint16             gst_klv_crc16_ccitt (const guint8 * data, gsize size);
+
+GST_TAG_API
+guint16             gst_klv_crc16_ccitt_update (guint16 crc, const guint8 * data, gsize size);
+
+/* Reuse of unchanged payloads */
+
+/**
+ * GstKLVPayloadCache:
+ *
+ * An opaque structure remembering recently attached KLV payloads, so that
+ * identical payloads can share one #GBytes.
+ */
+typedef struct _GstKLVPayloadCache GstKLVPayloadCache;
+
+GST_TAG_API
+GstKLVPayloadCache * gst_klv_payload_cache_new (guint n_entries);
+
+GST_TAG_API
+void                gst_klv_payload_cache_free (GstKLVPayloadCache * cache);
+
+GST_TAG_API
+void                gst_klv_payload_cache_clear (GstKLVPayloadCache * cache);
+
+GST_TAG_API
+void                gst_klv_payload_cache_get_stats (GstKLVPayloadCache * cache, guint64 * hits, guint64 * lookups, guint64 * inlined);
+
+GST_TAG_API
+GstKLVMeta        * gst_buffer_add_klv_meta_from_cache (GstBuffer * buffer, GstKLVPayloadCache * cache, const guint8 * data, gsize size);
+
 G_END_DECLS
 
 #endif /* __GST_TAG_KLV_H__ */
@@ -0,0 +1,796 @@
+/* GStreamer KLV Metadata Support Library
+ * Copyright (C) 2016-2019 Tim-Philipp Müller <tim@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:gstklvst0601
+ * @short_description: MISB ST 0601 UAS Datalink Local Set support
+ * @title: MISB ST 0601 support
+ *
+ * <refsect2>
+ * <para>
+ * Encoding and decoding of MISB ST 0601 UAS Datalink Local Set tags, driven
+ * by a static table that describes the length, type and mapping to
+ * engineering units of every tag.
+ * </para>
+ * <para>
+ * Decoding works on single tags, straight from the serialized set, so a
+ * caller only pays for the tags it is interested in. Encoding writes the
+ * values into a #GstKLVBuilder template.
+ * </para>
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "klvst0601.h"
+
+static const guint8 st0601_key[16] = { 0x06, 0x0e, 0x2b, 0x34, 0x02, 0x0b,
+  0x01, 0x01, 0x0e, 0x01, 0x03, 0x01, 0x01, 0x00, 0x00, 0x00
+};
+
+#define TAG_UINT(t,n,l)      [t] = { t, n, GST_KLV_ST0601_TYPE_UINT, l, 0, 0 }
+#define TAG_INT(t,n,l)       [t] = { t, n, GST_KLV_ST0601_TYPE_INT, l, 0, 0 }
+#define TAG_UMAP(t,n,l,a,b)  [t] = { t, n, GST_KLV_ST0601_TYPE_UMAPPED, l, a, b }
+#define TAG_IMAP(t,n,l,b)    [t] = { t, n, GST_KLV_ST0601_TYPE_IMAPPED, l, -b, b }
+#define TAG_STRING(t,n)      [t] = { t, n, GST_KLV_ST0601_TYPE_STRING, 0, 0, 0 }
+#define TAG_BYTES(t,n)       [t] = { t, n, GST_KLV_ST0601_TYPE_BYTES, 0, 0, 0 }
+#define TAG_LOCAL_SET(t,n)   [t] = { t, n, GST_KLV_ST0601_TYPE_LOCAL_SET, 0, 0, 0 }
+
+/* indexed by tag, see MISB ST 0601 table 1 */
+static const GstKLVST0601TagInfo st0601_tags[GST_KLV_ST0601_MAX_TAG + 1] = {
+  TAG_UINT (1, "checksum", 2),
+  TAG_UINT (2, "precision-time-stamp", 8),
+  TAG_STRING (3, "mission-id"),
+  TAG_STRING (4, "platform-tail-number"),
+  TAG_UMAP (5, "platform-heading-angle", 2, 0, 360),
+  TAG_IMAP (6, "platform-pitch-angle", 2, 20),
+  TAG_IMAP (7, "platform-roll-angle", 2, 50),
+  TAG_UINT (8, "platform-true-airspeed", 1),
+  TAG_UINT (9, "platform-indicated-airspeed", 1),
+  TAG_STRING (10, "platform-designation"),
+  TAG_STRING (11, "image-source-sensor"),
+  TAG_STRING (12, "image-coordinate-system"),
+  TAG_IMAP (13, "sensor-latitude", 4, 90),
+  TAG_IMAP (14, "sensor-longitude", 4, 180),
+  TAG_UMAP (15, "sensor-true-altitude", 2, -900, 19000),
+  TAG_UMAP (16, "sensor-horizontal-fov", 2, 0, 180),
+  TAG_UMAP (17, "sensor-vertical-fov", 2, 0, 180),
+  TAG_UMAP (18, "sensor-relative-azimuth-angle", 4, 0, 360),
+  TAG_IMAP (19, "sensor-relative-elevation-angle", 4, 180),
+  TAG_UMAP (20, "sensor-relative-roll-angle", 4, 0, 360),
+  TAG_UMAP (21, "slant-range", 4, 0, 5000000),
+  TAG_UMAP (22, "target-width", 2, 0, 10000),
+  TAG_IMAP (23, "frame-center-latitude", 4, 90),
+  TAG_IMAP (24, "frame-center-longitude", 4, 180),
+  TAG_UMAP (25, "frame-center-elevation", 2, -900, 19000),
+  TAG_IMAP (26, "offset-corner-latitude-point-1", 2, 0.075),
+  TAG_IMAP (27, "offset-corner-longitude-point-1", 2, 0.075),
+  TAG_IMAP (28, "offset-corner-latitude-point-2", 2, 0.075),
+  TAG_IMAP (29, "offset-corner-longitude-point-2", 2, 0.075),
+  TAG_IMAP (30, "offset-corner-latitude-point-3", 2, 0.075),
+  TAG_IMAP (31, "offset-corner-longitude-point-3", 2, 0.075),
+  TAG_IMAP (32, "offset-corner-latitude-point-4", 2, 0.075),
+  TAG_IMAP (33, "offset-corner-longitude-point-4", 2, 0.075),
+  TAG_UINT (34, "icing-detected", 1),
+  TAG_UMAP (35, "wind-direction", 2, 0, 360),
+  TAG_UMAP (36, "wind-speed", 1, 0, 100),
+  TAG_UMAP (37, "static-pressure", 2, 0, 5000),
+  TAG_UMAP (38, "density-altitude", 2, -900, 19000),
+  TAG_INT (39, "outside-air-temperature", 1),
+  TAG_IMAP (40, "target-location-latitude", 4, 90),
+  TAG_IMAP (41, "target-location-longitude", 4, 180),
+  TAG_UMAP (42, "target-location-elevation", 2, -900, 19000),
+  TAG_UMAP (43, "target-track-gate-width", 1, 0, 510),
+  TAG_UMAP (44, "target-track-gate-height", 1, 0, 510),
+  TAG_UMAP (45, "target-error-estimate-ce90", 2, 0, 4095),
+  TAG_UMAP (46, "target-error-estimate-le90", 2, 0, 4095),
+  TAG_UINT (47, "generic-flag-data", 1),
+  TAG_LOCAL_SET (48, "security-local-set"),
+  TAG_UMAP (49, "differential-pressure", 2, 0, 5000),
+  TAG_IMAP (50, "platform-angle-of-attack", 2, 20),
+  TAG_IMAP (51, "platform-vertical-speed", 2, 180),
+  TAG_IMAP (52, "platform-sideslip-angle", 2, 20),
+  TAG_UMAP (53, "airfield-barometric-pressure", 2, 0, 5000),
+  TAG_UMAP (54, "airfield-elevation", 2, -900, 19000),
+  TAG_UMAP (55, "relative-humidity", 1, 0, 100),
+  TAG_UINT (56, "platform-ground-speed", 1),
+  TAG_UMAP (57, "ground-range", 4, 0, 5000000),
+  TAG_UMAP (58, "platform-fuel-remaining", 2, 0, 10000),
+  TAG_STRING (59, "platform-call-sign"),
+  TAG_UINT (60, "weapon-load", 2),
+  TAG_UINT (61, "weapon-fired", 1),
+  TAG_UINT (62, "laser-prf-code", 2),
+  TAG_UINT (63, "sensor-fov-name", 1),
+  TAG_UMAP (64, "platform-magnetic-heading", 2, 0, 360),
+  TAG_UINT (65, "uas-datalink-ls-version-number", 1),
+  TAG_BYTES (66, "target-location-covariance-matrix"),
+  TAG_IMAP (67, "alternate-platform-latitude", 4, 90),
+  TAG_IMAP (68, "alternate-platform-longitude", 4, 180),
+  TAG_UMAP (69, "alternate-platform-altitude", 2, -900, 19000),
+  TAG_STRING (70, "alternate-platform-name"),
+  TAG_UMAP (71, "alternate-platform-heading", 2, 0, 360),
+  TAG_UINT (72, "event-start-time-utc", 8),
+  TAG_LOCAL_SET (73, "rvt-local-set"),
+  TAG_LOCAL_SET (74, "vmti-local-set"),
+  TAG_UMAP (75, "sensor-ellipsoid-height", 2, -900, 19000),
+  TAG_UMAP (76, "alternate-platform-ellipsoid-height", 2, -900, 19000),
+  TAG_UINT (77, "operational-mode", 1),
+  TAG_UMAP (78, "frame-center-height-above-ellipsoid", 2, -900, 19000),
+  TAG_IMAP (79, "sensor-north-velocity", 2, 327),
+  TAG_IMAP (80, "sensor-east-velocity", 2, 327),
+  TAG_LOCAL_SET (81, "image-horizon-pixel-pack"),
+  TAG_IMAP (82, "corner-latitude-point-1", 4, 90),
+  TAG_IMAP (83, "corner-longitude-point-1", 4, 180),
+  TAG_IMAP (84, "corner-latitude-point-2", 4, 90),
+  TAG_IMAP (85, "corner-longitude-point-2", 4, 180),
+  TAG_IMAP (86, "corner-latitude-point-3", 4, 90),
+  TAG_IMAP (87, "corner-longitude-point-3", 4, 180),
+  TAG_IMAP (88, "corner-latitude-point-4", 4, 90),
+  TAG_IMAP (89, "corner-longitude-point-4", 4, 180),
+  TAG_IMAP (90, "platform-pitch-angle-full", 4, 90),
+  TAG_IMAP (91, "platform-roll-angle-full", 4, 90),
+  TAG_IMAP (92, "platform-angle-of-attack-full", 4, 90),
+  TAG_IMAP (93, "platform-sideslip-angle-full", 4, 180),
+  TAG_BYTES (94, "miis-core-identifier"),
+};
+
+#undef TAG_UINT
+#undef TAG_INT
+#undef TAG_UMAP
+#undef TAG_IMAP
+#undef TAG_STRING
+#undef TAG_BYTES
+#undef TAG_LOCAL_SET
+
+/**
+ * gst_klv_st0601_get_key:
+ *
+ * Returns: (array fixed-size=16) (transfer none): the 16-byte Universal Label
+ *     key of the UAS Datalink Local Set
+ */
+const guint8 *
+gst_klv_st0601_get_key (void)
+{
+  return st0601_key;
+}
+
+/**
+ * gst_klv_st0601_get_tag_info:
+ * @tag: a MISB ST 0601 tag
+ *
+ * Returns: (transfer none) (nullable): the description of @tag, or %NULL if
+ *     the tag is not known
+ */
+const GstKLVST0601TagInfo *
+gst_klv_st0601_get_tag_info (guint tag)
+{
+  if (tag == 0 || tag > GST_KLV_ST0601_MAX_TAG)
+    return NULL;
+
+  if (st0601_tags[tag].type == GST_KLV_ST0601_TYPE_UNKNOWN)
+    return NULL;
+
+  return &st0601_tags[tag];
+}
+
+static GHashTable *
+gst_klv_st0601_get_names (void)
+{
+  static gsize names = 0;
+
+  if (g_once_init_enter (&names)) {
+    GHashTable *table = g_hash_table_new (g_str_hash, g_str_equal);
+    guint tag;
+
+    for (tag = 1; tag <= GST_KLV_ST0601_MAX_TAG; tag++) {
+      if (st0601_tags[tag].name)
+        g_hash_table_insert (table, (gpointer) st0601_tags[tag].name,
+            (gpointer) & st0601_tags[tag]);
+    }
+
+    g_once_init_leave (&names, (gsize) table);
+  }
+
+  return (GHashTable *) names;
+}
+
+/**
+ * gst_klv_st0601_get_tag_info_by_name:
+ * @name: the field name of a MISB ST 0601 tag
+ *
+ * Returns: (transfer none) (nullable): the description of the tag with field
+ *     name @name, or %NULL if there is none
+ */
+const GstKLVST0601TagInfo *
+gst_klv_st0601_get_tag_info_by_name (const gchar * name)
+{
+  g_return_val_if_fail (name != NULL, NULL);
+
+  return g_hash_table_lookup (gst_klv_st0601_get_names (), name);
+}
+
+static guint64
+gst_klv_st0601_read_uint (const guint8 * data, gsize length)
+{
+  guint64 val = 0;
+  gsize i;
+
+  for (i = 0; i < length; i++)
+    val = (val << 8) | data[i];
+
+  return val;
+}
+
+static gint64
+gst_klv_st0601_read_int (const guint8 * data, gsize length)
+{
+  guint64 val = gst_klv_st0601_read_uint (data, length);
+  guint shift = 64 - 8 * length;
+
+  /* sign extend */
+  return ((gint64) (val << shift)) >> shift;
+}
+
+static void
+gst_klv_st0601_write_uint (guint8 * data, gsize length, guint64 val)
+{
+  gsize i;
+
+  for (i = 0; i < length; i++)
+    data[length - 1 - i] = (guint8) (val >> (8 * i));
+}
+
+/**
+ * gst_klv_st0601_item_get_double:
+ * @tag: the MISB ST 0601 tag of the item
+ * @value: (array length=length): the value of the item
+ * @length: length of @value in bytes
+ * @result: (out): the value in engineering units
+ *
+ * Converts the value of a numeric item to engineering units, e.g. degrees
+ * for latitudes or meters for altitudes.
+ *
+ * Returns: %TRUE on success, %FALSE if @tag is not numeric, @length does not
+ *     match the tag or the value is the error indicator
+ */
+gboolean
+gst_klv_st0601_item_get_double (guint tag, const guint8 * value,
+    gsize length, gdouble * result)
+{
+  const GstKLVST0601TagInfo *info;
+
+  g_return_val_if_fail (value != NULL || length == 0, FALSE);
+  g_return_val_if_fail (result != NULL, FALSE);
+
+  info = gst_klv_st0601_get_tag_info (tag);
+  if (info == NULL || length == 0 || length > 8 || length != info->length)
+    return FALSE;
+
+  switch (info->type) {
+    case GST_KLV_ST0601_TYPE_UINT:
+      *result = (gdouble) gst_klv_st0601_read_uint (value, length);
+      return TRUE;
+    case GST_KLV_ST0601_TYPE_INT:
+      *result = (gdouble) gst_klv_st0601_read_int (value, length);
+      return TRUE;
+    case GST_KLV_ST0601_TYPE_UMAPPED:{
+      guint64 range = G_MAXUINT64 >> (64 - 8 * length);
+      guint64 val = gst_klv_st0601_read_uint (value, length);
+
+      *result = info->min + (info->max - info->min) * val / (gdouble) range;
+      return TRUE;
+    }
+    case GST_KLV_ST0601_TYPE_IMAPPED:{
+      gint64 range = G_MAXINT64 >> (64 - 8 * length);
+      gint64 val = gst_klv_st0601_read_int (value, length);
+
+      /* most negative value is reserved as error indicator */
+      if (val < -range)
+        return FALSE;
+
+      *result = info->max * val / (gdouble) range;
+      return TRUE;
+    }
+    default:
+      return FALSE;
+  }
+}
+
+/**
+ * gst_klv_st0601_item_get_value:
+ * @tag: the MISB ST 0601 tag of the item
+ * @value: (array length=length): the value of the item
+ * @length: length of @value in bytes
+ * @result: (out caller-allocates): an uninitialized #GValue
+ *
+ * Converts the value of an item to a #GValue of the natural type of the tag:
+ * #G_TYPE_DOUBLE in engineering units for mapped values, #G_TYPE_UINT64 or
+ * #G_TYPE_INT64 for plain integers, #G_TYPE_STRING for strings and
+ * #G_TYPE_BYTES for anything else.
+ *
+ * Returns: %TRUE if @result was initialized
+ */
+gboolean
+gst_klv_st0601_item_get_value (guint tag, const guint8 * value,
+    gsize length, GValue * result)
+{
+  const GstKLVST0601TagInfo *info;
+
+  g_return_val_if_fail (value != NULL || length == 0, FALSE);
+  g_return_val_if_fail (result != NULL, FALSE);
+
+  info = gst_klv_st0601_get_tag_info (tag);
+  if (info == NULL)
+    return FALSE;
+
+  switch (info->type) {
+    case GST_KLV_ST0601_TYPE_UINT:
+      if (length == 0 || length > 8 || length != info->length)
+        return FALSE;
+      g_value_init (result, G_TYPE_UINT64);
+      g_value_set_uint64 (result, gst_klv_st0601_read_uint (value, length));
+      return TRUE;
+    case GST_KLV_ST0601_TYPE_INT:
+      if (length == 0 || length > 8 || length != info->length)
+        return FALSE;
+      g_value_init (result, G_TYPE_INT64);
+      g_value_set_int64 (result, gst_klv_st0601_read_int (value, length));
+      return TRUE;
+    case GST_KLV_ST0601_TYPE_UMAPPED:
+    case GST_KLV_ST0601_TYPE_IMAPPED:{
+      gdouble val;
+
+      if (!gst_klv_st0601_item_get_double (tag, value, length, &val))
+        return FALSE;
+      g_value_init (result, G_TYPE_DOUBLE);
+      g_value_set_double (result, val);
+      return TRUE;
+    }
+    case GST_KLV_ST0601_TYPE_STRING:
+      g_value_init (result, G_TYPE_STRING);
+      g_value_take_string (result, g_strndup ((const gchar *) value, length));
+      return TRUE;
+    default:
+      g_value_init (result, G_TYPE_BYTES);
+      g_value_take_boxed (result, g_bytes_new (value, length));
+      return TRUE;
+  }
+}
+
+/**
+ * gst_klv_st0601_get_double:
+ * @set: (array length=size): the value of a UAS Datalink Local Set packet
+ * @size: size of @set in bytes
+ * @tag: the tag to look up
+ * @result: (out): the value in engineering units
+ *
+ * Looks up @tag in @set and converts it with
+ * gst_klv_st0601_item_get_double(). No other tags are decoded.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+gst_klv_st0601_get_double (const guint8 * set, gsize size, guint tag,
+    gdouble * result)
+{
+  const guint8 *value;
+  gsize length;
+
+  if (!gst_klv_local_set_find (set, size, tag, &value, &length))
+    return FALSE;
+
+  return gst_klv_st0601_item_get_double (tag, value, length, result);
+}
+
+/**
+ * gst_klv_st0601_get_value:
+ * @set: (array length=size): the value of a UAS Datalink Local Set packet
+ * @size: size of @set in bytes
+ * @tag: the tag to look up
+ * @result: (out caller-allocates): an uninitialized #GValue
+ *
+ * Looks up @tag in @set and converts it with
+ * gst_klv_st0601_item_get_value(). No other tags are decoded.
+ *
+ * Returns: %TRUE if @result was initialized
+ */
+gboolean
+gst_klv_st0601_get_value (const guint8 * set, gsize size, guint tag,
+    GValue * result)
+{
+  const guint8 *value;
+  gsize length;
+
+  if (!gst_klv_local_set_find (set, size, tag, &value, &length))
+    return FALSE;
+
+  return gst_klv_st0601_item_get_value (tag, value, length, result);
+}
+
+/**
+ * gst_klv_st0601_item_set_double:
+ * @tag: the MISB ST 0601 tag of the item
+ * @value: the value in engineering units
+ * @data: (array length=length): where to write the encoded value
+ * @length: length of @data, must match the length of @tag
+ *
+ * Encodes a numeric value, rounding to the nearest representable value.
+ * Values out of range are encoded as the error indicator if the tag has one,
+ * and clamped otherwise.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+gst_klv_st0601_item_set_double (guint tag, gdouble value, guint8 * data,
+    gsize length)
+{
+  const GstKLVST0601TagInfo *info;
+
+  g_return_val_if_fail (data != NULL, FALSE);
+
+  info = gst_klv_st0601_get_tag_info (tag);
+  if (info == NULL || length == 0 || length > 8 || length != info->length)
+    return FALSE;
+
+  switch (info->type) {
+    case GST_KLV_ST0601_TYPE_UINT:{
+      guint64 range = G_MAXUINT64 >> (64 - 8 * length);
+      gdouble val = CLAMP (value, 0, (gdouble) range);
+
+      gst_klv_st0601_write_uint (data, length, (guint64) (val + 0.5));
+      return TRUE;
+    }
+    case GST_KLV_ST0601_TYPE_INT:{
+      gint64 range = G_MAXINT64 >> (64 - 8 * length);
+      gdouble val = CLAMP (value, (gdouble) (-range - 1), (gdouble) range);
+
+      val = val < 0 ? val - 0.5 : val + 0.5;
+      gst_klv_st0601_write_uint (data, length, (guint64) (gint64) val);
+      return TRUE;
+    }
+    case GST_KLV_ST0601_TYPE_UMAPPED:{
+      guint64 range = G_MAXUINT64 >> (64 - 8 * length);
+      gdouble val = CLAMP (value, info->min, info->max);
+
+      val = (val - info->min) / (info->max - info->min) * range;
+      gst_klv_st0601_write_uint (data, length, (guint64) (val + 0.5));
+      return TRUE;
+    }
+    case GST_KLV_ST0601_TYPE_IMAPPED:{
+      gint64 range = G_MAXINT64 >> (64 - 8 * length);
+      gdouble val;
+
+      if (!(value >= info->min && value <= info->max)) {
+        /* error indicator, the most negative value */
+        gst_klv_st0601_write_uint (data, length, (guint64) (-range - 1));
+        return TRUE;
+      }
+
+      val = value / info->max * range;
+      val = val < 0 ? val - 0.5 : val + 0.5;
+      gst_klv_st0601_write_uint (data, length, (guint64) (gint64) val);
+      return TRUE;
+    }
+    default:
+      return FALSE;
+  }
+}
+
+/**
+ * gst_klv_st0601_builder_add_tag:
+ * @builder: a #GstKLVBuilder
+ * @tag: a MISB ST 0601 tag with a fixed length
+ *
+ * Adds an item for @tag with the length given by the tag table to @builder,
+ * initialized to zeroes.
+ *
+ * Returns: the index of the new item, or -1 if @tag has no fixed length
+ */
+gint
+gst_klv_st0601_builder_add_tag (GstKLVBuilder * builder, guint tag)
+{
+  const GstKLVST0601TagInfo *info;
+
+  g_return_val_if_fail (builder != NULL, -1);
+
+  info = gst_klv_st0601_get_tag_info (tag);
+  if (info == NULL || info->length == 0)
+    return -1;
+
+  return gst_klv_builder_add_item (builder, tag, NULL, info->length);
+}
+
+/**
+ * gst_klv_st0601_builder_set_double:
+ * @builder: a #GstKLVBuilder
+ * @item: index of the item as returned by gst_klv_st0601_builder_add_tag()
+ * @tag: the MISB ST 0601 tag of @item
+ * @value: the value in engineering units
+ *
+ * Encodes @value with gst_klv_st0601_item_set_double() straight into the
+ * template of @builder.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+gst_klv_st0601_builder_set_double (GstKLVBuilder * builder, gint item,
+    guint tag, gdouble value)
+{
+  guint8 *data;
+  gsize length;
+
+  data = gst_klv_builder_get_item_data (builder, item, &length);
+  if (data == NULL)
+    return FALSE;
+
+  return gst_klv_st0601_item_set_double (tag, value, data, length);
+}
+
+static gboolean
+gst_klv_st0601_builder_add_value (GstKLVBuilder * builder,
+    const GstKLVST0601TagInfo * info, const GValue * value)
+{
+  gint item;
+
+  switch (info->type) {
+    case GST_KLV_ST0601_TYPE_UINT:
+    case GST_KLV_ST0601_TYPE_INT:
+      /* keep full precision for 64-bit timestamps */
+      if (G_VALUE_HOLDS_UINT64 (value) || G_VALUE_HOLDS_INT64 (value)) {
+        guint64 val = G_VALUE_HOLDS_UINT64 (value) ?
+            g_value_get_uint64 (value) : (guint64) g_value_get_int64 (value);
+
+        item = gst_klv_builder_add_item (builder, info->tag, NULL,
+            info->length);
+        return gst_klv_builder_set_item_uint (builder, item, val);
+      }
+      /* fall through */
+    case GST_KLV_ST0601_TYPE_UMAPPED:
+    case GST_KLV_ST0601_TYPE_IMAPPED:{
+      GValue val = G_VALUE_INIT;
+      gboolean ret;
+
+      if (!g_value_type_transformable (G_VALUE_TYPE (value), G_TYPE_DOUBLE))
+        return FALSE;
+
+      g_value_init (&val, G_TYPE_DOUBLE);
+      g_value_transform (value, &val);
+      item = gst_klv_builder_add_item (builder, info->tag, NULL,
+          info->length);
+      ret = gst_klv_st0601_builder_set_double (builder, item, info->tag,
+          g_value_get_double (&val));
+      g_value_unset (&val);
+      return ret;
+    }
+    case GST_KLV_ST0601_TYPE_STRING:{
+      const gchar *str;
+
+      if (!G_VALUE_HOLDS_STRING (value))
+        return FALSE;
+
+      str = g_value_get_string (value);
+      if (str == NULL)
+        return FALSE;
+
+      gst_klv_builder_add_item (builder, info->tag, (const guint8 *) str,
+          strlen (str));
+      return TRUE;
+    }
+    default:{
+      GBytes *bytes;
+      gconstpointer data;
+      gsize size;
+
+      if (!G_VALUE_HOLDS (value, G_TYPE_BYTES))
+        return FALSE;
+
+      bytes = g_value_get_boxed (value);
+      if (bytes == NULL)
+        return FALSE;
+
+      data = g_bytes_get_data (bytes, &size);
+      gst_klv_builder_add_item (builder, info->tag, data, size);
+      return TRUE;
+    }
+  }
+}
+
+/**
+ * gst_klv_st0601_builder_new_from_structure:
+ * @structure: a #GstStructure with engineering values
+ *
+ * Creates a #GstKLVBuilder for a UAS Datalink Local Set from the fields of
+ * @structure that are named after MISB ST 0601 tags, see
+ * #GstKLVST0601TagInfo. Numeric fields hold engineering units, e.g.
+ * "sensor-latitude" in degrees, string fields hold strings and all other
+ * fields hold #GBytes. The precision time stamp comes first and the other
+ * items follow in tag order. Unknown fields and the checksum are ignored, the
+ * checksum can be added last with gst_klv_st0601_builder_add_tag() and filled
+ * in with gst_klv_st0601_builder_set_checksum().
+ *
+ * The returned builder can be attached to any number of buffers, with
+ * changing values patched with gst_klv_builder_set_item() and friends in
+ * between.
+ *
+ * Returns: (transfer full): a new #GstKLVBuilder
+ */
+GstKLVBuilder *
+gst_klv_st0601_builder_new_from_structure (const GstStructure * structure)
+{
+  GstKLVBuilder *builder;
+  GHashTable *names;
+  guint tag;
+  gint i;
+
+  g_return_val_if_fail (structure != NULL, NULL);
+
+  builder = gst_klv_builder_new (st0601_key);
+  names = gst_klv_st0601_get_names ();
+
+  for (tag = 2; tag <= GST_KLV_ST0601_MAX_TAG; tag++) {
+    const GstKLVST0601TagInfo *info = &st0601_tags[tag];
+    const GValue *value;
+
+    if (info->name == NULL)
+      continue;
+
+    value = gst_structure_get_value (structure, info->name);
+    if (value == NULL)
+      continue;
+
+    if (!gst_klv_st0601_builder_add_value (builder, info, value))
+      GST_WARNING ("Can't encode field '%s' of type %s", info->name,
+          G_VALUE_TYPE_NAME (value));
+  }
+
+  for (i = 0; i < gst_structure_n_fields (structure); i++) {
+    const gchar *name = gst_structure_nth_field_name (structure, i);
+
+    if (!g_hash_table_contains (names, name))
+      GST_DEBUG ("Ignoring unknown field '%s'", name);
+  }
+
+  return builder;
+}
+
+/**
+ * gst_klv_st0601_checksum:
+ * @data: (array length=size): data to compute the checksum of
+ * @size: size of @data in bytes
+ *
+ * Computes the ST 0601 checksum, a running 16-bit sum of @data read as big
+ * endian 16-bit words, i.e. byte i is added shifted left by 8 bits if i is
+ * even. For a packet this covers everything from the first byte of the key up
+ * to and including the tag and length of the checksum item.
+ *
+ * Returns: the checksum of @data
+ */
+guint16
+gst_klv_st0601_checksum (const guint8 * data, gsize size)
+{
+  guint32 sum = 0;
+  gsize i;
+
+  for (i = 0; i + 1 < size; i += 2)
+    sum += GST_READ_UINT16_BE (data + i);
+  if (i < size)
+    sum += data[i] << 8;
+
+  return (guint16) sum;
+}
+
+/**
+ * gst_klv_st0601_validate_checksum:
+ * @data: (array length=size): a complete UAS Datalink Local Set packet,
+ *     starting with the key
+ * @size: size of @data in bytes
+ *
+ * Checks that the packet ends with a checksum item (tag 1) holding the
+ * gst_klv_st0601_checksum() of everything before the checksum value, from the
+ * first byte of the key up to and including the tag and length of the checksum
+ * item.
+ *
+ * Returns: %TRUE if @data holds a packet with a correct checksum
+ */
+gboolean
+gst_klv_st0601_validate_checksum (const guint8 * data, gsize size)
+{
+  GstKLVReader reader;
+  const guint8 *value;
+  gsize length, packet_size;
+
+  gst_klv_reader_init (&reader, data, size);
+  if (!gst_klv_reader_next_packet (&reader, NULL, &value, &length))
+    return FALSE;
+
+  /* checksum is always the last item: tag 1, length 2, 16-bit sum */
+  if (length < 4 || value[length - 4] != 1 || value[length - 3] != 2)
+    return FALSE;
+
+  packet_size = (value - data) + length;
+
+  return gst_klv_st0601_checksum (data, packet_size - 2) ==
+      GST_READ_UINT16_BE (data + packet_size - 2);
+}
+
+/**
+ * gst_klv_st0601_update_checksum:
+ * @data: (array length=size): a complete UAS Datalink Local Set packet,
+ *     starting with the key
+ * @size: size of @data in bytes
+ *
+ * Recomputes the gst_klv_st0601_checksum() of a packet whose values have been
+ * modified in place. The packet has to end with a checksum item already.
+ *
+ * Returns: %TRUE if the checksum was updated
+ */
+gboolean
+gst_klv_st0601_update_checksum (guint8 * data, gsize size)
+{
+  GstKLVReader reader;
+  const guint8 *value;
+  gsize length, packet_size;
+
+  gst_klv_reader_init (&reader, data, size);
+  if (!gst_klv_reader_next_packet (&reader, NULL, &value, &length))
+    return FALSE;
+
+  if (length < 4 || value[length - 4] != 1 || value[length - 3] != 2)
+    return FALSE;
+
+  packet_size = (value - data) + length;
+  GST_WRITE_UINT16_BE (data + packet_size - 2,
+      gst_klv_st0601_checksum (data, packet_size - 2));
+
+  return TRUE;
+}
+
+/**
+ * gst_klv_st0601_builder_set_checksum:
+ * @builder: a #GstKLVBuilder
+ * @item: index of the checksum item, which must be the last item
+ *
+ * Computes the gst_klv_st0601_checksum() of the packet in @builder and writes
+ * it into @item.
+ * This has to be called after all other values have been patched, right
+ * before attaching the packet to a buffer.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+gst_klv_st0601_builder_set_checksum (GstKLVBuilder * builder, gint item)
+{
+  const guint8 *data;
+  guint8 *checksum;
+  gsize size, length;
+
+  checksum = gst_klv_builder_get_item_data (builder, item, &length);
+  if (checksum == NULL || length != 2)
+    return FALSE;
+
+  data = gst_klv_builder_get_data (builder, &size);
+  g_return_val_if_fail (checksum + 2 == data + size, FALSE);
+
+  GST_WRITE_UINT16_BE (checksum, gst_klv_st0601_checksum (data, size - 2));
+  return TRUE;
+}
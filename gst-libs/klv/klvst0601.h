@@ -0,0 +1,134 @@
+/* GStreamer KLV Metadata Support Library
+ * Copyright (C) 2016-2019 Tim-Philipp Müller <tim@centricular.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_KLV_ST0601_H__
+#define __GST_KLV_ST0601_H__
+
+#include <gst/gst.h>
+#include "klv.h"
+
+G_BEGIN_DECLS
+
+/**
+ * GST_KLV_ST0601_MAX_TAG:
+ *
+ * The highest MISB ST 0601 tag described by the tag table.
+ */
+#define GST_KLV_ST0601_MAX_TAG 94
+
+/**
+ * GstKLVST0601Type:
+ * @GST_KLV_ST0601_TYPE_UNKNOWN: tag is not known
+ * @GST_KLV_ST0601_TYPE_UINT: unsigned integer, used as is
+ * @GST_KLV_ST0601_TYPE_INT: signed integer, used as is
+ * @GST_KLV_ST0601_TYPE_UMAPPED: unsigned integer mapped linearly to
+ *     [min, max]
+ * @GST_KLV_ST0601_TYPE_IMAPPED: signed integer mapped linearly to
+ *     [-max, max], with the most negative value reserved as error indicator
+ * @GST_KLV_ST0601_TYPE_STRING: ISO 646 string
+ * @GST_KLV_ST0601_TYPE_BYTES: opaque bytes
+ * @GST_KLV_ST0601_TYPE_LOCAL_SET: nested local set
+ *
+ * How the value of a MISB ST 0601 tag is encoded.
+ */
+typedef enum {
+  GST_KLV_ST0601_TYPE_UNKNOWN,
+  GST_KLV_ST0601_TYPE_UINT,
+  GST_KLV_ST0601_TYPE_INT,
+  GST_KLV_ST0601_TYPE_UMAPPED,
+  GST_KLV_ST0601_TYPE_IMAPPED,
+  GST_KLV_ST0601_TYPE_STRING,
+  GST_KLV_ST0601_TYPE_BYTES,
+  GST_KLV_ST0601_TYPE_LOCAL_SET
+} GstKLVST0601Type;
+
+/**
+ * GstKLVST0601TagInfo:
+ * @tag: the local set tag
+ * @name: field name used for the tag in a #GstStructure
+ * @type: how the value is encoded
+ * @length: length of the value in bytes, or 0 if it has variable length
+ * @min: lowest value in engineering units for mapped types
+ * @max: highest value in engineering units for mapped types
+ *
+ * Static description of a MISB ST 0601 UAS Datalink Local Set tag.
+ */
+typedef struct {
+  guint tag;
+  const gchar *name;
+  GstKLVST0601Type type;
+  guint length;
+  gdouble min;
+  gdouble max;
+} GstKLVST0601TagInfo;
+
+GST_TAG_API
+const guint8              * gst_klv_st0601_get_key (void);
+
+GST_TAG_API
+const GstKLVST0601TagInfo * gst_klv_st0601_get_tag_info (guint tag);
+
+GST_TAG_API
+const GstKLVST0601TagInfo * gst_klv_st0601_get_tag_info_by_name (const gchar * name);
+
+/* Decode single tags without parsing the whole set */
+
+GST_TAG_API
+gboolean                    gst_klv_st0601_item_get_double (guint tag, const guint8 * value, gsize length, gdouble * result);
+
+GST_TAG_API
+gboolean                    gst_klv_st0601_item_get_value (guint tag, const guint8 * value, gsize length, GValue * result);
+
+GST_TAG_API
+gboolean                    gst_klv_st0601_get_double (const guint8 * set, gsize size, guint tag, gdouble * result);
+
+GST_TAG_API
+gboolean                    gst_klv_st0601_get_value (const guint8 * set, gsize size, guint tag, GValue * result);
+
+/* Encode tags into a GstKLVBuilder template */
+
+GST_TAG_API
+gboolean                    gst_klv_st0601_item_set_double (guint tag, gdouble value, guint8 * data, gsize length);
+
+GST_TAG_API
+gint                        gst_klv_st0601_builder_add_tag (GstKLVBuilder * builder, guint tag);
+
+GST_TAG_API
+gboolean                    gst_klv_st0601_builder_set_double (GstKLVBuilder * builder, gint item, guint tag, gdouble value);
+
+GST_TAG_API
+GstKLVBuilder             * gst_klv_st0601_builder_new_from_structure (const GstStructure * structure);
+
+/* Checksum (tag 1) */
+
+GST_TAG_API
+guint16                     gst_klv_st0601_checksum (const guint8 * data, gsize size);
+
+GST_TAG_API
+gboolean                    gst_klv_st0601_validate_checksum (const guint8 * data, gsize size);
+
+GST_TAG_API
+gboolean                    gst_klv_st0601_update_checksum (guint8 * data, gsize size);
+
+GST_TAG_API
+gboolean                    gst_klv_st0601_builder_set_checksum (GstKLVBuilder * builder, gint item);
+
+G_END_DECLS
+
+#endif /* __GST_KLV_ST0601_H__ */
@@ -21,6 +21,21 @@
  *
  * The klvinject element injects KLV metadata on passing buffers.
  *
+ * By default a MISB ST 0601 test packet with a fixed position is injected.
+ * If #GstKlvInject:location is set, packets are replayed from a file of
+ * concatenated ST 0601 packets instead. The file is memory-mapped and indexed
+ * by the precision time stamp (tag 2) of each packet when the element starts,
+ * so that for each buffer the packet in effect at the buffer time is found
+ * with a binary search, without any file I/O or parsing on the streaming
+ * thread. The buffer time is taken from its "timestamp/x-unix" reference
+ * timestamp meta if present, and otherwise the PTS is used as offset from the
+ * first packet in the file.
+ *
+ * With #GstKlvInject:interpolation set, the sensor position and platform
+ * heading of the packet are interpolated between the two packets around the
+ * buffer time, which avoids jitter when telemetry is recorded at a lower rate
+ * than the video.
+ *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
@@ -34,24 +49,84 @@
 #include "config.h"
 #endif
 
+#include <math.h>
+#include <string.h>
+
 #include <gst/gst.h>
 #include <gst/base/gstbasetransform.h>
-#include <gst/base/gstbytewriter.h>
 #include "gstklvinject.h"
 #include "klv.h"
+#include "klvst0601.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_klvinject_debug_category);
 #define GST_CAT_DEFAULT gst_klvinject_debug_category
 
 /* prototypes */
+static void gst_klvinject_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_klvinject_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+static void gst_klvinject_finalize (GObject * object);
+static gboolean gst_klvinject_start (GstBaseTransform * trans);
+static gboolean gst_klvinject_stop (GstBaseTransform * trans);
 static GstFlowReturn gst_klvinject_transform_ip (GstBaseTransform * trans,
     GstBuffer * buf);
 
 enum
 {
-  PROP_0
+  PROP_0,
+  PROP_LOCATION,
+  PROP_TIME_OFFSET,
+  PROP_INTERPOLATION,
+  PROP_REUSE_PAYLOADS,
+  PROP_REUSE_HITS,
+  PROP_REUSE_INLINED,
+  PROP_REUSE_HIT_RATE
+};
+
+#define DEFAULT_PROP_LOCATION NULL
+#define DEFAULT_PROP_TIME_OFFSET 0
+#define DEFAULT_PROP_INTERPOLATION GST_KLVINJECT_INTERPOLATION_NONE
+#define DEFAULT_PROP_REUSE_PAYLOADS FALSE
+
+/* number of recent payloads compared against for reuse */
+#define PAYLOAD_CACHE_SIZE 8
+
+/* ST 0601 tags of the interpolated values, in GstKlvInjectSample order */
+static const guint interpolated_tags[GST_KLVINJECT_N_VALUES] = {
+  13,                           /* Sensor Latitude */
+  14,                           /* Sensor Longitude */
+  15,                           /* Sensor True Altitude */
+  5                             /* Platform Heading Angle */
 };
 
+#define GST_TYPE_KLVINJECT_INTERPOLATION (gst_klvinject_interpolation_get_type())
+static GType
+gst_klvinject_interpolation_get_type (void)
+{
+  static GType klvinject_interpolation_type = 0;
+  static const GEnumValue klvinject_interpolation[] = {
+    {GST_KLVINJECT_INTERPOLATION_NONE, "none", "none"},
+    {GST_KLVINJECT_INTERPOLATION_LINEAR, "linear", "linear"},
+    {GST_KLVINJECT_INTERPOLATION_SPHERICAL, "spherical", "spherical"},
+    {0, NULL, NULL},
+  };
+
+  if (!klvinject_interpolation_type) {
+    klvinject_interpolation_type =
+        g_enum_register_static ("GstKlvInjectInterpolation",
+        klvinject_interpolation);
+  }
+  return klvinject_interpolation_type;
+}
+
+typedef struct
+{
+  guint64 timestamp;            /* microseconds since the unix epoch */
+  gsize offset;
+  gsize size;
+} GstKlvInjectIndexEntry;
+
 /* pad templates */
 
 #define SRC_CAPS "ANY"
@@ -67,9 +142,53 @@ G_DEFINE_TYPE_WITH_CODE (GstKlvInject, gst_klvinject, GST_TYPE_BASE_TRANSFORM,
 static void
 gst_klvinject_class_init (GstKlvInjectClass * klass)
 {
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
   GstBaseTransformClass *base_transform_class =
       GST_BASE_TRANSFORM_CLASS (klass);
 
+  gobject_class->set_property = gst_klvinject_set_property;
+  gobject_class->get_property = gst_klvinject_get_property;
+  gobject_class->finalize = gst_klvinject_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_LOCATION,
+      g_param_spec_string ("location", "File location",
+          "File of concatenated MISB ST 0601 packets to replay, or NULL to "
+          "inject a test packet", DEFAULT_PROP_LOCATION,
+          G_PARAM_STATIC_STRINGS | G_PARAM_READWRITE |
+          GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_TIME_OFFSET,
+      g_param_spec_int64 ("time-offset", "Time offset",
+          "Offset in nanoseconds added to the buffer time before looking up "
+          "the packet to replay", G_MININT64, G_MAXINT64,
+          DEFAULT_PROP_TIME_OFFSET,
+          G_PARAM_STATIC_STRINGS | G_PARAM_READWRITE));
+  g_object_class_install_property (gobject_class, PROP_INTERPOLATION,
+      g_param_spec_enum ("interpolation", "Interpolation",
+          "How to interpolate sensor position and heading between packets "
+          "replayed from file", GST_TYPE_KLVINJECT_INTERPOLATION,
+          DEFAULT_PROP_INTERPOLATION,
+          G_PARAM_STATIC_STRINGS | G_PARAM_READWRITE));
+  g_object_class_install_property (gobject_class, PROP_REUSE_PAYLOADS,
+      g_param_spec_boolean ("reuse-payloads", "Reuse payloads",
+          "Attach a ref to an identical recent generated payload instead of a "
+          "copy where that is cheaper",
+          DEFAULT_PROP_REUSE_PAYLOADS,
+          G_PARAM_STATIC_STRINGS | G_PARAM_READWRITE));
+  g_object_class_install_property (gobject_class, PROP_REUSE_HITS,
+      g_param_spec_uint64 ("reuse-hits", "Reuse hits",
+          "Number of payloads that were attached as ref to an identical one",
+          0, G_MAXUINT64, 0, G_PARAM_STATIC_STRINGS | G_PARAM_READABLE));
+  g_object_class_install_property (gobject_class, PROP_REUSE_INLINED,
+      g_param_spec_uint64 ("reuse-inlined", "Reuse inlined",
+          "Number of payloads small enough to be stored inline with the meta "
+          "without a lookup", 0, G_MAXUINT64, 0,
+          G_PARAM_STATIC_STRINGS | G_PARAM_READABLE));
+  g_object_class_install_property (gobject_class, PROP_REUSE_HIT_RATE,
+      g_param_spec_double ("reuse-hit-rate", "Reuse hit rate",
+          "Fraction of payloads attached without allocating a copy, as ref to "
+          "an identical one or inline",
+          0.0, 1.0, 0.0, G_PARAM_STATIC_STRINGS | G_PARAM_READABLE));
+
   /* Setting up pads and setting metadata should be moved to
      base_class_init if you intend to subclass this class. */
   gst_element_class_add_pad_template (GST_ELEMENT_CLASS (klass),
@@ -83,6 +202,8 @@ gst_klvinject_class_init (GstKlvInjectClass * klass)
       "Inject KLV", "Filter", "Inject KLV metadata",
       "Joshua M. Doe <oss@nvl.army.mil>");
 
+  base_transform_class->start = GST_DEBUG_FUNCPTR (gst_klvinject_start);
+  base_transform_class->stop = GST_DEBUG_FUNCPTR (gst_klvinject_stop);
   base_transform_class->transform_ip =
       GST_DEBUG_FUNCPTR (gst_klvinject_transform_ip);
 
@@ -93,99 +214,569 @@ gst_klvinject_class_init (GstKlvInjectClass * klass)
 static void
 gst_klvinject_init (GstKlvInject * filt)
 {
+/* Add KLV meta for testing, here: Motion Imagery Standards Board (MISB)
+ * Engineering Guideline MISB EG 0902 - MISB Minimum Metadata Set.
+ * Also see: SMPTE S336M for KLV specification, also ITU-R BT.1563-1 */
+  /* The layout of the test packet never changes, so serialize it once and
+   * only patch the item values for each buffer */
+  filt->builder = gst_klv_builder_new (gst_klv_st0601_get_key ());
+
+  /* Tag 2: unix timestamp */
+  filt->timestamp_item = gst_klv_st0601_builder_add_tag (filt->builder, 2);
+
+  /* Tag 12: Image Coordinate System */
+  gst_klv_builder_add_item (filt->builder, 12, (guint8 *) "Geodetic WGS84",
+      14);
+
+  /* Tag 13: Sensor Latitude */
+  filt->latitude_item = gst_klv_st0601_builder_add_tag (filt->builder, 13);
+
+  /* Tag 14: Sensor Longitude */
+  filt->longitude_item = gst_klv_st0601_builder_add_tag (filt->builder, 14);
+
+  /* Tag 15: Sensor True Altitude (MSL) (elevation) */
+  filt->elevation_item = gst_klv_st0601_builder_add_tag (filt->builder, 15);
+
+  /* Tag 1: Checksum, always the last item */
+  filt->checksum_item = gst_klv_st0601_builder_add_tag (filt->builder, 1);
+
+  filt->location = DEFAULT_PROP_LOCATION;
+  filt->time_offset = DEFAULT_PROP_TIME_OFFSET;
+  filt->interpolation = DEFAULT_PROP_INTERPOLATION;
+  filt->reuse_payloads = DEFAULT_PROP_REUSE_PAYLOADS;
+  filt->payload_cache = gst_klv_payload_cache_new (PAYLOAD_CACHE_SIZE);
+  filt->index = g_array_new (FALSE, FALSE, sizeof (GstKlvInjectIndexEntry));
+  filt->scratch = g_byte_array_new ();
 }
 
 static void
-gst_klvinject_dispose (GstKlvInject * filt)
+gst_klvinject_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
 {
+  GstKlvInject *filt = GST_KLVINJECT (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_free (filt->location);
+      filt->location = g_value_dup_string (value);
+      break;
+    case PROP_TIME_OFFSET:
+      filt->time_offset = g_value_get_int64 (value);
+      break;
+    case PROP_INTERPOLATION:
+      filt->interpolation = g_value_get_enum (value);
+      break;
+    case PROP_REUSE_PAYLOADS:
+      filt->reuse_payloads = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
 }
 
-static GstStaticCaps unix_reference = GST_STATIC_CAPS ("timestamp/x-unix");
+static void
+gst_klvinject_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstKlvInject *filt = GST_KLVINJECT (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_value_set_string (value, filt->location);
+      break;
+    case PROP_TIME_OFFSET:
+      g_value_set_int64 (value, filt->time_offset);
+      break;
+    case PROP_INTERPOLATION:
+      g_value_set_enum (value, filt->interpolation);
+      break;
+    case PROP_REUSE_PAYLOADS:
+      g_value_set_boolean (value, filt->reuse_payloads);
+      break;
+    case PROP_REUSE_HITS:{
+      guint64 hits;
+
+      GST_OBJECT_LOCK (filt);
+      gst_klv_payload_cache_get_stats (filt->payload_cache, &hits, NULL,
+          NULL);
+      GST_OBJECT_UNLOCK (filt);
+      g_value_set_uint64 (value, hits);
+      break;
+    }
+    case PROP_REUSE_INLINED:{
+      guint64 inlined;
+
+      GST_OBJECT_LOCK (filt);
+      gst_klv_payload_cache_get_stats (filt->payload_cache, NULL, NULL,
+          &inlined);
+      GST_OBJECT_UNLOCK (filt);
+      g_value_set_uint64 (value, inlined);
+      break;
+    }
+    case PROP_REUSE_HIT_RATE:{
+      guint64 hits, lookups, inlined;
+
+      GST_OBJECT_LOCK (filt);
+      gst_klv_payload_cache_get_stats (filt->payload_cache, &hits, &lookups,
+          &inlined);
+      GST_OBJECT_UNLOCK (filt);
+      /* static sets are mostly small enough to be inlined, which saves the
+       * allocation as a hit does */
+      g_value_set_double (value, lookups + inlined ?
+          (gdouble) (hits + inlined) / (lookups + inlined) : 0.0);
+      break;
+    }
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
 
 static void
-gst_klvinject_add_test_meta (GstKlvInject * filt, GstBuffer * buf)
+gst_klvinject_finalize (GObject * object)
 {
-/* Add KLV meta for testing, here: Motion Imagery Standards Board (MISB)
- * Engineering Guideline MISB EG 0902 - MISB Minimum Metadata Set.
- * Also see: SMPTE S336M for KLV specification, also ITU-R BT.1563-1 */
-  const guint8 klv_header[16] = { 0x06, 0x0e, 0x2b, 0x34, 0x02, 0x0b, 0x01,
-    0x01, 0x0e, 0x01, 0x03, 0x01, 0x01, 0x00, 0x00, 0x00
-  };
-  GstByteWriter bw;
-  /* NOTE: MISB defines MISP time, which is NOT UTC, but use UTC for now */
-  gint64 utc_us = -1;
+  GstKlvInject *filt = GST_KLVINJECT (object);
+
+  gst_klv_builder_free (filt->builder);
+  g_free (filt->location);
+  g_array_unref (filt->index);
+  g_byte_array_unref (filt->scratch);
+  gst_klv_payload_cache_free (filt->payload_cache);
+
+  G_OBJECT_CLASS (gst_klvinject_parent_class)->finalize (object);
+}
+
+static gint
+gst_klvinject_compare_entries (gconstpointer a, gconstpointer b)
+{
+  const GstKlvInjectIndexEntry *entry_a = a;
+  const GstKlvInjectIndexEntry *entry_b = b;
+
+  if (entry_a->timestamp < entry_b->timestamp)
+    return -1;
+  return entry_a->timestamp > entry_b->timestamp;
+}
 
+static gboolean
+gst_klvinject_build_index (GstKlvInject * filt)
+{
+  GstKLVReader reader;
+  const guint8 *data, *key, *value;
+  gsize size, length;
+  guint n_skipped = 0;
+  gboolean sorted = TRUE;
+  guint64 last_timestamp = 0;
+
+  data = g_bytes_get_data (filt->file_bytes, &size);
+
+  gst_klv_reader_init (&reader, data, size);
+  while (gst_klv_reader_next_packet (&reader, &key, &value, &length)) {
+    GstKlvInjectIndexEntry entry;
+    const guint8 *ts;
+    gsize ts_length;
+
+    if (memcmp (key, gst_klv_st0601_get_key (), 16) != 0 ||
+        !gst_klv_local_set_find (value, length, 2, &ts, &ts_length) ||
+        ts_length != 8) {
+      n_skipped++;
+      continue;
+    }
+
+    entry.timestamp = GST_READ_UINT64_BE (ts);
+    entry.offset = key - data;
+    entry.size = (value - key) + length;
+    g_array_append_val (filt->index, entry);
+
+    if (entry.timestamp < last_timestamp)
+      sorted = FALSE;
+    last_timestamp = entry.timestamp;
+  }
+
+  if (reader.pos < size) {
+    GST_WARNING_OBJECT (filt, "Ignoring %" G_GSIZE_FORMAT " trailing bytes "
+        "that are not a complete KLV packet", size - reader.pos);
+  }
+
+  /* recordings are normally in order already */
+  if (!sorted)
+    g_array_sort (filt->index, gst_klvinject_compare_entries);
+
+  GST_INFO_OBJECT (filt, "Indexed %u packets, skipped %u without ST 0601 "
+      "key or time stamp", filt->index->len, n_skipped);
+
+  return filt->index->len > 0;
+}
+
+static gboolean
+gst_klvinject_start (GstBaseTransform * trans)
+{
+  GstKlvInject *filt = GST_KLVINJECT (trans);
+  GError *err = NULL;
+  guint i;
+
+  for (i = 0; i < GST_KLVINJECT_N_SAMPLES; i++)
+    filt->samples[i].index = -1;
+  filt->next_sample = 0;
+  filt->cursor = -1;
+
+  GST_OBJECT_LOCK (filt);
+  gst_klv_payload_cache_clear (filt->payload_cache);
+  GST_OBJECT_UNLOCK (filt);
+
+  if (filt->location == NULL)
+    return TRUE;
+
+  filt->file = g_mapped_file_new (filt->location, FALSE, &err);
+  if (filt->file == NULL) {
+    GST_ELEMENT_ERROR (filt, RESOURCE, OPEN_READ,
+        ("Could not open file \"%s\" for reading.", filt->location),
+        ("%s", err->message));
+    g_error_free (err);
+    return FALSE;
+  }
+  filt->file_bytes = g_mapped_file_get_bytes (filt->file);
+
+  if (!gst_klvinject_build_index (filt)) {
+    GST_ELEMENT_ERROR (filt, STREAM, WRONG_TYPE,
+        ("No time stamped MISB ST 0601 packets in file \"%s\".",
+            filt->location), (NULL));
+    /* stop() isn't called if the pads fail to activate */
+    gst_klvinject_stop (trans);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_klvinject_stop (GstBaseTransform * trans)
+{
+  GstKlvInject *filt = GST_KLVINJECT (trans);
+
+  g_array_set_size (filt->index, 0);
+  if (filt->file_bytes) {
+    g_bytes_unref (filt->file_bytes);
+    filt->file_bytes = NULL;
+  }
+  if (filt->file) {
+    g_mapped_file_unref (filt->file);
+    filt->file = NULL;
+  }
+
+  return TRUE;
+}
+
+static GstStaticCaps unix_reference = GST_STATIC_CAPS ("timestamp/x-unix");
+
+/* Returns the time of @buf in microseconds since the unix epoch, or -1 */
+static gint64
+gst_klvinject_get_unix_time (GstKlvInject * filt, GstBuffer * buf)
+{
 #if GST_CHECK_VERSION(1,14,0)
   GstReferenceTimestampMeta *time_meta;
   time_meta =
       gst_buffer_get_reference_timestamp_meta (buf,
       gst_static_caps_get (&unix_reference));
   if (time_meta) {
-    utc_us = time_meta->timestamp / 1000;
+    return time_meta->timestamp / 1000;
   }
 #endif
 
-  if (utc_us == -1) {
-    GDateTime *dt = g_date_time_new_now_utc ();
-    utc_us = g_date_time_to_unix (dt) * 1000000;        /* microseconds */
-    utc_us += g_date_time_get_microsecond (dt);
-    g_date_time_unref (dt);
+  return -1;
+}
+
+/* Attaches @data, as ref to an identical recent payload if enabled */
+static void
+gst_klvinject_add_meta (GstKlvInject * filt, GstBuffer * buf,
+    const guint8 * data, gsize size)
+{
+  if (filt->reuse_payloads) {
+    GST_OBJECT_LOCK (filt);
+    gst_buffer_add_klv_meta_from_cache (buf, filt->payload_cache, data, size);
+    GST_OBJECT_UNLOCK (filt);
+  } else {
+    gst_buffer_add_klv_meta_from_data (buf, data, size);
   }
+}
 
-  gst_byte_writer_init (&bw);
+/* Returns the index of the last packet at or before @timestamp, or -1 */
+static gint
+gst_klvinject_lookup (GstKlvInject * filt, guint64 timestamp)
+{
+  const GstKlvInjectIndexEntry *entries =
+      (const GstKlvInjectIndexEntry *) filt->index->data;
+  guint lo = 0, hi = filt->index->len;
+  gint i;
+
+  /* buffer times mostly advance by less than the packet interval, so first
+   * try the packet of the last buffer and the one after it */
+  for (i = filt->cursor; i >= 0 && i <= filt->cursor + 1; i++) {
+    if (i >= (gint) hi || entries[i].timestamp > timestamp)
+      break;
+    if (i + 1 == (gint) hi || entries[i + 1].timestamp > timestamp)
+      return filt->cursor = i;
+  }
 
-  /* KLV header */
-  gst_byte_writer_put_data (&bw, klv_header, 16);
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
 
-  /* Total length in BER long form (verbatim as long as <= 127) */
-  gst_byte_writer_put_uint8 (&bw,
-      (1 + 1 + 8) + (1 + 1 + 14) + (1 + 1 + 4) + (1 + 1 + 4) + (1 + 1 + 2));
+    if (entries[mid].timestamp <= timestamp)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
 
-  /* Tag 1: unix timestamp */
-  gst_byte_writer_put_uint8 (&bw, 2);   /* local tag: unix timestamp    */
-  gst_byte_writer_put_uint8 (&bw, 8);   /* data length (BER short form) */
-  gst_byte_writer_put_uint64_be (&bw, utc_us);
+  return filt->cursor = (gint) lo - 1;
+}
 
-  /* Tag 2: Image Coordinate System */
-  gst_byte_writer_put_uint8 (&bw, 12);  /* local tag: unix timestamp    */
-  gst_byte_writer_put_uint8 (&bw, 14);  /* data length (BER short form) */
-  gst_byte_writer_put_data (&bw, (guint8 *) "Geodetic WGS84", 14);
+/* Returns the decoded values of packet @idx, decoding it only if it is not in
+ * the ring of recently used samples */
+static const GstKlvInjectSample *
+gst_klvinject_get_sample (GstKlvInject * filt, gint idx)
+{
+  const GstKlvInjectIndexEntry *entry;
+  GstKlvInjectSample *sample;
+  GstKLVReader reader;
+  const guint8 *data, *value;
+  gsize length;
+  guint i;
+
+  for (i = 0; i < GST_KLVINJECT_N_SAMPLES; i++) {
+    if (filt->samples[i].index == idx)
+      return &filt->samples[i];
+  }
 
-  /* Tag 3: Sensor Latitude */
-  gst_byte_writer_put_uint8 (&bw, 13);  /* local tag: latitude */
-  gst_byte_writer_put_uint8 (&bw, 4);   /* data length (BER short form) */
-  {
-    /* Map -(2^31-1)..(2^31-1) to +/-90 with 0x80000000 = error */
-    gdouble latitude = 51.449825;
-    gint32 val = (gint) ((latitude / 90.0) * 2147483647.0);
-    gst_byte_writer_put_int32_be (&bw, val);
+  sample = &filt->samples[filt->next_sample];
+  filt->next_sample = (filt->next_sample + 1) % GST_KLVINJECT_N_SAMPLES;
+
+  entry = &g_array_index (filt->index, GstKlvInjectIndexEntry, idx);
+  data = (const guint8 *) g_bytes_get_data (filt->file_bytes, NULL) +
+      entry->offset;
+
+  sample->index = idx;
+  sample->timestamp = entry->timestamp;
+
+  gst_klv_reader_init (&reader, data, entry->size);
+  gst_klv_reader_next_packet (&reader, NULL, &value, &length);
+  for (i = 0; i < GST_KLVINJECT_N_VALUES; i++) {
+    sample->values[i] = 0.0;
+    sample->valid[i] = gst_klv_st0601_get_double (value, length,
+        interpolated_tags[i], &sample->values[i]);
   }
 
-  /* Tag 4: Sensor Longitude */
-  gst_byte_writer_put_uint8 (&bw, 14);  /* local tag: longitude */
-  gst_byte_writer_put_uint8 (&bw, 4);   /* data length (BER short form) */
-  {
-    /* Map -(2^31-1)..(2^31-1) to +/-180 with 0x80000000 = error */
-    gdouble longitude = -2.600439;
-    gint32 val = (gint) ((longitude / 180.0) * 2147483647.0);
-    gst_byte_writer_put_int32_be (&bw, val);
+  return sample;
+}
+
+/* Interpolates between angles @a and @b in degrees the shortest way around,
+ * wrapping the result to [@min, @min + 360) */
+static gdouble
+gst_klvinject_interpolate_angle (gdouble a, gdouble b, gdouble f, gdouble min)
+{
+  gdouble d = b - a, val;
+
+  if (d > 180.0)
+    d -= 360.0;
+  else if (d < -180.0)
+    d += 360.0;
+
+  val = a + f * d;
+  if (val < min)
+    val += 360.0;
+  else if (val >= min + 360.0)
+    val -= 360.0;
+
+  return val;
+}
+
+/* Interpolates latitude and longitude along the great circle */
+static void
+gst_klvinject_interpolate_spherical (const gdouble * a, const gdouble * b,
+    gdouble f, gdouble * lat, gdouble * lon)
+{
+  gdouble va[3], vb[3], v[3], omega, sa, sb, s;
+  gdouble lat_a = a[0] * G_PI / 180.0, lon_a = a[1] * G_PI / 180.0;
+  gdouble lat_b = b[0] * G_PI / 180.0, lon_b = b[1] * G_PI / 180.0;
+  gint i;
+
+  va[0] = cos (lat_a) * cos (lon_a);
+  va[1] = cos (lat_a) * sin (lon_a);
+  va[2] = sin (lat_a);
+  vb[0] = cos (lat_b) * cos (lon_b);
+  vb[1] = cos (lat_b) * sin (lon_b);
+  vb[2] = sin (lat_b);
+
+  omega = acos (CLAMP (va[0] * vb[0] + va[1] * vb[1] + va[2] * vb[2], -1.0,
+          1.0));
+  s = sin (omega);
+  if (s < 1e-12) {
+    /* (almost) the same point */
+    *lat = a[0];
+    *lon = a[1];
+    return;
+  }
+
+  sa = sin ((1.0 - f) * omega) / s;
+  sb = sin (f * omega) / s;
+  for (i = 0; i < 3; i++)
+    v[i] = sa * va[i] + sb * vb[i];
+
+  *lat = atan2 (v[2], sqrt (v[0] * v[0] + v[1] * v[1])) * 180.0 / G_PI;
+  *lon = atan2 (v[1], v[0]) * 180.0 / G_PI;
+}
+
+/* Attaches a copy of packet @idx with the values interpolated to
+ * @timestamp. Returns FALSE if there is nothing to interpolate. */
+static gboolean
+gst_klvinject_add_interpolated_meta (GstKlvInject * filt, GstBuffer * buf,
+    gint idx, guint64 timestamp)
+{
+  const GstKlvInjectIndexEntry *entry;
+  const GstKlvInjectSample *a, *b;
+  gdouble values[GST_KLVINJECT_N_VALUES];
+  GstKLVReader reader;
+  const guint8 *set;
+  gsize set_length;
+  gdouble f;
+  guint i;
+
+  if (idx + 1 >= (gint) filt->index->len)
+    return FALSE;
+
+  a = gst_klvinject_get_sample (filt, idx);
+  b = gst_klvinject_get_sample (filt, idx + 1);
+  if (timestamp <= a->timestamp || b->timestamp <= a->timestamp)
+    return FALSE;
+
+  f = (gdouble) (timestamp - a->timestamp) / (b->timestamp - a->timestamp);
+
+  values[0] = a->values[0] + f * (b->values[0] - a->values[0]);
+  values[1] = gst_klvinject_interpolate_angle (a->values[1], b->values[1], f,
+      -180.0);
+  values[2] = a->values[2] + f * (b->values[2] - a->values[2]);
+  values[3] = gst_klvinject_interpolate_angle (a->values[3], b->values[3], f,
+      0.0);
+
+  if (filt->interpolation == GST_KLVINJECT_INTERPOLATION_SPHERICAL &&
+      a->valid[0] && a->valid[1] && b->valid[0] && b->valid[1]) {
+    gst_klvinject_interpolate_spherical (a->values, b->values, f, &values[0],
+        &values[1]);
+  }
+
+  /* patch a copy of the earlier packet, so all other values are kept */
+  entry = &g_array_index (filt->index, GstKlvInjectIndexEntry, idx);
+  g_byte_array_set_size (filt->scratch, 0);
+  g_byte_array_append (filt->scratch,
+      (const guint8 *) g_bytes_get_data (filt->file_bytes, NULL) +
+      entry->offset, entry->size);
+
+  gst_klv_reader_init (&reader, filt->scratch->data, filt->scratch->len);
+  gst_klv_reader_next_packet (&reader, NULL, &set, &set_length);
+
+  for (i = 0; i < GST_KLVINJECT_N_VALUES; i++) {
+    const guint8 *value;
+    gsize length;
+
+    if (!a->valid[i] || !b->valid[i])
+      continue;
+
+    if (gst_klv_local_set_find (set, set_length, interpolated_tags[i], &value,
+            &length)) {
+      gst_klv_st0601_item_set_double (interpolated_tags[i], values[i],
+          (guint8 *) value, length);
+    }
   }
 
-  /* Tag 5: Sensor True Altitude (MSL) (elevation) */
-  gst_byte_writer_put_uint8 (&bw, 15);  /* local tag: elevation */
-  gst_byte_writer_put_uint8 (&bw, 2);   /* data length (BER short form) */
   {
-    /* Map 0..(2^16-1) to -900..19000 meters, so resolution 0.303654536m */
-    gdouble elevation = 10.0;
-    guint16 val = ((elevation + 900.0 + 0.151827268) / 19900.0) * 65535.0;
-    gst_byte_writer_put_int16_be (&bw, val);
+    const guint8 *value;
+    gsize length;
+
+    if (gst_klv_local_set_find (set, set_length, 2, &value, &length) &&
+        length == 8)
+      GST_WRITE_UINT64_BE ((guint8 *) value, timestamp);
+  }
+
+  gst_klv_st0601_update_checksum (filt->scratch->data, filt->scratch->len);
+
+  gst_klvinject_add_meta (filt, buf, filt->scratch->data, filt->scratch->len);
+
+  return TRUE;
+}
+
+static void
+gst_klvinject_add_file_meta (GstKlvInject * filt, GstBuffer * buf)
+{
+  const GstKlvInjectIndexEntry *entry;
+  GBytes *bytes;
+  gint64 timestamp, offset_us = filt->time_offset / 1000;
+  gint idx;
+
+  timestamp = gst_klvinject_get_unix_time (filt, buf);
+  if (timestamp == -1) {
+    if (!GST_BUFFER_PTS_IS_VALID (buf)) {
+      GST_DEBUG_OBJECT (filt, "Buffer without time, not injecting KLV");
+      return;
+    }
+    timestamp = g_array_index (filt->index, GstKlvInjectIndexEntry,
+        0).timestamp + GST_BUFFER_PTS (buf) / 1000;
+  }
+  timestamp += offset_us;
+
+  idx = timestamp < 0 ? -1 : gst_klvinject_lookup (filt, timestamp);
+  if (idx < 0) {
+    GST_DEBUG_OBJECT (filt, "Buffer time before first packet, not injecting");
+    return;
+  }
+
+  if (filt->interpolation != GST_KLVINJECT_INTERPOLATION_NONE &&
+      gst_klvinject_add_interpolated_meta (filt, buf, idx, timestamp)) {
+    GST_LOG_OBJECT (filt, "Injecting packet %d interpolated to time %"
+        G_GINT64_FORMAT " us", idx, timestamp);
+    return;
+  }
+
+  entry = &g_array_index (filt->index, GstKlvInjectIndexEntry, idx);
+  GST_LOG_OBJECT (filt, "Injecting packet %d for time %" G_GINT64_FORMAT
+      " us", idx, timestamp);
+
+  /* a slice of the mapped file is already shared, so the cache can't save
+   * anything here */
+  bytes = g_bytes_new_from_bytes (filt->file_bytes, entry->offset,
+      entry->size);
+  gst_buffer_add_klv_meta_take_bytes (buf, bytes);
+}
+
+static void
+gst_klvinject_add_test_meta (GstKlvInject * filt, GstBuffer * buf)
+{
+  /* NOTE: MISB defines MISP time, which is NOT UTC, but use UTC for now */
+  gint64 utc_us = gst_klvinject_get_unix_time (filt, buf);
+
+  if (utc_us == -1) {
+    GDateTime *dt = g_date_time_new_now_utc ();
+    utc_us = g_date_time_to_unix (dt) * 1000000;        /* microseconds */
+    utc_us += g_date_time_get_microsecond (dt);
+    g_date_time_unref (dt);
   }
 
+  gst_klv_builder_set_item_uint (filt->builder, filt->timestamp_item, utc_us);
+
+  /* the tag table takes care of mapping to the integer ranges */
+  gst_klv_st0601_builder_set_double (filt->builder, filt->latitude_item, 13,
+      51.449825);
+  gst_klv_st0601_builder_set_double (filt->builder, filt->longitude_item, 14,
+      -2.600439);
+  gst_klv_st0601_builder_set_double (filt->builder, filt->elevation_item, 15,
+      10.0);
+
+  gst_klv_st0601_builder_set_checksum (filt->builder, filt->checksum_item);
+
   {
-    gsize klv_size = gst_byte_writer_get_size (&bw);
-    guint8 *klv_data = gst_byte_writer_reset_and_get_data (&bw);
+    const guint8 *data;
+    gsize size;
 
-    gst_buffer_add_klv_meta_take_data (buf, klv_data, klv_size);
+    data = gst_klv_builder_get_data (filt->builder, &size);
+    gst_klvinject_add_meta (filt, buf, data, size);
   }
 }
 
@@ -194,8 +785,12 @@ gst_klvinject_transform_ip (GstBaseTransform * trans, GstBuffer * buf)
 {
   GstKlvInject *filt = GST_KLVINJECT (trans);
 
-  GST_LOG_OBJECT (filt, "Injecting test KLV metadata");
-  gst_klvinject_add_test_meta (filt, buf);
+  if (filt->file_bytes) {
+    gst_klvinject_add_file_meta (filt, buf);
+  } else {
+    GST_LOG_OBJECT (filt, "Injecting test KLV metadata");
+    gst_klvinject_add_test_meta (filt, buf);
+  }
 
   return GST_FLOW_OK;
 }
@@ -22,6 +22,8 @@
 
 #include <gst/base/gstbasetransform.h>
 
+#include "klv.h"
+
 G_BEGIN_DECLS
 
 #define GST_TYPE_KLVINJECT   (gst_klvinject_get_type())
@@ -30,12 +32,70 @@ G_BEGIN_DECLS
 #define GST_IS_KLVINJECT(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_KLVINJECT))
 #define GST_IS_KLVINJECT_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_KLVINJECT))
 
+/**
+ * GstKlvInjectInterpolation:
+ * @GST_KLVINJECT_INTERPOLATION_NONE: use the last packet at or before the
+ *     buffer time
+ * @GST_KLVINJECT_INTERPOLATION_LINEAR: interpolate linearly, with angles
+ *     taking the shortest way around
+ * @GST_KLVINJECT_INTERPOLATION_SPHERICAL: like linear, but interpolate the
+ *     position along the great circle between the two samples
+ *
+ * How sensor position and heading are interpolated between packets.
+ */
+typedef enum {
+  GST_KLVINJECT_INTERPOLATION_NONE,
+  GST_KLVINJECT_INTERPOLATION_LINEAR,
+  GST_KLVINJECT_INTERPOLATION_SPHERICAL
+} GstKlvInjectInterpolation;
+
+/* interpolated values: sensor latitude, longitude, altitude and heading */
+#define GST_KLVINJECT_N_VALUES 4
+#define GST_KLVINJECT_N_SAMPLES 4
+
+typedef struct
+{
+  gint index;
+  guint64 timestamp;
+  gdouble values[GST_KLVINJECT_N_VALUES];
+  gboolean valid[GST_KLVINJECT_N_VALUES];
+} GstKlvInjectSample;
+
 typedef struct _GstKlvInject GstKlvInject;
 typedef struct _GstKlvInjectClass GstKlvInjectClass;
 
 struct _GstKlvInject
 {
   GstBaseTransform base_klvinject;
+
+  /* test packet template, only the item values are patched per buffer */
+  GstKLVBuilder *builder;
+  gint timestamp_item;
+  gint latitude_item;
+  gint longitude_item;
+  gint elevation_item;
+  gint checksum_item;
+
+  /* properties */
+  gchar *location;
+  gint64 time_offset;
+  GstKlvInjectInterpolation interpolation;
+  gboolean reuse_payloads;
+
+  /* recently attached payloads, protected by the object lock */
+  GstKLVPayloadCache *payload_cache;
+
+  /* telemetry file and index sorted by timestamp */
+  GMappedFile *file;
+  GBytes *file_bytes;
+  GArray *index;
+
+  /* decoded packets around the current position, and the packet before the
+   * last buffer time */
+  GstKlvInjectSample samples[GST_KLVINJECT_N_SAMPLES];
+  guint next_sample;
+  gint cursor;
+  GByteArray *scratch;
 };
 
 struct _GstKlvInjectClass
@@ -21,6 +21,12 @@
  *
  * The klvinspect element inspects KLV metadata on passing buffers.
  *
+ * Statistics about the KLV packets seen, such as packet counts per key and
+ * tag, a packet size histogram, timestamp gaps between frames carrying KLV and
+ * the number of frames without KLV, are available from the #GstKlvInspect:stats
+ * property, and are posted as "klv-stats" element message every
+ * #GstKlvInspect:stats-interval milliseconds if set.
+ *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
@@ -34,23 +40,51 @@
 #include "config.h"
 #endif
 
+#include <string.h>
+
 #include <gst/gst.h>
 #include <gst/base/gstbasetransform.h>
 #include "gstklvinspect.h"
 #include "klv.h"
+#include "klvst0601.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_klvinspect_debug_category);
 #define GST_CAT_DEFAULT gst_klvinspect_debug_category
 
 /* prototypes */
+static void gst_klvinspect_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_klvinspect_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+static void gst_klvinspect_finalize (GObject * object);
+static gboolean gst_klvinspect_start (GstBaseTransform * trans);
+static gboolean gst_klvinspect_stop (GstBaseTransform * trans);
 static GstFlowReturn gst_klvinspect_transform_ip (GstBaseTransform * trans,
     GstBuffer * buf);
 
 enum
 {
-  PROP_0
+  PROP_0,
+  PROP_VALIDATE_CHECKSUM,
+  PROP_STATS,
+  PROP_STATS_INTERVAL
 };
 
+#define DEFAULT_PROP_VALIDATE_CHECKSUM FALSE
+#define DEFAULT_PROP_STATS_INTERVAL 0
+
+/* tags above this are counted together as "other-tags" */
+#define MAX_COUNTED_TAG 1023
+
+typedef struct
+{
+  guint8 key[16];
+  guint64 packets;
+  guint64 bytes;
+  guint64 other_tags;
+  GArray *tags;
+} GstKlvInspectKeyStats;
+
 /* pad templates */
 
 #define SRC_CAPS "ANY"
@@ -66,9 +100,30 @@ G_DEFINE_TYPE_WITH_CODE (GstKlvInspect, gst_klvinspect, GST_TYPE_BASE_TRANSFORM,
 static void
 gst_klvinspect_class_init (GstKlvInspectClass * klass)
 {
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
   GstBaseTransformClass *base_transform_class =
       GST_BASE_TRANSFORM_CLASS (klass);
 
+  gobject_class->set_property = gst_klvinspect_set_property;
+  gobject_class->get_property = gst_klvinspect_get_property;
+  gobject_class->finalize = gst_klvinspect_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_VALIDATE_CHECKSUM,
+      g_param_spec_boolean ("validate-checksum", "Validate checksum",
+          "Validate the checksum of MISB ST 0601 packets and count corrupt ones",
+          DEFAULT_PROP_VALIDATE_CHECKSUM,
+          G_PARAM_STATIC_STRINGS | G_PARAM_READWRITE));
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Statistics about the KLV metadata seen since the element started",
+          GST_TYPE_STRUCTURE, G_PARAM_STATIC_STRINGS | G_PARAM_READABLE));
+  g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+      g_param_spec_uint ("stats-interval", "Statistics interval",
+          "Interval in milliseconds for posting the statistics as element "
+          "message, or 0 to disable", 0, G_MAXUINT,
+          DEFAULT_PROP_STATS_INTERVAL,
+          G_PARAM_STATIC_STRINGS | G_PARAM_READWRITE));
+
   /* Setting up pads and setting metadata should be moved to
      base_class_init if you intend to subclass this class. */
   gst_element_class_add_pad_template (GST_ELEMENT_CLASS (klass),
@@ -82,6 +137,8 @@ gst_klvinspect_class_init (GstKlvInspectClass * klass)
       "Inspect KLV", "Filter", "Inspect KLV metadata",
       "Joshua M. Doe <oss@nvl.army.mil>");
 
+  base_transform_class->start = GST_DEBUG_FUNCPTR (gst_klvinspect_start);
+  base_transform_class->stop = GST_DEBUG_FUNCPTR (gst_klvinspect_stop);
   base_transform_class->transform_ip =
       GST_DEBUG_FUNCPTR (gst_klvinspect_transform_ip);
 
@@ -89,14 +146,341 @@ gst_klvinspect_class_init (GstKlvInspectClass * klass)
   base_transform_class->transform_ip_on_passthrough = TRUE;
 }
 
+static void
+gst_klvinspect_key_stats_free (GstKlvInspectKeyStats * key_stats)
+{
+  g_array_unref (key_stats->tags);
+  g_free (key_stats);
+}
+
 static void
 gst_klvinspect_init (GstKlvInspect * filt)
 {
+  filt->validate_checksum = DEFAULT_PROP_VALIDATE_CHECKSUM;
+  filt->stats_interval = DEFAULT_PROP_STATS_INTERVAL;
+  filt->key_stats =
+      g_ptr_array_new_with_free_func ((GDestroyNotify)
+      gst_klvinspect_key_stats_free);
 }
 
 static void
-gst_klvinspect_dispose (GstKlvInspect * filt)
+gst_klvinspect_finalize (GObject * object)
+{
+  GstKlvInspect *filt = GST_KLVINSPECT (object);
+
+  g_ptr_array_unref (filt->key_stats);
+
+  G_OBJECT_CLASS (gst_klvinspect_parent_class)->finalize (object);
+}
+
+/* call with the object lock held */
+static GstStructure *
+gst_klvinspect_get_stats (GstKlvInspect * filt)
 {
+  GstStructure *stats;
+  GValue array = G_VALUE_INIT;
+  GValue val = G_VALUE_INIT;
+  guint i, j;
+
+  stats = gst_structure_new ("klv-stats",
+      "frames", G_TYPE_UINT64, filt->n_frames,
+      "frames-without-klv", G_TYPE_UINT64, filt->n_frames_without_klv,
+      "packets", G_TYPE_UINT64, filt->n_packets,
+      "bytes", G_TYPE_UINT64, filt->n_bytes,
+      "packets-per-frame", G_TYPE_DOUBLE, filt->n_frames ?
+      (gdouble) filt->n_packets / filt->n_frames : 0.0,
+      "max-packets-per-frame", G_TYPE_UINT, filt->max_packets_per_frame,
+      "min-gap", GST_TYPE_CLOCK_TIME, filt->min_gap,
+      "max-gap", GST_TYPE_CLOCK_TIME, filt->max_gap,
+      "mean-gap", GST_TYPE_CLOCK_TIME, filt->n_gaps ?
+      filt->total_gap / filt->n_gaps : GST_CLOCK_TIME_NONE,
+      "checked-packets", G_TYPE_UINT64, filt->n_checked,
+      "corrupt-packets", G_TYPE_UINT64, filt->n_corrupt, NULL);
+
+  /* packet sizes, bins are <= 64, <= 128, ... <= 4096, > 4096 bytes */
+  g_value_init (&array, GST_TYPE_ARRAY);
+  for (i = 0; i < GST_KLVINSPECT_SIZE_BINS; i++) {
+    g_value_init (&val, G_TYPE_UINT64);
+    g_value_set_uint64 (&val, filt->size_histogram[i]);
+    gst_value_array_append_and_take_value (&array, &val);
+  }
+  gst_structure_take_value (stats, "size-histogram", &array);
+
+  /* one structure per key, with the number of occurrences of each tag */
+  g_value_init (&array, GST_TYPE_ARRAY);
+  for (i = 0; i < filt->key_stats->len; i++) {
+    GstKlvInspectKeyStats *key_stats = g_ptr_array_index (filt->key_stats, i);
+    GstStructure *s;
+    gchar key[33];
+
+    for (j = 0; j < 16; j++)
+      g_snprintf (key + 2 * j, 3, "%02x", key_stats->key[j]);
+
+    s = gst_structure_new ("klv-key-stats",
+        "key", G_TYPE_STRING, key,
+        "packets", G_TYPE_UINT64, key_stats->packets,
+        "bytes", G_TYPE_UINT64, key_stats->bytes,
+        "other-tags", G_TYPE_UINT64, key_stats->other_tags, NULL);
+
+    for (j = 0; j < key_stats->tags->len; j++) {
+      guint64 count = g_array_index (key_stats->tags, guint64, j);
+      gchar name[16];
+
+      if (count == 0)
+        continue;
+
+      g_snprintf (name, sizeof (name), "tag-%u", j);
+      gst_structure_set (s, name, G_TYPE_UINT64, count, NULL);
+    }
+
+    g_value_init (&val, GST_TYPE_STRUCTURE);
+    g_value_take_boxed (&val, s);
+    gst_value_array_append_and_take_value (&array, &val);
+  }
+  gst_structure_take_value (stats, "keys", &array);
+
+  return stats;
+}
+
+/* call with the object lock held */
+static void
+gst_klvinspect_reset_stats (GstKlvInspect * filt)
+{
+  filt->n_checked = 0;
+  filt->n_corrupt = 0;
+  filt->n_frames = 0;
+  filt->n_frames_without_klv = 0;
+  filt->n_packets = 0;
+  filt->n_bytes = 0;
+  filt->max_packets_per_frame = 0;
+  memset (filt->size_histogram, 0, sizeof (filt->size_histogram));
+  filt->last_klv_pts = GST_CLOCK_TIME_NONE;
+  filt->min_gap = GST_CLOCK_TIME_NONE;
+  filt->max_gap = GST_CLOCK_TIME_NONE;
+  filt->total_gap = 0;
+  filt->n_gaps = 0;
+  g_ptr_array_set_size (filt->key_stats, 0);
+  filt->last_stats_time = g_get_monotonic_time ();
+}
+
+static void
+gst_klvinspect_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstKlvInspect *filt = GST_KLVINSPECT (object);
+
+  switch (prop_id) {
+    case PROP_VALIDATE_CHECKSUM:
+      filt->validate_checksum = g_value_get_boolean (value);
+      break;
+    case PROP_STATS_INTERVAL:
+      filt->stats_interval = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_klvinspect_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstKlvInspect *filt = GST_KLVINSPECT (object);
+
+  switch (prop_id) {
+    case PROP_VALIDATE_CHECKSUM:
+      g_value_set_boolean (value, filt->validate_checksum);
+      break;
+    case PROP_STATS:
+      GST_OBJECT_LOCK (filt);
+      g_value_take_boxed (value, gst_klvinspect_get_stats (filt));
+      GST_OBJECT_UNLOCK (filt);
+      break;
+    case PROP_STATS_INTERVAL:
+      g_value_set_uint (value, filt->stats_interval);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static gboolean
+gst_klvinspect_start (GstBaseTransform * trans)
+{
+  GstKlvInspect *filt = GST_KLVINSPECT (trans);
+
+  GST_OBJECT_LOCK (filt);
+  gst_klvinspect_reset_stats (filt);
+  GST_OBJECT_UNLOCK (filt);
+
+  return TRUE;
+}
+
+static gboolean
+gst_klvinspect_stop (GstBaseTransform * trans)
+{
+  GstKlvInspect *filt = GST_KLVINSPECT (trans);
+
+  if (filt->validate_checksum) {
+    guint64 n_checked, n_corrupt;
+
+    GST_OBJECT_LOCK (filt);
+    n_checked = filt->n_checked;
+    n_corrupt = filt->n_corrupt;
+    GST_OBJECT_UNLOCK (filt);
+
+    GST_INFO_OBJECT (filt, "%" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT
+        " checked packets were corrupt", n_corrupt, n_checked);
+  }
+
+  return TRUE;
+}
+
+static void
+gst_klvinspect_validate_checksum (GstKlvInspect * filt, const guint8 * data,
+    gsize size)
+{
+  guint64 n_checked, n_corrupt;
+  gboolean valid;
+
+  if (size < 16 || memcmp (data, gst_klv_st0601_get_key (), 16) != 0)
+    return;
+
+  valid = gst_klv_st0601_validate_checksum (data, size);
+
+  GST_OBJECT_LOCK (filt);
+  n_checked = ++filt->n_checked;
+  n_corrupt = valid ? filt->n_corrupt : ++filt->n_corrupt;
+  GST_OBJECT_UNLOCK (filt);
+
+  if (!valid) {
+    GST_WARNING_OBJECT (filt, "Corrupt ST 0601 packet of %" G_GSIZE_FORMAT
+        " bytes, %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT
+        " packets corrupt so far", size, n_corrupt, n_checked);
+  }
+}
+
+/* call with the object lock held */
+static void
+gst_klvinspect_count_packet (GstKlvInspect * filt, const guint8 * key,
+    const guint8 * value, gsize length, gsize size)
+{
+  GstKlvInspectKeyStats *key_stats = NULL;
+  guint i, bin;
+
+  filt->n_packets++;
+  filt->n_bytes += size;
+
+  for (bin = 0; bin < GST_KLVINSPECT_SIZE_BINS - 1; bin++) {
+    if (size <= (64 << bin))
+      break;
+  }
+  filt->size_histogram[bin]++;
+
+  /* there are only ever a handful of different keys in a stream */
+  for (i = 0; i < filt->key_stats->len; i++) {
+    GstKlvInspectKeyStats *s = g_ptr_array_index (filt->key_stats, i);
+    if (memcmp (s->key, key, 16) == 0) {
+      key_stats = s;
+      break;
+    }
+  }
+
+  if (key_stats == NULL) {
+    key_stats = g_new0 (GstKlvInspectKeyStats, 1);
+    memcpy (key_stats->key, key, 16);
+    key_stats->tags = g_array_new (FALSE, TRUE, sizeof (guint64));
+    g_ptr_array_add (filt->key_stats, key_stats);
+  }
+
+  key_stats->packets++;
+  key_stats->bytes += size;
+
+  /* count tags of local sets with BER-OID or 1-byte tags and BER lengths */
+  if (key[4] == 0x02 && (key[5] == 0x0b || key[5] == 0x03)) {
+    GstKLVReader local_set;
+    guint tag;
+
+    gst_klv_reader_init (&local_set, value, length);
+    while (gst_klv_reader_next_item (&local_set, &tag, NULL, NULL)) {
+      if (tag > MAX_COUNTED_TAG) {
+        key_stats->other_tags++;
+        continue;
+      }
+      if (tag >= key_stats->tags->len)
+        g_array_set_size (key_stats->tags, tag + 1);
+      g_array_index (key_stats->tags, guint64, tag)++;
+    }
+  }
+}
+
+/* call with the object lock held */
+static void
+gst_klvinspect_count_frame (GstKlvInspect * filt, GstBuffer * buf,
+    guint n_packets)
+{
+  GstClockTime pts = GST_BUFFER_PTS (buf);
+
+  filt->n_frames++;
+  if (n_packets == 0) {
+    filt->n_frames_without_klv++;
+    return;
+  }
+
+  filt->max_packets_per_frame = MAX (filt->max_packets_per_frame, n_packets);
+
+  if (!GST_CLOCK_TIME_IS_VALID (pts))
+    return;
+
+  if (GST_CLOCK_TIME_IS_VALID (filt->last_klv_pts) &&
+      pts >= filt->last_klv_pts) {
+    GstClockTime gap = pts - filt->last_klv_pts;
+
+    if (!GST_CLOCK_TIME_IS_VALID (filt->min_gap) || gap < filt->min_gap)
+      filt->min_gap = gap;
+    if (!GST_CLOCK_TIME_IS_VALID (filt->max_gap) || gap > filt->max_gap)
+      filt->max_gap = gap;
+    filt->total_gap += gap;
+    filt->n_gaps++;
+  }
+  filt->last_klv_pts = pts;
+}
+
+static void
+gst_klvinspect_log_items (GstKlvInspect * filt, const guint8 * data,
+    gsize size)
+{
+  GstKLVReader reader, local_set;
+  const guint8 *key, *value;
+  gsize length;
+  guint tag;
+
+  gst_klv_reader_init (&reader, data, size);
+  while (gst_klv_reader_next_packet (&reader, &key, &value, &length)) {
+    gboolean is_st0601 = memcmp (key, gst_klv_st0601_get_key (), 16) == 0;
+
+    GST_LOG_OBJECT (filt, "KLV packet with %" G_GSIZE_FORMAT " bytes value",
+        length);
+    gst_klv_reader_init (&local_set, value, length);
+    while (gst_klv_reader_next_item (&local_set, &tag, &value, &length)) {
+      GValue val = G_VALUE_INIT;
+
+      if (is_st0601 && gst_klv_st0601_item_get_value (tag, value, length,
+              &val)) {
+        gchar *str = gst_value_serialize (&val);
+
+        GST_LOG_OBJECT (filt, "  tag %u (%s): %s", tag,
+            gst_klv_st0601_get_tag_info (tag)->name, GST_STR_NULL (str));
+        g_free (str);
+        g_value_unset (&val);
+      } else {
+        GST_LOG_OBJECT (filt, "  tag %u, %" G_GSIZE_FORMAT " bytes", tag,
+            length);
+      }
+    }
+  }
 }
 
 static GstFlowReturn
@@ -106,6 +490,8 @@ gst_klvinspect_transform_ip (GstBaseTransform * trans, GstBuffer * buf)
   GstKLVMeta *klv_meta;
   gpointer iter = NULL;
   gint n_klv_meta_found = 0;
+  guint n_packets = 0;
+  GstStructure *stats = NULL;
 
   while ((klv_meta = (GstKLVMeta *) gst_buffer_iterate_meta_filtered (buf,
               &iter, GST_KLV_META_API_TYPE))) {
@@ -113,11 +499,48 @@ gst_klvinspect_transform_ip (GstBaseTransform * trans, GstBuffer * buf)
     const guint8 *klv_data;
     klv_data = gst_klv_meta_get_data (klv_meta, &klv_size);
     if (klv_data) {
-      GST_MEMDUMP_OBJECT (filt, "KLV data", klv_data, (guint) klv_size);
+      GstKLVReader reader;
+      const guint8 *key, *value;
+      gsize length;
+
+      GST_OBJECT_LOCK (filt);
+      gst_klv_reader_init (&reader, klv_data, klv_size);
+      while (gst_klv_reader_next_packet (&reader, &key, &value, &length)) {
+        gst_klvinspect_count_packet (filt, key, value, length,
+            (value - key) + length);
+        n_packets++;
+      }
+      GST_OBJECT_UNLOCK (filt);
+
+      if (filt->validate_checksum)
+        gst_klvinspect_validate_checksum (filt, klv_data, klv_size);
+      if (gst_debug_category_get_threshold (GST_CAT_DEFAULT) >=
+          GST_LEVEL_MEMDUMP)
+        GST_MEMDUMP_OBJECT (filt, "KLV data", klv_data, (guint) klv_size);
+      if (gst_debug_category_get_threshold (GST_CAT_DEFAULT) >= GST_LEVEL_LOG)
+        gst_klvinspect_log_items (filt, klv_data, klv_size);
       ++n_klv_meta_found;
     }
   }
 
+  GST_OBJECT_LOCK (filt);
+  gst_klvinspect_count_frame (filt, buf, n_packets);
+
+  if (filt->stats_interval > 0) {
+    gint64 now = g_get_monotonic_time ();
+
+    if (now - filt->last_stats_time >= filt->stats_interval * (gint64) 1000) {
+      stats = gst_klvinspect_get_stats (filt);
+      filt->last_stats_time = now;
+    }
+  }
+  GST_OBJECT_UNLOCK (filt);
+
+  if (stats) {
+    gst_element_post_message (GST_ELEMENT (filt),
+        gst_message_new_element (GST_OBJECT (filt), stats));
+  }
+
   GST_LOG_OBJECT (filt, "Found %d KLV meta", n_klv_meta_found);
 
   return GST_FLOW_OK;
@@ -30,12 +30,35 @@ G_BEGIN_DECLS
 #define GST_IS_KLVINSPECT(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_KLVINSPECT))
 #define GST_IS_KLVINSPECT_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_KLVINSPECT))
 
+/* packet size histogram bins: <= 64, <= 128, ... <= 4096, > 4096 bytes */
+#define GST_KLVINSPECT_SIZE_BINS 8
+
 typedef struct _GstKlvInspect GstKlvInspect;
 typedef struct _GstKlvInspectClass GstKlvInspectClass;
 
 struct _GstKlvInspect
 {
   GstBaseTransform base_klvinspect;
+
+  gboolean validate_checksum;
+  guint stats_interval;
+
+  /* statistics, protected by the object lock */
+  guint64 n_checked;
+  guint64 n_corrupt;
+  guint64 n_frames;
+  guint64 n_frames_without_klv;
+  guint64 n_packets;
+  guint64 n_bytes;
+  guint max_packets_per_frame;
+  guint64 size_histogram[GST_KLVINSPECT_SIZE_BINS];
+  GstClockTime last_klv_pts;
+  GstClockTime min_gap;
+  GstClockTime max_gap;
+  GstClockTime total_gap;
+  guint64 n_gaps;
+  GPtrArray *key_stats;
+  gint64 last_stats_time;
 };
 
 struct _GstKlvInspectClass
@@ -39,11 +39,10 @@
 #endif
 
 #include "gstmisbirpack.h"
+#include "gstmisbkernels.h"
 
 #include <gst/video/video.h>
 
-//#include "gstextractcolororc-dist.h"
-
 /* GstMisbIrPack signals and args */
 enum
 {
@@ -280,6 +279,9 @@ gst_misb_ir_pack_set_info (GstVideoFilter * filter, GstCaps * incaps,
   memcpy (&filt->info_in, in_info, sizeof (GstVideoInfo));
   memcpy (&filt->info_out, out_info, sizeof (GstVideoInfo));
 
+  filt->pack_line = gst_misb_ir_pack_get_line_func (&filt->pack_line_name);
+  GST_DEBUG_OBJECT (filt, "Using %s kernel", filt->pack_line_name);
+
   return res;
 }
 
@@ -288,102 +290,34 @@ gst_misb_ir_pack_transform_frame (GstVideoFilter * filter,
     GstVideoFrame * in_frame, GstVideoFrame * out_frame)
 {
   GstMisbIrPack *filt = GST_MISB_IR_PACK (filter);
-  GTimer *timer = NULL;
+  gint64 start = 0;
   guint offset = filt->offset_value;
   gint y;
-  guint16 *src, *src_end;
+  guint16 *src;
   guint32 *dst;
-  guint32 word0;
-  guint32 word1;
-  guint16 luma0, chroma0, luma1, chroma1, luma2, chroma2;
 
   GST_LOG_OBJECT (filt, "Performing non-inplace transform");
 
-#if 0
-  timer = g_timer_new ();
-#endif
+  if (gst_debug_category_get_threshold (GST_CAT_DEFAULT) >= GST_LEVEL_LOG)
+    start = g_get_monotonic_time ();
 
   for (y = 0; y < GST_VIDEO_FRAME_COMP_HEIGHT (in_frame, 0); y++) {
-    src = (guint16 *) (GST_VIDEO_FRAME_COMP_DATA (in_frame, 0) +
+    src = (guint16 *) ((guint8 *) GST_VIDEO_FRAME_COMP_DATA (in_frame, 0) +
         y * GST_VIDEO_FRAME_COMP_STRIDE (in_frame, 0));
-    src_end = src + GST_VIDEO_FRAME_COMP_WIDTH (in_frame, 0);
-    dst = (guint32 *) (GST_VIDEO_FRAME_COMP_DATA (out_frame, 0) +
+    dst = (guint32 *) ((guint8 *) GST_VIDEO_FRAME_COMP_DATA (out_frame, 0) +
         y * GST_VIDEO_FRAME_COMP_STRIDE (out_frame, 0));
 
-    while (src + 2 < src_end) {
-      chroma0 = (*src & 0xff) + offset;
-      luma0 = ((*src & 0xff00) >> 8) + offset;
-      src++;
-      chroma1 = (*src & 0xff) + offset;
-      luma1 = ((*src & 0xff00) >> 8) + offset;
-      src++;
-      chroma2 = (*src & 0xff) + offset;
-      luma2 = ((*src & 0xff00) >> 8) + offset;
-      src++;
-
-      word0 = chroma0 | luma0 << 10 | chroma1 << 20;
-      word1 = luma1 | chroma2 << 10 | luma2 << 20;
-
-      *dst++ = word0;
-      *dst++ = word1;
-    }
-
-    /* handle the last one or two pixels if they exist */
-    if (src_end - src) {
-      chroma0 = (*src & 0xff) + offset;
-      luma0 = ((*src & 0xff00) >> 8) + offset;
-      src++;
-      if (src_end - src) {
-        chroma1 = (*src & 0xff) + offset;
-        luma1 = ((*src & 0xff00) >> 8) + offset;
-      } else {
-        chroma1 = luma1 = 0;
-      }
-      chroma2 = luma2 = 0;
-
-      word0 = chroma0 | luma0 << 10 | chroma1 << 20;
-      word1 = luma1 | chroma2 << 10 | luma2 << 20;
-
-      *dst++ = word0;
-      *dst++ = word1;
-    }
+    filt->pack_line (dst, src, GST_VIDEO_FRAME_COMP_WIDTH (in_frame, 0),
+        offset);
   }
 
-  //for (y = 0; y < GST_VIDEO_FRAME_COMP_HEIGHT (in_frame, 0); y++) {
-  //    src = (guint16 *) (GST_VIDEO_FRAME_COMP_DATA (in_frame, 0) + 
-  //        y * GST_VIDEO_FRAME_COMP_STRIDE (in_frame, 0));
-  //    dst = (guint32 *) (GST_VIDEO_FRAME_COMP_DATA (out_frame, 0) + 
-  //        y * GST_VIDEO_FRAME_COMP_STRIDE (out_frame, 0));
-  //    for (x = 0; x < GST_VIDEO_FRAME_COMP_WIDTH (in_frame, 0); ) {
-  //        guint32 word0;
-  //        guint32 word1;
-  //        guint16 luma0, chroma0, luma1, chroma1, luma2, chroma2;
-
-  //        chroma0 = *src & 0xff + offset;
-  //        luma0 = (*src & 0xff00) >> 8 + offset;
-  //        src++;
-  //        chroma1 = *src & 0xff + offset;
-  //        luma1 = (*src & 0xff00) >> 8 + offset;
-  //        src++;
-  //        chroma2 = *src & 0xff + offset;
-  //        luma2 = (*src & 0xff00) >> 8 + offset;
-  //        src++;
-
-  //        word0 = 0;
-  //        word0 = chroma0 | luma0 << 10 | chroma1 << 20;
-  //        word1 = 0;
-  //        word1 = luma1 | chroma2 << 10 | luma2 << 20;
-
-  //        dst[x++] = word0;
-  //        dst[x++] = word1;
-  //    }
-  //}
-
-#if 0
-  GST_LOG_OBJECT (filt, "Processing took %.3f ms", g_timer_elapsed (timer,
-          NULL) * 1000);
-  g_timer_destroy (timer);
-#endif
+  if (start) {
+    gint64 elapsed = MAX (g_get_monotonic_time () - start, 1);
+
+    GST_LOG_OBJECT (filt, "Processing took %.3f ms (%.1f MPix/s)",
+        elapsed / 1000.0, GST_VIDEO_FRAME_COMP_WIDTH (in_frame, 0) *
+        GST_VIDEO_FRAME_COMP_HEIGHT (in_frame, 0) / (gdouble) elapsed);
+  }
 
   return GST_FLOW_OK;
 }
@@ -28,6 +28,8 @@
 #include <gst/video/gstvideofilter.h>
 #include <gst/video/video.h>
 
+#include "gstmisbkernels.h"
+
 G_BEGIN_DECLS
 
 #define GST_TYPE_MISB_IR_PACK \
@@ -61,6 +63,10 @@ struct _GstMisbIrPack
 
   /* properties */
   guint offset_value;
+
+  /* line kernel chosen for the CPU in set_info */
+  GstMisbIrPackLineFunc pack_line;
+  const gchar *pack_line_name;
 };
 
 struct _GstMisbIrPackClass
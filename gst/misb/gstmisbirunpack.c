@@ -42,8 +42,6 @@
 
 #include <gst/video/video.h>
 
-//#include "gstextractcolororc-dist.h"
-
 /* GstMisbIrUnpack signals and args */
 enum
 {
@@ -94,6 +92,10 @@ static void gst_misb_ir_unpack_dispose (GObject * object);
 /* GstBaseTransform vmethod declarations */
 static GstCaps *gst_misb_ir_unpack_transform_caps (GstBaseTransform * trans,
     GstPadDirection direction, GstCaps * caps, GstCaps * filter_caps);
+static GstFlowReturn gst_misb_ir_unpack_prepare_output_buffer (GstBaseTransform
+    * trans, GstBuffer * inbuf, GstBuffer ** outbuf);
+static GstFlowReturn gst_misb_ir_unpack_transform (GstBaseTransform * trans,
+    GstBuffer * inbuf, GstBuffer * outbuf);
 
 /* GstVideoFilter vmethod declarations */
 static gboolean gst_misb_ir_unpack_set_info (GstVideoFilter * filter,
@@ -104,6 +106,9 @@ static GstFlowReturn gst_misb_ir_unpack_transform_frame (GstVideoFilter *
 
 /* GstMisbIrUnpack method declarations */
 static void gst_misb_ir_unpack_reset (GstMisbIrUnpack * filter);
+static void gst_misb_ir_unpack_select_kernel (GstMisbIrUnpack * filt);
+static void gst_misb_ir_unpack_lines (GstMisbIrUnpack * filt,
+    GstVideoFrame * in_frame, GstVideoFrame * out_frame);
 
 /* setup debug */
 GST_DEBUG_CATEGORY_STATIC (misb_ir_unpack_debug);
@@ -195,6 +200,10 @@ gst_misb_ir_unpack_class_init (GstMisbIrUnpackClass * klass)
   /* Register GstBaseTransform vmethods */
   gstbasetransform_class->transform_caps =
       GST_DEBUG_FUNCPTR (gst_misb_ir_unpack_transform_caps);
+  gstbasetransform_class->prepare_output_buffer =
+      GST_DEBUG_FUNCPTR (gst_misb_ir_unpack_prepare_output_buffer);
+  gstbasetransform_class->transform =
+      GST_DEBUG_FUNCPTR (gst_misb_ir_unpack_transform);
 
   gstvideofilter_class->set_info =
       GST_DEBUG_FUNCPTR (gst_misb_ir_unpack_set_info);
@@ -226,6 +235,7 @@ gst_misb_ir_unpack_set_property (GObject * object, guint prop_id,
 
   GST_DEBUG_OBJECT (filt, "setting property %s", pspec->name);
 
+  GST_OBJECT_LOCK (filt);
   switch (prop_id) {
     case PROP_OFFSET:
       filt->offset_value = g_value_get_int (value);
@@ -246,6 +256,8 @@ gst_misb_ir_unpack_set_property (GObject * object, guint prop_id,
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
   }
+  gst_misb_ir_unpack_select_kernel (filt);
+  GST_OBJECT_UNLOCK (filt);
 }
 
 static void
@@ -334,109 +346,191 @@ gst_misb_ir_unpack_set_info (GstVideoFilter * filter, GstCaps * incaps,
   GST_DEBUG_OBJECT (filt,
       "set_caps: in %" GST_PTR_FORMAT " out %" GST_PTR_FORMAT, incaps, outcaps);
 
+  /* set_property reads the input format to pick a kernel */
+  GST_OBJECT_LOCK (filt);
   memcpy (&filt->info_in, in_info, sizeof (GstVideoInfo));
   memcpy (&filt->info_out, out_info, sizeof (GstVideoInfo));
+  gst_misb_ir_unpack_select_kernel (filt);
+  GST_OBJECT_UNLOCK (filt);
+
+  /* UYVY and GRAY16 have the same size, so as long as the lines line up a
+   * writable input buffer can be turned into the output buffer */
+  filt->reuse_input = GST_VIDEO_INFO_FORMAT (in_info) == GST_VIDEO_FORMAT_UYVY
+      && GST_VIDEO_INFO_PLANE_STRIDE (in_info, 0) ==
+      GST_VIDEO_INFO_PLANE_STRIDE (out_info, 0)
+      && GST_VIDEO_INFO_PLANE_OFFSET (in_info, 0) ==
+      GST_VIDEO_INFO_PLANE_OFFSET (out_info, 0)
+      && GST_VIDEO_INFO_SIZE (in_info) == GST_VIDEO_INFO_SIZE (out_info);
+
+  GST_DEBUG_OBJECT (filt, "Using %s kernel%s", filt->unpack_line_name,
+      filt->reuse_input ? ", unpacking writable buffers in place" : "");
 
   return res;
 }
 
+static gboolean
+gst_misb_ir_unpack_can_reuse_input (GstMisbIrUnpack * filt, GstBuffer * inbuf)
+{
+  GstVideoMeta *meta;
+
+  if (!filt->reuse_input || !gst_buffer_is_writable (inbuf))
+    return FALSE;
+
+  /* the lines must be where downstream expects GRAY16 lines */
+  meta = gst_buffer_get_video_meta (inbuf);
+  if (meta) {
+    return meta->n_planes == 1 &&
+        meta->stride[0] == GST_VIDEO_INFO_PLANE_STRIDE (&filt->info_out, 0) &&
+        meta->offset[0] == GST_VIDEO_INFO_PLANE_OFFSET (&filt->info_out, 0);
+  }
+
+  return gst_buffer_get_size (inbuf) == GST_VIDEO_INFO_SIZE (&filt->info_out);
+}
+
+static GstFlowReturn
+gst_misb_ir_unpack_prepare_output_buffer (GstBaseTransform * trans,
+    GstBuffer * inbuf, GstBuffer ** outbuf)
+{
+  GstMisbIrUnpack *filt = GST_MISB_IR_UNPACK (trans);
+
+  if (gst_misb_ir_unpack_can_reuse_input (filt, inbuf)) {
+    GST_LOG_OBJECT (filt, "reusing writable input buffer");
+    *outbuf = inbuf;
+    return GST_FLOW_OK;
+  }
+
+  return
+      GST_BASE_TRANSFORM_CLASS
+      (gst_misb_ir_unpack_parent_class)->prepare_output_buffer (trans, inbuf,
+      outbuf);
+}
+
+static GstFlowReturn
+gst_misb_ir_unpack_transform (GstBaseTransform * trans, GstBuffer * inbuf,
+    GstBuffer * outbuf)
+{
+  GstMisbIrUnpack *filt = GST_MISB_IR_UNPACK (trans);
+  GstVideoFrame frame;
+  GstVideoMeta *meta;
+
+  if (inbuf != outbuf)
+    return
+        GST_BASE_TRANSFORM_CLASS
+        (gst_misb_ir_unpack_parent_class)->transform (trans, inbuf, outbuf);
+
+  GST_LOG_OBJECT (filt, "Performing inplace transform");
+
+  if (filt->unpack_line == NULL)
+    return GST_FLOW_NOT_NEGOTIATED;
+
+  if (!gst_video_frame_map (&frame, &filt->info_in, inbuf,
+          GST_MAP_READWRITE | GST_VIDEO_FRAME_MAP_FLAG_NO_REF)) {
+    GST_ELEMENT_ERROR (filt, CORE, FAILED, ("Failed to map input buffer"),
+        (NULL));
+    return GST_FLOW_ERROR;
+  }
+
+  gst_misb_ir_unpack_lines (filt, &frame, &frame);
+  gst_video_frame_unmap (&frame);
+
+  meta = gst_buffer_get_video_meta (outbuf);
+  if (meta)
+    meta->format = GST_VIDEO_FORMAT_GRAY16_LE;
+
+  return GST_FLOW_OK;
+}
+
 static GstFlowReturn
 gst_misb_ir_unpack_transform_frame (GstVideoFilter * filter,
     GstVideoFrame * in_frame, GstVideoFrame * out_frame)
 {
   GstMisbIrUnpack *filt = GST_MISB_IR_UNPACK (filter);
-  GTimer *timer = NULL;
-  gint16 offset = filt->offset_value;
-  guint shift = filt->shift_value;
-  gint x, y;
-  guint16 *dst;
 
   GST_LOG_OBJECT (filt, "Performing non-inplace transform");
 
-#if 0
-  timer = g_timer_new ();
-#endif
+  if (filt->unpack_line == NULL)
+    return GST_FLOW_NOT_NEGOTIATED;
 
-  if (filt->info_in.finfo->format == GST_VIDEO_FORMAT_v210) {
-    for (y = 0; y < GST_VIDEO_FRAME_COMP_HEIGHT (in_frame, 0); y++) {
-      guint32 *src = (guint32 *) (GST_VIDEO_FRAME_COMP_DATA (in_frame, 0) +
-          y * GST_VIDEO_FRAME_COMP_STRIDE (in_frame, 0));
-      dst = (guint16 *) (GST_VIDEO_FRAME_COMP_DATA (out_frame, 0) +
-          y * GST_VIDEO_FRAME_COMP_STRIDE (out_frame, 0));
-      for (x = 0; x < GST_VIDEO_FRAME_COMP_WIDTH (in_frame, 0);) {
-        guint32 word0 = *src++;
-        guint32 word1 = *src++;
-        guint16 luma, chroma, temp;
-
-        chroma = word0 & 0x3ff;
-        luma = (word0 & 0xffc00) >> 10;
-        if (filt->swap) {
-          temp = chroma;
-          chroma = luma;
-          luma = temp;
-        }
-        dst[x++] =
-            ((chroma + offset) & filt->chroma_mask) | (((luma +
-                    offset) & filt->luma_mask) << shift);
-
-        chroma = (word0 & 0x3ff00000) >> 20;
-        luma = word1 & 0x3ff;
-        if (filt->swap) {
-          temp = chroma;
-          chroma = luma;
-          luma = temp;
-        }
-        dst[x++] =
-            (chroma + offset) & filt->chroma_mask | ((luma +
-                offset) & filt->luma_mask) << shift;
-
-        chroma = (word1 & 0xffc00) >> 10;
-        luma = (word1 & 0x3ff00000) >> 20;
-        if (filt->swap) {
-          temp = chroma;
-          chroma = luma;
-          luma = temp;
-        }
-        dst[x++] =
-            (chroma + offset) & filt->chroma_mask | ((luma +
-                offset) & filt->luma_mask) << shift;
-      }
-    }
-  } else if (filt->info_in.finfo->format == GST_VIDEO_FORMAT_UYVY) {
-    for (y = 0; y < GST_VIDEO_FRAME_COMP_HEIGHT (in_frame, 0); y++) {
-      guint8 *src = (guint8 *) (GST_VIDEO_FRAME_COMP_DATA (in_frame, 0) +
-          y * GST_VIDEO_FRAME_COMP_STRIDE (in_frame, 0));
-      dst = (guint16 *) (GST_VIDEO_FRAME_COMP_DATA (out_frame, 0) +
-          y * GST_VIDEO_FRAME_COMP_STRIDE (out_frame, 0));
-      for (x = 0; x < GST_VIDEO_FRAME_COMP_WIDTH (in_frame, 0);) {
-        guint8 chroma = *src++;
-        guint8 luma = *src++;
-        guint8 temp;
-
-        if (filt->swap) {
-          temp = chroma;
-          chroma = luma;
-          luma = temp;
-        }
-        dst[x++] =
-            ((chroma + offset) & filt->chroma_mask) | (((luma +
-                    offset) & filt->luma_mask) << shift);
-      }
-    }
-  }
-#if 0
-  GST_LOG_OBJECT (filt, "Processing took %.3f ms", g_timer_elapsed (timer,
-          NULL) * 1000);
-  g_timer_destroy (timer);
-#endif
+  gst_misb_ir_unpack_lines (filt, in_frame, out_frame);
 
   return GST_FLOW_OK;
 }
 
+/* Unpacks all lines of @in_frame into @out_frame, which may be the same
+ * frame for UYVY */
+static void
+gst_misb_ir_unpack_lines (GstMisbIrUnpack * filt, GstVideoFrame * in_frame,
+    GstVideoFrame * out_frame)
+{
+  GstMisbIrUnpackLineFunc unpack_line;
+  GstMisbIrUnpackParams params;
+  gint64 start = 0;
+  gint width, y;
+
+  if (gst_debug_category_get_threshold (GST_CAT_DEFAULT) >= GST_LEVEL_LOG)
+    start = g_get_monotonic_time ();
+
+  GST_OBJECT_LOCK (filt);
+  unpack_line = filt->unpack_line;
+  params = filt->unpack_params;
+  GST_OBJECT_UNLOCK (filt);
+
+  width = GST_VIDEO_FRAME_COMP_WIDTH (in_frame, 0);
+  for (y = 0; y < GST_VIDEO_FRAME_COMP_HEIGHT (in_frame, 0); y++) {
+    const guint8 *src = (guint8 *) GST_VIDEO_FRAME_COMP_DATA (in_frame, 0) +
+        y * GST_VIDEO_FRAME_COMP_STRIDE (in_frame, 0);
+    guint16 *dst = (guint16 *) ((guint8 *)
+        GST_VIDEO_FRAME_COMP_DATA (out_frame, 0) +
+        y * GST_VIDEO_FRAME_COMP_STRIDE (out_frame, 0));
+
+    unpack_line (dst, src, width, &params);
+  }
+
+  if (start) {
+    gint64 elapsed = MAX (g_get_monotonic_time () - start, 1);
+
+    GST_LOG_OBJECT (filt, "Processing took %.3f ms (%.1f MPix/s)",
+        elapsed / 1000.0, width * GST_VIDEO_FRAME_COMP_HEIGHT (in_frame, 0) /
+        (gdouble) elapsed);
+  }
+}
+
+/* Picks the line kernel for the negotiated format, specialized for the
+ * current properties. Must be called with the object lock held. */
+static void
+gst_misb_ir_unpack_select_kernel (GstMisbIrUnpack * filt)
+{
+  GstMisbIrUnpackParams *params = &filt->unpack_params;
+
+  params->offset = (guint16) filt->offset_value;
+  params->shift = filt->shift_value;
+  params->luma_mask = filt->luma_mask;
+  params->chroma_mask = filt->chroma_mask;
+  params->swap = filt->swap;
+
+  switch (GST_VIDEO_INFO_FORMAT (&filt->info_in)) {
+    case GST_VIDEO_FORMAT_v210:
+      filt->unpack_line = gst_misb_ir_unpack_get_v210_line_func (params,
+          &filt->unpack_line_name);
+      break;
+    case GST_VIDEO_FORMAT_UYVY:
+      filt->unpack_line = gst_misb_ir_unpack_get_uyvy_line_func (params,
+          &filt->unpack_line_name);
+      break;
+    default:
+      filt->unpack_line = NULL;
+      filt->unpack_line_name = "none";
+      break;
+  }
+}
 
 static void
 gst_misb_ir_unpack_reset (GstMisbIrUnpack * misb_ir_unpack)
 {
   gst_video_info_init (&misb_ir_unpack->info_in);
   gst_video_info_init (&misb_ir_unpack->info_out);
+
+  misb_ir_unpack->unpack_line = NULL;
+  misb_ir_unpack->unpack_line_name = "none";
+  misb_ir_unpack->reuse_input = FALSE;
 }
@@ -28,6 +28,8 @@
 #include <gst/video/gstvideofilter.h>
 #include <gst/video/video.h>
 
+#include "gstmisbkernels.h"
+
 G_BEGIN_DECLS
 
 #define GST_TYPE_MISB_IR_UNPACK \
@@ -65,6 +67,14 @@ struct _GstMisbIrUnpack
   gboolean swap;
   guint luma_mask;
   guint chroma_mask;
+
+  /* kernel for the current format and properties */
+  GstMisbIrUnpackLineFunc unpack_line;
+  const gchar *unpack_line_name;
+  GstMisbIrUnpackParams unpack_params;
+
+  /* whether writable input buffers can be unpacked in place */
+  gboolean reuse_input;
 };
 
 struct _GstMisbIrUnpackClass
@@ -0,0 +1,541 @@
+/* GStreamer
+ * Copyright (C) 2018 United States Government, Joshua M. Doe <oss@nvl.army.mil>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Line kernels for packing and unpacking MISB ST 0402 IR video.
+ *
+ * Each kernel has a scalar version, which is always available and is the
+ * reference, and vectorized versions that are compiled in where the compiler
+ * supports them and picked at runtime according to the CPU features. The
+ * vectorized versions must produce bit-identical output. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstmisbkernels.h"
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define HAVE_SSSE3_KERNELS 1
+#define SSSE3_TARGET __attribute__ ((target ("ssse3")))
+#elif defined (_MSC_VER) && (defined (_M_X64) || defined (_M_IX86))
+#define HAVE_SSSE3_KERNELS 1
+#define SSSE3_TARGET
+#include <intrin.h>
+#endif
+
+#ifdef HAVE_SSSE3_KERNELS
+#include <tmmintrin.h>
+#endif
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#define HAVE_NEON_KERNELS 1
+#include <arm_neon.h>
+#endif
+
+#ifdef HAVE_SSSE3_KERNELS
+static gboolean
+gst_misb_cpu_has_ssse3 (void)
+{
+#if defined (_MSC_VER)
+  int info[4];
+
+  __cpuid (info, 1);
+  return (info[2] & (1 << 9)) != 0;
+#else
+  __builtin_cpu_init ();
+  return __builtin_cpu_supports ("ssse3");
+#endif
+}
+#endif
+
+/************************************************************************/
+/* GRAY16 to v210 packing                                               */
+/************************************************************************/
+
+/* ST 0402 Method 2 puts the low byte of each pixel in a chroma sample and
+ * the high byte in the following luma sample. In memory order this makes the
+ * GRAY16_LE bytes b0, b1, b2, ... end up three per 32-bit v210 word:
+ *
+ *   word[k] = (b[3k] + offset) | (b[3k+1] + offset) << 10 |
+ *       (b[3k+2] + offset) << 20
+ *
+ * which is what the vectorized kernels implement directly. */
+
+void
+gst_misb_ir_pack_line_scalar (guint32 * dst, const guint16 * src, gint width,
+    guint offset)
+{
+  const guint16 *src_end = src + width;
+  guint32 word0;
+  guint32 word1;
+  guint16 luma0, chroma0, luma1, chroma1, luma2, chroma2;
+
+  while (src + 2 < src_end) {
+    chroma0 = (*src & 0xff) + offset;
+    luma0 = ((*src & 0xff00) >> 8) + offset;
+    src++;
+    chroma1 = (*src & 0xff) + offset;
+    luma1 = ((*src & 0xff00) >> 8) + offset;
+    src++;
+    chroma2 = (*src & 0xff) + offset;
+    luma2 = ((*src & 0xff00) >> 8) + offset;
+    src++;
+
+    word0 = chroma0 | luma0 << 10 | chroma1 << 20;
+    word1 = luma1 | chroma2 << 10 | luma2 << 20;
+
+    *dst++ = word0;
+    *dst++ = word1;
+  }
+
+  /* handle the last one or two pixels if they exist */
+  if (src_end - src) {
+    chroma0 = (*src & 0xff) + offset;
+    luma0 = ((*src & 0xff00) >> 8) + offset;
+    src++;
+    if (src_end - src) {
+      chroma1 = (*src & 0xff) + offset;
+      luma1 = ((*src & 0xff00) >> 8) + offset;
+    } else {
+      chroma1 = luma1 = 0;
+    }
+    chroma2 = luma2 = 0;
+
+    word0 = chroma0 | luma0 << 10 | chroma1 << 20;
+    word1 = luma1 | chroma2 << 10 | luma2 << 20;
+
+    *dst++ = word0;
+    *dst++ = word1;
+  }
+}
+
+#ifdef HAVE_SSSE3_KERNELS
+SSSE3_TARGET static void
+gst_misb_ir_pack_line_ssse3 (guint32 * dst, const guint16 * src, gint width,
+    guint offset)
+{
+  const guint8 *bytes = (const guint8 *) src;
+  /* per 32-bit lane k: 16-bit b[3k], b[3k+1] and 32-bit b[3k+2] */
+  const __m128i shuf_ab = _mm_setr_epi8 (0, -1, 1, -1, 3, -1, 4, -1,
+      6, -1, 7, -1, 9, -1, 10, -1);
+  const __m128i shuf_c = _mm_setr_epi8 (2, -1, -1, -1, 5, -1, -1, -1,
+      8, -1, -1, -1, 11, -1, -1, -1);
+  const __m128i off16 = _mm_set1_epi16 ((gint16) offset);
+  const __m128i off32 = _mm_set1_epi32 ((gint32) offset);
+  const __m128i mask_lo = _mm_set1_epi32 (0xffff);
+  gint x = 0;
+
+  /* 6 pixels (12 bytes) make 4 words, but 16 bytes are loaded */
+  for (; x + 8 <= width; x += 6) {
+    __m128i in = _mm_loadu_si128 ((const __m128i *) (bytes + 2 * x));
+    __m128i ab = _mm_add_epi16 (_mm_shuffle_epi8 (in, shuf_ab), off16);
+    __m128i c = _mm_add_epi32 (_mm_shuffle_epi8 (in, shuf_c), off32);
+    __m128i out = _mm_or_si128 (_mm_and_si128 (ab, mask_lo),
+        _mm_slli_epi32 (_mm_srli_epi32 (ab, 16), 10));
+
+    out = _mm_or_si128 (out, _mm_slli_epi32 (c, 20));
+    _mm_storeu_si128 ((__m128i *) dst, out);
+    dst += 4;
+  }
+
+  gst_misb_ir_pack_line_scalar (dst, src + x, width - x, offset);
+}
+#endif
+
+#ifdef HAVE_NEON_KERNELS
+static void
+gst_misb_ir_pack_line_neon (guint32 * dst, const guint16 * src, gint width,
+    guint offset)
+{
+  const guint8 *bytes = (const guint8 *) src;
+  const uint16x8_t off = vdupq_n_u16 ((guint16) offset);
+  gint x = 0;
+
+  /* 12 pixels (24 bytes) make 8 words */
+  for (; x + 12 <= width; x += 12) {
+    uint8x8x3_t in = vld3_u8 (bytes + 2 * x);
+    uint16x8_t a = vaddq_u16 (vmovl_u8 (in.val[0]), off);
+    uint16x8_t b = vaddq_u16 (vmovl_u8 (in.val[1]), off);
+    uint16x8_t c = vaddq_u16 (vmovl_u8 (in.val[2]), off);
+    uint32x4_t lo, hi;
+
+    lo = vorrq_u32 (vmovl_u16 (vget_low_u16 (a)),
+        vshlq_n_u32 (vmovl_u16 (vget_low_u16 (b)), 10));
+    lo = vorrq_u32 (lo, vshlq_n_u32 (vmovl_u16 (vget_low_u16 (c)), 20));
+    hi = vorrq_u32 (vmovl_u16 (vget_high_u16 (a)),
+        vshlq_n_u32 (vmovl_u16 (vget_high_u16 (b)), 10));
+    hi = vorrq_u32 (hi, vshlq_n_u32 (vmovl_u16 (vget_high_u16 (c)), 20));
+
+    vst1q_u32 (dst, lo);
+    vst1q_u32 (dst + 4, hi);
+    dst += 8;
+  }
+
+  gst_misb_ir_pack_line_scalar (dst, src + x, width - x, offset);
+}
+#endif
+
+GstMisbIrPackLineFunc
+gst_misb_ir_pack_get_line_func (const gchar ** name)
+{
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#ifdef HAVE_NEON_KERNELS
+  *name = "neon";
+  return gst_misb_ir_pack_line_neon;
+#endif
+#ifdef HAVE_SSSE3_KERNELS
+  if (gst_misb_cpu_has_ssse3 ()) {
+    *name = "ssse3";
+    return gst_misb_ir_pack_line_ssse3;
+  }
+#endif
+#endif
+
+  *name = "scalar";
+  return gst_misb_ir_pack_line_scalar;
+}
+
+/************************************************************************/
+/* v210 and UYVY to GRAY16 unpacking                                    */
+/************************************************************************/
+
+/* The kernels are generated from inline bodies with swap and default_masks
+ * as compile-time constants, so each combination gets its own loop without
+ * per-pixel branches. Default masks are 0xff for both components with a
+ * shift of 8, where each output byte is simply one input sample plus the
+ * offset, modulo 256. */
+
+static inline guint16
+gst_misb_ir_unpack_pixel (guint chroma, guint luma,
+    const GstMisbIrUnpackParams * params, gboolean swap,
+    gboolean default_masks)
+{
+  guint c = swap ? luma : chroma;
+  guint l = swap ? chroma : luma;
+
+  if (default_masks)
+    return ((c + params->offset) & 0xff) | (l + params->offset) << 8;
+
+  return ((c + params->offset) & params->chroma_mask) |
+      ((l + params->offset) & params->luma_mask) << params->shift;
+}
+
+static inline void
+gst_misb_ir_unpack_v210_body_scalar (guint16 * dst, const guint8 * src,
+    gint width, const GstMisbIrUnpackParams * params, gboolean swap,
+    gboolean default_masks)
+{
+  const guint32 *words = (const guint32 *) src;
+  guint32 word0, word1;
+  gint x = 0;
+
+  /* two words hold three chroma/luma pairs */
+  for (; x + 3 <= width; x += 3) {
+    word0 = GUINT32_FROM_LE (words[0]);
+    word1 = GUINT32_FROM_LE (words[1]);
+    words += 2;
+
+    dst[x] = gst_misb_ir_unpack_pixel (word0 & 0x3ff,
+        (word0 >> 10) & 0x3ff, params, swap, default_masks);
+    dst[x + 1] = gst_misb_ir_unpack_pixel ((word0 >> 20) & 0x3ff,
+        word1 & 0x3ff, params, swap, default_masks);
+    dst[x + 2] = gst_misb_ir_unpack_pixel ((word1 >> 10) & 0x3ff,
+        (word1 >> 20) & 0x3ff, params, swap, default_masks);
+  }
+
+  /* v210 lines are padded to 48 pixels, so both words can be read */
+  if (x < width) {
+    word0 = GUINT32_FROM_LE (words[0]);
+    word1 = GUINT32_FROM_LE (words[1]);
+
+    dst[x] = gst_misb_ir_unpack_pixel (word0 & 0x3ff,
+        (word0 >> 10) & 0x3ff, params, swap, default_masks);
+    if (x + 1 < width)
+      dst[x + 1] = gst_misb_ir_unpack_pixel ((word0 >> 20) & 0x3ff,
+          word1 & 0x3ff, params, swap, default_masks);
+  }
+}
+
+static inline void
+gst_misb_ir_unpack_uyvy_body_scalar (guint16 * dst, const guint8 * src,
+    gint width, const GstMisbIrUnpackParams * params, gboolean swap,
+    gboolean default_masks)
+{
+  gint x;
+
+  for (x = 0; x < width; x++)
+    dst[x] = gst_misb_ir_unpack_pixel (src[2 * x], src[2 * x + 1], params,
+        swap, default_masks);
+}
+
+void
+gst_misb_ir_unpack_v210_line_scalar (guint16 * dst, const guint8 * src,
+    gint width, const GstMisbIrUnpackParams * params)
+{
+  if (params->swap)
+    gst_misb_ir_unpack_v210_body_scalar (dst, src, width, params, TRUE, FALSE);
+  else
+    gst_misb_ir_unpack_v210_body_scalar (dst, src, width, params, FALSE, FALSE);
+}
+
+void
+gst_misb_ir_unpack_uyvy_line_scalar (guint16 * dst, const guint8 * src,
+    gint width, const GstMisbIrUnpackParams * params)
+{
+  if (params->swap)
+    gst_misb_ir_unpack_uyvy_body_scalar (dst, src, width, params, TRUE, FALSE);
+  else
+    gst_misb_ir_unpack_uyvy_body_scalar (dst, src, width, params, FALSE, FALSE);
+}
+
+/* Instantiates the kernels for the four combinations of swap and default
+ * masks, in the order gst_misb_ir_unpack_variant() indexes them. */
+#define DEFINE_UNPACK_LINE(fmt, isa, target, variant, swap, default_masks)  \
+target static void                                                          \
+gst_misb_ir_unpack_##fmt##_line_##isa##_##variant (guint16 * dst,           \
+    const guint8 * src, gint width, const GstMisbIrUnpackParams * params)  \
+{                                                                           \
+  gst_misb_ir_unpack_##fmt##_body_##isa (dst, src, width, params, swap,    \
+      default_masks);                                                       \
+}
+
+#define DEFINE_UNPACK_LINES(fmt, isa, target)                               \
+DEFINE_UNPACK_LINE (fmt, isa, target, custom, FALSE, FALSE)                 \
+DEFINE_UNPACK_LINE (fmt, isa, target, swap_custom, TRUE, FALSE)             \
+DEFINE_UNPACK_LINE (fmt, isa, target, default, FALSE, TRUE)                 \
+DEFINE_UNPACK_LINE (fmt, isa, target, swap_default, TRUE, TRUE)             \
+static const GstMisbIrUnpackLineFunc gst_misb_ir_unpack_##fmt##_##isa[] = { \
+  gst_misb_ir_unpack_##fmt##_line_##isa##_custom,                           \
+  gst_misb_ir_unpack_##fmt##_line_##isa##_swap_custom,                      \
+  gst_misb_ir_unpack_##fmt##_line_##isa##_default,                          \
+  gst_misb_ir_unpack_##fmt##_line_##isa##_swap_default                      \
+};
+
+DEFINE_UNPACK_LINES (v210, scalar,)
+DEFINE_UNPACK_LINES (uyvy, scalar,)
+
+#ifdef HAVE_SSSE3_KERNELS
+/* Returns the 16-bit samples of the 16 v210 bytes in @in at the sample
+ * positions selected by @shuf, each 16-bit lane holding the two bytes the
+ * sample straddles. Samples start at bit 0, 2 or 4 of their lane; @mul
+ * moves them all to bit 4 so a single shift extracts them. */
+SSSE3_TARGET static inline __m128i
+gst_misb_ir_unpack_v210_samples_ssse3 (__m128i in, __m128i shuf, __m128i mul)
+{
+  __m128i v = _mm_mullo_epi16 (_mm_shuffle_epi8 (in, shuf), mul);
+
+  return _mm_and_si128 (_mm_srli_epi16 (v, 4), _mm_set1_epi16 (0x3ff));
+}
+
+SSSE3_TARGET static inline __m128i
+gst_misb_ir_unpack_combine_ssse3 (__m128i chroma, __m128i luma,
+    const GstMisbIrUnpackParams * params, gboolean default_masks)
+{
+  const __m128i off = _mm_set1_epi16 ((gint16) params->offset);
+
+  chroma = _mm_add_epi16 (chroma, off);
+  luma = _mm_add_epi16 (luma, off);
+
+  if (default_masks)
+    return _mm_or_si128 (_mm_and_si128 (chroma, _mm_set1_epi16 (0xff)),
+        _mm_slli_epi16 (luma, 8));
+
+  chroma = _mm_and_si128 (chroma,
+      _mm_set1_epi16 ((gint16) params->chroma_mask));
+  luma = _mm_and_si128 (luma, _mm_set1_epi16 ((gint16) params->luma_mask));
+  return _mm_or_si128 (chroma, _mm_sll_epi16 (luma,
+          _mm_cvtsi32_si128 (params->shift)));
+}
+
+SSSE3_TARGET static inline void
+gst_misb_ir_unpack_v210_body_ssse3 (guint16 * dst, const guint8 * src,
+    gint width, const GstMisbIrUnpackParams * params, gboolean swap,
+    gboolean default_masks)
+{
+  /* the 12 samples of 4 words sit at bit 0, 10, 20, 32, ... and alternate
+   * between chroma (even) and luma (odd) */
+  const __m128i shuf_even = _mm_setr_epi8 (0, 1, 2, 3, 5, 6, 8, 9,
+      10, 11, 13, 14, -1, -1, -1, -1);
+  const __m128i mul_even = _mm_setr_epi16 (16, 1, 4, 16, 1, 4, 0, 0);
+  const __m128i shuf_odd = _mm_setr_epi8 (1, 2, 4, 5, 6, 7, 9, 10,
+      12, 13, 14, 15, -1, -1, -1, -1);
+  const __m128i mul_odd = _mm_setr_epi16 (4, 16, 1, 4, 16, 1, 0, 0);
+  gint x = 0;
+
+  /* 16 bytes hold 6 pixels, but 8 pixels are stored */
+  for (; x + 8 <= width; x += 6) {
+    __m128i in = _mm_loadu_si128 ((const __m128i *) src);
+    __m128i even = gst_misb_ir_unpack_v210_samples_ssse3 (in, shuf_even,
+        mul_even);
+    __m128i odd = gst_misb_ir_unpack_v210_samples_ssse3 (in, shuf_odd,
+        mul_odd);
+    __m128i out;
+
+    if (swap)
+      out = gst_misb_ir_unpack_combine_ssse3 (odd, even, params,
+          default_masks);
+    else
+      out = gst_misb_ir_unpack_combine_ssse3 (even, odd, params,
+          default_masks);
+
+    _mm_storeu_si128 ((__m128i *) (dst + x), out);
+    src += 16;
+  }
+
+  gst_misb_ir_unpack_v210_body_scalar (dst + x, src, width - x, params, swap,
+      default_masks);
+}
+
+SSSE3_TARGET static inline void
+gst_misb_ir_unpack_uyvy_body_ssse3 (guint16 * dst, const guint8 * src,
+    gint width, const GstMisbIrUnpackParams * params, gboolean swap,
+    gboolean default_masks)
+{
+  const __m128i off8 = _mm_set1_epi8 ((gint8) params->offset);
+  gint x = 0;
+
+  for (; x + 8 <= width; x += 8) {
+    __m128i in = _mm_loadu_si128 ((const __m128i *) (src + 2 * x));
+    __m128i out;
+
+    if (default_masks) {
+      /* each output byte is an input byte plus the offset */
+      if (swap)
+        in = _mm_or_si128 (_mm_slli_epi16 (in, 8), _mm_srli_epi16 (in, 8));
+      out = _mm_add_epi8 (in, off8);
+    } else {
+      __m128i first = _mm_and_si128 (in, _mm_set1_epi16 (0xff));
+      __m128i second = _mm_srli_epi16 (in, 8);
+
+      if (swap)
+        out = gst_misb_ir_unpack_combine_ssse3 (second, first, params, FALSE);
+      else
+        out = gst_misb_ir_unpack_combine_ssse3 (first, second, params, FALSE);
+    }
+
+    _mm_storeu_si128 ((__m128i *) (dst + x), out);
+  }
+
+  gst_misb_ir_unpack_uyvy_body_scalar (dst + x, src + 2 * x, width - x,
+      params, swap, default_masks);
+}
+
+DEFINE_UNPACK_LINES (v210, ssse3, SSSE3_TARGET)
+DEFINE_UNPACK_LINES (uyvy, ssse3, SSSE3_TARGET)
+#endif
+
+#ifdef HAVE_NEON_KERNELS
+static inline void
+gst_misb_ir_unpack_uyvy_body_neon (guint16 * dst, const guint8 * src,
+    gint width, const GstMisbIrUnpackParams * params, gboolean swap,
+    gboolean default_masks)
+{
+  const uint8x16_t off8 = vdupq_n_u8 ((guint8) params->offset);
+  const uint16x8_t off = vdupq_n_u16 (params->offset);
+  const uint16x8_t chroma_mask = vdupq_n_u16 (params->chroma_mask);
+  const uint16x8_t luma_mask = vdupq_n_u16 (params->luma_mask);
+  const int16x8_t shift = vdupq_n_s16 (params->shift);
+  gint x = 0;
+
+  /* 16 pixels per iteration, de-interleaved into chroma and luma */
+  for (; x + 16 <= width; x += 16) {
+    uint8x16x2_t in = vld2q_u8 (src + 2 * x);
+    uint8x16_t chroma = swap ? in.val[1] : in.val[0];
+    uint8x16_t luma = swap ? in.val[0] : in.val[1];
+
+    if (default_masks) {
+      uint8x16x2_t out;
+
+      out.val[0] = vaddq_u8 (chroma, off8);
+      out.val[1] = vaddq_u8 (luma, off8);
+      vst2q_u8 ((guint8 *) (dst + x), out);
+    } else {
+      uint16x8_t c, l;
+
+      c = vandq_u16 (vaddq_u16 (vmovl_u8 (vget_low_u8 (chroma)), off),
+          chroma_mask);
+      l = vandq_u16 (vaddq_u16 (vmovl_u8 (vget_low_u8 (luma)), off),
+          luma_mask);
+      vst1q_u16 (dst + x, vorrq_u16 (c, vshlq_u16 (l, shift)));
+
+      c = vandq_u16 (vaddq_u16 (vmovl_u8 (vget_high_u8 (chroma)), off),
+          chroma_mask);
+      l = vandq_u16 (vaddq_u16 (vmovl_u8 (vget_high_u8 (luma)), off),
+          luma_mask);
+      vst1q_u16 (dst + x + 8, vorrq_u16 (c, vshlq_u16 (l, shift)));
+    }
+  }
+
+  gst_misb_ir_unpack_uyvy_body_scalar (dst + x, src + 2 * x, width - x,
+      params, swap, default_masks);
+}
+
+DEFINE_UNPACK_LINES (uyvy, neon,)
+#endif
+
+static guint
+gst_misb_ir_unpack_variant (const GstMisbIrUnpackParams * params)
+{
+  gboolean default_masks = params->chroma_mask == 0xff &&
+      params->luma_mask == 0xff && params->shift == 8;
+
+  return (params->swap ? 1 : 0) | (default_masks ? 2 : 0);
+}
+
+GstMisbIrUnpackLineFunc
+gst_misb_ir_unpack_get_v210_line_func (const GstMisbIrUnpackParams * params,
+    const gchar ** name)
+{
+  guint variant = gst_misb_ir_unpack_variant (params);
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#ifdef HAVE_SSSE3_KERNELS
+  if (gst_misb_cpu_has_ssse3 ()) {
+    *name = "ssse3";
+    return gst_misb_ir_unpack_v210_ssse3[variant];
+  }
+#endif
+#endif
+
+  *name = "scalar";
+  return gst_misb_ir_unpack_v210_scalar[variant];
+}
+
+GstMisbIrUnpackLineFunc
+gst_misb_ir_unpack_get_uyvy_line_func (const GstMisbIrUnpackParams * params,
+    const gchar ** name)
+{
+  guint variant = gst_misb_ir_unpack_variant (params);
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#ifdef HAVE_NEON_KERNELS
+  *name = "neon";
+  return gst_misb_ir_unpack_uyvy_neon[variant];
+#endif
+#ifdef HAVE_SSSE3_KERNELS
+  if (gst_misb_cpu_has_ssse3 ()) {
+    *name = "ssse3";
+    return gst_misb_ir_unpack_uyvy_ssse3[variant];
+  }
+#endif
+#endif
+
+  *name = "scalar";
+  return gst_misb_ir_unpack_uyvy_scalar[variant];
+}
@@ -0,0 +1,71 @@
+/* GStreamer
+ * Copyright (C) 2018 United States Government, Joshua M. Doe <oss@nvl.army.mil>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __GST_MISB_KERNELS_H__
+#define __GST_MISB_KERNELS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Packs one line of @width GRAY16_LE pixels into v210, adding @offset to
+ * each byte. The scalar kernel is the reference the others must match. */
+typedef void (*GstMisbIrPackLineFunc) (guint32 * dst, const guint16 * src,
+    gint width, guint offset);
+
+void gst_misb_ir_pack_line_scalar (guint32 * dst, const guint16 * src,
+    gint width, guint offset);
+
+GstMisbIrPackLineFunc gst_misb_ir_pack_get_line_func (const gchar ** name);
+
+/* Unpacking parameters, as set on misbirunpack. The offset is only ever
+ * used modulo 2^16, as the result is truncated to 16 bits anyway. */
+typedef struct
+{
+  guint16 offset;
+  guint shift;
+  guint16 luma_mask;
+  guint16 chroma_mask;
+  gboolean swap;
+} GstMisbIrUnpackParams;
+
+/* Unpacks one line of @width v210 or UYVY pixels into GRAY16_LE as
+ *
+ *   dst = ((chroma + offset) & chroma_mask) |
+ *       ((luma + offset) & luma_mask) << shift
+ *
+ * with chroma and luma exchanged if swap is set. UYVY kernels may be run in
+ * place, with @dst pointing at @src. */
+typedef void (*GstMisbIrUnpackLineFunc) (guint16 * dst, const guint8 * src,
+    gint width, const GstMisbIrUnpackParams * params);
+
+void gst_misb_ir_unpack_v210_line_scalar (guint16 * dst, const guint8 * src,
+    gint width, const GstMisbIrUnpackParams * params);
+void gst_misb_ir_unpack_uyvy_line_scalar (guint16 * dst, const guint8 * src,
+    gint width, const GstMisbIrUnpackParams * params);
+
+GstMisbIrUnpackLineFunc gst_misb_ir_unpack_get_v210_line_func (const
+    GstMisbIrUnpackParams * params, const gchar ** name);
+GstMisbIrUnpackLineFunc gst_misb_ir_unpack_get_uyvy_line_func (const
+    GstMisbIrUnpackParams * params, const gchar ** name);
+
+G_END_DECLS
+
+#endif /* __GST_MISB_KERNELS_H__ */
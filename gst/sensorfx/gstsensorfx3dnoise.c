@@ -45,16 +45,15 @@
 #  include <config.h>
 #endif
 
+#include <string.h>
+
 #include <gst/gst.h>
 #include <gst/video/video.h>
 
-#include "gstopencvutils.h"
 #include "gstsensorfx3dnoise.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_sfx3dnoise_debug);
 #define GST_CAT_DEFAULT gst_sfx3dnoise_debug
-#define DEBUG_INIT(bla) \
-  GST_DEBUG_CATEGORY_INIT (gst_sfx3dnoise_debug, "sfx3dnoise", 0, "ARF 3D-noise sensor effects");
 
 /* Filter signals and args */
 enum
@@ -71,7 +70,8 @@ enum
   PROP_SIGMA_TV,
   PROP_SIGMA_TH,
   PROP_SIGMA_VH,
-  PROP_SIGMA_TVH
+  PROP_SIGMA_TVH,
+  PROP_BANK_SIZE
 };
 
 #define DEFAULT_SIGMA_T 0.0
@@ -81,31 +81,75 @@ enum
 #define DEFAULT_SIGMA_TH 0.0
 #define DEFAULT_SIGMA_VH 0.0
 #define DEFAULT_SIGMA_TVH 0.0
+#define DEFAULT_BANK_SIZE 0
+
+static GstStaticPadTemplate gst_sfx3dnoise_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("{ GRAY8, GRAY16_LE }"))
+    );
+
+static GstStaticPadTemplate gst_sfx3dnoise_src_template =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("{ GRAY8, GRAY16_LE }"))
+    );
 
-GST_BOILERPLATE_FULL (GstSfx3DNoise, gst_sfx3dnoise, GstOpencvBaseTransform,
-    GST_TYPE_OPENCV_BASE_TRANSFORM, DEBUG_INIT);
+G_DEFINE_TYPE (GstSfx3DNoise, gst_sfx3dnoise, GST_TYPE_VIDEO_FILTER);
 
 static void gst_sfx3dnoise_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec);
 static void gst_sfx3dnoise_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec);
 
-static GstFlowReturn gst_sfx3dnoise_cv_transform (GstOpencvBaseTransform *
-    filter, GstBuffer * buf, IplImage * img, GstBuffer * outbuf,
-    IplImage * outimg);
-static gboolean gst_sfx3dnoise_cv_set_caps (GstOpencvBaseTransform * trans,
-    gint in_width, gint in_height, gint in_depth, gint in_channels,
-    gint out_width, gint out_height, gint out_depth, gint out_channels);
-
-void gst_sfx3dnoise_create_fixed_noise (GstSfx3DNoise * filter, CvMat * arr);
-void gst_sfx3dnoise_add_sigma_t (GstSfx3DNoise * filter, CvMat * arr,
-    double sigma);
-void gst_sfx3dnoise_add_sigma_tv (GstSfx3DNoise * filter, CvMat * arr,
-    double sigma);
-void gst_sfx3dnoise_add_sigma_th (GstSfx3DNoise * filter, CvMat * arr,
-    double sigma);
-void gst_sfx3dnoise_add_sigma_tvh (GstSfx3DNoise * filter, CvMat * arr,
-    double sigma);
+static GstFlowReturn gst_sfx3dnoise_transform_frame_ip (GstVideoFilter *
+    vfilter, GstVideoFrame * frame);
+static gboolean gst_sfx3dnoise_set_info (GstVideoFilter * vfilter,
+    GstCaps * incaps, GstVideoInfo * in_info, GstCaps * outcaps,
+    GstVideoInfo * out_info);
+
+static void gst_sfx3dnoise_create_fixed_noise (GstSfx3DNoise * filter,
+    gdouble sigma_v, gdouble sigma_h, gdouble sigma_vh);
+static void gst_sfx3dnoise_create_bank (GstSfx3DNoise * filter, guint size);
+static void gst_sfx3dnoise_temporal_noise (GstSfx3DNoise * filter,
+    gfloat * dest, const gfloat * bank, gint n, gdouble sigma);
+static gfloat gst_sfx3dnoise_bank_scale (GstSfx3DNoise * filter,
+    gdouble sigma);
+static void gst_sfx3dnoise_copy_shifted (gfloat * dst, const gfloat * src,
+    gint n, gint shift, gfloat scale);
+static void gst_sfx3dnoise_apply_line_8 (guint8 * line,
+    const gfloat * noise, gfloat offset, gint width);
+static void gst_sfx3dnoise_apply_line_16 (guint16 * line,
+    const gfloat * noise, gfloat offset, gint width);
+
+static void
+gst_sfx3dnoise_free_bank (GstSfx3DNoise * filter)
+{
+  g_free (filter->bank_tvh);
+  filter->bank_tvh = NULL;
+  g_free (filter->bank_tv);
+  filter->bank_tv = NULL;
+  g_free (filter->bank_th);
+  filter->bank_th = NULL;
+  filter->bank_planes = 0;
+}
+
+static void
+gst_sfx3dnoise_free_planes (GstSfx3DNoise * filter)
+{
+  g_free (filter->fixed_noise);
+  filter->fixed_noise = NULL;
+  g_free (filter->noise_v);
+  filter->noise_v = NULL;
+  g_free (filter->noise_h);
+  filter->noise_h = NULL;
+  g_free (filter->noise_line);
+  filter->noise_line = NULL;
+
+  gst_sfx3dnoise_free_bank (filter);
+}
 
 /* Clean up */
 static void
@@ -113,61 +157,40 @@ gst_sfx3dnoise_finalize (GObject * obj)
 {
   GstSfx3DNoise *filter = GST_SFX3DNOISE (obj);
 
-  if (filter->fixed_noise)
-    cvReleaseMat (&filter->fixed_noise);
-  filter->fixed_noise = NULL;
-
-  if (filter->intermediary)
-    cvReleaseMat (&filter->intermediary);
-  filter->intermediary = NULL;
+  gst_sfx3dnoise_free_planes (filter);
 
-  G_OBJECT_CLASS (parent_class)->finalize (obj);
+  G_OBJECT_CLASS (gst_sfx3dnoise_parent_class)->finalize (obj);
 }
 
 /* GObject vmethod implementations */
 
-static void
-gst_sfx3dnoise_base_init (gpointer gclass)
-{
-  GstElementClass *element_class = GST_ELEMENT_CLASS (gclass);
-  GstCaps *caps;
-  GstPadTemplate *templ;
-
-  /* add sink and source pad templates */
-  caps = gst_caps_from_string (GST_VIDEO_CAPS_GRAY16 ("1234"));
-  templ = gst_pad_template_new ("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
-      gst_caps_ref (caps));
-  gst_element_class_add_pad_template (element_class, templ);
-  templ = gst_pad_template_new ("src", GST_PAD_SRC, GST_PAD_ALWAYS, caps);
-  gst_element_class_add_pad_template (element_class, templ);
-
-  gst_element_class_set_details_simple (element_class,
-      "sfx3dnoise",
-      "Transform/Effect/Video",
-      "Add 3D noise to video", "Joshua M. Doe <oss@nvl.army.mil>");
-}
-
 static void
 gst_sfx3dnoise_class_init (GstSfx3DNoiseClass * klass)
 {
-  GObjectClass *gobject_class;
-  GstBaseTransformClass *gstbasetransform_class;
-  GstOpencvBaseTransformClass *gstopencvbasefilter_class;
-  GstElementClass *gstelement_class;
-
-  gobject_class = (GObjectClass *) klass;
-  gstelement_class = (GstElementClass *) klass;
-  gstbasetransform_class = (GstBaseTransformClass *) klass;
-  gstopencvbasefilter_class = (GstOpencvBaseTransformClass *) klass;
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+  GstVideoFilterClass *gstvideofilter_class = GST_VIDEO_FILTER_CLASS (klass);
 
-  parent_class = g_type_class_peek_parent (klass);
+  GST_DEBUG_CATEGORY_INIT (gst_sfx3dnoise_debug, "sfx3dnoise", 0,
+      "ARF 3D-noise sensor effects");
 
   gobject_class->finalize = GST_DEBUG_FUNCPTR (gst_sfx3dnoise_finalize);
   gobject_class->set_property = gst_sfx3dnoise_set_property;
   gobject_class->get_property = gst_sfx3dnoise_get_property;
 
-  gstopencvbasefilter_class->cv_trans_func = gst_sfx3dnoise_cv_transform;
-  gstopencvbasefilter_class->cv_set_caps = gst_sfx3dnoise_cv_set_caps;
+  gstvideofilter_class->set_info = GST_DEBUG_FUNCPTR (gst_sfx3dnoise_set_info);
+  gstvideofilter_class->transform_frame_ip =
+      GST_DEBUG_FUNCPTR (gst_sfx3dnoise_transform_frame_ip);
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&gst_sfx3dnoise_sink_template));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&gst_sfx3dnoise_src_template));
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "sfx3dnoise",
+      "Transform/Effect/Video",
+      "Add 3D noise to video", "Joshua M. Doe <oss@nvl.army.mil>");
 
   g_object_class_install_property (gobject_class, PROP_SIGMA_T,
       g_param_spec_double ("sigma-t", "sigma-t",
@@ -178,42 +201,56 @@ gst_sfx3dnoise_class_init (GstSfx3DNoiseClass * klass)
   g_object_class_install_property (gobject_class, PROP_SIGMA_V,
       g_param_spec_double ("sigma-v", "sigma-v",
           "Adds fixed row noise (horizontal lines)",
-          0.0, 1.0, DEFAULT_SIGMA_T, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)
+          0.0, 1.0, DEFAULT_SIGMA_V, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)
       );
 
   g_object_class_install_property (gobject_class, PROP_SIGMA_H,
       g_param_spec_double ("sigma-h", "sigma-h",
           "Adds fixed column noise (vertical lines)",
-          0.0, 1.0, DEFAULT_SIGMA_T, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)
+          0.0, 1.0, DEFAULT_SIGMA_H, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)
       );
 
   g_object_class_install_property (gobject_class, PROP_SIGMA_TV,
       g_param_spec_double ("sigma-tv", "sigma-tv",
           "Adds temporal row bounce (random horizontal lines)",
-          0.0, 1.0, DEFAULT_SIGMA_T, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)
+          0.0, 1.0, DEFAULT_SIGMA_TV, G_PARAM_READWRITE |
+          G_PARAM_STATIC_STRINGS)
       );
 
   g_object_class_install_property (gobject_class, PROP_SIGMA_TH,
       g_param_spec_double ("sigma-th", "sigma-th",
           "Adds temporal column bounce (random vertical lines)",
-          0.0, 1.0, DEFAULT_SIGMA_T, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)
+          0.0, 1.0, DEFAULT_SIGMA_TH, G_PARAM_READWRITE |
+          G_PARAM_STATIC_STRINGS)
       );
 
   g_object_class_install_property (gobject_class, PROP_SIGMA_VH,
       g_param_spec_double ("sigma-vh", "sigma-vh",
           "Adds random time-independent spatial noise (fixed pattern noise)",
-          0.0, 1.0, DEFAULT_SIGMA_T, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)
+          0.0, 1.0, DEFAULT_SIGMA_VH, G_PARAM_READWRITE |
+          G_PARAM_STATIC_STRINGS)
       );
 
   g_object_class_install_property (gobject_class, PROP_SIGMA_TVH,
       g_param_spec_double ("sigma-tvh", "sigma-tvh",
           "Adds random spatio-temporal noise",
-          0.0, 1.0, DEFAULT_SIGMA_T, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)
+          0.0, 1.0, DEFAULT_SIGMA_TVH, G_PARAM_READWRITE |
+          G_PARAM_STATIC_STRINGS)
+      );
+
+  g_object_class_install_property (gobject_class, PROP_BANK_SIZE,
+      g_param_spec_uint ("bank-size", "Noise bank size",
+          "Number of temporal noise planes generated up front and replayed "
+          "with random shifts, each taking width * height * 4 bytes "
+          "(0 = generate fresh noise every frame). Changing it while playing "
+          "stalls the next frame until the new bank is generated",
+          0, 1024, DEFAULT_BANK_SIZE, G_PARAM_READWRITE |
+          G_PARAM_STATIC_STRINGS)
       );
 }
 
 static void
-gst_sfx3dnoise_init (GstSfx3DNoise * filter, GstSfx3DNoiseClass * gclass)
+gst_sfx3dnoise_init (GstSfx3DNoise * filter)
 {
   GST_DEBUG ("Initializing");
 
@@ -225,12 +262,22 @@ gst_sfx3dnoise_init (GstSfx3DNoise * filter, GstSfx3DNoiseClass * gclass)
   filter->sigma_vh = filter->sigma_vh_old = DEFAULT_SIGMA_VH;
   filter->sigma_tvh = DEFAULT_SIGMA_TVH;
 
-  filter->rng = cvRNG (-1);
+  gst_sfx_random_init (&filter->rng, G_MAXUINT64);
   filter->fixed_noise = NULL;
-  filter->intermediary = NULL;
+  filter->noise_v = NULL;
+  filter->noise_h = NULL;
+  filter->noise_line = NULL;
+
+  filter->bank_size = DEFAULT_BANK_SIZE;
+  filter->bank_planes = 0;
+  filter->bank_tvh = NULL;
+  filter->bank_tv = NULL;
+  filter->bank_th = NULL;
 
   filter->width = 0;
   filter->height = 0;
+  filter->depth = 16;
+  filter->sigma_scale = G_MAXUINT16 - 1;
 
   gst_base_transform_set_in_place (GST_BASE_TRANSFORM (filter), TRUE);
 }
@@ -241,6 +288,7 @@ gst_sfx3dnoise_set_property (GObject * object, guint prop_id,
 {
   GstSfx3DNoise *filter = GST_SFX3DNOISE (object);
 
+  GST_OBJECT_LOCK (filter);
   switch (prop_id) {
     case PROP_SIGMA_T:
       filter->sigma_t = g_value_get_double (value);
@@ -263,10 +311,14 @@ gst_sfx3dnoise_set_property (GObject * object, guint prop_id,
     case PROP_SIGMA_TVH:
       filter->sigma_tvh = g_value_get_double (value);
       break;
+    case PROP_BANK_SIZE:
+      filter->bank_size = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
   }
+  GST_OBJECT_UNLOCK (filter);
 }
 
 static void
@@ -275,6 +327,7 @@ gst_sfx3dnoise_get_property (GObject * object, guint prop_id,
 {
   GstSfx3DNoise *filter = GST_SFX3DNOISE (object);
 
+  GST_OBJECT_LOCK (filter);
   switch (prop_id) {
     case PROP_SIGMA_T:
       g_value_set_double (value, filter->sigma_t);
@@ -297,93 +350,164 @@ gst_sfx3dnoise_get_property (GObject * object, guint prop_id,
     case PROP_SIGMA_TVH:
       g_value_set_double (value, filter->sigma_tvh);
       break;
+    case PROP_BANK_SIZE:
+      g_value_set_uint (value, filter->bank_size);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
   }
+  GST_OBJECT_UNLOCK (filter);
 }
 
 static GstFlowReturn
-gst_sfx3dnoise_cv_transform (GstOpencvBaseTransform * base, GstBuffer * buf,
-    IplImage * img, GstBuffer * outbuf, IplImage * outimg)
+gst_sfx3dnoise_transform_frame_ip (GstVideoFilter * vfilter,
+    GstVideoFrame * frame)
 {
-  GstSfx3DNoise *filter = GST_SFX3DNOISE (base);
+  GstSfx3DNoise *filter = GST_SFX3DNOISE (vfilter);
+  gdouble sigma_t, sigma_v, sigma_h, sigma_tv, sigma_th, sigma_vh, sigma_tvh;
+  guint bank_size;
+  const gfloat *fixed = NULL;
+  const gfloat *bank_tvh = NULL;
+  gfloat offset = 0.0f, scale_tvh = 0.0f;
+  gint dx = 0, dy = 0;
+  guint8 *data;
+  gint stride, x, y;
 
   GST_DEBUG ("Transforming");
 
-  cvConvert (img, filter->intermediary);
-
-  if (filter->sigma_h != filter->sigma_h_old ||
-      filter->sigma_v != filter->sigma_v_old ||
-      filter->sigma_vh != filter->sigma_vh_old) {
+  GST_OBJECT_LOCK (filter);
+  sigma_t = filter->sigma_t;
+  sigma_v = filter->sigma_v;
+  sigma_h = filter->sigma_h;
+  sigma_tv = filter->sigma_tv;
+  sigma_th = filter->sigma_th;
+  sigma_vh = filter->sigma_vh;
+  sigma_tvh = filter->sigma_tvh;
+  bank_size = filter->bank_size;
+  GST_OBJECT_UNLOCK (filter);
+
+  /* the bank is built in set_info, this only catches bank-size changing
+   * while playing, and stalls this frame for as long as generating it takes */
+  if (bank_size != filter->bank_planes)
+    gst_sfx3dnoise_create_bank (filter, bank_size);
+
+  if (sigma_h != filter->sigma_h_old ||
+      sigma_v != filter->sigma_v_old || sigma_vh != filter->sigma_vh_old) {
     GST_DEBUG ("Creating new fixed pattern noise image");
-    gst_sfx3dnoise_create_fixed_noise (filter, filter->fixed_noise);
+    gst_sfx3dnoise_create_fixed_noise (filter, sigma_v, sigma_h, sigma_vh);
 
-    filter->sigma_h_old = filter->sigma_h;
-    filter->sigma_v_old = filter->sigma_v;
-    filter->sigma_vh_old = filter->sigma_vh;
+    filter->sigma_h_old = sigma_h;
+    filter->sigma_v_old = sigma_v;
+    filter->sigma_vh_old = sigma_vh;
   }
 
-  if (filter->sigma_h != 0.0 || filter->sigma_v != 0.0
-      || filter->sigma_vh != 0.0) {
-    cvAdd (filter->intermediary, filter->fixed_noise, filter->intermediary, 0);
-  }
+  if (sigma_h != 0.0 || sigma_v != 0.0 || sigma_vh != 0.0)
+    fixed = filter->fixed_noise;
 
-  if (filter->sigma_tvh > 0.0) {
-    gst_sfx3dnoise_add_sigma_tvh (filter, filter->intermediary,
-        filter->sigma_tvh);
-  }
+  /* noise shared by the whole frame, a row or a column is drawn up front and
+   * broadcast, so the pass below reads and writes each pixel once */
+  if (sigma_t > 0.0)
+    offset = gst_sfx_random_normal (&filter->rng) * sigma_t *
+        filter->sigma_scale;
 
-  if (filter->sigma_tv > 0.0) {
-    gst_sfx3dnoise_add_sigma_tv (filter, filter->intermediary,
-        filter->sigma_tv);
-  }
+  if (sigma_tv > 0.0)
+    gst_sfx3dnoise_temporal_noise (filter, filter->noise_v, filter->bank_tv,
+        filter->height, sigma_tv);
 
-  if (filter->sigma_th > 0.0) {
-    gst_sfx3dnoise_add_sigma_th (filter, filter->intermediary,
-        filter->sigma_th);
-  }
+  if (sigma_th > 0.0)
+    gst_sfx3dnoise_temporal_noise (filter, filter->noise_h, filter->bank_th,
+        filter->width, sigma_th);
+
+  if (sigma_tvh > 0.0 && filter->bank_planes) {
+    gsize plane = (gsize) filter->width * filter->height;
 
-  if (filter->sigma_t > 0.0) {
-    gst_sfx3dnoise_add_sigma_t (filter, filter->intermediary, filter->sigma_t);
+    bank_tvh = filter->bank_tvh +
+        (gst_sfx_random_next (&filter->rng) % filter->bank_planes) * plane;
+    dx = gst_sfx_random_next (&filter->rng) % filter->width;
+    dy = gst_sfx_random_next (&filter->rng) % filter->height;
+    scale_tvh = gst_sfx3dnoise_bank_scale (filter, sigma_tvh);
   }
 
-  cvConvert (filter->intermediary, outimg);
+  data = GST_VIDEO_FRAME_PLANE_DATA (frame, 0);
+  stride = GST_VIDEO_FRAME_PLANE_STRIDE (frame, 0);
+
+  for (y = 0; y < filter->height; y++) {
+    gfloat *line_noise = filter->noise_line;
+    gfloat line_offset = offset;
+
+    if (sigma_tv > 0.0)
+      line_offset += filter->noise_v[y];
+
+    /* sum the per pixel noise of the line, it stays in cache */
+    if (bank_tvh) {
+      gst_sfx3dnoise_copy_shifted (line_noise,
+          bank_tvh + ((y + dy) % filter->height) * filter->width,
+          filter->width, dx, scale_tvh);
+    } else if (sigma_tvh > 0.0) {
+      gst_sfx_random_fill_normal (&filter->rng, line_noise, filter->width,
+          sigma_tvh * filter->sigma_scale);
+    } else {
+      memset (line_noise, 0, filter->width * sizeof (gfloat));
+    }
+
+    if (sigma_th > 0.0) {
+      for (x = 0; x < filter->width; x++)
+        line_noise[x] += filter->noise_h[x];
+    }
+
+    if (fixed) {
+      for (x = 0; x < filter->width; x++)
+        line_noise[x] += fixed[x];
+      fixed += filter->width;
+    }
+
+    if (filter->depth == 8)
+      gst_sfx3dnoise_apply_line_8 (data + y * stride, line_noise,
+          line_offset, filter->width);
+    else
+      gst_sfx3dnoise_apply_line_16 ((guint16 *) (data + y * stride),
+          line_noise, line_offset, filter->width);
+  }
 
   return GST_FLOW_OK;
 }
 
 static gboolean
-gst_sfx3dnoise_cv_set_caps (GstOpencvBaseTransform * trans, gint in_width,
-    gint in_height, gint in_depth, gint in_channels, gint out_width,
-    gint out_height, gint out_depth, gint out_channels)
+gst_sfx3dnoise_set_info (GstVideoFilter * vfilter, GstCaps * incaps,
+    GstVideoInfo * in_info, GstCaps * outcaps, GstVideoInfo * out_info)
 {
-  GstSfx3DNoise *filter = GST_SFX3DNOISE (trans);
+  GstSfx3DNoise *filter = GST_SFX3DNOISE (vfilter);
+  guint bank_size;
 
   GST_DEBUG ("Caps have been set");
 
-  filter->width = in_width;
-  filter->height = in_height;
-
-  if (filter->intermediary) {
-    cvReleaseMat (&filter->intermediary);
-    filter->intermediary = NULL;
-  }
+  filter->width = GST_VIDEO_INFO_WIDTH (in_info);
+  filter->height = GST_VIDEO_INFO_HEIGHT (in_info);
+  filter->depth = GST_VIDEO_INFO_COMP_DEPTH (in_info, 0);
 
-  if (out_depth != IPL_DEPTH_32F) {
-    filter->intermediary = cvCreateMat (out_height, out_width, CV_32FC1);
-  }
+  /* sigmas are given as a fraction of the full range */
+  filter->sigma_scale = (1 << filter->depth) - 2;
 
-  if (filter->fixed_noise) {
-    cvReleaseMat (&filter->fixed_noise);
-    filter->fixed_noise = NULL;
-  }
-  filter->fixed_noise = cvCreateMat (out_height, out_width, CV_32FC1);
-  gst_sfx3dnoise_create_fixed_noise (filter, filter->fixed_noise);
+  /* everything the transform needs is allocated here, not per frame */
+  gst_sfx3dnoise_free_planes (filter);
+  filter->fixed_noise = g_new (gfloat, (gsize) filter->width * filter->height);
+  filter->noise_v = g_new (gfloat, filter->height);
+  filter->noise_h = g_new (gfloat, filter->width);
+  filter->noise_line = g_new (gfloat, filter->width);
 
+  GST_OBJECT_LOCK (filter);
+  filter->sigma_v_old = filter->sigma_v;
+  filter->sigma_h_old = filter->sigma_h;
+  filter->sigma_vh_old = filter->sigma_vh;
+  bank_size = filter->bank_size;
+  GST_OBJECT_UNLOCK (filter);
 
+  gst_sfx3dnoise_create_fixed_noise (filter, filter->sigma_v_old,
+      filter->sigma_h_old, filter->sigma_vh_old);
 
-  /* TODO create fixed noise here */
+  /* drawing a large bank takes a while, so do it before the first frame */
+  gst_sfx3dnoise_create_bank (filter, bank_size);
 
   return TRUE;
 }
@@ -397,100 +521,158 @@ gst_sfx3dnoise_plugin_init (GstPlugin * plugin)
       GST_TYPE_SFX3DNOISE);
 }
 
-void
-gst_sfx3dnoise_create_fixed_noise (GstSfx3DNoise * filter, CvMat * arr)
-{
-  cvZero (arr);
-  gst_sfx3dnoise_add_sigma_tvh (filter, arr, filter->sigma_vh);
-  gst_sfx3dnoise_add_sigma_th (filter, arr, filter->sigma_h);
-  gst_sfx3dnoise_add_sigma_tv (filter, arr, filter->sigma_v);
-}
-
-/* Add sigma-vh or sigma-tvh noise, which adds random noise to every pixel */
-void
-gst_sfx3dnoise_add_sigma_tvh (GstSfx3DNoise * filter, CvMat * arr, double sigma)
+/* The fixed pattern of sigma-v row noise, sigma-h column noise and sigma-vh
+ * pixel noise is summed into one plane, drawn again when they change */
+static void
+gst_sfx3dnoise_create_fixed_noise (GstSfx3DNoise * filter, gdouble sigma_v,
+    gdouble sigma_h, gdouble sigma_vh)
 {
-  CvMat *noise = cvCreateMat (filter->height, filter->width, CV_32F);
+  gfloat *arr = filter->fixed_noise;
+  gint x, y;
 
-  /* TODO move scaling of sigma somewhere else? */
-  cvRandArr (&filter->rng, noise, CV_RAND_NORMAL, cvScalarAll (0),
-      cvScalarAll (sigma * (G_MAXUINT16 - 1)));
+  if (sigma_v > 0.0)
+    gst_sfx_random_fill_normal (&filter->rng, filter->noise_v, filter->height,
+        sigma_v * filter->sigma_scale);
+  else
+    memset (filter->noise_v, 0, filter->height * sizeof (gfloat));
 
-  cvAdd (arr, noise, arr, 0);
+  if (sigma_h > 0.0)
+    gst_sfx_random_fill_normal (&filter->rng, filter->noise_h, filter->width,
+        sigma_h * filter->sigma_scale);
+  else
+    memset (filter->noise_h, 0, filter->width * sizeof (gfloat));
 
-  cvReleaseMat (&noise);
+  for (y = 0; y < filter->height; y++) {
+    if (sigma_vh > 0.0)
+      gst_sfx_random_fill_normal (&filter->rng, arr, filter->width,
+          sigma_vh * filter->sigma_scale);
+    else
+      memset (arr, 0, filter->width * sizeof (gfloat));
+
+    for (x = 0; x < filter->width; x++)
+      arr[x] += filter->noise_h[x] + filter->noise_v[y];
+    arr += filter->width;
+  }
 }
 
-
-/* Add sigma-v or sigma-tv noise, which adds random horizontal lines */
-void
-gst_sfx3dnoise_add_sigma_tv (GstSfx3DNoise * filter, CvMat * arr, double sigma)
+/* The noise bank holds unit deviates so sigmas can change without
+ * regenerating it. Each frame picks a plane, offsets and a sign at random,
+ * so replaying the bank costs a few adds per pixel instead of new draws. */
+static void
+gst_sfx3dnoise_create_bank (GstSfx3DNoise * filter, guint size)
 {
-  CvMat *noise = cvCreateMat (1, filter->height, CV_32F);
-  gfloat *data;
-  gfloat *noisedata;
-  int step, x, y;
+  gsize plane = (gsize) filter->width * filter->height;
+  guint i;
+
+  gst_sfx3dnoise_free_bank (filter);
+
+  if (size == 0)
+    return;
+
+  GST_DEBUG_OBJECT (filter, "Creating noise bank of %u planes", size);
+
+  filter->bank_tvh = g_try_new (gfloat, plane * size);
+  filter->bank_tv = g_try_new (gfloat, (gsize) filter->height * size);
+  filter->bank_th = g_try_new (gfloat, (gsize) filter->width * size);
+  if (!filter->bank_tvh || !filter->bank_tv || !filter->bank_th) {
+    GST_ELEMENT_WARNING (filter, RESOURCE, NO_SPACE_LEFT,
+        ("Not enough memory for a noise bank of %u planes", size), (NULL));
+    gst_sfx3dnoise_free_bank (filter);
+
+    /* don't retry on every frame */
+    GST_OBJECT_LOCK (filter);
+    filter->bank_size = 0;
+    GST_OBJECT_UNLOCK (filter);
+    g_object_notify (G_OBJECT (filter), "bank-size");
+    return;
+  }
 
-  /* TODO move scaling of sigma somewhere else? */
-  cvRandArr (&filter->rng, noise, CV_RAND_NORMAL, cvScalarAll (0),
-      cvScalarAll (sigma * (G_MAXUINT16 - 1)));
+  for (i = 0; i < size; i++) {
+    gst_sfx_random_fill_normal (&filter->rng, filter->bank_tvh + i * plane,
+        plane, 1.0f);
+    gst_sfx_random_fill_normal (&filter->rng,
+        filter->bank_tv + i * filter->height, filter->height, 1.0f);
+    gst_sfx_random_fill_normal (&filter->rng,
+        filter->bank_th + i * filter->width, filter->width, 1.0f);
+  }
 
-  cvGetRawData (arr, (uchar **) & data, &step, NULL);
-  cvGetRawData (noise, (uchar **) & noisedata, NULL, NULL);
+  filter->bank_planes = size;
+}
 
-  step /= sizeof (gfloat);
+/* Scales a sigma by a random sign, which doubles the variety of the bank */
+static gfloat
+gst_sfx3dnoise_bank_scale (GstSfx3DNoise * filter, gdouble sigma)
+{
+  if (gst_sfx_random_next (&filter->rng) & 1)
+    sigma = -sigma;
+  return sigma * filter->sigma_scale;
+}
 
-  for (y = 0; y < filter->height; y++) {
-    for (x = 0; x < filter->width; x++) {
-      data[y * step + x] += noisedata[y];
-    }
+/* Draws @n values of sigma-tv or sigma-th noise, either fresh or from a
+ * random offset into the bank vector */
+static void
+gst_sfx3dnoise_temporal_noise (GstSfx3DNoise * filter, gfloat * dest,
+    const gfloat * bank, gint n, gdouble sigma)
+{
+  guint len, i;
+  gfloat scale;
+  gint x;
+
+  if (!filter->bank_planes) {
+    gst_sfx_random_fill_normal (&filter->rng, dest, n,
+        sigma * filter->sigma_scale);
+    return;
   }
 
-  cvReleaseMat (&noise);
-}
+  len = filter->bank_planes * n;
+  i = gst_sfx_random_next (&filter->rng) % len;
+  scale = gst_sfx3dnoise_bank_scale (filter, sigma);
 
+  for (x = 0; x < n; x++) {
+    dest[x] = scale * bank[i];
+    if (++i == len)
+      i = 0;
+  }
+}
 
-/* Add sigma-h and sigma-th noise, which adds random vertical lines */
-void
-gst_sfx3dnoise_add_sigma_th (GstSfx3DNoise * filter, CvMat * arr, double sigma)
+/* Computes dst[x] = scale * src[(x + shift) % n] */
+static void
+gst_sfx3dnoise_copy_shifted (gfloat * dst, const gfloat * src, gint n,
+    gint shift, gfloat scale)
 {
-  CvMat *noise = cvCreateMat (1, filter->width, CV_32F);
-  gfloat *data;
-  gfloat *noisedata;
-  int step, x, y;
+  gint x;
 
-  /* TODO move scaling of sigma somewhere else? */
-  cvRandArr (&filter->rng, noise, CV_RAND_NORMAL, cvScalarAll (0),
-      cvScalarAll (sigma * (G_MAXUINT16 - 1)));
+  for (x = 0; x < n - shift; x++)
+    dst[x] = scale * src[x + shift];
+  for (; x < n; x++)
+    dst[x] = scale * src[x + shift - n];
+}
 
-  cvGetRawData (arr, (uchar **) & data, &step, NULL);
-  cvGetRawData (noise, (uchar **) & noisedata, NULL, NULL);
+/* Adds the noise to a line, rounding to nearest and saturating */
+static void
+gst_sfx3dnoise_apply_line_8 (guint8 * line, const gfloat * noise,
+    gfloat offset, gint width)
+{
+  gint x;
 
-  step /= sizeof (gfloat);
+  for (x = 0; x < width; x++) {
+    gfloat v = line[x] + offset + noise[x];
 
-  for (y = 0; y < filter->height; y++) {
-    for (x = 0; x < filter->width; x++) {
-      data[y * step + x] += noisedata[x];
-    }
+    v = CLAMP (v, 0.0f, 255.0f);
+    line[x] = (guint8) (v + 0.5f);
   }
-
-  cvReleaseMat (&noise);
 }
 
-/* Add Sigma_T noise, which creates a flashing effect */
-void
-gst_sfx3dnoise_add_sigma_t (GstSfx3DNoise * filter, CvMat * arr, double sigma)
+static void
+gst_sfx3dnoise_apply_line_16 (guint16 * line, const gfloat * noise,
+    gfloat offset, gint width)
 {
-  CvMat *noise = cvCreateMat (1, 1, CV_32F);
-  float *data;
-
-  /* TODO move scaling of sigma somewhere else? */
-  cvRandArr (&filter->rng, noise, CV_RAND_NORMAL, cvScalarAll (0),
-      cvScalarAll (sigma * (G_MAXUINT16 - 1)));
+  gint x;
 
-  cvGetRawData (noise, (uchar **) & data, NULL, NULL);
+  for (x = 0; x < width; x++) {
+    gfloat v = GUINT16_FROM_LE (line[x]) + offset + noise[x];
 
-  cvAddS (arr, cvScalarAll (*data), arr, 0);
-
-  cvReleaseMat (&noise);
+    v = CLAMP (v, 0.0f, 65535.0f);
+    line[x] = GUINT16_TO_LE ((guint16) (v + 0.5f));
+  }
 }
@@ -45,8 +45,10 @@
 #define __GST_SFX3DNOISE_H__
 
 #include <gst/gst.h>
-#include <cv.h>
-#include <gstopencvbasetrans.h>
+#include <gst/video/video.h>
+#include <gst/video/gstvideofilter.h>
+
+#include "gstsensorfxrandom.h"
 
 G_BEGIN_DECLS
 
@@ -67,7 +69,7 @@ typedef struct _GstSfx3DNoiseClass GstSfx3DNoiseClass;
 
 struct _GstSfx3DNoise
 {
-  GstOpencvBaseTransform element;
+  GstVideoFilter element;
 
   gdouble sigma_t;
   gdouble sigma_v;
@@ -83,15 +85,32 @@ struct _GstSfx3DNoise
 
   gint width;
   gint height;
+  gint depth;
+  gdouble sigma_scale;
+
+  /* the fixed noise plane of width * height values, row noise of height
+   * values and column and line noise of width values, allocated when caps are
+   * set */
+  GstSfxRandom rng;
+  gfloat * fixed_noise;
+  gfloat * noise_v;
+  gfloat * noise_h;
+  gfloat * noise_line;
 
-  CvRNG rng;
-  CvMat * fixed_noise;
-  CvMat * intermediary;
+  /* temporal noise bank of unit deviates, bank_planes planes of
+   * width * height values plus row and column vectors of bank_planes * height
+   * and bank_planes * width values, created when caps are set or on the
+   * next frame if bank-size changes while playing */
+  guint bank_size;
+  guint bank_planes;
+  gfloat * bank_tvh;
+  gfloat * bank_tv;
+  gfloat * bank_th;
 };
 
 struct _GstSfx3DNoiseClass 
 {
-  GstOpencvBaseTransformClass parent_class;
+  GstVideoFilterClass parent_class;
 };
 
 GType gst_sfx3dnoise_get_type (void);
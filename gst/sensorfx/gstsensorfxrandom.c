@@ -0,0 +1,235 @@
+/* GStreamer
+ * Copyright (C) 2010 United States Government, Joshua M. Doe <oss@nvl.army.mil>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include "gstsensorfxrandom.h"
+
+/* uniforms drawn per batch when filling normal deviates */
+#define NORMAL_BATCH 256
+
+/* Marsaglia & Tsang ziggurat with 128 layers, see "The Ziggurat Method for
+ * Generating Random Variables", J. Stat. Software 5(8), 2000. The low seven
+ * bits of each draw select the layer and are masked out of the value, so
+ * layer and position are independent. */
+#define ZIGGURAT_R 3.442619855899
+#define ZIGGURAT_V 9.91256303526217e-3
+
+static guint32 ziggurat_k[128];
+static gfloat ziggurat_w[128];
+static gfloat ziggurat_f[128];
+
+static void
+gst_sfx_random_init_tables (void)
+{
+  static gsize initialized = 0;
+  const gdouble m = 2147483648.0;
+  gdouble d = ZIGGURAT_R, t = ZIGGURAT_R;
+  gdouble q;
+  gint i;
+
+  if (!g_once_init_enter (&initialized))
+    return;
+
+  q = ZIGGURAT_V / exp (-0.5 * d * d);
+  ziggurat_k[0] = (guint32) ((d / q) * m);
+  ziggurat_k[1] = 0;
+  ziggurat_w[0] = (gfloat) (q / m);
+  ziggurat_w[127] = (gfloat) (d / m);
+  ziggurat_f[0] = 1.0f;
+  ziggurat_f[127] = (gfloat) exp (-0.5 * d * d);
+
+  for (i = 126; i >= 1; i--) {
+    d = sqrt (-2.0 * log (ZIGGURAT_V / d + exp (-0.5 * d * d)));
+    ziggurat_k[i + 1] = (guint32) ((d / t) * m);
+    t = d;
+    ziggurat_f[i] = (gfloat) exp (-0.5 * d * d);
+    ziggurat_w[i] = (gfloat) (d / m);
+  }
+
+  g_once_init_leave (&initialized, 1);
+}
+
+static inline guint32
+rotl (guint32 x, gint k)
+{
+  return (x << k) | (x >> (32 - k));
+}
+
+static guint64
+splitmix64 (guint64 * x)
+{
+  guint64 z = (*x += G_GUINT64_CONSTANT (0x9e3779b97f4a7c15));
+
+  z = (z ^ (z >> 30)) * G_GUINT64_CONSTANT (0xbf58476d1ce4e5b9);
+  z = (z ^ (z >> 27)) * G_GUINT64_CONSTANT (0x94d049bb133111eb);
+  return z ^ (z >> 31);
+}
+
+void
+gst_sfx_random_init (GstSfxRandom * rand, guint64 seed)
+{
+  gint l, w;
+
+  gst_sfx_random_init_tables ();
+
+  /* splitmix64 never yields an all zero state for a lane */
+  for (l = 0; l < GST_SFX_RANDOM_LANES; l++) {
+    for (w = 0; w < 4; w += 2) {
+      guint64 z = splitmix64 (&seed);
+      rand->s[w][l] = (guint32) z;
+      rand->s[w + 1][l] = (guint32) (z >> 32);
+    }
+  }
+}
+
+/* Advances all lanes once and stores one value per lane, the state is passed
+ * separately from the generator so the compiler knows it doesn't alias @dest */
+static inline void
+gst_sfx_random_step (guint32 s[4][GST_SFX_RANDOM_LANES], guint32 * dest)
+{
+  gint l;
+
+  for (l = 0; l < GST_SFX_RANDOM_LANES; l++) {
+    guint32 t = s[1][l] << 9;
+
+    dest[l] = rotl (s[1][l] * 5, 7) * 9;
+    s[2][l] ^= s[0][l];
+    s[3][l] ^= s[1][l];
+    s[1][l] ^= s[2][l];
+    s[0][l] ^= s[3][l];
+    s[2][l] ^= t;
+    s[3][l] = rotl (s[3][l], 11);
+  }
+}
+
+/* Single draws advance the first lane only */
+guint32
+gst_sfx_random_next (GstSfxRandom * rand)
+{
+  guint32 *s0 = rand->s[0], *s1 = rand->s[1];
+  guint32 *s2 = rand->s[2], *s3 = rand->s[3];
+  guint32 result = rotl (s1[0] * 5, 7) * 9;
+  guint32 t = s1[0] << 9;
+
+  s2[0] ^= s0[0];
+  s3[0] ^= s1[0];
+  s1[0] ^= s2[0];
+  s0[0] ^= s3[0];
+  s2[0] ^= t;
+  s3[0] = rotl (s3[0], 11);
+
+  return result;
+}
+
+void
+gst_sfx_random_fill (GstSfxRandom * rand, guint32 * dest, gint n)
+{
+  guint32 s[4][GST_SFX_RANDOM_LANES];
+  guint32 tail[GST_SFX_RANDOM_LANES];
+  gint i;
+
+  memcpy (s, rand->s, sizeof (s));
+
+  for (i = 0; i + GST_SFX_RANDOM_LANES <= n; i += GST_SFX_RANDOM_LANES)
+    gst_sfx_random_step (s, dest + i);
+
+  if (i < n) {
+    gst_sfx_random_step (s, tail);
+    memcpy (dest + i, tail, (n - i) * sizeof (guint32));
+  }
+
+  memcpy (rand->s, s, sizeof (s));
+}
+
+/* uniform in (0, 1), never 0 so it can be passed to log () */
+static inline gdouble
+gst_sfx_random_uniform (GstSfxRandom * rand)
+{
+  return ((gst_sfx_random_next (rand) >> 8) + 0.5) * (1.0 / 16777216.0);
+}
+
+/* Rejection path for draws that fall outside the rectangular part of a
+ * layer, which happens for about 1.2% of them */
+static gfloat
+gst_sfx_random_normal_slow (GstSfxRandom * rand, guint32 u)
+{
+  for (;;) {
+    gint iz = u & 127;
+    gint32 hz = (gint32) (u & ~127u);
+    guint32 az = hz < 0 ? -(guint32) hz : (guint32) hz;
+    gdouble x;
+
+    if (az < ziggurat_k[iz])
+      return hz * ziggurat_w[iz];
+
+    if (iz == 0) {
+      gdouble y;
+
+      /* tail beyond the base layer */
+      do {
+        x = -log (gst_sfx_random_uniform (rand)) / ZIGGURAT_R;
+        y = -log (gst_sfx_random_uniform (rand));
+      } while (y + y < x * x);
+      return (gfloat) (hz > 0 ? ZIGGURAT_R + x : -ZIGGURAT_R - x);
+    }
+
+    x = hz * (gdouble) ziggurat_w[iz];
+    if (ziggurat_f[iz] + gst_sfx_random_uniform (rand) *
+        (ziggurat_f[iz - 1] - ziggurat_f[iz]) < exp (-0.5 * x * x))
+      return (gfloat) x;
+
+    u = gst_sfx_random_next (rand);
+  }
+}
+
+gfloat
+gst_sfx_random_normal (GstSfxRandom * rand)
+{
+  return gst_sfx_random_normal_slow (rand, gst_sfx_random_next (rand));
+}
+
+void
+gst_sfx_random_fill_normal (GstSfxRandom * rand, gfloat * dest, gint n,
+    gfloat sigma)
+{
+  guint32 u[NORMAL_BATCH];
+  gint i, j, count;
+
+  for (i = 0; i < n; i += count) {
+    count = MIN (n - i, NORMAL_BATCH);
+    gst_sfx_random_fill (rand, u, count);
+
+    for (j = 0; j < count; j++) {
+      gint iz = u[j] & 127;
+      gint32 hz = (gint32) (u[j] & ~127u);
+      guint32 az = hz < 0 ? -(guint32) hz : (guint32) hz;
+
+      if (G_LIKELY (az < ziggurat_k[iz]))
+        dest[i + j] = hz * ziggurat_w[iz] * sigma;
+      else
+        dest[i + j] = gst_sfx_random_normal_slow (rand, u[j]) * sigma;
+    }
+  }
+}
@@ -0,0 +1,52 @@
+/* GStreamer
+ * Copyright (C) 2010 United States Government, Joshua M. Doe <oss@nvl.army.mil>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __GST_SFX_RANDOM_H__
+#define __GST_SFX_RANDOM_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define GST_SFX_RANDOM_LANES 4
+
+/* xoshiro128** generators run in lockstep, one per lane. The state is stored
+ * word-major so that each step is a plain loop over the lanes which the
+ * compiler turns into vector instructions. */
+typedef struct {
+  guint32 s[4][GST_SFX_RANDOM_LANES];
+} GstSfxRandom;
+
+void     gst_sfx_random_init        (GstSfxRandom * rand, guint64 seed);
+
+guint32  gst_sfx_random_next        (GstSfxRandom * rand);
+
+void     gst_sfx_random_fill        (GstSfxRandom * rand, guint32 * dest,
+                                     gint n);
+
+/* Normal deviates use the ziggurat method, drawing uniforms in batches */
+gfloat   gst_sfx_random_normal      (GstSfxRandom * rand);
+
+void     gst_sfx_random_fill_normal (GstSfxRandom * rand, gfloat * dest,
+                                     gint n, gfloat sigma);
+
+G_END_DECLS
+
+#endif /* __GST_SFX_RANDOM_H__ */
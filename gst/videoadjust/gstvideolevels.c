@@ -26,6 +26,13 @@
 *
 * Convert grayscale video from one bpp/depth combination to another.
 *
+* The histogram of the input is posted as "videolevels-histogram" element
+* message according to #GstVideoLevels:post-histogram, at most every
+* #GstVideoLevels:histogram-interval milliseconds. It has the fields
+* "timestamp", "lower-input-level" and "upper-input-level" with the levels
+* after the adjustment, "bin-width" with the number of input values per bin
+* and "histogram" with the counts of the bins.
+*
 * <refsect2>
 * <title>Example launch line</title>
 * |[
@@ -44,6 +51,7 @@
 #include "genicampixelformat.h"
 
 #include <gst/video/video.h>
+#include <gst/video/gstvideopool.h>
 
 /* GstVideoLevels signals and args */
 enum
@@ -61,6 +69,19 @@ enum
   PROP_HIGHOUT,
   PROP_AUTO,
   PROP_INTERVAL,
+  PROP_SAMPLE_STEP,
+  PROP_ROI_X,
+  PROP_ROI_Y,
+  PROP_ROI_WIDTH,
+  PROP_ROI_HEIGHT,
+  PROP_SMOOTHING,
+  PROP_MODE,
+  PROP_TILES_X,
+  PROP_TILES_Y,
+  PROP_CLIP_LIMIT,
+  PROP_N_THREADS,
+  PROP_POST_HISTOGRAM,
+  PROP_HISTOGRAM_INTERVAL,
   PROP_LAST
 };
 
@@ -72,6 +93,26 @@ static GParamSpec *properties[PROP_LAST];
 #define DEFAULT_PROP_HIGHOUT  255
 #define DEFAULT_PROP_AUTO 0
 #define DEFAULT_PROP_INTERVAL (GST_SECOND / 2)
+#define DEFAULT_PROP_SAMPLE_STEP 1
+#define DEFAULT_PROP_ROI_X 0
+#define DEFAULT_PROP_ROI_Y 0
+#define DEFAULT_PROP_ROI_WIDTH 0
+#define DEFAULT_PROP_ROI_HEIGHT 0
+#define DEFAULT_PROP_SMOOTHING 0.0
+#define DEFAULT_PROP_MODE GST_VIDEOLEVELS_MODE_LEVELS
+#define DEFAULT_PROP_TILES_X 8
+#define DEFAULT_PROP_TILES_Y 8
+#define DEFAULT_PROP_CLIP_LIMIT 2.0
+#define DEFAULT_PROP_N_THREADS 0
+#define DEFAULT_PROP_POST_HISTOGRAM GST_VIDEOLEVELS_POST_HISTOGRAM_NONE
+#define DEFAULT_PROP_HISTOGRAM_INTERVAL 1000
+
+/* row alignment of the pool proposed upstream, for the vector kernels */
+#define GST_VIDEOLEVELS_STRIDE_ALIGN 31
+
+/* interleaved histograms, so runs of equal pixels don't stall on
+ * incrementing the same counter */
+#define GST_VIDEOLEVELS_HISTOGRAM_BANKS 4
 
 /* the capabilities of the inputs and outputs */
 static GstStaticPadTemplate gst_videolevels_src_template =
@@ -113,35 +154,101 @@ gst_videolevels_auto_get_type (void)
   return videolevels_auto_type;
 }
 
+#define GST_TYPE_VIDEOLEVELS_POST_HISTOGRAM \
+  (gst_videolevels_post_histogram_get_type())
+static GType
+gst_videolevels_post_histogram_get_type (void)
+{
+  static GType videolevels_post_histogram_type = 0;
+  static const GEnumValue videolevels_post_histogram[] = {
+    {GST_VIDEOLEVELS_POST_HISTOGRAM_NONE, "none", "none"},
+    {GST_VIDEOLEVELS_POST_HISTOGRAM_AUTO, "auto", "auto"},
+    {GST_VIDEOLEVELS_POST_HISTOGRAM_ALWAYS, "always", "always"},
+    {0, NULL, NULL},
+  };
+
+  if (!videolevels_post_histogram_type) {
+    videolevels_post_histogram_type =
+        g_enum_register_static ("GstVideoLevelsPostHistogram",
+        videolevels_post_histogram);
+  }
+  return videolevels_post_histogram_type;
+}
+
+#define GST_TYPE_VIDEOLEVELS_MODE (gst_videolevels_mode_get_type())
+static GType
+gst_videolevels_mode_get_type (void)
+{
+  static GType videolevels_mode_type = 0;
+  static const GEnumValue videolevels_mode[] = {
+    {GST_VIDEOLEVELS_MODE_LEVELS, "Map input levels to output levels",
+        "levels"},
+    {GST_VIDEOLEVELS_MODE_ADAPTIVE,
+        "Contrast limited adaptive histogram equalization", "adaptive"},
+    {0, NULL, NULL},
+  };
+
+  if (!videolevels_mode_type) {
+    videolevels_mode_type =
+        g_enum_register_static ("GstVideoLevelsMode", videolevels_mode);
+  }
+  return videolevels_mode_type;
+}
+
 /* GObject vmethod declarations */
 static void gst_videolevels_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec);
 static void gst_videolevels_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec);
 static void gst_videolevels_dispose (GObject * object);
+static void gst_videolevels_finalize (GObject * object);
 
 /* GstBaseTransform vmethod declarations */
 static GstCaps *gst_videolevels_transform_caps (GstBaseTransform * trans,
     GstPadDirection direction, GstCaps * caps, GstCaps * filter_caps);
-static gboolean gst_videolevels_set_caps (GstBaseTransform * trans,
-    GstCaps * incaps, GstCaps * outcaps);
-static GstFlowReturn gst_videolevels_transform (GstBaseTransform * trans,
-    GstBuffer * inbuf, GstBuffer * outbuf);
+static gboolean gst_videolevels_get_unit_size (GstBaseTransform * trans,
+    GstCaps * caps, gsize * size);
+static gboolean gst_videolevels_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query);
+static gboolean gst_videolevels_start (GstBaseTransform * trans);
+static gboolean gst_videolevels_stop (GstBaseTransform * trans);
+static void gst_videolevels_before_transform (GstBaseTransform * trans,
+    GstBuffer * buffer);
+
+/* GstVideoFilter vmethod declarations */
+static gboolean gst_videolevels_set_info (GstVideoFilter * filter,
+    GstCaps * incaps, GstVideoInfo * in_info, GstCaps * outcaps,
+    GstVideoInfo * out_info);
+static GstFlowReturn gst_videolevels_transform_frame (GstVideoFilter * filter,
+    GstVideoFrame * in_frame, GstVideoFrame * out_frame);
 
 /* GstVideoLevels method declarations */
 static void gst_videolevels_reset (GstVideoLevels * filter);
 static gboolean gst_videolevels_calculate_lut (GstVideoLevels * videolevels);
 static gboolean gst_videolevels_calculate_histogram (GstVideoLevels *
-    videolevels, guint16 * data);
+    videolevels, guint16 * data, gint stride);
 static gboolean gst_videolevels_auto_adjust (GstVideoLevels * videolevels,
-    guint16 * data);
-static void gst_videolevels_check_passthrough (GstVideoLevels * videolevels);
+    guint16 * data, gint stride, gboolean smooth);
+static gpointer gst_videolevels_worker (gpointer data);
+static void gst_videolevels_worker_queue (GstVideoLevels * videolevels,
+    GstBuffer * buffer);
+static void gst_videolevels_worker_flush (GstVideoLevels * videolevels);
+static gboolean gst_videolevels_histogram_due (GstVideoLevels * videolevels);
+static void gst_videolevels_post_histogram (GstVideoLevels * videolevels,
+    GstClockTime timestamp, gboolean adjusted);
+static void gst_videolevels_check_passthrough (GstVideoLevels * videolevels,
+    gint low_in, gint high_in, gint low_out, gint high_out);
+static void gst_videolevels_tiles_free (GstVideoLevels * videolevels);
+static void gst_videolevels_tile_runner (gpointer data, gpointer user_data);
+static void gst_videolevels_transform_tiles (GstVideoLevels * videolevels,
+    const guint8 * in_data, gint in_stride, guint8 * out_data,
+    gint out_stride);
 
 /* setup debug */
 GST_DEBUG_CATEGORY_STATIC (videolevels_debug);
 #define GST_CAT_DEFAULT videolevels_debug
 
-G_DEFINE_TYPE (GstVideoLevels, gst_videolevels, GST_TYPE_BASE_TRANSFORM);
+G_DEFINE_TYPE (GstVideoLevels, gst_videolevels, GST_TYPE_VIDEO_FILTER);
 
 /************************************************************************/
 /* GObject vmethod implementations                                      */
@@ -160,6 +267,10 @@ gst_videolevels_dispose (GObject * object)
   GST_DEBUG ("dispose");
 
   g_free (videolevels->lookup_table);
+  videolevels->lookup_table = NULL;
+  videolevels->lookup_table_size = 0;
+  videolevels->line_func = gst_videolevels_line_scalar;
+  videolevels->line_func_name = "lut";
 
   gst_videolevels_reset (videolevels);
 
@@ -167,6 +278,19 @@ gst_videolevels_dispose (GObject * object)
   G_OBJECT_CLASS (gst_videolevels_parent_class)->dispose (object);
 }
 
+static void
+gst_videolevels_finalize (GObject * object)
+{
+  GstVideoLevels *videolevels = GST_VIDEOLEVELS (object);
+
+  g_mutex_clear (&videolevels->worker_lock);
+  g_cond_clear (&videolevels->worker_cond);
+  g_mutex_clear (&videolevels->pool_lock);
+  g_cond_clear (&videolevels->pool_cond);
+
+  G_OBJECT_CLASS (gst_videolevels_parent_class)->finalize (object);
+}
+
 /**
  * gst_videolevels_class_init:
  * @object: #GstVideoLevelsClass.
@@ -179,6 +303,7 @@ gst_videolevels_class_init (GstVideoLevelsClass * klass)
   GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
   GstBaseTransformClass *gstbasetransform_class =
       GST_BASE_TRANSFORM_CLASS (klass);
+  GstVideoFilterClass *gstvideofilter_class = GST_VIDEO_FILTER_CLASS (klass);
 
   GST_DEBUG_CATEGORY_INIT (videolevels_debug, "videolevels", 0,
       "Video Levels Filter");
@@ -187,6 +312,7 @@ gst_videolevels_class_init (GstVideoLevelsClass * klass)
 
   /* Register GObject vmethods */
   gobject_class->dispose = GST_DEBUG_FUNCPTR (gst_videolevels_dispose);
+  gobject_class->finalize = GST_DEBUG_FUNCPTR (gst_videolevels_finalize);
   gobject_class->set_property =
       GST_DEBUG_FUNCPTR (gst_videolevels_set_property);
   gobject_class->get_property =
@@ -224,6 +350,68 @@ gst_videolevels_class_init (GstVideoLevelsClass * klass)
       g_param_spec_uint64 ("interval", "Interval",
           "Interval of time between adjustments (in nanoseconds)", 1,
           G_MAXUINT64, DEFAULT_PROP_INTERVAL, G_PARAM_READWRITE));
+  g_object_class_install_property (gobject_class, PROP_SAMPLE_STEP,
+      g_param_spec_uint ("sample-step", "Sample step",
+          "Use only every n-th row and column for auto adjustment", 1, 1024,
+          DEFAULT_PROP_SAMPLE_STEP,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_ROI_X,
+      g_param_spec_int ("roi-x", "ROI x",
+          "Left edge of the region used for auto adjustment", 0, G_MAXINT,
+          DEFAULT_PROP_ROI_X, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_ROI_Y,
+      g_param_spec_int ("roi-y", "ROI y",
+          "Top edge of the region used for auto adjustment", 0, G_MAXINT,
+          DEFAULT_PROP_ROI_Y, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_ROI_WIDTH,
+      g_param_spec_int ("roi-width", "ROI width",
+          "Width of the region used for auto adjustment (0 = to the right edge)",
+          0, G_MAXINT, DEFAULT_PROP_ROI_WIDTH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_ROI_HEIGHT,
+      g_param_spec_int ("roi-height", "ROI height",
+          "Height of the region used for auto adjustment (0 = to the bottom edge)",
+          0, G_MAXINT, DEFAULT_PROP_ROI_HEIGHT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_SMOOTHING,
+      g_param_spec_double ("smoothing", "Smoothing",
+          "Weight of the current levels when blending in new continuous auto "
+          "levels (0 = no smoothing)", 0.0, 0.99, DEFAULT_PROP_SMOOTHING,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_MODE,
+      g_param_spec_enum ("mode", "Mode",
+          "How input values are mapped, adaptive mode needs more than 8 bits "
+          "of input and ignores the input levels",
+          GST_TYPE_VIDEOLEVELS_MODE, DEFAULT_PROP_MODE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_TILES_X,
+      g_param_spec_int ("tiles-x", "Tiles x",
+          "Number of tile columns in adaptive mode", 1, 64,
+          DEFAULT_PROP_TILES_X, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_TILES_Y,
+      g_param_spec_int ("tiles-y", "Tiles y",
+          "Number of tile rows in adaptive mode", 1, 64,
+          DEFAULT_PROP_TILES_Y, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_CLIP_LIMIT,
+      g_param_spec_double ("clip-limit", "Clip limit",
+          "Limit of a tile histogram bin relative to the average bin in "
+          "adaptive mode (0 = no limit)", 0.0, 256.0, DEFAULT_PROP_CLIP_LIMIT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_N_THREADS,
+      g_param_spec_uint ("n-threads", "Number of threads",
+          "Number of threads used in adaptive mode, applied when starting "
+          "(0 = number of processors)", 0, 64, DEFAULT_PROP_N_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_POST_HISTOGRAM,
+      g_param_spec_enum ("post-histogram", "Post histogram",
+          "When to post the input histogram as element message",
+          GST_TYPE_VIDEOLEVELS_POST_HISTOGRAM, DEFAULT_PROP_POST_HISTOGRAM,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_HISTOGRAM_INTERVAL,
+      g_param_spec_uint ("histogram-interval", "Histogram interval",
+          "Minimum interval in milliseconds between histogram messages, or 0 "
+          "for every histogram", 0, G_MAXUINT, DEFAULT_PROP_HISTOGRAM_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   gst_element_class_add_pad_template (gstelement_class,
       gst_static_pad_template_get (&gst_videolevels_sink_template));
@@ -239,10 +427,20 @@ gst_videolevels_class_init (GstVideoLevelsClass * klass)
   gstbasetransform_class->transform_caps =
       GST_DEBUG_FUNCPTR (gst_videolevels_transform_caps);
 
-  gstbasetransform_class->set_caps =
-      GST_DEBUG_FUNCPTR (gst_videolevels_set_caps);
-  gstbasetransform_class->transform =
-      GST_DEBUG_FUNCPTR (gst_videolevels_transform);
+  gstbasetransform_class->get_unit_size =
+      GST_DEBUG_FUNCPTR (gst_videolevels_get_unit_size);
+  gstbasetransform_class->propose_allocation =
+      GST_DEBUG_FUNCPTR (gst_videolevels_propose_allocation);
+  gstbasetransform_class->start = GST_DEBUG_FUNCPTR (gst_videolevels_start);
+  gstbasetransform_class->stop = GST_DEBUG_FUNCPTR (gst_videolevels_stop);
+  gstbasetransform_class->before_transform =
+      GST_DEBUG_FUNCPTR (gst_videolevels_before_transform);
+
+  /* Register GstVideoFilter vmethods */
+  gstvideofilter_class->set_info =
+      GST_DEBUG_FUNCPTR (gst_videolevels_set_info);
+  gstvideofilter_class->transform_frame =
+      GST_DEBUG_FUNCPTR (gst_videolevels_transform_frame);
 }
 
 /**
@@ -259,7 +457,36 @@ gst_videolevels_init (GstVideoLevels * videolevels)
 
   videolevels->passthrough = FALSE;
 
-  videolevels->lookup_table = g_new (guint8, G_MAXUINT16 + 1);
+  /* sized from the input depth in set_info */
+  videolevels->lookup_table = NULL;
+  videolevels->lookup_table_size = 0;
+  videolevels->line_func = gst_videolevels_line_scalar;
+  videolevels->line_func_name = "lut";
+
+  g_mutex_init (&videolevels->worker_lock);
+  g_cond_init (&videolevels->worker_cond);
+  videolevels->worker = NULL;
+  videolevels->worker_pending = NULL;
+  videolevels->worker_busy = FALSE;
+  videolevels->worker_stop = FALSE;
+
+  g_mutex_init (&videolevels->pool_lock);
+  g_cond_init (&videolevels->pool_cond);
+  videolevels->pool = NULL;
+  videolevels->pool_pending = 0;
+
+  videolevels->tile_grid_x = 0;
+  videolevels->tile_grid_y = 0;
+  videolevels->tile_tables = NULL;
+  videolevels->tile_histograms = NULL;
+  videolevels->tile_x1 = NULL;
+  videolevels->tile_x2 = NULL;
+  videolevels->tile_wx = NULL;
+  videolevels->tile_y1 = NULL;
+  videolevels->tile_y2 = NULL;
+  videolevels->tile_wy = NULL;
+  videolevels->tile_line_func =
+      gst_videolevels_get_tile_line_func (&videolevels->tile_line_func_name);
 
   gst_videolevels_reset (videolevels);
 }
@@ -282,28 +509,103 @@ gst_videolevels_set_property (GObject * object, guint prop_id,
 
   switch (prop_id) {
     case PROP_LOWIN:
+      GST_OBJECT_LOCK (videolevels);
       videolevels->lower_input = g_value_get_int (value);
-      gst_videolevels_calculate_lut (videolevels);
+      g_atomic_int_set (&videolevels->lut_dirty, TRUE);
+      GST_OBJECT_UNLOCK (videolevels);
       break;
     case PROP_HIGHIN:
+      GST_OBJECT_LOCK (videolevels);
       videolevels->upper_input = g_value_get_int (value);
-      gst_videolevels_calculate_lut (videolevels);
+      g_atomic_int_set (&videolevels->lut_dirty, TRUE);
+      GST_OBJECT_UNLOCK (videolevels);
       break;
     case PROP_LOWOUT:
+      GST_OBJECT_LOCK (videolevels);
       videolevels->lower_output = g_value_get_int (value);
-      gst_videolevels_calculate_lut (videolevels);
+      g_atomic_int_set (&videolevels->lut_dirty, TRUE);
+      GST_OBJECT_UNLOCK (videolevels);
       break;
     case PROP_HIGHOUT:
+      GST_OBJECT_LOCK (videolevels);
       videolevels->upper_output = g_value_get_int (value);
-      gst_videolevels_calculate_lut (videolevels);
+      g_atomic_int_set (&videolevels->lut_dirty, TRUE);
+      GST_OBJECT_UNLOCK (videolevels);
       break;
     case PROP_AUTO:{
+      GST_OBJECT_LOCK (videolevels);
       videolevels->auto_adjust = g_value_get_enum (value);
+      GST_OBJECT_UNLOCK (videolevels);
       break;
     }
     case PROP_INTERVAL:
+      GST_OBJECT_LOCK (videolevels);
       videolevels->interval = g_value_get_uint64 (value);
       videolevels->last_auto_timestamp = GST_CLOCK_TIME_NONE;
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_SAMPLE_STEP:
+      GST_OBJECT_LOCK (videolevels);
+      videolevels->sample_step = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_ROI_X:
+      GST_OBJECT_LOCK (videolevels);
+      videolevels->roi_x = g_value_get_int (value);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_ROI_Y:
+      GST_OBJECT_LOCK (videolevels);
+      videolevels->roi_y = g_value_get_int (value);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_ROI_WIDTH:
+      GST_OBJECT_LOCK (videolevels);
+      videolevels->roi_width = g_value_get_int (value);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_ROI_HEIGHT:
+      GST_OBJECT_LOCK (videolevels);
+      videolevels->roi_height = g_value_get_int (value);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_SMOOTHING:
+      GST_OBJECT_LOCK (videolevels);
+      videolevels->smoothing = g_value_get_double (value);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_MODE:
+      GST_OBJECT_LOCK (videolevels);
+      videolevels->mode = g_value_get_enum (value);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_TILES_X:
+      GST_OBJECT_LOCK (videolevels);
+      videolevels->tiles_x = g_value_get_int (value);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_TILES_Y:
+      GST_OBJECT_LOCK (videolevels);
+      videolevels->tiles_y = g_value_get_int (value);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_CLIP_LIMIT:
+      GST_OBJECT_LOCK (videolevels);
+      videolevels->clip_limit = g_value_get_double (value);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_N_THREADS:
+      videolevels->n_threads = g_value_get_uint (value);
+      break;
+    case PROP_POST_HISTOGRAM:
+      GST_OBJECT_LOCK (videolevels);
+      videolevels->post_histogram = g_value_get_enum (value);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_HISTOGRAM_INTERVAL:
+      GST_OBJECT_LOCK (videolevels);
+      videolevels->histogram_interval = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (videolevels);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -329,22 +631,97 @@ gst_videolevels_get_property (GObject * object, guint prop_id, GValue * value,
 
   switch (prop_id) {
     case PROP_LOWIN:
+      GST_OBJECT_LOCK (videolevels);
       g_value_set_int (value, videolevels->lower_input);
+      GST_OBJECT_UNLOCK (videolevels);
       break;
     case PROP_HIGHIN:
+      GST_OBJECT_LOCK (videolevels);
       g_value_set_int (value, videolevels->upper_input);
+      GST_OBJECT_UNLOCK (videolevels);
       break;
     case PROP_LOWOUT:
+      GST_OBJECT_LOCK (videolevels);
       g_value_set_int (value, videolevels->lower_output);
+      GST_OBJECT_UNLOCK (videolevels);
       break;
     case PROP_HIGHOUT:
+      GST_OBJECT_LOCK (videolevels);
       g_value_set_int (value, videolevels->upper_output);
+      GST_OBJECT_UNLOCK (videolevels);
       break;
     case PROP_AUTO:
+      GST_OBJECT_LOCK (videolevels);
       g_value_set_enum (value, videolevels->auto_adjust);
+      GST_OBJECT_UNLOCK (videolevels);
       break;
     case PROP_INTERVAL:
+      GST_OBJECT_LOCK (videolevels);
       g_value_set_uint64 (value, videolevels->interval);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_SAMPLE_STEP:
+      GST_OBJECT_LOCK (videolevels);
+      g_value_set_uint (value, videolevels->sample_step);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_ROI_X:
+      GST_OBJECT_LOCK (videolevels);
+      g_value_set_int (value, videolevels->roi_x);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_ROI_Y:
+      GST_OBJECT_LOCK (videolevels);
+      g_value_set_int (value, videolevels->roi_y);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_ROI_WIDTH:
+      GST_OBJECT_LOCK (videolevels);
+      g_value_set_int (value, videolevels->roi_width);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_ROI_HEIGHT:
+      GST_OBJECT_LOCK (videolevels);
+      g_value_set_int (value, videolevels->roi_height);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_SMOOTHING:
+      GST_OBJECT_LOCK (videolevels);
+      g_value_set_double (value, videolevels->smoothing);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_MODE:
+      GST_OBJECT_LOCK (videolevels);
+      g_value_set_enum (value, videolevels->mode);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_TILES_X:
+      GST_OBJECT_LOCK (videolevels);
+      g_value_set_int (value, videolevels->tiles_x);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_TILES_Y:
+      GST_OBJECT_LOCK (videolevels);
+      g_value_set_int (value, videolevels->tiles_y);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_CLIP_LIMIT:
+      GST_OBJECT_LOCK (videolevels);
+      g_value_set_double (value, videolevels->clip_limit);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_N_THREADS:
+      g_value_set_uint (value, videolevels->n_threads);
+      break;
+    case PROP_POST_HISTOGRAM:
+      GST_OBJECT_LOCK (videolevels);
+      g_value_set_enum (value, videolevels->post_histogram);
+      GST_OBJECT_UNLOCK (videolevels);
+      break;
+    case PROP_HISTOGRAM_INTERVAL:
+      GST_OBJECT_LOCK (videolevels);
+      g_value_set_uint (value, videolevels->histogram_interval);
+      GST_OBJECT_UNLOCK (videolevels);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -515,51 +892,160 @@ gst_videolevels_transform_caps (GstBaseTransform * trans,
   return other_caps;
 }
 
+/* Bayer is encoded to GstVideoInfo, its rows are packed to 4 bytes */
+static gint
+gst_videolevels_bayer_stride (const GstStructure * st, gint width)
+{
+  const gchar *format = gst_structure_get_string (st, "format");
+
+  if (format && g_str_has_suffix (format, "16"))
+    return GST_ROUND_UP_4 (width * 2);
+  else
+    return GST_ROUND_UP_4 (width);
+}
+
 static gboolean
-gst_videolevels_set_caps (GstBaseTransform * trans, GstCaps * incaps,
-    GstCaps * outcaps)
+gst_videolevels_get_unit_size (GstBaseTransform * trans, GstCaps * caps,
+    gsize * size)
 {
-  GstVideoLevels *levels = GST_VIDEOLEVELS (trans);
+  GstVideoInfo info;
+
+  if (!gst_video_info_from_caps (&info, caps)) {
+    GST_WARNING_OBJECT (trans, "Failed to parse caps %" GST_PTR_FORMAT, caps);
+    return FALSE;
+  }
+
+  if (GST_VIDEO_INFO_FORMAT (&info) == GST_VIDEO_FORMAT_ENCODED)
+    *size = gst_videolevels_bayer_stride (gst_caps_get_structure (caps, 0),
+        GST_VIDEO_INFO_WIDTH (&info)) * GST_VIDEO_INFO_HEIGHT (&info);
+  else
+    *size = GST_VIDEO_INFO_SIZE (&info);
+
+  return TRUE;
+}
+
+/**
+ * gst_videolevels_propose_allocation:
+ * @base: #GstBaseTransform
+ * @decide_query: #GstQuery
+ * @query: #GstQuery
+ *
+ * Propose a pool with rows aligned for the vector kernels, and accept any
+ * strides upstream describes with video meta
+ *
+ * Returns: TRUE on success
+ */
+static gboolean
+gst_videolevels_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query)
+{
+  GstCaps *caps;
+  GstVideoInfo info;
+  GstBufferPool *pool;
+  GstStructure *config;
+  GstAllocationParams params;
+  gsize size;
+
+  /* passthrough, downstream is asked */
+  if (decide_query == NULL)
+    return GST_BASE_TRANSFORM_CLASS (gst_videolevels_parent_class)->
+        propose_allocation (trans, decide_query, query);
+
+  gst_query_parse_allocation (query, &caps, NULL);
+  if (caps == NULL || !gst_video_info_from_caps (&info, caps))
+    return FALSE;
+
+  if (gst_query_get_n_allocation_pools (query) == 0) {
+    gst_allocation_params_init (&params);
+    params.align = GST_VIDEOLEVELS_STRIDE_ALIGN;
+
+    if (GST_VIDEO_INFO_FORMAT (&info) == GST_VIDEO_FORMAT_ENCODED) {
+      gst_videolevels_get_unit_size (trans, caps, &size);
+      pool = gst_buffer_pool_new ();
+      config = gst_buffer_pool_get_config (pool);
+      gst_buffer_pool_config_set_params (config, caps, size, 0, 0);
+    } else {
+      GstVideoAlignment align;
+      guint i;
+
+      gst_video_alignment_reset (&align);
+      for (i = 0; i < GST_VIDEO_MAX_PLANES; i++)
+        align.stride_align[i] = GST_VIDEOLEVELS_STRIDE_ALIGN;
+      gst_video_info_align (&info, &align);
+      size = GST_VIDEO_INFO_SIZE (&info);
+
+      pool = gst_video_buffer_pool_new ();
+      config = gst_buffer_pool_get_config (pool);
+      gst_buffer_pool_config_set_params (config, caps, size, 0, 0);
+      gst_buffer_pool_config_add_option (config,
+          GST_BUFFER_POOL_OPTION_VIDEO_META);
+      gst_buffer_pool_config_add_option (config,
+          GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT);
+      gst_buffer_pool_config_set_video_alignment (config, &align);
+    }
+    gst_buffer_pool_config_set_allocator (config, NULL, &params);
+
+    if (!gst_buffer_pool_set_config (pool, config)) {
+      GST_WARNING_OBJECT (trans, "Failed to set pool configuration");
+      gst_object_unref (pool);
+      return FALSE;
+    }
+
+    GST_DEBUG_OBJECT (trans, "Proposing pool with %" G_GSIZE_FORMAT
+        " byte buffers", size);
+    gst_query_add_allocation_pool (query, pool, size, 0, 0);
+    gst_query_add_allocation_param (query, NULL, &params);
+    gst_object_unref (pool);
+  }
+
+  gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
+
+  return TRUE;
+}
+
+static gboolean
+gst_videolevels_set_info (GstVideoFilter * filter, GstCaps * incaps,
+    GstVideoInfo * in_info, GstCaps * outcaps, GstVideoInfo * out_info)
+{
+  GstVideoLevels *levels = GST_VIDEOLEVELS (filter);
   GstStructure *st;
   gboolean res;
-  GstVideoInfo invinfo, outvinfo;
 
   GST_DEBUG_OBJECT (levels,
-      "set_caps: in %" GST_PTR_FORMAT " out %" GST_PTR_FORMAT, incaps, outcaps);
+      "set_info: in %" GST_PTR_FORMAT " out %" GST_PTR_FORMAT, incaps, outcaps);
+
+  /* the worker may still be reading a frame with the old format, and it uses
+   * every field written below */
+  gst_videolevels_worker_flush (levels);
 
   /* always assume 8-bit output */
   levels->bpp_out = 8;
 
-  /* GstVideoInfo treats Bayer as encoded, but it's still useful */
-  gst_video_info_from_caps (&invinfo, incaps);
-  gst_video_info_from_caps (&outvinfo, outcaps);
-
-  levels->width = GST_VIDEO_INFO_WIDTH (&invinfo);
-  levels->height = GST_VIDEO_INFO_HEIGHT (&invinfo);
+  levels->width = GST_VIDEO_INFO_WIDTH (in_info);
+  levels->height = GST_VIDEO_INFO_HEIGHT (in_info);
 
-  /* these won't be valid for Bayer, we'll fix later */
-  levels->stride_in = GST_VIDEO_INFO_COMP_STRIDE (&invinfo, 0);
-  levels->stride_out = GST_VIDEO_INFO_COMP_STRIDE (&outvinfo, 0);
-  levels->bpp_in = invinfo.finfo->bits;
+  /* raw formats use the strides of each frame, these are for Bayer */
+  levels->stride_in = GST_VIDEO_INFO_COMP_STRIDE (in_info, 0);
+  levels->stride_out = GST_VIDEO_INFO_COMP_STRIDE (out_info, 0);
+  levels->bpp_in = in_info->finfo->bits;
 
   st = gst_caps_get_structure (incaps, 0);
 
-  if (invinfo.finfo->format == GST_VIDEO_FORMAT_GRAY8) {
+  if (in_info->finfo->format == GST_VIDEO_FORMAT_GRAY8) {
     // do nothing
-  } else if (invinfo.finfo->format == GST_VIDEO_FORMAT_GRAY16_BE) {
+  } else if (in_info->finfo->format == GST_VIDEO_FORMAT_GRAY16_BE) {
     levels->endianness_in = G_BIG_ENDIAN;
-  } else if (invinfo.finfo->format == GST_VIDEO_FORMAT_GRAY16_LE) {
+  } else if (in_info->finfo->format == GST_VIDEO_FORMAT_GRAY16_LE) {
     levels->endianness_in = G_LITTLE_ENDIAN;
   } else {
     const gchar *format = gst_structure_get_string (st, "format");
     if (g_str_has_suffix (format, "16")) {
       gst_structure_get_int (st, "endianness", &levels->endianness_in);
       levels->bpp_in = 16;
-      levels->stride_in = GST_ROUND_UP_4 (levels->width * 2);
     } else {
       levels->bpp_in = 8;
-      levels->stride_in = GST_ROUND_UP_4 (levels->width);
     }
+    levels->stride_in = gst_videolevels_bayer_stride (st, levels->width);
     levels->stride_out = GST_ROUND_UP_4 (levels->width);
   }
 
@@ -570,81 +1056,216 @@ gst_videolevels_set_caps (GstBaseTransform * trans, GstCaps * incaps,
   g_assert (levels->bpp_in >= 1 && levels->bpp_in <= 16);
 
   levels->nbins = MIN (4096, 1 << levels->bpp_in);
+  g_free (levels->histogram);
+  levels->histogram = NULL;
+  g_free (levels->histogram_banks);
+  levels->histogram_banks = NULL;
+
+  /* tile geometry depends on the frame size and nbins */
+  gst_videolevels_tiles_free (levels);
+
+  /* one entry per possible input value, e.g. 4096 for 12-bit */
+  if (levels->lookup_table_size != 1 << levels->bpp_in) {
+    levels->lookup_table_size = 1 << levels->bpp_in;
+    g_free (levels->lookup_table);
+    levels->lookup_table = g_new (guint8, levels->lookup_table_size);
+    GST_DEBUG_OBJECT (levels, "Allocated lookup table with %d entries",
+        levels->lookup_table_size);
+  }
 
   res = gst_videolevels_calculate_lut (levels);
 
   return res;
 }
 
+static gboolean
+gst_videolevels_start (GstBaseTransform * trans)
+{
+  GstVideoLevels *videolevels = GST_VIDEOLEVELS (trans);
+  GError *err = NULL;
+  guint n_threads;
+
+  videolevels->worker_stop = FALSE;
+  videolevels->worker = g_thread_try_new ("videolevels-auto",
+      gst_videolevels_worker, videolevels, &err);
+  if (videolevels->worker == NULL) {
+    GST_ELEMENT_ERROR (videolevels, RESOURCE, FAILED,
+        ("Failed to start auto adjustment thread"), ("%s", err->message));
+    g_error_free (err);
+    return FALSE;
+  }
+
+  /* the streaming thread takes part in adaptive mode jobs */
+  n_threads = videolevels->n_threads ? videolevels->n_threads :
+      (guint) g_get_num_processors ();
+  if (n_threads > 1) {
+    videolevels->pool = g_thread_pool_new (gst_videolevels_tile_runner,
+        videolevels, n_threads - 1, FALSE, &err);
+    if (videolevels->pool == NULL) {
+      GST_WARNING_OBJECT (videolevels, "Failed to create thread pool, "
+          "adaptive mode will run on a single thread: %s", err->message);
+      g_clear_error (&err);
+    }
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_videolevels_stop (GstBaseTransform * trans)
+{
+  GstVideoLevels *videolevels = GST_VIDEOLEVELS (trans);
+
+  if (videolevels->worker) {
+    g_mutex_lock (&videolevels->worker_lock);
+    videolevels->worker_stop = TRUE;
+    g_cond_broadcast (&videolevels->worker_cond);
+    g_mutex_unlock (&videolevels->worker_lock);
+
+    g_thread_join (videolevels->worker);
+    videolevels->worker = NULL;
+  }
+
+  gst_buffer_replace (&videolevels->worker_pending, NULL);
+
+  if (videolevels->pool) {
+    g_thread_pool_free (videolevels->pool, FALSE, TRUE);
+    videolevels->pool = NULL;
+  }
+
+  return TRUE;
+}
+
 /**
- * gst_videolevels_transform:
+ * gst_videolevels_before_transform:
  * @base: #GstBaseTransform
- * @inbuf: #GstBuffer
- * @outbuf: #GstBuffer
+ * @buffer: #GstBuffer
+ *
+ * Applies level changes made since the last buffer. This also runs in
+ * passthrough, so leaving passthrough works.
+ */
+static void
+gst_videolevels_before_transform (GstBaseTransform * trans, GstBuffer * buffer)
+{
+  GstVideoLevels *videolevels = GST_VIDEOLEVELS (trans);
+
+  /* set by the application and the auto adjustment thread */
+  if (g_atomic_int_get (&videolevels->lut_dirty))
+    gst_videolevels_calculate_lut (videolevels);
+}
+
+/* Bayer frames are mapped as a whole, with rows packed as for
+ * gst_videolevels_bayer_stride() */
+static void
+gst_videolevels_frame_data (GstVideoFrame * frame, gint bayer_stride,
+    guint8 ** data, gint * stride)
+{
+  if (GST_VIDEO_FRAME_FORMAT (frame) == GST_VIDEO_FORMAT_ENCODED) {
+    *data = frame->map[0].data;
+    *stride = bayer_stride;
+  } else {
+    *data = GST_VIDEO_FRAME_PLANE_DATA (frame, 0);
+    *stride = GST_VIDEO_FRAME_PLANE_STRIDE (frame, 0);
+  }
+}
+
+/**
+ * gst_videolevels_transform_frame:
+ * @filter: #GstVideoFilter
+ * @in_frame: #GstVideoFrame
+ * @out_frame: #GstVideoFrame
  *
- * Transforms input buffer to output buffer.
+ * Transforms input frame to output frame.
  *
  * Returns: GST_FLOW_OK on success
  */
 static GstFlowReturn
-gst_videolevels_transform (GstBaseTransform * trans, GstBuffer * inbuf,
-    GstBuffer * outbuf)
+gst_videolevels_transform_frame (GstVideoFilter * filter,
+    GstVideoFrame * in_frame, GstVideoFrame * out_frame)
 {
-  GstVideoLevels *videolevels = GST_VIDEOLEVELS (trans);
+  GstVideoLevels *videolevels = GST_VIDEOLEVELS (filter);
+  GstBuffer *inbuf = in_frame->buffer;
   GstClockTimeDiff elapsed;
-  GstClockTime start =
-      gst_clock_get_time (gst_element_get_clock (GST_ELEMENT (videolevels)));
+  gint64 start = 0;
   gint r, c;
   guint8 *in_data, *out_data;
+  gint in_stride, out_stride;
   guint8 *lut;
-  GstMapInfo inminfo, outminfo;
+  GstVideoLevelsMode mode;
+  GstVideoLevelsAuto auto_adjust;
+  gboolean due;
 
   GST_LOG_OBJECT (videolevels, "Performing non-inplace transform");
 
-  gst_buffer_map (inbuf, &inminfo, GST_MAP_READ);
-  gst_buffer_map (outbuf, &outminfo, GST_MAP_WRITE);
-
-  if (!inminfo.data || !outminfo.data) {
-    GST_ELEMENT_ERROR (videolevels, STREAM, FAILED, ("Failed to map buffer"),
-        (NULL));
-    return GST_FLOW_ERROR;
+  if (gst_debug_category_get_threshold (GST_CAT_DEFAULT) >= GST_LEVEL_LOG)
+    start = g_get_monotonic_time ();
+
+  gst_videolevels_frame_data (in_frame, videolevels->stride_in, &in_data,
+      &in_stride);
+  gst_videolevels_frame_data (out_frame, videolevels->stride_out, &out_data,
+      &out_stride);
+
+  GST_OBJECT_LOCK (videolevels);
+  mode = videolevels->mode;
+  auto_adjust = videolevels->auto_adjust;
+  GST_OBJECT_UNLOCK (videolevels);
+
+  /* auto adjustment only sets the input levels, which aren't used here */
+  if (mode == GST_VIDEOLEVELS_MODE_ADAPTIVE && videolevels->bpp_in > 8) {
+    if (gst_videolevels_histogram_due (videolevels))
+      gst_videolevels_worker_queue (videolevels, inbuf);
+    gst_videolevels_transform_tiles (videolevels, in_data, in_stride,
+        out_data, out_stride);
+    goto done;
   }
-  in_data = inminfo.data;
-  out_data = outminfo.data;
 
-  if (videolevels->auto_adjust == 1) {
+  if (auto_adjust == GST_VIDEOLEVELS_AUTO_SINGLE) {
     GST_DEBUG_OBJECT (videolevels, "Auto adjusting levels (once)");
-    gst_videolevels_auto_adjust (videolevels, (guint16 *) in_data);
-    videolevels->auto_adjust = 0;
+    /* the worker may still be using the histogram */
+    gst_videolevels_worker_flush (videolevels);
+    gst_videolevels_auto_adjust (videolevels, (guint16 *) in_data, in_stride,
+        FALSE);
+    gst_videolevels_post_histogram (videolevels, GST_BUFFER_TIMESTAMP (inbuf),
+        TRUE);
+    gst_videolevels_calculate_lut (videolevels);
+    GST_OBJECT_LOCK (videolevels);
+    /* keep a mode that was set while adjusting */
+    if (videolevels->auto_adjust == GST_VIDEOLEVELS_AUTO_SINGLE)
+      videolevels->auto_adjust = GST_VIDEOLEVELS_AUTO_OFF;
+    GST_OBJECT_UNLOCK (videolevels);
     g_object_notify (G_OBJECT (videolevels), "auto");
-  } else if (videolevels->auto_adjust == 2) {
+  } else if (auto_adjust == GST_VIDEOLEVELS_AUTO_CONTINUOUS) {
+    GST_OBJECT_LOCK (videolevels);
     elapsed =
         GST_CLOCK_DIFF (videolevels->last_auto_timestamp,
         GST_BUFFER_TIMESTAMP (inbuf));
-    if (videolevels->last_auto_timestamp == GST_CLOCK_TIME_NONE
-        || elapsed >= (GstClockTimeDiff) videolevels->interval || elapsed < 0) {
-      GST_LOG_OBJECT (videolevels, "Auto adjusting levels (%d ns since last)",
-          elapsed);
-      gst_videolevels_auto_adjust (videolevels, (guint16 *) in_data);
+    due = videolevels->last_auto_timestamp == GST_CLOCK_TIME_NONE
+        || elapsed >= (GstClockTimeDiff) videolevels->interval || elapsed < 0;
+    if (due)
       videolevels->last_auto_timestamp = GST_BUFFER_TIMESTAMP (inbuf);
+    GST_OBJECT_UNLOCK (videolevels);
+
+    if (due) {
+      GST_LOG_OBJECT (videolevels, "Queueing auto adjustment (%"
+          G_GINT64_FORMAT " ns since last)", elapsed);
+
+      /* the new levels are picked up in before_transform once ready */
+      gst_videolevels_worker_queue (videolevels, inbuf);
     }
+  } else if (gst_videolevels_histogram_due (videolevels)) {
+    gst_videolevels_worker_queue (videolevels, inbuf);
   }
 
-  lut = videolevels->lookup_table;
   if (videolevels->bpp_in > 8) {
     for (r = 0; r < videolevels->height; r++) {
-      guint16 *src = (guint16 *) in_data;
-      guint8 *dst = out_data;
-
-      for (c = 0; c < videolevels->width; c++) {
-        //GST_LOG_OBJECT (videolevels, "Converting pixel (%d, %d), %d->%d", c, r, *src, lut[*src]);
-        *dst++ = lut[*src++];
-      }
+      videolevels->line_func (out_data, (guint16 *) in_data,
+          videolevels->width, &videolevels->params);
 
-      in_data += videolevels->stride_in;
-      out_data += videolevels->stride_out;
+      in_data += in_stride;
+      out_data += out_stride;
     }
   } else {
+    lut = videolevels->lookup_table;
     for (r = 0; r < videolevels->height; r++) {
       guint8 *src = (guint8 *) in_data;
       guint8 *dst = out_data;
@@ -654,18 +1275,15 @@ gst_videolevels_transform (GstBaseTransform * trans, GstBuffer * inbuf,
         *dst++ = lut[*src++];
       }
 
-      in_data += videolevels->stride_in;
-      out_data += videolevels->stride_out;
+      in_data += in_stride;
+      out_data += out_stride;
     }
   }
 
-  gst_buffer_unmap (inbuf, &inminfo);
-  gst_buffer_unmap (outbuf, &outminfo);
-
-  GST_LOG_OBJECT (videolevels, "Processing took %" G_GINT64_FORMAT "ms",
-      GST_TIME_AS_MSECONDS (GST_CLOCK_DIFF (start,
-              gst_clock_get_time (gst_element_get_clock (GST_ELEMENT
-                      (videolevels))))));
+done:
+  if (start)
+    GST_LOG_OBJECT (videolevels, "Processing took %" G_GINT64_FORMAT " us",
+        g_get_monotonic_time () - start);
 
   return GST_FLOW_OK;
 }
@@ -689,10 +1307,28 @@ gst_videolevels_reset (GstVideoLevels * videolevels)
   videolevels->upper_input = DEFAULT_PROP_HIGHIN;
   videolevels->lower_output = DEFAULT_PROP_LOWOUT;
   videolevels->upper_output = DEFAULT_PROP_HIGHOUT;
+  videolevels->lut_dirty = FALSE;
 
   videolevels->auto_adjust = DEFAULT_PROP_AUTO;
   videolevels->interval = DEFAULT_PROP_INTERVAL;
   videolevels->last_auto_timestamp = GST_CLOCK_TIME_NONE;
+  videolevels->smoothing = DEFAULT_PROP_SMOOTHING;
+
+  videolevels->mode = DEFAULT_PROP_MODE;
+  videolevels->tiles_x = DEFAULT_PROP_TILES_X;
+  videolevels->tiles_y = DEFAULT_PROP_TILES_Y;
+  videolevels->clip_limit = DEFAULT_PROP_CLIP_LIMIT;
+  videolevels->n_threads = DEFAULT_PROP_N_THREADS;
+
+  videolevels->post_histogram = DEFAULT_PROP_POST_HISTOGRAM;
+  videolevels->histogram_interval = DEFAULT_PROP_HISTOGRAM_INTERVAL;
+  videolevels->last_histogram_time = -1;
+
+  videolevels->sample_step = DEFAULT_PROP_SAMPLE_STEP;
+  videolevels->roi_x = DEFAULT_PROP_ROI_X;
+  videolevels->roi_y = DEFAULT_PROP_ROI_Y;
+  videolevels->roi_width = DEFAULT_PROP_ROI_WIDTH;
+  videolevels->roi_height = DEFAULT_PROP_ROI_HEIGHT;
 
   videolevels->lower_pix_sat = 0.01f;
   videolevels->upper_pix_sat = 0.01f;
@@ -702,9 +1338,12 @@ gst_videolevels_reset (GstVideoLevels * videolevels)
 
   g_free (videolevels->histogram);
   videolevels->histogram = NULL;
+  g_free (videolevels->histogram_banks);
+  videolevels->histogram_banks = NULL;
+
+  gst_videolevels_tiles_free (videolevels);
 }
 
-#define GINT_CLAMP(x, low, high) ((gint)(CLAMP((x),(low),(high))))
 #define GUINT8_CLAMP(x, low, high) ((guint8)(CLAMP((x),(low),(high))))
 
 static gboolean
@@ -714,34 +1353,49 @@ gst_videolevels_calculate_lut (GstVideoLevels * videolevels)
   gdouble m;
   gdouble b;
   guint8 *lut = (guint8 *) videolevels->lookup_table;
+  GstVideoLevelsParams *params = &videolevels->params;
   const guint16 max_in = (1 << videolevels->bpp_in) - 1;
   guint16 low_in;
   guint16 high_in;
   const guint8 max_out = (1 << videolevels->bpp_out) - 1;
-  const guint8 low_out = videolevels->lower_output;
-  const guint8 high_out = videolevels->upper_output;
+  guint8 low_out;
+  guint8 high_out;
+  gboolean reset_low_in = FALSE, reset_high_in = FALSE;
 
-  if (videolevels->bpp_in == 0) {
+  if (videolevels->bpp_in == 0 || lut == NULL) {
     return FALSE;
   }
 
   GST_LOG_OBJECT (videolevels, "Calculating lookup table");
 
+  /* levels are set from the application thread, but the table and kernel
+   * are only ever touched here on the streaming thread, so working on a
+   * snapshot of the levels is enough to keep the two apart */
+  GST_OBJECT_LOCK (videolevels);
   if (videolevels->lower_input < 0 || videolevels->lower_input > max_in) {
     videolevels->lower_input = 0;
-    g_object_notify_by_pspec (G_OBJECT (videolevels), properties[PROP_LOWIN]);
+    reset_low_in = TRUE;
   }
   if (videolevels->upper_input < 0 || videolevels->upper_input > max_in) {
     videolevels->upper_input = max_in;
-    g_object_notify_by_pspec (G_OBJECT (videolevels), properties[PROP_HIGHIN]);
+    reset_high_in = TRUE;
   }
+  low_in = videolevels->lower_input;
+  high_in = videolevels->upper_input;
+  low_out = videolevels->lower_output;
+  high_out = videolevels->upper_output;
+  g_atomic_int_set (&videolevels->lut_dirty, FALSE);
+  GST_OBJECT_UNLOCK (videolevels);
+
+  if (reset_low_in)
+    g_object_notify_by_pspec (G_OBJECT (videolevels), properties[PROP_LOWIN]);
+  if (reset_high_in)
+    g_object_notify_by_pspec (G_OBJECT (videolevels), properties[PROP_HIGHIN]);
 
-  gst_videolevels_check_passthrough (videolevels);
+  gst_videolevels_check_passthrough (videolevels, low_in, high_in, low_out,
+      high_out);
 
   if (!videolevels->passthrough) {
-    low_in = videolevels->lower_input;
-    high_in = videolevels->upper_input;
-
     GST_LOG_OBJECT (videolevels, "Make linear LUT mapping (%d, %d) -> (%d, %d)",
         low_in, high_in, low_out, high_out);
 
@@ -752,81 +1406,152 @@ gst_videolevels_calculate_lut (GstVideoLevels * videolevels)
 
     b = low_out - m * low_in;
 
-    if (videolevels->endianness_in == G_LITTLE_ENDIAN)
-      for (i = 0; i < G_MAXUINT16; i++)
-        lut[i] = GUINT8_CLAMP (m * GUINT16_FROM_LE (i) + b, low_out, high_out);
-    else if (videolevels->endianness_in == G_BIG_ENDIAN)
-      for (i = 0; i < G_MAXUINT16; i++)
-        lut[i] = GUINT8_CLAMP (m * GUINT16_FROM_BE (i) + b, low_out, high_out);
-    else
-      for (i = 0; i < G_MAXUINT16; i++)
+    params->swap = videolevels->bpp_in > 8 && videolevels->endianness_in != 0
+        && videolevels->endianness_in != G_BYTE_ORDER;
+    params->mask = videolevels->lookup_table_size - 1;
+    params->lut = lut;
+
+    /* levels that are a plain shift or a shrinking linear map don't need
+     * the table, which leaves it for inverted or expanding mappings */
+    if (videolevels->bpp_in > 8 && low_in == 0 && low_out == 0 &&
+        high_out == 255 && high_in >= 255 && ((high_in + 1) & high_in) == 0) {
+      params->mapping = GST_VIDEOLEVELS_MAPPING_SHIFT;
+      params->high_in = high_in;
+      params->shift = g_bit_storage (high_in) - 8;
+    } else if (videolevels->bpp_in > 8 && low_in < high_in &&
+        low_out <= high_out && high_out - low_out < high_in - low_in) {
+      /* rounding the scale up makes high_in map exactly to high_out */
+      params->mapping = GST_VIDEOLEVELS_MAPPING_LINEAR;
+      params->low_in = low_in;
+      params->range_in = high_in - low_in;
+      params->scale = (guint16) ((((guint64) (high_out - low_out) << 16) +
+              params->range_in - 1) / params->range_in);
+      params->low_out = low_out;
+    } else {
+      /* indexed by value, non-native input is swapped first */
+      params->mapping = GST_VIDEOLEVELS_MAPPING_LUT;
+      for (i = 0; i < videolevels->lookup_table_size; i++)
         lut[i] = GUINT8_CLAMP (m * i + b, low_out, high_out);
+    }
+
+    videolevels->line_func = gst_videolevels_get_line_func (params,
+        &videolevels->line_func_name);
+    GST_LOG_OBJECT (videolevels, "Using %s kernel",
+        videolevels->line_func_name);
   }
 
   return TRUE;
 }
 
 
+/* nbins is a power of two no larger than the input range, so binning is
+ * a shift */
+static guint
+gst_videolevels_histogram_shift (GstVideoLevels * videolevels)
+{
+  return videolevels->bpp_in - (g_bit_storage (videolevels->nbins) - 1);
+}
+
+static inline guint
+gst_videolevels_bin (guint16 value, gboolean swap, guint16 mask, guint shift)
+{
+  if (swap)
+    value = GUINT16_SWAP_LE_BE (value);
+  return (value & mask) >> shift;
+}
+
 /**
 * gst_videolevels_calculate_histogram
 * @videolevels: #GstVideoLevels
 * @data: input frame data
+* @stride: input row stride in bytes
 *
-* Calculate histogram of input frame
+* Calculate histogram of the region of interest of the input frame, using
+* every sample-step'th row and column
 *
 * Returns: TRUE on success
 */
 gboolean
 gst_videolevels_calculate_histogram (GstVideoLevels * videolevels,
-    guint16 * data)
+    guint16 * data, gint stride)
 {
   gint *hist;
+  guint *banks[GST_VIDEOLEVELS_HISTOGRAM_BANKS];
   gint nbins = videolevels->nbins;
-  gint r;
-  gint c;
-  gfloat factor;
-  gint stride = videolevels->stride_in;
-  gint endianness = videolevels->endianness_in;
-  gint maxVal = (1 << videolevels->bpp_in) - 1;
-
-  factor = (gfloat) ((nbins - 1.0) / maxVal);
+  gint r, c, i, x0, y0, x1, y1, step;
+  const guint16 mask = (1 << videolevels->bpp_in) - 1;
+  const guint shift = gst_videolevels_histogram_shift (videolevels);
+  const gboolean swap = videolevels->endianness_in != 0 &&
+      videolevels->endianness_in != G_BYTE_ORDER;
 
   if (videolevels->histogram == NULL) {
     GST_DEBUG_OBJECT (videolevels,
         "First call, allocate memory for histogram (%d bins)", nbins);
     videolevels->histogram = g_new (gint, nbins);
+    videolevels->histogram_banks =
+        g_new (guint, GST_VIDEOLEVELS_HISTOGRAM_BANKS * nbins);
   }
 
   hist = videolevels->histogram;
+  for (i = 0; i < GST_VIDEOLEVELS_HISTOGRAM_BANKS; i++)
+    banks[i] = videolevels->histogram_banks + i * nbins;
 
   /* reset histogram */
-  memset (hist, 0, sizeof (gint) * nbins);
+  memset (videolevels->histogram_banks, 0,
+      sizeof (guint) * GST_VIDEOLEVELS_HISTOGRAM_BANKS * nbins);
+
+  GST_OBJECT_LOCK (videolevels);
+  step = videolevels->sample_step;
+  x0 = MIN (videolevels->roi_x, videolevels->width);
+  y0 = MIN (videolevels->roi_y, videolevels->height);
+  x1 = videolevels->roi_width ? MIN (x0 + (gint64) videolevels->roi_width,
+      videolevels->width) : videolevels->width;
+  y1 = videolevels->roi_height ? MIN (y0 + (gint64) videolevels->roi_height,
+      videolevels->height) : videolevels->height;
+  GST_OBJECT_UNLOCK (videolevels);
+
+  if (x0 >= x1 || y0 >= y1) {
+    GST_DEBUG_OBJECT (videolevels, "ROI outside of frame, using whole frame");
+    x0 = y0 = 0;
+    x1 = videolevels->width;
+    y1 = videolevels->height;
+  }
 
-  GST_LOG_OBJECT (videolevels, "Calculating histogram");
+  GST_LOG_OBJECT (videolevels, "Calculating histogram of (%d, %d)-(%d, %d), "
+      "step %d", x0, y0, x1, y1, step);
   if (videolevels->bpp_in > 8) {
-    if (endianness == G_BYTE_ORDER) {
-      for (r = 0; r < videolevels->height; r++) {
-        for (c = 0; c < videolevels->width; c++) {
-          hist[GINT_CLAMP (data[c + r * stride / 2] * factor, 0, nbins - 1)]++;
-        }
-      }
-    } else {
-      for (r = 0; r < videolevels->height; r++) {
-        for (c = 0; c < videolevels->width; c++) {
-          hist[GINT_CLAMP (GUINT16_FROM_BE (data[c +
-                          r * stride / 2]) * factor, 0, nbins - 1)]++;
-        }
+    for (r = y0; r < y1; r += step) {
+      const guint16 *line = (const guint16 *) ((guint8 *) data + r * stride);
+
+      for (c = x0; c + 3 * step < x1; c += 4 * step) {
+        banks[0][gst_videolevels_bin (line[c], swap, mask, shift)]++;
+        banks[1][gst_videolevels_bin (line[c + step], swap, mask, shift)]++;
+        banks[2][gst_videolevels_bin (line[c + 2 * step], swap, mask,
+                shift)]++;
+        banks[3][gst_videolevels_bin (line[c + 3 * step], swap, mask,
+                shift)]++;
       }
+      for (; c < x1; c += step)
+        banks[0][gst_videolevels_bin (line[c], swap, mask, shift)]++;
     }
   } else {
-    guint8 *data8 = (guint8 *) data;
-    for (r = 0; r < videolevels->height; r++) {
-      for (c = 0; c < videolevels->width; c++) {
-        hist[GINT_CLAMP (data8[c + r * stride / 2] * factor, 0, nbins - 1)]++;
+    for (r = y0; r < y1; r += step) {
+      const guint8 *line = (guint8 *) data + r * stride;
+
+      for (c = x0; c + 3 * step < x1; c += 4 * step) {
+        banks[0][(line[c] & mask) >> shift]++;
+        banks[1][(line[c + step] & mask) >> shift]++;
+        banks[2][(line[c + 2 * step] & mask) >> shift]++;
+        banks[3][(line[c + 3 * step] & mask) >> shift]++;
       }
+      for (; c < x1; c += step)
+        banks[0][(line[c] & mask) >> shift]++;
     }
   }
 
+  for (i = 0; i < nbins; i++)
+    hist[i] = banks[0][i] + banks[1][i] + banks[2][i] + banks[3][i];
+
   return TRUE;
 }
 
@@ -834,13 +1559,17 @@ gst_videolevels_calculate_histogram (GstVideoLevels * videolevels,
 * gst_videolevels_auto_adjust
 * @videolevels: #GstVideoLevels
 * @data: input frame data
+* @stride: input row stride in bytes
+* @smooth: whether to blend the new levels with the current ones
 *
-* Calculate lower and upper levels based on the histogram of the frame
+* Calculate lower and upper levels based on the histogram of the frame. The
+* lookup table is rebuilt by the streaming thread before the next frame.
 *
 * Returns: TRUE on success
 */
 gboolean
-gst_videolevels_auto_adjust (GstVideoLevels * videolevels, guint16 * data)
+gst_videolevels_auto_adjust (GstVideoLevels * videolevels, guint16 * data,
+    gint stride, gboolean smooth)
 {
   guint npixsat;
   guint sum;
@@ -848,10 +1577,14 @@ gst_videolevels_auto_adjust (GstVideoLevels * videolevels, guint16 * data)
   gint size;
   gint minVal = 0;
   gint maxVal = (1 << videolevels->bpp_in) - 1;
-  float factor = maxVal / (videolevels->nbins - 1.0f);
-  gst_videolevels_calculate_histogram (videolevels, data);
+  gint lower_input = -1, upper_input = -1;
+  guint shift = gst_videolevels_histogram_shift (videolevels);
+  gst_videolevels_calculate_histogram (videolevels, data, stride);
 
-  size = videolevels->width * videolevels->height;
+  /* number of sampled pixels */
+  size = 0;
+  for (i = 0; i < videolevels->nbins; i++)
+    size += videolevels->histogram[i];
 
   /* pixels to saturate on low end */
   npixsat = (guint) (videolevels->lower_pix_sat * size);
@@ -859,7 +1592,7 @@ gst_videolevels_auto_adjust (GstVideoLevels * videolevels, guint16 * data)
   for (i = 0; i < videolevels->nbins; i++) {
     sum += videolevels->histogram[i];
     if (sum > npixsat) {
-      videolevels->lower_input = (gint) CLAMP (i * factor, minVal, maxVal);
+      lower_input = (gint) CLAMP (i << shift, minVal, maxVal);
       break;
     }
   }
@@ -870,15 +1603,31 @@ gst_videolevels_auto_adjust (GstVideoLevels * videolevels, guint16 * data)
   for (i = videolevels->nbins - 1; i >= 0; i--) {
     sum += videolevels->histogram[i];
     if (sum > npixsat) {
-      videolevels->upper_input = (gint) CLAMP (i * factor, minVal, maxVal);
+      upper_input = (gint) CLAMP (((i + 1) << shift) - 1, minVal, maxVal);
       break;
     }
   }
 
-  gst_videolevels_calculate_lut (videolevels);
+  GST_OBJECT_LOCK (videolevels);
+  if (smooth) {
+    gdouble a = videolevels->smoothing;
+
+    if (lower_input >= 0)
+      lower_input = (gint) (a * videolevels->lower_input +
+          (1.0 - a) * lower_input + 0.5);
+    if (upper_input >= 0)
+      upper_input = (gint) (a * videolevels->upper_input +
+          (1.0 - a) * upper_input + 0.5);
+  }
+  if (lower_input >= 0)
+    videolevels->lower_input = lower_input;
+  if (upper_input >= 0)
+    videolevels->upper_input = upper_input;
+  g_atomic_int_set (&videolevels->lut_dirty, TRUE);
+  GST_OBJECT_UNLOCK (videolevels);
 
   GST_LOG_OBJECT (videolevels, "Contrast stretch with npixsat=%d, (%d, %d)",
-      npixsat, videolevels->lower_input, videolevels->upper_input);
+      npixsat, lower_input, upper_input);
 
   g_object_notify_by_pspec (G_OBJECT (videolevels), properties[PROP_LOWIN]);
   g_object_notify_by_pspec (G_OBJECT (videolevels), properties[PROP_HIGHIN]);
@@ -886,13 +1635,174 @@ gst_videolevels_auto_adjust (GstVideoLevels * videolevels, guint16 * data)
   return TRUE;
 }
 
+/**
+* gst_videolevels_histogram_due
+* @videolevels: #GstVideoLevels
+*
+* Whether a histogram should be computed only to be posted, which is the
+* case if the histogram interval passed in "always" mode
+*
+* Returns: TRUE if a histogram should be posted
+*/
+static gboolean
+gst_videolevels_histogram_due (GstVideoLevels * videolevels)
+{
+  gboolean due;
+
+  GST_OBJECT_LOCK (videolevels);
+  due = videolevels->post_histogram == GST_VIDEOLEVELS_POST_HISTOGRAM_ALWAYS
+      && (videolevels->last_histogram_time < 0 ||
+      g_get_monotonic_time () - videolevels->last_histogram_time >=
+      videolevels->histogram_interval * (gint64) 1000);
+  GST_OBJECT_UNLOCK (videolevels);
+
+  return due;
+}
+
+/**
+* gst_videolevels_post_histogram
+* @videolevels: #GstVideoLevels
+* @timestamp: timestamp of the frame the histogram is from
+* @adjusted: whether the histogram was used for auto adjustment
+*
+* Post the last histogram and the current input levels as element message,
+* unless disabled or the last one was posted less than the histogram
+* interval ago
+*/
+static void
+gst_videolevels_post_histogram (GstVideoLevels * videolevels,
+    GstClockTime timestamp, gboolean adjusted)
+{
+  GstStructure *st;
+  GValue array = G_VALUE_INIT;
+  GValue val = G_VALUE_INIT;
+  gint64 now = g_get_monotonic_time ();
+  gint lower_input, upper_input;
+  gint i;
+
+  GST_OBJECT_LOCK (videolevels);
+  if (videolevels->post_histogram == GST_VIDEOLEVELS_POST_HISTOGRAM_NONE ||
+      (videolevels->post_histogram == GST_VIDEOLEVELS_POST_HISTOGRAM_AUTO &&
+          !adjusted) || (videolevels->last_histogram_time >= 0 &&
+          now - videolevels->last_histogram_time <
+          videolevels->histogram_interval * (gint64) 1000)) {
+    GST_OBJECT_UNLOCK (videolevels);
+    return;
+  }
+  videolevels->last_histogram_time = now;
+  lower_input = videolevels->lower_input;
+  upper_input = videolevels->upper_input;
+  GST_OBJECT_UNLOCK (videolevels);
+
+  st = gst_structure_new ("videolevels-histogram",
+      "timestamp", GST_TYPE_CLOCK_TIME, timestamp,
+      "lower-input-level", G_TYPE_INT, lower_input,
+      "upper-input-level", G_TYPE_INT, upper_input,
+      "bin-width", G_TYPE_INT,
+      1 << gst_videolevels_histogram_shift (videolevels), NULL);
+
+  g_value_init (&array, GST_TYPE_ARRAY);
+  for (i = 0; i < videolevels->nbins; i++) {
+    g_value_init (&val, G_TYPE_INT);
+    g_value_set_int (&val, videolevels->histogram[i]);
+    gst_value_array_append_and_take_value (&array, &val);
+  }
+  gst_structure_take_value (st, "histogram", &array);
+
+  gst_element_post_message (GST_ELEMENT (videolevels),
+      gst_message_new_element (GST_OBJECT (videolevels), st));
+}
+
+/* Auto adjusts continuously and computes histograms to be posted on the
+ * frames queued by the streaming thread */
+static gpointer
+gst_videolevels_worker (gpointer data)
+{
+  GstVideoLevels *videolevels = GST_VIDEOLEVELS (data);
+  GstBuffer *buffer;
+  GstVideoFrame frame;
+  guint8 *in_data;
+  gint in_stride;
+  gboolean adjust, post;
+
+  g_mutex_lock (&videolevels->worker_lock);
+  while (TRUE) {
+    while (videolevels->worker_pending == NULL && !videolevels->worker_stop)
+      g_cond_wait (&videolevels->worker_cond, &videolevels->worker_lock);
+    if (videolevels->worker_stop)
+      break;
+
+    buffer = videolevels->worker_pending;
+    videolevels->worker_pending = NULL;
+    videolevels->worker_busy = TRUE;
+    g_mutex_unlock (&videolevels->worker_lock);
+
+    /* either may have been switched off since the frame was queued */
+    GST_OBJECT_LOCK (videolevels);
+    adjust = videolevels->auto_adjust == GST_VIDEOLEVELS_AUTO_CONTINUOUS &&
+        videolevels->mode == GST_VIDEOLEVELS_MODE_LEVELS;
+    post = videolevels->post_histogram ==
+        GST_VIDEOLEVELS_POST_HISTOGRAM_ALWAYS;
+    GST_OBJECT_UNLOCK (videolevels);
+
+    if (!adjust && !post) {
+      GST_LOG_OBJECT (videolevels, "Nothing to do, dropping frame");
+    } else if (gst_video_frame_map (&frame,
+            &GST_VIDEO_FILTER (videolevels)->in_info, buffer, GST_MAP_READ)) {
+      gst_videolevels_frame_data (&frame, videolevels->stride_in, &in_data,
+          &in_stride);
+      if (adjust)
+        gst_videolevels_auto_adjust (videolevels, (guint16 *) in_data,
+            in_stride, TRUE);
+      else
+        gst_videolevels_calculate_histogram (videolevels, (guint16 *) in_data,
+            in_stride);
+      gst_video_frame_unmap (&frame);
+
+      gst_videolevels_post_histogram (videolevels,
+          GST_BUFFER_TIMESTAMP (buffer), adjust);
+    } else {
+      GST_WARNING_OBJECT (videolevels, "Failed to map buffer for auto adjust");
+    }
+    gst_buffer_unref (buffer);
+
+    g_mutex_lock (&videolevels->worker_lock);
+    videolevels->worker_busy = FALSE;
+    g_cond_broadcast (&videolevels->worker_cond);
+  }
+  g_mutex_unlock (&videolevels->worker_lock);
+
+  return NULL;
+}
+
+/* Hands a frame to the worker, replacing one it didn't get to yet */
+static void
+gst_videolevels_worker_queue (GstVideoLevels * videolevels,
+    GstBuffer * buffer)
+{
+  g_mutex_lock (&videolevels->worker_lock);
+  gst_buffer_replace (&videolevels->worker_pending, buffer);
+  g_cond_signal (&videolevels->worker_cond);
+  g_mutex_unlock (&videolevels->worker_lock);
+}
+
+/* Drops a queued frame and waits for the worker to finish the current one */
+static void
+gst_videolevels_worker_flush (GstVideoLevels * videolevels)
+{
+  g_mutex_lock (&videolevels->worker_lock);
+  gst_buffer_replace (&videolevels->worker_pending, NULL);
+  while (videolevels->worker_busy)
+    g_cond_wait (&videolevels->worker_cond, &videolevels->worker_lock);
+  g_mutex_unlock (&videolevels->worker_lock);
+}
+
 static void
-gst_videolevels_check_passthrough (GstVideoLevels * levels)
+gst_videolevels_check_passthrough (GstVideoLevels * levels, gint low_in,
+    gint high_in, gint low_out, gint high_out)
 {
   gboolean passthrough;
-  if (levels->bpp_in == 8 &&
-      levels->lower_input == levels->lower_output &&
-      levels->upper_input == levels->upper_output) {
+  if (levels->bpp_in == 8 && low_in == low_out && high_in == high_out) {
     passthrough = TRUE;
   } else {
     passthrough = FALSE;
@@ -905,3 +1815,354 @@ gst_videolevels_check_passthrough (GstVideoLevels * levels)
         levels->passthrough);
   }
 }
+
+/************************************************************************/
+/* Adaptive mode                                                        */
+/************************************************************************/
+
+/* A frame split into jobs, which are either the tile rows whose tables are
+ * built, or bands of output rows. Jobs are taken by the streaming thread
+ * and the pool threads until none are left. */
+typedef struct
+{
+  GstVideoLevels *levels;
+  gboolean tables;
+  gint njobs;
+  gint next;
+
+  const guint8 *in_data;
+  gint in_stride;
+  guint8 *out_data;
+  gint out_stride;
+  gdouble clip_limit;
+  guint8 low_out;
+  guint8 high_out;
+} GstVideoLevelsTileWork;
+
+static void
+gst_videolevels_tiles_free (GstVideoLevels * videolevels)
+{
+  videolevels->tile_grid_x = 0;
+  videolevels->tile_grid_y = 0;
+  g_free (videolevels->tile_tables);
+  videolevels->tile_tables = NULL;
+  g_free (videolevels->tile_histograms);
+  videolevels->tile_histograms = NULL;
+  g_free (videolevels->tile_x1);
+  videolevels->tile_x1 = NULL;
+  g_free (videolevels->tile_x2);
+  videolevels->tile_x2 = NULL;
+  g_free (videolevels->tile_wx);
+  videolevels->tile_wx = NULL;
+  g_free (videolevels->tile_y1);
+  videolevels->tile_y1 = NULL;
+  g_free (videolevels->tile_y2);
+  videolevels->tile_y2 = NULL;
+  g_free (videolevels->tile_wy);
+  videolevels->tile_wy = NULL;
+}
+
+/* first pixel of tile @t out of @ntiles along an axis of @size pixels */
+static inline gint
+gst_videolevels_tile_start (gint t, gint ntiles, gint size)
+{
+  return (gint) ((gint64) t * size / ntiles);
+}
+
+/* For each pixel along an axis, the offsets of the tables of the tiles
+ * whose centers enclose it and the weight of the second one. Pixels
+ * outside of the outer centers only use the outer tile. */
+static void
+gst_videolevels_tile_axis (gint size, gint ntiles, guint32 scale,
+    guint32 * t1, guint32 * t2, guint16 * w)
+{
+  gint i, t = 0;
+
+  for (i = 0; i < size; i++) {
+    /* twice the tile centers, so they stay integer */
+    gint c0, c1;
+
+    while (t + 1 < ntiles && 2 * i >=
+        gst_videolevels_tile_start (t + 1, ntiles, size) +
+        gst_videolevels_tile_start (t + 2, ntiles, size) - 1)
+      t++;
+
+    c0 = gst_videolevels_tile_start (t, ntiles, size) +
+        gst_videolevels_tile_start (t + 1, ntiles, size) - 1;
+    if (2 * i <= c0 || t + 1 == ntiles) {
+      t1[i] = t2[i] = t * scale;
+      w[i] = 0;
+    } else {
+      c1 = gst_videolevels_tile_start (t + 1, ntiles, size) +
+          gst_videolevels_tile_start (t + 2, ntiles, size) - 1;
+      t1[i] = t * scale;
+      t2[i] = (t + 1) * scale;
+      w[i] = ((2 * i - c0) * 256 + (c1 - c0) / 2) / (c1 - c0);
+    }
+  }
+}
+
+static void
+gst_videolevels_tiles_setup (GstVideoLevels * videolevels, gint tiles_x,
+    gint tiles_y)
+{
+  const gint nbins = videolevels->nbins;
+
+  tiles_x = MIN (tiles_x, videolevels->width);
+  tiles_y = MIN (tiles_y, videolevels->height);
+  if (tiles_x == videolevels->tile_grid_x &&
+      tiles_y == videolevels->tile_grid_y)
+    return;
+
+  GST_DEBUG_OBJECT (videolevels, "Using %dx%d tiles with %d bins", tiles_x,
+      tiles_y, nbins);
+
+  gst_videolevels_tiles_free (videolevels);
+  videolevels->tile_grid_x = tiles_x;
+  videolevels->tile_grid_y = tiles_y;
+  videolevels->tile_tables = g_new (guint8, tiles_x * tiles_y * nbins);
+  videolevels->tile_histograms =
+      g_new (guint32, tiles_y * GST_VIDEOLEVELS_HISTOGRAM_BANKS * nbins);
+
+  videolevels->tile_x1 = g_new (guint32, videolevels->width);
+  videolevels->tile_x2 = g_new (guint32, videolevels->width);
+  videolevels->tile_wx = g_new (guint16, videolevels->width);
+  gst_videolevels_tile_axis (videolevels->width, tiles_x, nbins,
+      videolevels->tile_x1, videolevels->tile_x2, videolevels->tile_wx);
+
+  videolevels->tile_y1 = g_new (guint32, videolevels->height);
+  videolevels->tile_y2 = g_new (guint32, videolevels->height);
+  videolevels->tile_wy = g_new (guint16, videolevels->height);
+  gst_videolevels_tile_axis (videolevels->height, tiles_y, tiles_x * nbins,
+      videolevels->tile_y1, videolevels->tile_y2, videolevels->tile_wy);
+}
+
+/* Clips the histogram of a tile of @npixels pixels, spreading the excess
+ * over all bins, and turns its cumulative sum into the tile's table */
+static void
+gst_videolevels_tile_table (guint32 * hist, gint nbins, guint npixels,
+    gdouble clip_limit, guint8 low_out, guint8 high_out, guint8 * table)
+{
+  const gdouble scale = (gdouble) (high_out - low_out) / npixels;
+  guint32 sum = 0;
+  gint i;
+
+  if (clip_limit > 0.0) {
+    const guint32 clip = MAX (1, (guint32) (clip_limit * npixels / nbins));
+    guint32 excess = 0, batch, residual;
+
+    for (i = 0; i < nbins; i++) {
+      if (hist[i] > clip) {
+        excess += hist[i] - clip;
+        hist[i] = clip;
+      }
+    }
+
+    batch = excess / nbins;
+    residual = excess - batch * nbins;
+    for (i = 0; i < nbins; i++)
+      hist[i] += batch;
+    if (residual > 0) {
+      const gint step = MAX (nbins / residual, 1);
+
+      for (i = 0; i < nbins && residual > 0; i += step, residual--)
+        hist[i]++;
+    }
+  }
+
+  for (i = 0; i < nbins; i++) {
+    sum += hist[i];
+    table[i] = low_out + (guint8) (sum * scale + 0.5);
+  }
+}
+
+static void
+gst_videolevels_tile_job (GstVideoLevelsTileWork * work, gint job)
+{
+  GstVideoLevels *videolevels = work->levels;
+  const gint nbins = videolevels->nbins;
+  const gint tiles_x = videolevels->tile_grid_x;
+  const gint tiles_y = videolevels->tile_grid_y;
+  const guint16 mask = (1 << videolevels->bpp_in) - 1;
+  const guint shift = gst_videolevels_histogram_shift (videolevels);
+  const gboolean swap = videolevels->endianness_in != 0 &&
+      videolevels->endianness_in != G_BYTE_ORDER;
+  gint r, c, i, tx;
+
+  if (work->tables) {
+    guint32 *hist = videolevels->tile_histograms +
+        job * GST_VIDEOLEVELS_HISTOGRAM_BANKS * nbins;
+    guint32 *banks[GST_VIDEOLEVELS_HISTOGRAM_BANKS];
+    const gint y0 = gst_videolevels_tile_start (job, tiles_y,
+        videolevels->height);
+    const gint y1 = gst_videolevels_tile_start (job + 1, tiles_y,
+        videolevels->height);
+
+    for (tx = 0; tx < tiles_x; tx++) {
+      const gint x0 = gst_videolevels_tile_start (tx, tiles_x,
+          videolevels->width);
+      const gint x1 = gst_videolevels_tile_start (tx + 1, tiles_x,
+          videolevels->width);
+
+      memset (hist, 0,
+          GST_VIDEOLEVELS_HISTOGRAM_BANKS * nbins * sizeof (guint32));
+      for (i = 0; i < GST_VIDEOLEVELS_HISTOGRAM_BANKS; i++)
+        banks[i] = hist + i * nbins;
+
+      for (r = y0; r < y1; r++) {
+        const guint16 *line = (const guint16 *) (work->in_data +
+            r * work->in_stride);
+
+        for (c = x0; c + 3 < x1; c += 4) {
+          banks[0][gst_videolevels_bin (line[c], swap, mask, shift)]++;
+          banks[1][gst_videolevels_bin (line[c + 1], swap, mask, shift)]++;
+          banks[2][gst_videolevels_bin (line[c + 2], swap, mask, shift)]++;
+          banks[3][gst_videolevels_bin (line[c + 3], swap, mask, shift)]++;
+        }
+        for (; c < x1; c++)
+          banks[0][gst_videolevels_bin (line[c], swap, mask, shift)]++;
+      }
+
+      for (i = 0; i < nbins; i++)
+        hist[i] += banks[1][i] + banks[2][i] + banks[3][i];
+
+      gst_videolevels_tile_table (hist, nbins, (x1 - x0) * (y1 - y0),
+          work->clip_limit, work->low_out, work->high_out,
+          videolevels->tile_tables + (job * tiles_x + tx) * nbins);
+    }
+  } else {
+    GstVideoLevelsTileRow row;
+    const gint y0 = gst_videolevels_tile_start (job, work->njobs,
+        videolevels->height);
+    const gint y1 = gst_videolevels_tile_start (job + 1, work->njobs,
+        videolevels->height);
+
+    row.swap = swap;
+    row.mask = mask;
+    row.shift = shift;
+    row.x1 = videolevels->tile_x1;
+    row.x2 = videolevels->tile_x2;
+    row.wx = videolevels->tile_wx;
+
+    for (r = y0; r < y1; r++) {
+      row.top = videolevels->tile_tables + videolevels->tile_y1[r];
+      row.bottom = videolevels->tile_tables + videolevels->tile_y2[r];
+      row.wy = videolevels->tile_wy[r];
+      videolevels->tile_line_func (work->out_data + r * work->out_stride,
+          (const guint16 *) (work->in_data + r * work->in_stride),
+          videolevels->width, &row);
+    }
+  }
+}
+
+static void
+gst_videolevels_tile_work (GstVideoLevelsTileWork * work)
+{
+  gint job;
+
+  while ((job = g_atomic_int_add (&work->next, 1)) < work->njobs)
+    gst_videolevels_tile_job (work, job);
+}
+
+static void
+gst_videolevels_tile_runner (gpointer data, gpointer user_data)
+{
+  GstVideoLevels *videolevels = GST_VIDEOLEVELS (user_data);
+
+  gst_videolevels_tile_work ((GstVideoLevelsTileWork *) data);
+
+  g_mutex_lock (&videolevels->pool_lock);
+  if (--videolevels->pool_pending == 0)
+    g_cond_signal (&videolevels->pool_cond);
+  g_mutex_unlock (&videolevels->pool_lock);
+}
+
+/* Runs all jobs of @work and returns once they are done */
+static void
+gst_videolevels_tile_run (GstVideoLevels * videolevels,
+    GstVideoLevelsTileWork * work)
+{
+  gint i, runners = 0;
+
+  work->next = 0;
+  if (videolevels->pool)
+    runners = MIN (work->njobs - 1,
+        g_thread_pool_get_max_threads (videolevels->pool));
+
+  if (runners > 0) {
+    g_mutex_lock (&videolevels->pool_lock);
+    videolevels->pool_pending = runners;
+    g_mutex_unlock (&videolevels->pool_lock);
+
+    for (i = 0; i < runners; i++)
+      g_thread_pool_push (videolevels->pool, work, NULL);
+  }
+
+  gst_videolevels_tile_work (work);
+
+  if (runners > 0) {
+    g_mutex_lock (&videolevels->pool_lock);
+    while (videolevels->pool_pending > 0)
+      g_cond_wait (&videolevels->pool_cond, &videolevels->pool_lock);
+    g_mutex_unlock (&videolevels->pool_lock);
+  }
+}
+
+/**
+ * gst_videolevels_transform_tiles:
+ * @videolevels: #GstVideoLevels
+ * @in_data: input frame data, more than 8 bits per pixel
+ * @in_stride: input row stride in bytes
+ * @out_data: output frame data
+ * @out_stride: output row stride in bytes
+ *
+ * Contrast limited adaptive histogram equalization. Each tile gets a table
+ * from its clipped histogram, and each pixel is mapped by interpolating
+ * the tables of the four nearest tiles.
+ */
+static void
+gst_videolevels_transform_tiles (GstVideoLevels * videolevels,
+    const guint8 * in_data, gint in_stride, guint8 * out_data,
+    gint out_stride)
+{
+  GstVideoLevelsTileWork work;
+  gint tiles_x, tiles_y, threads = 1;
+  gint64 start = 0;
+
+  if (gst_debug_category_get_threshold (GST_CAT_DEFAULT) >= GST_LEVEL_LOG)
+    start = g_get_monotonic_time ();
+
+  GST_OBJECT_LOCK (videolevels);
+  tiles_x = videolevels->tiles_x;
+  tiles_y = videolevels->tiles_y;
+  work.clip_limit = videolevels->clip_limit;
+  work.low_out = videolevels->lower_output;
+  work.high_out = MAX (videolevels->upper_output, videolevels->lower_output);
+  GST_OBJECT_UNLOCK (videolevels);
+
+  gst_videolevels_tiles_setup (videolevels, tiles_x, tiles_y);
+
+  if (videolevels->pool)
+    threads += g_thread_pool_get_max_threads (videolevels->pool);
+
+  work.levels = videolevels;
+  work.in_data = in_data;
+  work.in_stride = in_stride;
+  work.out_data = out_data;
+  work.out_stride = out_stride;
+
+  work.tables = TRUE;
+  work.njobs = videolevels->tile_grid_y;
+  gst_videolevels_tile_run (videolevels, &work);
+
+  work.tables = FALSE;
+  work.njobs = MIN (videolevels->height, 4 * threads);
+  gst_videolevels_tile_run (videolevels, &work);
+
+  if (start)
+    GST_LOG_OBJECT (videolevels, "Adaptive mapping of %dx%d tiles using %s "
+        "kernel on %d threads took %" G_GINT64_FORMAT " us",
+        videolevels->tile_grid_x, videolevels->tile_grid_y,
+        videolevels->tile_line_func_name, threads,
+        g_get_monotonic_time () - start);
+}
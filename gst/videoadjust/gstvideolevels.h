@@ -25,8 +25,10 @@
 #ifndef __GST_VIDEO_LEVELS_H__
 #define __GST_VIDEO_LEVELS_H__
 
-#include <gst/base/gstbasetransform.h>
 #include <gst/video/video.h>
+#include <gst/video/gstvideofilter.h>
+
+#include "gstvideolevelskernels.h"
 
 G_BEGIN_DECLS
 
@@ -58,6 +60,35 @@ typedef enum {
   GST_VIDEOLEVELS_AUTO_CONTINUOUS
 } GstVideoLevelsAuto;
 
+/**
+* GstVideoLevelsPostHistogram:
+* @GST_VIDEOLEVELS_POST_HISTOGRAM_NONE: don't post histograms
+* @GST_VIDEOLEVELS_POST_HISTOGRAM_AUTO: post the histogram auto adjustment
+*   used
+* @GST_VIDEOLEVELS_POST_HISTOGRAM_ALWAYS: also compute and post histograms
+*   when not auto adjusting
+*
+* When to post "videolevels-histogram" element messages.
+*/
+typedef enum {
+  GST_VIDEOLEVELS_POST_HISTOGRAM_NONE,
+  GST_VIDEOLEVELS_POST_HISTOGRAM_AUTO,
+  GST_VIDEOLEVELS_POST_HISTOGRAM_ALWAYS
+} GstVideoLevelsPostHistogram;
+
+/**
+* GstVideoLevelsMode:
+* @GST_VIDEOLEVELS_MODE_LEVELS: map the input levels to the output levels
+* @GST_VIDEOLEVELS_MODE_ADAPTIVE: contrast limited adaptive histogram
+*   equalization (CLAHE) over a grid of tiles
+*
+* How input values are mapped to output values.
+*/
+typedef enum {
+  GST_VIDEOLEVELS_MODE_LEVELS,
+  GST_VIDEOLEVELS_MODE_ADAPTIVE
+} GstVideoLevelsMode;
+
 /**
 * GstVideoLevels:
 * @element: the parent element.
@@ -67,9 +98,10 @@ typedef enum {
 */
 struct _GstVideoLevels
 {
-  GstBaseTransform element;
+  GstVideoFilter element;
 
-  /* format */
+  /* format, strides are only used for Bayer as raw formats are mapped as
+   * GstVideoFrame, which honours upstream video meta */
   gint width;
   gint height;
   gint bpp_in;
@@ -83,9 +115,16 @@ struct _GstVideoLevels
   gint upper_input;
   gint lower_output;
   gint upper_output;
+  gboolean lut_dirty;
 
   /* tables */
   gpointer lookup_table;
+  gint lookup_table_size;
+
+  /* kernel for >8-bit input */
+  GstVideoLevelsParams params;
+  GstVideoLevelsLineFunc line_func;
+  const gchar *line_func_name;
 
   GstVideoLevelsAuto auto_adjust;
   guint64 interval;
@@ -93,15 +132,62 @@ struct _GstVideoLevels
   gfloat upper_pix_sat;
   gint nbins;
   gint * histogram;
+  guint * histogram_banks;
+  guint sample_step;
+  gint roi_x;
+  gint roi_y;
+  gint roi_width;
+  gint roi_height;
 
   guint64 last_auto_timestamp;
+  gdouble smoothing;
+
+  GstVideoLevelsPostHistogram post_histogram;
+  guint histogram_interval;
+  gint64 last_histogram_time;
+
+  /* continuous auto adjustment runs on a worker thread, which takes the
+   * most recent pending frame */
+  GThread *worker;
+  GMutex worker_lock;
+  GCond worker_cond;
+  GstBuffer *worker_pending;
+  gboolean worker_busy;
+  gboolean worker_stop;
+
+  /* adaptive mode, the tables of tile (x, y) start at
+   * tile_tables + (y * tile_grid_x + x) * nbins */
+  GstVideoLevelsMode mode;
+  gint tiles_x;
+  gint tiles_y;
+  gdouble clip_limit;
+  guint n_threads;
+  gint tile_grid_x;
+  gint tile_grid_y;
+  guint8 *tile_tables;
+  guint32 *tile_histograms;
+  guint32 *tile_x1;
+  guint32 *tile_x2;
+  guint16 *tile_wx;
+  guint32 *tile_y1;
+  guint32 *tile_y2;
+  guint16 *tile_wy;
+  GstVideoLevelsTileLineFunc tile_line_func;
+  const gchar *tile_line_func_name;
+
+  /* adaptive mode splits frames into jobs, the streaming thread runs the
+   * first one itself and waits for the pool to finish the others */
+  GThreadPool *pool;
+  GMutex pool_lock;
+  GCond pool_cond;
+  gint pool_pending;
 
   gboolean passthrough;
 };
 
 struct _GstVideoLevelsClass
 {
-  GstBaseTransformClass parent_class;
+  GstVideoFilterClass parent_class;
 };
 
 GType gst_videolevels_get_type(void);
@@ -0,0 +1,393 @@
+/* GStreamer
+ * Copyright (C) 2010 United States Government, Joshua M. Doe <oss@nvl.army.mil>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Line kernels mapping 16-bit grayscale to 8-bit.
+ *
+ * The scalar kernel handles every mapping and is the reference. Linear and
+ * shift mappings need no table, so they also have vectorized versions that
+ * are picked at runtime according to the CPU features and must produce
+ * bit-identical output.
+ *
+ * Adaptive mode has its own kernels, where the table lookups stay scalar
+ * and binning and blending are vectorized. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstvideolevelskernels.h"
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define HAVE_SSE2_KERNELS 1
+#define SSE2_TARGET __attribute__ ((target ("sse2")))
+#elif defined (_MSC_VER) && (defined (_M_X64) || defined (_M_IX86))
+#define HAVE_SSE2_KERNELS 1
+#define SSE2_TARGET
+#include <intrin.h>
+#endif
+
+#ifdef HAVE_SSE2_KERNELS
+#include <emmintrin.h>
+#endif
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#define HAVE_NEON_KERNELS 1
+#include <arm_neon.h>
+#endif
+
+#ifdef HAVE_SSE2_KERNELS
+static gboolean
+gst_videolevels_cpu_has_sse2 (void)
+{
+#if defined (_MSC_VER)
+  int info[4];
+
+  __cpuid (info, 1);
+  return (info[3] & (1 << 26)) != 0;
+#else
+  __builtin_cpu_init ();
+  return __builtin_cpu_supports ("sse2");
+#endif
+}
+#endif
+
+static inline guint8
+gst_videolevels_map_pixel (guint16 x, const GstVideoLevelsParams * params)
+{
+  if (params->swap)
+    x = GUINT16_SWAP_LE_BE (x);
+  x &= params->mask;
+
+  switch (params->mapping) {
+    case GST_VIDEOLEVELS_MAPPING_LINEAR:
+      x = x < params->low_in ? 0 : x - params->low_in;
+      x = MIN (x, params->range_in);
+      return params->low_out + ((x * (guint32) params->scale) >> 16);
+    case GST_VIDEOLEVELS_MAPPING_SHIFT:
+      return MIN (x, params->high_in) >> params->shift;
+    default:
+      return params->lut[x];
+  }
+}
+
+void
+gst_videolevels_line_scalar (guint8 * dst, const guint16 * src, gint width,
+    const GstVideoLevelsParams * params)
+{
+  gint x;
+
+  for (x = 0; x < width; x++)
+    dst[x] = gst_videolevels_map_pixel (src[x], params);
+}
+
+static inline guint8
+gst_videolevels_tile_pixel (guint16 x, gint c, const GstVideoLevelsTileRow * row)
+{
+  guint wx = row->wx[c];
+  guint t, u;
+
+  if (row->swap)
+    x = GUINT16_SWAP_LE_BE (x);
+  x = (x & row->mask) >> row->shift;
+
+  t = (row->top[row->x1[c] + x] * (256 - wx) + row->top[row->x2[c] + x] * wx +
+      128) >> 8;
+  u = (row->bottom[row->x1[c] + x] * (256 - wx) +
+      row->bottom[row->x2[c] + x] * wx + 128) >> 8;
+  return (t * (256 - row->wy) + u * row->wy + 128) >> 8;
+}
+
+void
+gst_videolevels_tile_line_scalar (guint8 * dst, const guint16 * src,
+    gint width, const GstVideoLevelsTileRow * row)
+{
+  gint x;
+
+  for (x = 0; x < width; x++)
+    dst[x] = gst_videolevels_tile_pixel (src[x], x, row);
+}
+
+#ifdef HAVE_SSE2_KERNELS
+SSE2_TARGET static inline __m128i
+gst_videolevels_load_sse2 (const guint16 * src,
+    const GstVideoLevelsParams * params)
+{
+  __m128i x = _mm_loadu_si128 ((const __m128i *) src);
+
+  if (params->swap)
+    x = _mm_or_si128 (_mm_slli_epi16 (x, 8), _mm_srli_epi16 (x, 8));
+  return _mm_and_si128 (x, _mm_set1_epi16 ((gint16) params->mask));
+}
+
+/* unsigned 16-bit minimum, which SSE2 lacks */
+SSE2_TARGET static inline __m128i
+gst_videolevels_min_epu16_sse2 (__m128i a, __m128i b)
+{
+  return _mm_sub_epi16 (a, _mm_subs_epu16 (a, b));
+}
+
+SSE2_TARGET static inline __m128i
+gst_videolevels_linear_sse2 (__m128i x, const GstVideoLevelsParams * params)
+{
+  x = _mm_subs_epu16 (x, _mm_set1_epi16 ((gint16) params->low_in));
+  x = gst_videolevels_min_epu16_sse2 (x,
+      _mm_set1_epi16 ((gint16) params->range_in));
+  x = _mm_mulhi_epu16 (x, _mm_set1_epi16 ((gint16) params->scale));
+  return _mm_add_epi16 (x, _mm_set1_epi16 (params->low_out));
+}
+
+SSE2_TARGET static void
+gst_videolevels_line_linear_sse2 (guint8 * dst, const guint16 * src,
+    gint width, const GstVideoLevelsParams * params)
+{
+  gint x = 0;
+
+  for (; x + 16 <= width; x += 16) {
+    __m128i lo = gst_videolevels_load_sse2 (src + x, params);
+    __m128i hi = gst_videolevels_load_sse2 (src + x + 8, params);
+
+    lo = gst_videolevels_linear_sse2 (lo, params);
+    hi = gst_videolevels_linear_sse2 (hi, params);
+    _mm_storeu_si128 ((__m128i *) (dst + x), _mm_packus_epi16 (lo, hi));
+  }
+
+  gst_videolevels_line_scalar (dst + x, src + x, width - x, params);
+}
+
+SSE2_TARGET static void
+gst_videolevels_line_shift_sse2 (guint8 * dst, const guint16 * src,
+    gint width, const GstVideoLevelsParams * params)
+{
+  const __m128i high_in = _mm_set1_epi16 ((gint16) params->high_in);
+  const __m128i shift = _mm_cvtsi32_si128 (params->shift);
+  gint x = 0;
+
+  for (; x + 16 <= width; x += 16) {
+    __m128i lo = gst_videolevels_load_sse2 (src + x, params);
+    __m128i hi = gst_videolevels_load_sse2 (src + x + 8, params);
+
+    lo = _mm_srl_epi16 (gst_videolevels_min_epu16_sse2 (lo, high_in), shift);
+    hi = _mm_srl_epi16 (gst_videolevels_min_epu16_sse2 (hi, high_in), shift);
+    _mm_storeu_si128 ((__m128i *) (dst + x), _mm_packus_epi16 (lo, hi));
+  }
+
+  gst_videolevels_line_scalar (dst + x, src + x, width - x, params);
+}
+
+/* (a * (256 - w) + b * w + 128) >> 8, no term exceeds 16 bits */
+SSE2_TARGET static inline __m128i
+gst_videolevels_blend_sse2 (__m128i a, __m128i b, __m128i w)
+{
+  const __m128i one = _mm_set1_epi16 (256);
+  __m128i x = _mm_add_epi16 (_mm_mullo_epi16 (a, _mm_sub_epi16 (one, w)),
+      _mm_mullo_epi16 (b, w));
+
+  return _mm_srli_epi16 (_mm_add_epi16 (x, _mm_set1_epi16 (128)), 8);
+}
+
+SSE2_TARGET static void
+gst_videolevels_tile_line_sse2 (guint8 * dst, const guint16 * src,
+    gint width, const GstVideoLevelsTileRow * row)
+{
+  const __m128i mask = _mm_set1_epi16 ((gint16) row->mask);
+  const __m128i shift = _mm_cvtsi32_si128 (row->shift);
+  const __m128i wy = _mm_set1_epi16 ((gint16) row->wy);
+  guint16 bins[8];
+  guint16 tl[8], tr[8], bl[8], br[8];
+  gint x = 0, i;
+
+  for (; x + 8 <= width; x += 8) {
+    __m128i v = _mm_loadu_si128 ((const __m128i *) (src + x));
+    __m128i t, u;
+
+    if (row->swap)
+      v = _mm_or_si128 (_mm_slli_epi16 (v, 8), _mm_srli_epi16 (v, 8));
+    v = _mm_srl_epi16 (_mm_and_si128 (v, mask), shift);
+    _mm_storeu_si128 ((__m128i *) bins, v);
+
+    for (i = 0; i < 8; i++) {
+      const guint32 o1 = row->x1[x + i] + bins[i];
+      const guint32 o2 = row->x2[x + i] + bins[i];
+
+      tl[i] = row->top[o1];
+      tr[i] = row->top[o2];
+      bl[i] = row->bottom[o1];
+      br[i] = row->bottom[o2];
+    }
+
+    v = _mm_loadu_si128 ((const __m128i *) (row->wx + x));
+    t = gst_videolevels_blend_sse2 (_mm_loadu_si128 ((const __m128i *) tl),
+        _mm_loadu_si128 ((const __m128i *) tr), v);
+    u = gst_videolevels_blend_sse2 (_mm_loadu_si128 ((const __m128i *) bl),
+        _mm_loadu_si128 ((const __m128i *) br), v);
+    v = gst_videolevels_blend_sse2 (t, u, wy);
+    _mm_storel_epi64 ((__m128i *) (dst + x), _mm_packus_epi16 (v, v));
+  }
+
+  for (; x < width; x++)
+    dst[x] = gst_videolevels_tile_pixel (src[x], x, row);
+}
+#endif
+
+#ifdef HAVE_NEON_KERNELS
+static inline uint16x8_t
+gst_videolevels_load_neon (const guint16 * src,
+    const GstVideoLevelsParams * params)
+{
+  uint16x8_t x = vld1q_u16 (src);
+
+  if (params->swap)
+    x = vreinterpretq_u16_u8 (vrev16q_u8 (vreinterpretq_u8_u16 (x)));
+  return vandq_u16 (x, vdupq_n_u16 (params->mask));
+}
+
+static void
+gst_videolevels_line_linear_neon (guint8 * dst, const guint16 * src,
+    gint width, const GstVideoLevelsParams * params)
+{
+  const uint16x8_t low_in = vdupq_n_u16 (params->low_in);
+  const uint16x8_t range_in = vdupq_n_u16 (params->range_in);
+  const uint16x4_t scale = vdup_n_u16 (params->scale);
+  const uint16x8_t low_out = vdupq_n_u16 (params->low_out);
+  gint x = 0;
+
+  for (; x + 8 <= width; x += 8) {
+    uint16x8_t v = gst_videolevels_load_neon (src + x, params);
+
+    v = vminq_u16 (vqsubq_u16 (v, low_in), range_in);
+    v = vcombine_u16 (vshrn_n_u32 (vmull_u16 (vget_low_u16 (v), scale), 16),
+        vshrn_n_u32 (vmull_u16 (vget_high_u16 (v), scale), 16));
+    vst1_u8 (dst + x, vmovn_u16 (vaddq_u16 (v, low_out)));
+  }
+
+  gst_videolevels_line_scalar (dst + x, src + x, width - x, params);
+}
+
+static void
+gst_videolevels_line_shift_neon (guint8 * dst, const guint16 * src,
+    gint width, const GstVideoLevelsParams * params)
+{
+  const uint16x8_t high_in = vdupq_n_u16 (params->high_in);
+  const int16x8_t shift = vdupq_n_s16 (-(gint16) params->shift);
+  gint x = 0;
+
+  for (; x + 8 <= width; x += 8) {
+    uint16x8_t v = gst_videolevels_load_neon (src + x, params);
+
+    v = vshlq_u16 (vminq_u16 (v, high_in), shift);
+    vst1_u8 (dst + x, vmovn_u16 (v));
+  }
+
+  gst_videolevels_line_scalar (dst + x, src + x, width - x, params);
+}
+
+static inline uint16x8_t
+gst_videolevels_blend_neon (uint16x8_t a, uint16x8_t b, uint16x8_t w)
+{
+  uint16x8_t x = vmlaq_u16 (vmulq_u16 (a, vsubq_u16 (vdupq_n_u16 (256), w)),
+      b, w);
+
+  return vrshrq_n_u16 (x, 8);
+}
+
+static void
+gst_videolevels_tile_line_neon (guint8 * dst, const guint16 * src,
+    gint width, const GstVideoLevelsTileRow * row)
+{
+  const uint16x8_t mask = vdupq_n_u16 (row->mask);
+  const int16x8_t shift = vdupq_n_s16 (-(gint16) row->shift);
+  const uint16x8_t wy = vdupq_n_u16 (row->wy);
+  guint16 bins[8];
+  guint16 tl[8], tr[8], bl[8], br[8];
+  gint x = 0, i;
+
+  for (; x + 8 <= width; x += 8) {
+    uint16x8_t v = vld1q_u16 (src + x);
+    uint16x8_t t, u, wx;
+
+    if (row->swap)
+      v = vreinterpretq_u16_u8 (vrev16q_u8 (vreinterpretq_u8_u16 (v)));
+    vst1q_u16 (bins, vshlq_u16 (vandq_u16 (v, mask), shift));
+
+    for (i = 0; i < 8; i++) {
+      const guint32 o1 = row->x1[x + i] + bins[i];
+      const guint32 o2 = row->x2[x + i] + bins[i];
+
+      tl[i] = row->top[o1];
+      tr[i] = row->top[o2];
+      bl[i] = row->bottom[o1];
+      br[i] = row->bottom[o2];
+    }
+
+    wx = vld1q_u16 (row->wx + x);
+    t = gst_videolevels_blend_neon (vld1q_u16 (tl), vld1q_u16 (tr), wx);
+    u = gst_videolevels_blend_neon (vld1q_u16 (bl), vld1q_u16 (br), wx);
+    vst1_u8 (dst + x, vmovn_u16 (gst_videolevels_blend_neon (t, u, wy)));
+  }
+
+  for (; x < width; x++)
+    dst[x] = gst_videolevels_tile_pixel (src[x], x, row);
+}
+#endif
+
+GstVideoLevelsLineFunc
+gst_videolevels_get_line_func (const GstVideoLevelsParams * params,
+    const gchar ** name)
+{
+  if (params->mapping == GST_VIDEOLEVELS_MAPPING_LUT) {
+    *name = "lut";
+    return gst_videolevels_line_scalar;
+  }
+#ifdef HAVE_NEON_KERNELS
+  *name = params->mapping == GST_VIDEOLEVELS_MAPPING_LINEAR ?
+      "linear-neon" : "shift-neon";
+  return params->mapping == GST_VIDEOLEVELS_MAPPING_LINEAR ?
+      gst_videolevels_line_linear_neon : gst_videolevels_line_shift_neon;
+#endif
+#ifdef HAVE_SSE2_KERNELS
+  if (gst_videolevels_cpu_has_sse2 ()) {
+    *name = params->mapping == GST_VIDEOLEVELS_MAPPING_LINEAR ?
+        "linear-sse2" : "shift-sse2";
+    return params->mapping == GST_VIDEOLEVELS_MAPPING_LINEAR ?
+        gst_videolevels_line_linear_sse2 : gst_videolevels_line_shift_sse2;
+  }
+#endif
+
+  *name = params->mapping == GST_VIDEOLEVELS_MAPPING_LINEAR ?
+      "linear" : "shift";
+  return gst_videolevels_line_scalar;
+}
+
+GstVideoLevelsTileLineFunc
+gst_videolevels_get_tile_line_func (const gchar ** name)
+{
+#ifdef HAVE_NEON_KERNELS
+  *name = "tile-neon";
+  return gst_videolevels_tile_line_neon;
+#endif
+#ifdef HAVE_SSE2_KERNELS
+  if (gst_videolevels_cpu_has_sse2 ()) {
+    *name = "tile-sse2";
+    return gst_videolevels_tile_line_sse2;
+  }
+#endif
+
+  *name = "tile";
+  return gst_videolevels_tile_line_scalar;
+}
@@ -0,0 +1,107 @@
+/* GStreamer
+ * Copyright (C) 2010 United States Government, Joshua M. Doe <oss@nvl.army.mil>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __GST_VIDEO_LEVELS_KERNELS_H__
+#define __GST_VIDEO_LEVELS_KERNELS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* How 16-bit input is mapped to 8-bit output */
+typedef enum {
+  GST_VIDEOLEVELS_MAPPING_LUT,
+  GST_VIDEOLEVELS_MAPPING_LINEAR,
+  GST_VIDEOLEVELS_MAPPING_SHIFT
+} GstVideoLevelsMapping;
+
+/* Parameters of a line kernel. Input pixels are byte-swapped if @swap is
+ * set, then masked with @mask. Depending on @mapping they are then
+ *
+ *   LUT:    looked up in @lut
+ *   LINEAR: low_out + ((CLAMP (x, low_in, low_in + range_in) - low_in) *
+ *               scale >> 16)
+ *   SHIFT:  MIN (x, high_in) >> shift
+ */
+typedef struct
+{
+  GstVideoLevelsMapping mapping;
+  gboolean swap;
+  guint16 mask;
+
+  const guint8 *lut;
+
+  guint16 low_in;
+  guint16 range_in;
+  guint16 scale;
+  guint8 low_out;
+
+  guint16 high_in;
+  guint shift;
+} GstVideoLevelsParams;
+
+typedef void (*GstVideoLevelsLineFunc) (guint8 * dst, const guint16 * src,
+    gint width, const GstVideoLevelsParams * params);
+
+void gst_videolevels_line_scalar (guint8 * dst, const guint16 * src,
+    gint width, const GstVideoLevelsParams * params);
+
+GstVideoLevelsLineFunc gst_videolevels_get_line_func (const
+    GstVideoLevelsParams * params, const gchar ** name);
+
+/* Parameters of a row in adaptive mode. Input pixels are byte-swapped if
+ * @swap is set, masked with @mask and shifted right by @shift to get the
+ * histogram bin b. That is looked up in the tables of the four tiles around
+ * the pixel, which are blended bilinearly:
+ *
+ *   t   = (top[x1[x] + b] * (256 - wx[x]) + top[x2[x] + b] * wx[x] + 128) >> 8
+ *   u   = likewise from bottom
+ *   out = (t * (256 - wy) + u * wy + 128) >> 8
+ *
+ * @x1 and @x2 are offsets of the left and right tile tables for each column,
+ * weights are in the range [0, 256].
+ */
+typedef struct
+{
+  gboolean swap;
+  guint16 mask;
+  guint shift;
+
+  const guint8 *top;
+  const guint8 *bottom;
+  guint16 wy;
+
+  const guint32 *x1;
+  const guint32 *x2;
+  const guint16 *wx;
+} GstVideoLevelsTileRow;
+
+typedef void (*GstVideoLevelsTileLineFunc) (guint8 * dst,
+    const guint16 * src, gint width, const GstVideoLevelsTileRow * row);
+
+void gst_videolevels_tile_line_scalar (guint8 * dst, const guint16 * src,
+    gint width, const GstVideoLevelsTileRow * row);
+
+GstVideoLevelsTileLineFunc gst_videolevels_get_tile_line_func (const
+    gchar ** name);
+
+G_END_DECLS
+
+#endif /* __GST_VIDEO_LEVELS_KERNELS_H__ */
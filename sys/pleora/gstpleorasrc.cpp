@@ -1617,9 +1617,21 @@ gst_pleorasrc_create (GstPushSrc * psrc, GstBuffer ** buf)
 
     gsize data_size = pvimage->GetImageSize ();
 
+    /* wrap the whole payload, so chunk data following the image can be
+       referenced by KLV meta without copying */
+    guint8 *payload = (guint8 *) pvbuffer->GetDataPointer ();
+    gsize payload_size = pvbuffer->GetAcquiredSize ();
+    gsize data_offset = (guint8 *) data - payload;
+    if (payload == NULL || (guint8 *) data < payload ||
+        data_offset + data_size > payload_size) {
+      payload = (guint8 *) data;
+      payload_size = data_size;
+      data_offset = 0;
+    }
+
     *buf =
         gst_buffer_new_wrapped_full ((GstMemoryFlags) GST_MEMORY_FLAG_READONLY,
-        (gpointer) data, data_size, 0, data_size, vf,
+        (gpointer) payload, payload_size, data_offset, data_size, vf,
         (GDestroyNotify) pvbuffer_release);
   } else {
     GstMapInfo minfo;
@@ -1697,6 +1709,20 @@ gst_pleorasrc_create (GstPushSrc * psrc, GstBuffer ** buf)
 
       GST_LOG_OBJECT (src, "Adding KLV meta to buffer");
       /* TODO: do we need to exclude padding that may be present? */
+      if (src->pleora_stride == src->gst_stride) {
+        /* reference the chunk in the wrapped payload instead of copying it */
+        GstMemory *mem = gst_buffer_peek_memory (*buf, 0);
+        gssize chunk_offset = chunk_data - (const guint8 *) data;
+
+        if ((gssize) mem->offset + chunk_offset >= 0 &&
+            mem->offset + chunk_offset + chunk_size <= mem->maxsize) {
+          GstMemory *chunk_mem = gst_memory_share (mem, chunk_offset,
+              chunk_size);
+          gst_buffer_add_klv_meta_from_memory (*buf, chunk_mem, 0, chunk_size);
+          gst_memory_unref (chunk_mem);
+          continue;
+        }
+      }
       gst_buffer_add_klv_meta_from_data (*buf, chunk_data, chunk_size);
     }
   }
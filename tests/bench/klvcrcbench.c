@@ -0,0 +1,178 @@
+/* GStreamer
+ * Copyright (C) 2010 United States Government, Joshua M. Doe <oss@nvl.army.mil>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Times the slice-by-8 gst_klv_crc16_ccitt(), which hashes payloads for the
+ * KLV payload cache, against a table lookup per byte, and the ST 0601 16-bit
+ * sum for comparison. Reports nanoseconds per call and MB/s as JSON, and the
+ * exit status is non-zero if the two CRCs disagree. */
+
+#include <gst/gst.h>
+
+#include "klv.h"
+#include "klvst0601.h"
+
+static const gsize sizes[] = { 64, 256, 1024, 4096 };
+
+static guint16 bytewise_table[256];
+
+static void
+init_bytewise_table (void)
+{
+  guint i, j;
+
+  for (i = 0; i < 256; i++) {
+    guint16 crc = i << 8;
+
+    for (j = 0; j < 8; j++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    bytewise_table[i] = crc;
+  }
+}
+
+static guint16
+crc16_bytewise (const guint8 * data, gsize size)
+{
+  guint16 crc = 0xffff;
+
+  while (size--)
+    crc = (crc << 8) ^ bytewise_table[(crc >> 8) ^ *data++];
+
+  return crc;
+}
+
+static void
+append_result (GString * json, const gchar * name, gsize size, gint64 elapsed,
+    gint iterations)
+{
+  gchar num[G_ASCII_DTOSTR_BUF_SIZE];
+  gdouble ns = MAX (elapsed * 1000.0 / iterations, 0.001);
+
+  g_string_append_printf (json, "%s\n    {\"size\": %" G_GSIZE_FORMAT ", "
+      "\"function\": \"%s\", ", json->str[json->len - 1] == '[' ? "" : ",",
+      size, name);
+  g_string_append_printf (json, "\"ns\": %s, ",
+      g_ascii_formatd (num, sizeof (num), "%.1f", ns));
+  g_string_append_printf (json, "\"mb_per_s\": %s}",
+      g_ascii_formatd (num, sizeof (num), "%.1f", size * 1000.0 / ns));
+}
+
+static gboolean
+run_size (gsize size, gint iterations, GString * json)
+{
+  guint8 *data = g_malloc (size);
+  volatile guint16 sink = 0;
+  guint16 expected;
+  gboolean valid;
+  gint64 start;
+  gsize i;
+  gint n;
+
+  for (i = 0; i < size; i++)
+    data[i] = (guint8) (i * 7 + 1);
+
+  expected = crc16_bytewise (data, size);
+  valid = gst_klv_crc16_ccitt (data, size) == expected;
+
+  start = g_get_monotonic_time ();
+  for (n = 0; n < iterations; n++)
+    sink ^= crc16_bytewise (data, size);
+  append_result (json, "bytewise", size, g_get_monotonic_time () - start,
+      iterations);
+
+  start = g_get_monotonic_time ();
+  for (n = 0; n < iterations; n++)
+    sink ^= gst_klv_crc16_ccitt (data, size);
+  append_result (json, "slice-by-8", size, g_get_monotonic_time () - start,
+      iterations);
+
+  start = g_get_monotonic_time ();
+  for (n = 0; n < iterations; n++)
+    sink ^= gst_klv_st0601_checksum (data, size);
+  append_result (json, "st0601-sum", size, g_get_monotonic_time () - start,
+      iterations);
+
+  g_free (data);
+
+  if (!valid)
+    g_printerr ("slice-by-8 CRC differs for %" G_GSIZE_FORMAT " bytes\n",
+        size);
+
+  return valid;
+}
+
+int
+main (int argc, char *argv[])
+{
+  gint iterations = 100000;
+  gchar *output = NULL;
+  GOptionEntry entries[] = {
+    {"iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+        "Number of timed calls per measurement", "N"},
+    {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+        "Write the JSON report to FILE instead of stdout", "FILE"},
+    {NULL}
+  };
+  GOptionContext *ctx;
+  GError *err = NULL;
+  GString *json;
+  gboolean valid = TRUE;
+  guint i;
+
+  ctx = g_option_context_new ("- benchmark KLV checksums");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    g_printerr ("Error initializing: %s\n", err->message);
+    g_clear_error (&err);
+    g_option_context_free (ctx);
+    return 1;
+  }
+  g_option_context_free (ctx);
+
+  if (iterations < 1) {
+    g_printerr ("Number of iterations must be positive\n");
+    return 1;
+  }
+
+  init_bytewise_table ();
+
+  json = g_string_new (NULL);
+  g_string_append_printf (json, "{\n  \"benchmark\": \"klv-crc\",\n"
+      "  \"iterations\": %d,\n  \"results\": [", iterations);
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++) {
+    if (!run_size (sizes[i], iterations, json))
+      valid = FALSE;
+  }
+  g_string_append (json, "\n  ]\n}\n");
+
+  if (output) {
+    if (!g_file_set_contents (output, json->str, json->len, &err)) {
+      g_printerr ("Failed to write %s: %s\n", output, err->message);
+      g_clear_error (&err);
+      valid = FALSE;
+    }
+  } else {
+    g_print ("%s", json->str);
+  }
+
+  g_string_free (json, TRUE);
+  g_free (output);
+
+  return valid ? 0 : 1;
+}
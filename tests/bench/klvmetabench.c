@@ -0,0 +1,221 @@
+/* GStreamer
+ * Copyright (C) 2010 United States Government, Joshua M. Doe <oss@nvl.army.mil>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Times adding, reading and copying a KLV meta for each way of storing the
+ * payload and reports nanoseconds per operation as JSON. "bytes" is how
+ * every meta was stored before small packets were kept inline, "inline" is
+ * gst_buffer_add_klv_meta_from_data() and "memory" references a GstMemory
+ * without copying. */
+
+#include <string.h>
+
+#include <gst/gst.h>
+
+#include "klv.h"
+
+typedef enum
+{
+  PATH_BYTES,
+  PATH_INLINE,
+  PATH_MEMORY
+} KLVPath;
+
+static const gchar *path_names[] = { "bytes", "inline", "memory" };
+
+static const gsize sizes[] = { 64, 200, 256, 1024 };
+
+static const guint8 st0601_key[16] = {
+  0x06, 0x0E, 0x2B, 0x34, 0x02, 0x0B, 0x01, 0x01,
+  0x0E, 0x01, 0x03, 0x01, 0x01, 0x00, 0x00, 0x00
+};
+
+static GstKLVMeta *
+add_meta (GstBuffer * buffer, KLVPath path, const guint8 * data, gsize size,
+    GstMemory * memory)
+{
+  switch (path) {
+    case PATH_BYTES:
+      return gst_buffer_add_klv_meta_take_bytes (buffer,
+          g_bytes_new (data, size));
+    case PATH_INLINE:
+      return gst_buffer_add_klv_meta_from_data (buffer, data, size);
+    default:
+      return gst_buffer_add_klv_meta_from_memory (buffer, memory, 0, size);
+  }
+}
+
+static gdouble
+ns_per_op (gint64 start, gint iterations)
+{
+  return (g_get_monotonic_time () - start) * 1000.0 / iterations;
+}
+
+static gboolean
+run_path (KLVPath path, gsize size, gint iterations, GString * json)
+{
+  guint8 *data = g_malloc (size);
+  GstMemory *memory;
+  GstBuffer *buffer;
+  GstKLVMeta *meta;
+  const guint8 *out;
+  gsize out_size;
+  gdouble add_ns, get_ns, get_bytes_ns, copy_ns;
+  gchar num[G_ASCII_DTOSTR_BUF_SIZE];
+  gboolean valid;
+  gint64 start;
+  gsize i;
+  gint n;
+
+  /* an ST 0601 packet with a BER short or long form length, the value is
+   * filler since only the key is checked */
+  memcpy (data, st0601_key, sizeof (st0601_key));
+  if (size - 17 < 128) {
+    data[16] = size - 17;
+    i = 17;
+  } else {
+    data[16] = 0x82;
+    GST_WRITE_UINT16_BE (data + 17, size - 19);
+    i = 19;
+  }
+  for (; i < size; i++)
+    data[i] = (guint8) (i * 7 + 1);
+  memory = gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY, data, size, 0,
+      size, NULL, NULL);
+
+  start = g_get_monotonic_time ();
+  for (n = 0; n < iterations; n++) {
+    buffer = gst_buffer_new ();
+    add_meta (buffer, path, data, size, memory);
+    gst_buffer_unref (buffer);
+  }
+  add_ns = ns_per_op (start, iterations);
+
+  buffer = gst_buffer_new ();
+  add_meta (buffer, path, data, size, memory);
+
+  start = g_get_monotonic_time ();
+  for (n = 0; n < iterations; n++) {
+    meta = gst_buffer_get_klv_meta (buffer);
+    out = gst_klv_meta_get_data (meta, &out_size);
+  }
+  get_ns = ns_per_op (start, iterations);
+  valid = out_size == size && memcmp (out, data, size) == 0;
+
+  start = g_get_monotonic_time ();
+  for (n = 0; n < iterations; n++) {
+    GBytes *bytes = gst_klv_meta_get_bytes (gst_buffer_get_klv_meta (buffer));
+
+    valid &= g_bytes_get_size (bytes) == size;
+  }
+  get_bytes_ns = ns_per_op (start, iterations);
+
+  /* copies a fresh buffer each time so the GBytes created above doesn't
+   * decide which path the copy takes */
+  gst_buffer_unref (buffer);
+  buffer = gst_buffer_new ();
+  add_meta (buffer, path, data, size, memory);
+
+  start = g_get_monotonic_time ();
+  for (n = 0; n < iterations; n++)
+    gst_buffer_unref (gst_buffer_copy (buffer));
+  copy_ns = ns_per_op (start, iterations);
+
+  gst_buffer_unref (buffer);
+  gst_memory_unref (memory);
+  g_free (data);
+
+  g_string_append_printf (json, "%s\n    {\"size\": %" G_GSIZE_FORMAT ", "
+      "\"path\": \"%s\", ", json->str[json->len - 1] == '[' ? "" : ",", size,
+      path_names[path]);
+  g_string_append_printf (json, "\"add_ns\": %s, ",
+      g_ascii_formatd (num, sizeof (num), "%.1f", add_ns));
+  g_string_append_printf (json, "\"get_ns\": %s, ",
+      g_ascii_formatd (num, sizeof (num), "%.1f", get_ns));
+  g_string_append_printf (json, "\"get_bytes_ns\": %s, ",
+      g_ascii_formatd (num, sizeof (num), "%.1f", get_bytes_ns));
+  g_string_append_printf (json, "\"copy_ns\": %s}",
+      g_ascii_formatd (num, sizeof (num), "%.1f", copy_ns));
+
+  if (!valid)
+    g_printerr ("%s path returned wrong data for %" G_GSIZE_FORMAT " bytes\n",
+        path_names[path], size);
+
+  return valid;
+}
+
+int
+main (int argc, char *argv[])
+{
+  gint iterations = 100000;
+  gchar *output = NULL;
+  GOptionEntry entries[] = {
+    {"iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+        "Number of timed operations per measurement", "N"},
+    {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+        "Write the JSON report to FILE instead of stdout", "FILE"},
+    {NULL}
+  };
+  GOptionContext *ctx;
+  GError *err = NULL;
+  GString *json;
+  gboolean valid = TRUE;
+  guint i, path;
+
+  ctx = g_option_context_new ("- benchmark KLV meta storage");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    g_printerr ("Error initializing: %s\n", err->message);
+    g_clear_error (&err);
+    g_option_context_free (ctx);
+    return 1;
+  }
+  g_option_context_free (ctx);
+
+  if (iterations < 1) {
+    g_printerr ("Number of iterations must be positive\n");
+    return 1;
+  }
+
+  json = g_string_new (NULL);
+  g_string_append_printf (json, "{\n  \"benchmark\": \"klv-meta\",\n"
+      "  \"iterations\": %d,\n  \"results\": [", iterations);
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++) {
+    for (path = PATH_BYTES; path <= PATH_MEMORY; path++) {
+      if (!run_path (path, sizes[i], iterations, json))
+        valid = FALSE;
+    }
+  }
+  g_string_append (json, "\n  ]\n}\n");
+
+  if (output) {
+    if (!g_file_set_contents (output, json->str, json->len, &err)) {
+      g_printerr ("Failed to write %s: %s\n", output, err->message);
+      g_clear_error (&err);
+      valid = FALSE;
+    }
+  } else {
+    g_print ("%s", json->str);
+  }
+
+  g_string_free (json, TRUE);
+  g_free (output);
+
+  return valid ? 0 : 1;
+}
@@ -0,0 +1,234 @@
+/* GStreamer
+ * Copyright (C) 2010 United States Government, Joshua M. Doe <oss@nvl.army.mil>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Times misbirpack ! misbirunpack round trips on synthetic GRAY16 frames and
+ * reports throughput and latency percentiles as JSON. Every output frame is
+ * compared against its input outside the timed section, and the exit status
+ * is non-zero if any of them differ. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gst/gst.h>
+#include <gst/check/gstharness.h>
+#include <gst/video/video.h>
+
+#define WARMUP_FRAMES 5
+
+static const struct
+{
+  gint width;
+  gint height;
+} resolutions[] = {
+  {320, 256}, {640, 480}, {640, 512}, {1280, 720}, {1280, 1024}, {1920, 1080}
+};
+
+static gint
+compare_gint64 (gconstpointer a, gconstpointer b)
+{
+  gint64 x = *(const gint64 *) a, y = *(const gint64 *) b;
+
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* nearest rank on sorted latencies, in milliseconds */
+static gdouble
+percentile_ms (const gint64 * sorted, gint n, gint p)
+{
+  gint rank = (p * n + 99) / 100;
+
+  return sorted[CLAMP (rank, 1, n) - 1] / 1000.0;
+}
+
+static GstBuffer *
+make_frame (GstVideoInfo * info, guint32 seed)
+{
+  GstBuffer *buf = gst_buffer_new_allocate (NULL, info->size, NULL);
+  GRand *rand = g_rand_new_with_seed (seed);
+  GstMapInfo map;
+  gsize i;
+
+  gst_buffer_map (buf, &map, GST_MAP_WRITE);
+  for (i = 0; i < map.size; i++)
+    map.data[i] = (guint8) g_rand_int (rand);
+  gst_buffer_unmap (buf, &map);
+  g_rand_free (rand);
+
+  return buf;
+}
+
+static gboolean
+frames_equal (GstVideoInfo * info, GstBuffer * a, GstBuffer * b)
+{
+  GstVideoFrame fa, fb;
+  gboolean equal = TRUE;
+  gint y;
+
+  if (!gst_video_frame_map (&fa, info, a, GST_MAP_READ))
+    return FALSE;
+  if (!gst_video_frame_map (&fb, info, b, GST_MAP_READ)) {
+    gst_video_frame_unmap (&fa);
+    return FALSE;
+  }
+
+  for (y = 0; y < GST_VIDEO_INFO_HEIGHT (info) && equal; y++) {
+    equal = memcmp ((guint8 *) GST_VIDEO_FRAME_PLANE_DATA (&fa, 0) +
+        y * GST_VIDEO_FRAME_PLANE_STRIDE (&fa, 0),
+        (guint8 *) GST_VIDEO_FRAME_PLANE_DATA (&fb, 0) +
+        y * GST_VIDEO_FRAME_PLANE_STRIDE (&fb, 0),
+        2 * GST_VIDEO_INFO_WIDTH (info)) == 0;
+  }
+
+  gst_video_frame_unmap (&fb);
+  gst_video_frame_unmap (&fa);
+
+  return equal;
+}
+
+static gboolean
+run_resolution (gint width, gint height, gint frames, GString * json)
+{
+  GstHarness *h = gst_harness_new_parse ("misbirpack offset=64 ! "
+      "misbirunpack offset=-64");
+  GstVideoInfo info;
+  GstBuffer *in;
+  gint64 *latency = g_new (gint64, frames);
+  gint64 total = 0;
+  gboolean exact = TRUE;
+  gchar num[G_ASCII_DTOSTR_BUF_SIZE];
+  gint i;
+
+  gst_video_info_set_format (&info, GST_VIDEO_FORMAT_GRAY16_LE, width,
+      height);
+  GST_VIDEO_INFO_FPS_N (&info) = 30;
+  GST_VIDEO_INFO_FPS_D (&info) = 1;
+  gst_harness_set_src_caps (h, gst_video_info_to_caps (&info));
+
+  in = make_frame (&info, width * height);
+
+  for (i = -WARMUP_FRAMES; i < frames; i++) {
+    GstBuffer *out;
+    gint64 start = g_get_monotonic_time ();
+
+    out = gst_harness_push_and_pull (h, gst_buffer_ref (in));
+
+    if (i >= 0) {
+      latency[i] = g_get_monotonic_time () - start;
+      total += latency[i];
+    }
+
+    if (out == NULL) {
+      g_printerr ("%dx%d: no output frame\n", width, height);
+      exact = FALSE;
+      break;
+    }
+
+    if (!frames_equal (&info, in, out))
+      exact = FALSE;
+    gst_buffer_unref (out);
+  }
+
+  if (i == frames) {
+    qsort (latency, frames, sizeof (gint64), compare_gint64);
+
+    g_string_append_printf (json, "%s\n    {\"width\": %d, \"height\": %d, "
+        "\"frames\": %d, \"exact\": %s, ", json->str[json->len - 1] == '['
+        ? "" : ",", width, height, frames, exact ? "true" : "false");
+    g_string_append_printf (json, "\"mpix_per_s\": %s, ",
+        g_ascii_formatd (num, sizeof (num), "%.1f",
+            (gdouble) width * height * frames / MAX (total, 1)));
+    g_string_append_printf (json, "\"latency_ms\": {\"p50\": %s, ",
+        g_ascii_formatd (num, sizeof (num), "%.3f",
+            percentile_ms (latency, frames, 50)));
+    g_string_append_printf (json, "\"p95\": %s, ",
+        g_ascii_formatd (num, sizeof (num), "%.3f",
+            percentile_ms (latency, frames, 95)));
+    g_string_append_printf (json, "\"p99\": %s}}",
+        g_ascii_formatd (num, sizeof (num), "%.3f",
+            percentile_ms (latency, frames, 99)));
+  }
+
+  if (!exact)
+    g_printerr ("%dx%d: round trip is not bit exact\n", width, height);
+
+  gst_buffer_unref (in);
+  g_free (latency);
+  gst_harness_teardown (h);
+
+  return exact;
+}
+
+int
+main (int argc, char *argv[])
+{
+  gint frames = 200;
+  gchar *output = NULL;
+  GOptionEntry entries[] = {
+    {"frames", 'n', 0, G_OPTION_ARG_INT, &frames,
+        "Number of timed frames per resolution", "N"},
+    {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+        "Write the JSON report to FILE instead of stdout", "FILE"},
+    {NULL}
+  };
+  GOptionContext *ctx;
+  GError *err = NULL;
+  GString *json;
+  gboolean exact = TRUE;
+  guint i;
+
+  ctx = g_option_context_new ("- benchmark MISB IR pack/unpack round trips");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    g_printerr ("Error initializing: %s\n", err->message);
+    g_clear_error (&err);
+    g_option_context_free (ctx);
+    return 1;
+  }
+  g_option_context_free (ctx);
+
+  if (frames < 1) {
+    g_printerr ("Number of frames must be positive\n");
+    return 1;
+  }
+
+  json = g_string_new ("{\n  \"benchmark\": \"misb-round-trip\",\n"
+      "  \"results\": [");
+  for (i = 0; i < G_N_ELEMENTS (resolutions); i++) {
+    if (!run_resolution (resolutions[i].width, resolutions[i].height, frames,
+            json))
+      exact = FALSE;
+  }
+  g_string_append (json, "\n  ]\n}\n");
+
+  if (output) {
+    if (!g_file_set_contents (output, json->str, json->len, &err)) {
+      g_printerr ("Failed to write %s: %s\n", output, err->message);
+      g_clear_error (&err);
+      exact = FALSE;
+    }
+  } else {
+    g_print ("%s", json->str);
+  }
+
+  g_string_free (json, TRUE);
+  g_free (output);
+
+  return exact ? 0 : 1;
+}
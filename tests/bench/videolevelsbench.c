@@ -0,0 +1,455 @@
+/* GStreamer
+ * Copyright (C) 2010 United States Government, Joshua M. Doe <oss@nvl.army.mil>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Times videolevels on synthetic GRAY16 frames and reports throughput and
+ * latency percentiles as JSON: the lookup table at 10 to 16 bits, auto
+ * adjustment on 4K frames at several sample steps, and adaptive mode on
+ * 1080p frames with an increasing number of threads. Every output frame is
+ * checked outside the timed section, and the exit status is non-zero if any
+ * of them is wrong. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gst/gst.h>
+#include <gst/check/gstharness.h>
+#include <gst/video/video.h>
+
+#define WARMUP_FRAMES 5
+
+static const gint depths[] = { 10, 12, 14, 16 };
+
+static const guint sample_steps[] = { 1, 2, 4, 8 };
+
+static const guint thread_counts[] = { 1, 2, 4, 8 };
+
+/* how far sampled auto levels may be from those of the full frame */
+#define LEVEL_TOLERANCE 256
+
+typedef void (*PrepareFunc) (GstHarness * h);
+typedef gboolean (*CheckFunc) (GstVideoFrame * in, GstVideoFrame * out,
+    gpointer user_data);
+
+static gint
+compare_gint64 (gconstpointer a, gconstpointer b)
+{
+  gint64 x = *(const gint64 *) a, y = *(const gint64 *) b;
+
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* nearest rank on sorted latencies, in milliseconds */
+static gdouble
+percentile_ms (const gint64 * sorted, gint n, gint p)
+{
+  gint rank = (p * n + 99) / 100;
+
+  return sorted[CLAMP (rank, 1, n) - 1] / 1000.0;
+}
+
+static void
+set_info (GstVideoInfo * info, gint width, gint height)
+{
+  gst_video_info_set_format (info, GST_VIDEO_FORMAT_GRAY16_LE, width,
+      height);
+  GST_VIDEO_INFO_FPS_N (info) = 30;
+  GST_VIDEO_INFO_FPS_D (info) = 1;
+}
+
+/* a frame of random @bpp bit values */
+static GstBuffer *
+make_frame (GstVideoInfo * info, gint bpp, guint32 seed)
+{
+  GstBuffer *buf = gst_buffer_new_allocate (NULL, info->size, NULL);
+  GRand *rand = g_rand_new_with_seed (seed);
+  const guint16 mask = (1 << bpp) - 1;
+  GstVideoFrame frame;
+  gint x, y;
+
+  gst_video_frame_map (&frame, info, buf, GST_MAP_WRITE);
+  for (y = 0; y < GST_VIDEO_INFO_HEIGHT (info); y++) {
+    guint16 *line = (guint16 *) ((guint8 *)
+        GST_VIDEO_FRAME_PLANE_DATA (&frame, 0) +
+        y * GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0));
+
+    for (x = 0; x < GST_VIDEO_INFO_WIDTH (info); x++)
+      line[x] = GUINT16_TO_LE (g_rand_int (rand) & mask);
+  }
+  gst_video_frame_unmap (&frame);
+  g_rand_free (rand);
+
+  return buf;
+}
+
+/* @element is configured before the harness starts it, which matters for
+ * properties that are applied when starting */
+static GstHarness *
+setup_harness (GstElement * element, GstVideoInfo * info, gint bpp)
+{
+  GstHarness *h = gst_harness_new_with_element (element, "sink", "src");
+  GstCaps *caps = gst_video_info_to_caps (info);
+
+  gst_object_unref (element);
+  gst_caps_set_simple (caps, "bpp", G_TYPE_INT, bpp, NULL);
+  gst_harness_set_src_caps (h, caps);
+
+  return h;
+}
+
+static gboolean
+check_frame (GstHarness * h, GstVideoInfo * in_info, GstBuffer * in,
+    GstBuffer * out, CheckFunc check, gpointer user_data)
+{
+  GstCaps *caps = gst_pad_get_current_caps (h->sinkpad);
+  GstVideoInfo out_info;
+  GstVideoFrame fin, fout;
+  gboolean ok;
+
+  ok = caps != NULL && gst_video_info_from_caps (&out_info, caps);
+  if (caps)
+    gst_caps_unref (caps);
+  if (!ok || !gst_video_frame_map (&fin, in_info, in, GST_MAP_READ))
+    return FALSE;
+  if (!gst_video_frame_map (&fout, &out_info, out, GST_MAP_READ)) {
+    gst_video_frame_unmap (&fin);
+    return FALSE;
+  }
+
+  ok = check (&fin, &fout, user_data);
+
+  gst_video_frame_unmap (&fout);
+  gst_video_frame_unmap (&fin);
+
+  return ok;
+}
+
+/* Pushes @in through @h for @frames timed frames after a warmup, and appends
+ * a JSON object with @fields and the timing to @json. @prepare runs before
+ * each push and @check on each output, both outside the timed section.
+ * Returns FALSE if an output is missing or fails @check. */
+static gboolean
+time_frames (GstHarness * h, GstVideoInfo * info, GstBuffer * in, gint frames,
+    PrepareFunc prepare, CheckFunc check, gpointer user_data,
+    const gchar * fields, GString * json)
+{
+  gint64 *latency = g_new (gint64, frames);
+  gint64 total = 0;
+  gboolean exact = TRUE;
+  gchar num[G_ASCII_DTOSTR_BUF_SIZE];
+  gint i;
+
+  for (i = -WARMUP_FRAMES; i < frames; i++) {
+    GstBuffer *out;
+    gint64 start;
+
+    if (prepare)
+      prepare (h);
+
+    start = g_get_monotonic_time ();
+    out = gst_harness_push_and_pull (h, gst_buffer_ref (in));
+
+    if (i >= 0) {
+      latency[i] = g_get_monotonic_time () - start;
+      total += latency[i];
+    }
+
+    if (out == NULL) {
+      g_printerr ("%s: no output frame\n", fields);
+      exact = FALSE;
+      break;
+    }
+
+    if (!check_frame (h, info, in, out, check, user_data))
+      exact = FALSE;
+    gst_buffer_unref (out);
+  }
+
+  if (i == frames) {
+    qsort (latency, frames, sizeof (gint64), compare_gint64);
+
+    g_string_append_printf (json, "%s\n    {%s, \"width\": %d, "
+        "\"height\": %d, \"frames\": %d, \"exact\": %s, ",
+        json->str[json->len - 1] == '[' ? "" : ",", fields,
+        GST_VIDEO_INFO_WIDTH (info), GST_VIDEO_INFO_HEIGHT (info), frames,
+        exact ? "true" : "false");
+    g_string_append_printf (json, "\"mpix_per_s\": %s, ",
+        g_ascii_formatd (num, sizeof (num), "%.1f",
+            (gdouble) GST_VIDEO_INFO_WIDTH (info) *
+            GST_VIDEO_INFO_HEIGHT (info) * frames / MAX (total, 1)));
+    g_string_append_printf (json, "\"latency_ms\": {\"p50\": %s, ",
+        g_ascii_formatd (num, sizeof (num), "%.3f",
+            percentile_ms (latency, frames, 50)));
+    g_string_append_printf (json, "\"p95\": %s, ",
+        g_ascii_formatd (num, sizeof (num), "%.3f",
+            percentile_ms (latency, frames, 95)));
+    g_string_append_printf (json, "\"p99\": %s}}",
+        g_ascii_formatd (num, sizeof (num), "%.3f",
+            percentile_ms (latency, frames, 99)));
+  }
+
+  if (!exact)
+    g_printerr ("%s: wrong output\n", fields);
+
+  g_free (latency);
+
+  return exact;
+}
+
+static gboolean
+check_lut (GstVideoFrame * in, GstVideoFrame * out, gpointer user_data)
+{
+  const guint8 *lut = user_data;
+  gint x, y;
+
+  for (y = 0; y < GST_VIDEO_FRAME_HEIGHT (in); y++) {
+    const guint16 *src = (const guint16 *) ((const guint8 *)
+        GST_VIDEO_FRAME_PLANE_DATA (in, 0) +
+        y * GST_VIDEO_FRAME_PLANE_STRIDE (in, 0));
+    const guint8 *dst = (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA (out, 0) +
+        y * GST_VIDEO_FRAME_PLANE_STRIDE (out, 0);
+
+    for (x = 0; x < GST_VIDEO_FRAME_WIDTH (in); x++) {
+      if (dst[x] != lut[GUINT16_FROM_LE (src[x])])
+        return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* inverted levels are the mapping that still goes through the table, which
+ * has one entry per @bpp bit value */
+static gboolean
+run_depth (gint bpp, gint frames, GString * json)
+{
+  const gint max_in = (1 << bpp) - 1;
+  guint8 *lut = g_new (guint8, 1 << bpp);
+  GstElement *element;
+  GstHarness *h;
+  GstVideoInfo info;
+  GstBuffer *in;
+  gchar *fields;
+  gdouble m, b;
+  gboolean exact;
+  gint i;
+
+  /* the same arithmetic as the element */
+  m = 255 / (gdouble) (0 - max_in);
+  b = 0 - m * max_in;
+  for (i = 0; i <= max_in; i++)
+    lut[i] = (guint8) CLAMP (m * i + b, 0, 255);
+
+  set_info (&info, 1920, 1080);
+  element = gst_element_factory_make ("videolevels", NULL);
+  g_object_set (element, "lower-input-level", max_in, "upper-input-level", 0,
+      NULL);
+  h = setup_harness (element, &info, bpp);
+  in = make_frame (&info, bpp, bpp);
+
+  fields = g_strdup_printf ("\"case\": \"lut\", \"bpp\": %d", bpp);
+  exact = time_frames (h, &info, in, frames, NULL, check_lut, lut, fields,
+      json);
+
+  g_free (fields);
+  gst_buffer_unref (in);
+  gst_harness_teardown (h);
+  g_free (lut);
+
+  return exact;
+}
+
+static void
+rearm_single (GstHarness * h)
+{
+  gst_util_set_object_arg (G_OBJECT (h->element), "auto", "single");
+}
+
+/* uniform frames saturate 1% at each end, which sampling must preserve */
+static gboolean
+check_levels (GstVideoFrame * in, GstVideoFrame * out, gpointer user_data)
+{
+  const gint expected = 65536 / 100;
+  gint lower, upper;
+
+  g_object_get (user_data, "lower-input-level", &lower, "upper-input-level",
+      &upper, NULL);
+
+  return ABS (lower - expected) <= LEVEL_TOLERANCE &&
+      ABS (upper - (65535 - expected)) <= LEVEL_TOLERANCE;
+}
+
+/* single auto adjustment builds the histogram on the streaming thread, so
+ * its cost is part of the frame latency */
+static gboolean
+run_sample_step (guint step, gint frames, GString * json)
+{
+  GstElement *element;
+  GstHarness *h;
+  GstVideoInfo info;
+  GstBuffer *in;
+  gchar *fields;
+  gboolean exact;
+
+  set_info (&info, 3840, 2160);
+  element = gst_element_factory_make ("videolevels", NULL);
+  g_object_set (element, "sample-step", step, NULL);
+  h = setup_harness (element, &info, 16);
+  in = make_frame (&info, 16, 16);
+
+  fields = g_strdup_printf ("\"case\": \"auto-single\", \"bpp\": 16, "
+      "\"sample_step\": %u", step);
+  exact = time_frames (h, &info, in, frames, rearm_single, check_levels,
+      h->element, fields, json);
+
+  g_free (fields);
+  gst_buffer_unref (in);
+  gst_harness_teardown (h);
+
+  return exact;
+}
+
+/* the single threaded output, which every thread count must match */
+typedef struct
+{
+  guint8 *pixels;
+  gboolean set;
+} Reference;
+
+static gboolean
+check_reference (GstVideoFrame * in, GstVideoFrame * out, gpointer user_data)
+{
+  Reference *ref = user_data;
+  const gint width = GST_VIDEO_FRAME_WIDTH (out);
+  gint y;
+
+  if (ref->pixels == NULL)
+    ref->pixels = g_new (guint8, width * GST_VIDEO_FRAME_HEIGHT (out));
+
+  for (y = 0; y < GST_VIDEO_FRAME_HEIGHT (out); y++) {
+    const guint8 *line = (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA (out, 0) +
+        y * GST_VIDEO_FRAME_PLANE_STRIDE (out, 0);
+
+    if (!ref->set)
+      memcpy (ref->pixels + y * width, line, width);
+    else if (memcmp (ref->pixels + y * width, line, width) != 0)
+      return FALSE;
+  }
+  ref->set = TRUE;
+
+  return TRUE;
+}
+
+static gboolean
+run_threads (guint n_threads, Reference * ref, gint frames, GString * json)
+{
+  GstElement *element;
+  GstHarness *h;
+  GstVideoInfo info;
+  GstBuffer *in;
+  gchar *fields;
+  gboolean exact;
+
+  set_info (&info, 1920, 1080);
+  element = gst_element_factory_make ("videolevels", NULL);
+  gst_util_set_object_arg (G_OBJECT (element), "mode", "adaptive");
+  g_object_set (element, "n-threads", n_threads, NULL);
+  h = setup_harness (element, &info, 16);
+  in = make_frame (&info, 16, 16);
+
+  fields = g_strdup_printf ("\"case\": \"adaptive\", \"bpp\": 16, "
+      "\"n_threads\": %u", n_threads);
+  exact = time_frames (h, &info, in, frames, NULL, check_reference, ref,
+      fields, json);
+
+  g_free (fields);
+  gst_buffer_unref (in);
+  gst_harness_teardown (h);
+
+  return exact;
+}
+
+int
+main (int argc, char *argv[])
+{
+  gint frames = 200;
+  gchar *output = NULL;
+  GOptionEntry entries[] = {
+    {"frames", 'n', 0, G_OPTION_ARG_INT, &frames,
+        "Number of timed frames per case", "N"},
+    {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+        "Write the JSON report to FILE instead of stdout", "FILE"},
+    {NULL}
+  };
+  GOptionContext *ctx;
+  GError *err = NULL;
+  GString *json;
+  Reference ref = { NULL, FALSE };
+  gboolean exact = TRUE;
+  guint i;
+
+  ctx = g_option_context_new ("- benchmark videolevels");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    g_printerr ("Error initializing: %s\n", err->message);
+    g_clear_error (&err);
+    g_option_context_free (ctx);
+    return 1;
+  }
+  g_option_context_free (ctx);
+
+  if (frames < 1) {
+    g_printerr ("Number of frames must be positive\n");
+    return 1;
+  }
+
+  /* thread scaling means little without the number of processors */
+  json = g_string_new (NULL);
+  g_string_append_printf (json, "{\n  \"benchmark\": \"videolevels\",\n"
+      "  \"processors\": %u,\n  \"results\": [", g_get_num_processors ());
+  for (i = 0; i < G_N_ELEMENTS (depths); i++) {
+    if (!run_depth (depths[i], frames, json))
+      exact = FALSE;
+  }
+  for (i = 0; i < G_N_ELEMENTS (sample_steps); i++) {
+    if (!run_sample_step (sample_steps[i], frames, json))
+      exact = FALSE;
+  }
+  for (i = 0; i < G_N_ELEMENTS (thread_counts); i++) {
+    if (!run_threads (thread_counts[i], &ref, frames, json))
+      exact = FALSE;
+  }
+  g_string_append (json, "\n  ]\n}\n");
+
+  if (output) {
+    if (!g_file_set_contents (output, json->str, json->len, &err)) {
+      g_printerr ("Failed to write %s: %s\n", output, err->message);
+      g_clear_error (&err);
+      exact = FALSE;
+    }
+  } else {
+    g_print ("%s", json->str);
+  }
+
+  g_string_free (json, TRUE);
+  g_free (ref.pixels);
+  g_free (output);
+
+  return exact ? 0 : 1;
+}
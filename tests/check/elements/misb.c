@@ -0,0 +1,320 @@
+/* GStreamer
+ * Copyright (C) 2010 United States Government, Joshua M. Doe <oss@nvl.army.mil>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Checks misbirpack and misbirunpack against ST 0402.2 Method 2, computed
+ * here independently of the element kernels */
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gstharness.h>
+#include <gst/video/video.h>
+
+static const gint widths[] = { 1, 2, 3, 4, 5, 7, 8, 47, 48, 49, 61, 640 };
+
+#define HEIGHT 3
+
+typedef struct
+{
+  gint offset;
+  guint shift;
+  guint luma_mask;
+  guint chroma_mask;
+  gboolean swap;
+} UnpackProps;
+
+static const UnpackProps unpack_props[] = {
+  {-64, 8, 0xff, 0xff, FALSE},
+  {-64, 8, 0xff, 0xff, TRUE},
+  {0, 8, 0xff, 0xff, FALSE},
+  {0, 8, 0x3ff, 0x3ff, FALSE},
+  {-4, 6, 0x3f, 0x3ff, FALSE},
+  {100, 2, 0xffff, 0x3, TRUE},
+  {-0xffff, 15, 0x1, 0xffff, FALSE},
+  {0xffff, 0, 0xf0f0, 0x0f0f, TRUE},
+};
+
+static GstBuffer *
+make_frame (GstVideoInfo * info, GRand * rand)
+{
+  GstBuffer *buf = gst_buffer_new_allocate (NULL, info->size, NULL);
+  GstMapInfo map;
+  gsize i;
+
+  fail_unless (gst_buffer_map (buf, &map, GST_MAP_WRITE));
+  for (i = 0; i < map.size; i++)
+    map.data[i] = (guint8) g_rand_int (rand);
+  gst_buffer_unmap (buf, &map);
+
+  return buf;
+}
+
+static void
+setup_harness (GstHarness * h, GstVideoFormat format, gint width)
+{
+  GstVideoInfo info;
+
+  gst_video_info_set_format (&info, format, width, HEIGHT);
+  GST_VIDEO_INFO_FPS_N (&info) = 30;
+  GST_VIDEO_INFO_FPS_D (&info) = 1;
+  gst_harness_set_src_caps (h, gst_video_info_to_caps (&info));
+}
+
+static void
+map_output (GstHarness * h, GstBuffer * buf, GstVideoFormat format,
+    GstVideoFrame * frame)
+{
+  GstCaps *caps = gst_pad_get_current_caps (h->sinkpad);
+  GstVideoInfo info;
+
+  fail_unless (caps != NULL);
+  fail_unless (gst_video_info_from_caps (&info, caps));
+  gst_caps_unref (caps);
+
+  fail_unless_equals_int (GST_VIDEO_INFO_FORMAT (&info), format);
+  fail_unless (gst_video_frame_map (frame, &info, buf, GST_MAP_READ));
+}
+
+/* v210 words hold three 10-bit samples, Method 2 puts the GRAY16_LE bytes in
+ * memory order into consecutive samples after adding the offset */
+static guint
+v210_sample (const guint8 * line, gint j)
+{
+  guint32 word = GST_READ_UINT32_LE (line + 4 * (j / 3));
+
+  return (word >> (10 * (j % 3))) & 0x3ff;
+}
+
+static guint16
+unpack_pixel (guint chroma, guint luma, const UnpackProps * props)
+{
+  guint16 offset = (guint16) props->offset;
+  guint c = props->swap ? luma : chroma;
+  guint l = props->swap ? chroma : luma;
+
+  return (guint16) (((c + offset) & props->chroma_mask) |
+      ((l + offset) & props->luma_mask) << props->shift);
+}
+
+GST_START_TEST (test_pack_method2)
+{
+  static const gint offsets[] = { 0, 64, 512, 768 };
+  GRand *rand = g_rand_new_with_seed (402);
+  guint i, w;
+
+  for (i = 0; i < G_N_ELEMENTS (offsets); i++) {
+    for (w = 0; w < G_N_ELEMENTS (widths); w++) {
+      GstHarness *h = gst_harness_new ("misbirpack");
+      GstVideoInfo in_info;
+      GstVideoFrame in_frame, out_frame;
+      GstBuffer *in, *out;
+      gint x, y, j;
+
+      g_object_set (h->element, "offset", offsets[i], NULL);
+      setup_harness (h, GST_VIDEO_FORMAT_GRAY16_LE, widths[w]);
+
+      gst_video_info_set_format (&in_info, GST_VIDEO_FORMAT_GRAY16_LE,
+          widths[w], HEIGHT);
+      in = make_frame (&in_info, rand);
+      fail_unless (gst_video_frame_map (&in_frame, &in_info, in,
+              GST_MAP_READ));
+
+      out = gst_harness_push_and_pull (h, gst_buffer_ref (in));
+      fail_unless (out != NULL);
+      map_output (h, out, GST_VIDEO_FORMAT_v210, &out_frame);
+
+      for (y = 0; y < HEIGHT; y++) {
+        const guint8 *src = (const guint8 *)
+            GST_VIDEO_FRAME_PLANE_DATA (&in_frame, 0) +
+            y * GST_VIDEO_FRAME_PLANE_STRIDE (&in_frame, 0);
+        const guint8 *dst = (const guint8 *)
+            GST_VIDEO_FRAME_PLANE_DATA (&out_frame, 0) +
+            y * GST_VIDEO_FRAME_PLANE_STRIDE (&out_frame, 0);
+
+        for (x = 0; x < widths[w]; x++) {
+          for (j = 2 * x; j < 2 * x + 2; j++) {
+            if (v210_sample (dst, j) != src[j] + offsets[i])
+              fail ("offset %d width %d: sample %d of line %d is %u, "
+                  "expected %u", offsets[i], widths[w], j, y,
+                  v210_sample (dst, j), src[j] + offsets[i]);
+          }
+        }
+      }
+
+      gst_video_frame_unmap (&out_frame);
+      gst_video_frame_unmap (&in_frame);
+      gst_buffer_unref (out);
+      gst_buffer_unref (in);
+      gst_harness_teardown (h);
+    }
+  }
+
+  g_rand_free (rand);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_round_trip)
+{
+  GRand *rand = g_rand_new_with_seed (402);
+  guint w;
+
+  for (w = 0; w < G_N_ELEMENTS (widths); w++) {
+    GstHarness *h = gst_harness_new_parse ("misbirpack offset=64 ! "
+        "misbirunpack offset=-64");
+    GstVideoInfo in_info;
+    GstVideoFrame in_frame, out_frame;
+    GstBuffer *in, *out;
+    gint y;
+
+    setup_harness (h, GST_VIDEO_FORMAT_GRAY16_LE, widths[w]);
+
+    gst_video_info_set_format (&in_info, GST_VIDEO_FORMAT_GRAY16_LE,
+        widths[w], HEIGHT);
+    in = make_frame (&in_info, rand);
+    fail_unless (gst_video_frame_map (&in_frame, &in_info, in, GST_MAP_READ));
+
+    out = gst_harness_push_and_pull (h, gst_buffer_ref (in));
+    fail_unless (out != NULL);
+    map_output (h, out, GST_VIDEO_FORMAT_GRAY16_LE, &out_frame);
+
+    for (y = 0; y < HEIGHT; y++) {
+      const guint8 *src = (const guint8 *)
+          GST_VIDEO_FRAME_PLANE_DATA (&in_frame, 0) +
+          y * GST_VIDEO_FRAME_PLANE_STRIDE (&in_frame, 0);
+      const guint8 *dst = (const guint8 *)
+          GST_VIDEO_FRAME_PLANE_DATA (&out_frame, 0) +
+          y * GST_VIDEO_FRAME_PLANE_STRIDE (&out_frame, 0);
+
+      if (memcmp (src, dst, 2 * widths[w]) != 0)
+        fail ("width %d: line %d differs after round trip", widths[w], y);
+    }
+
+    gst_video_frame_unmap (&out_frame);
+    gst_video_frame_unmap (&in_frame);
+    gst_buffer_unref (out);
+    gst_buffer_unref (in);
+    gst_harness_teardown (h);
+  }
+
+  g_rand_free (rand);
+}
+
+GST_END_TEST;
+
+static void
+check_unpack (GstVideoFormat format)
+{
+  GRand *rand = g_rand_new_with_seed (402);
+  guint i, w;
+
+  for (i = 0; i < G_N_ELEMENTS (unpack_props); i++) {
+    const UnpackProps *props = &unpack_props[i];
+
+    for (w = 0; w < G_N_ELEMENTS (widths); w++) {
+      GstHarness *h = gst_harness_new ("misbirunpack");
+      GstVideoInfo in_info;
+      GstVideoFrame in_frame, out_frame;
+      GstBuffer *in, *out;
+      gint x, y;
+
+      g_object_set (h->element, "offset", props->offset, "shift",
+          props->shift, "luma-mask", props->luma_mask, "chroma-mask",
+          props->chroma_mask, "swap", props->swap, NULL);
+      setup_harness (h, format, widths[w]);
+
+      /* random v210 words also exercise the two bits above each byte */
+      gst_video_info_set_format (&in_info, format, widths[w], HEIGHT);
+      in = make_frame (&in_info, rand);
+      fail_unless (gst_video_frame_map (&in_frame, &in_info, in,
+              GST_MAP_READ));
+
+      /* UYVY output has the same size, so pushing our only reference also
+       * covers unpacking in place */
+      out = gst_harness_push_and_pull (h, gst_buffer_copy_deep (in));
+      fail_unless (out != NULL);
+      map_output (h, out, GST_VIDEO_FORMAT_GRAY16_LE, &out_frame);
+
+      for (y = 0; y < HEIGHT; y++) {
+        const guint8 *src = (const guint8 *)
+            GST_VIDEO_FRAME_PLANE_DATA (&in_frame, 0) +
+            y * GST_VIDEO_FRAME_PLANE_STRIDE (&in_frame, 0);
+        const guint8 *dst = (const guint8 *)
+            GST_VIDEO_FRAME_PLANE_DATA (&out_frame, 0) +
+            y * GST_VIDEO_FRAME_PLANE_STRIDE (&out_frame, 0);
+
+        for (x = 0; x < widths[w]; x++) {
+          guint chroma, luma;
+          guint16 expected;
+
+          if (format == GST_VIDEO_FORMAT_v210) {
+            chroma = v210_sample (src, 2 * x);
+            luma = v210_sample (src, 2 * x + 1);
+          } else {
+            chroma = src[2 * x];
+            luma = src[2 * x + 1];
+          }
+          expected = unpack_pixel (chroma, luma, props);
+
+          if (GST_READ_UINT16_LE (dst + 2 * x) != expected)
+            fail ("%s props %u width %d: pixel %d of line %d is 0x%04x, "
+                "expected 0x%04x", gst_video_format_to_string (format), i,
+                widths[w], x, y, GST_READ_UINT16_LE (dst + 2 * x), expected);
+        }
+      }
+
+      gst_video_frame_unmap (&out_frame);
+      gst_video_frame_unmap (&in_frame);
+      gst_buffer_unref (out);
+      gst_buffer_unref (in);
+      gst_harness_teardown (h);
+    }
+  }
+
+  g_rand_free (rand);
+}
+
+GST_START_TEST (test_unpack_v210)
+{
+  check_unpack (GST_VIDEO_FORMAT_v210);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_unpack_uyvy)
+{
+  check_unpack (GST_VIDEO_FORMAT_UYVY);
+}
+
+GST_END_TEST;
+
+static Suite *
+misb_suite (void)
+{
+  Suite *s = suite_create ("misb");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_pack_method2);
+  tcase_add_test (tc_chain, test_round_trip);
+  tcase_add_test (tc_chain, test_unpack_v210);
+  tcase_add_test (tc_chain, test_unpack_uyvy);
+
+  return s;
+}
+
+GST_CHECK_MAIN (misb);
@@ -0,0 +1,526 @@
+/* GStreamer
+ * Copyright (C) 2010 United States Government, Joshua M. Doe <oss@nvl.army.mil>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Checks the structure and strength of the sfx3dnoise components, with and
+ * without the noise bank, and the generator behind them, which is built from
+ * the plugin sources since it isn't exported */
+
+#include <math.h>
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gstharness.h>
+#include <gst/video/video.h>
+
+#include "gst/sensorfx/gstsensorfxrandom.h"
+
+static const gint formats[] = { GST_VIDEO_FORMAT_GRAY8,
+  GST_VIDEO_FORMAT_GRAY16_LE
+};
+
+static const guint bank_sizes[] = { 0, 8 };
+
+#define WIDTH 61
+#define HEIGHT 7
+
+/* the padding of the padded stride frames */
+#define PADDING 35
+#define PAD_BYTE 0xa5
+
+static void
+setup_harness (GstHarness * h, GstVideoFormat format, gint width, gint height)
+{
+  GstVideoInfo info;
+
+  gst_video_info_set_format (&info, format, width, height);
+  GST_VIDEO_INFO_FPS_N (&info) = 30;
+  GST_VIDEO_INFO_FPS_D (&info) = 1;
+  gst_harness_set_src_caps (h, gst_video_info_to_caps (&info));
+}
+
+static guint
+get_pixel (const guint8 * line, gint x, gint depth)
+{
+  return depth == 8 ? line[x] : GST_READ_UINT16_LE (line + 2 * x);
+}
+
+static void
+set_pixel (guint8 * line, gint x, gint depth, guint value)
+{
+  if (depth == 8)
+    line[x] = (guint8) value;
+  else
+    GST_WRITE_UINT16_LE (line + 2 * x, value);
+}
+
+/* the default stride rounds lines up to four bytes, @padding adds to it */
+static gint
+get_stride (GstVideoFormat format, gint width, gint padding)
+{
+  GstVideoInfo info;
+
+  gst_video_info_set_format (&info, format, width, 1);
+  return GST_VIDEO_INFO_PLANE_STRIDE (&info, 0) + padding;
+}
+
+/* Makes a frame of @value, or random pixels if @rand is given, with @padding
+ * more bytes after each line described by a GstVideoMeta */
+static GstBuffer *
+make_frame (GstVideoFormat format, gint width, gint height, gint padding,
+    guint value, GRand * rand)
+{
+  gint depth = format == GST_VIDEO_FORMAT_GRAY8 ? 8 : 16;
+  gint stride = get_stride (format, width, padding);
+  gsize offset[GST_VIDEO_MAX_PLANES] = { 0, };
+  gint strides[GST_VIDEO_MAX_PLANES] = { stride, };
+  GstBuffer *buf = gst_buffer_new_allocate (NULL, stride * height, NULL);
+  GstMapInfo map;
+  gint x, y;
+
+  fail_unless (gst_buffer_map (buf, &map, GST_MAP_WRITE));
+  memset (map.data, PAD_BYTE, map.size);
+  for (y = 0; y < height; y++) {
+    for (x = 0; x < width; x++)
+      set_pixel (map.data + y * stride, x, depth,
+          rand ? g_rand_int_range (rand, 0, 1 << depth) : value);
+  }
+  gst_buffer_unmap (buf, &map);
+
+  if (padding)
+    gst_buffer_add_video_meta_full (buf, GST_VIDEO_FRAME_FLAG_NONE, format,
+        width, height, 1, offset, strides);
+
+  return buf;
+}
+
+GST_START_TEST (test_zero_sigmas)
+{
+  GRand *rand = g_rand_new_with_seed (3);
+  guint f, b;
+
+  for (f = 0; f < G_N_ELEMENTS (formats); f++) {
+    for (b = 0; b < G_N_ELEMENTS (bank_sizes); b++) {
+      GstHarness *h = gst_harness_new ("sfx3dnoise");
+      GstBuffer *in, *out;
+      GstMapInfo in_map, out_map;
+
+      g_object_set (h->element, "bank-size", bank_sizes[b], NULL);
+      setup_harness (h, formats[f], WIDTH, HEIGHT);
+
+      in = make_frame (formats[f], WIDTH, HEIGHT, 0, 0, rand);
+      out = gst_harness_push_and_pull (h, gst_buffer_copy_deep (in));
+      fail_unless (out != NULL);
+
+      fail_unless (gst_buffer_map (in, &in_map, GST_MAP_READ));
+      fail_unless (gst_buffer_map (out, &out_map, GST_MAP_READ));
+      fail_unless_equals_int (out_map.size, in_map.size);
+      if (memcmp (out_map.data, in_map.data, in_map.size) != 0)
+        fail ("%s bank-size %u: frame changed without noise",
+            gst_video_format_to_string (formats[f]), bank_sizes[b]);
+      gst_buffer_unmap (out, &out_map);
+      gst_buffer_unmap (in, &in_map);
+
+      gst_buffer_unref (out);
+      gst_buffer_unref (in);
+      gst_harness_teardown (h);
+    }
+  }
+
+  g_rand_free (rand);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_padding_untouched)
+{
+  guint f, b;
+
+  for (f = 0; f < G_N_ELEMENTS (formats); f++) {
+    for (b = 0; b < G_N_ELEMENTS (bank_sizes); b++) {
+      GstHarness *h = gst_harness_new ("sfx3dnoise");
+      gint depth = formats[f] == GST_VIDEO_FORMAT_GRAY8 ? 8 : 16;
+      gint stride = get_stride (formats[f], WIDTH, PADDING);
+      guint mid = 1 << (depth - 1);
+      gboolean changed = FALSE;
+      GstBuffer *out;
+      GstMapInfo map;
+      gint x, y;
+
+      g_object_set (h->element, "bank-size", bank_sizes[b], "sigma-t", 0.05,
+          "sigma-v", 0.05, "sigma-h", 0.05, "sigma-tv", 0.05, "sigma-th",
+          0.05, "sigma-vh", 0.05, "sigma-tvh", 0.05, NULL);
+      setup_harness (h, formats[f], WIDTH, HEIGHT);
+
+      out = gst_harness_push_and_pull (h,
+          make_frame (formats[f], WIDTH, HEIGHT, PADDING, mid, NULL));
+      fail_unless (out != NULL);
+
+      fail_unless (gst_buffer_map (out, &map, GST_MAP_READ));
+      for (y = 0; y < HEIGHT; y++) {
+        const guint8 *line = map.data + y * stride;
+
+        for (x = WIDTH * depth / 8; x < stride; x++) {
+          if (line[x] != PAD_BYTE)
+            fail ("%s bank-size %u: padding byte %d of line %d is 0x%02x",
+                gst_video_format_to_string (formats[f]), bank_sizes[b], x,
+                y, line[x]);
+        }
+        for (x = 0; x < WIDTH; x++)
+          changed |= get_pixel (line, x, depth) != mid;
+      }
+      gst_buffer_unmap (out, &map);
+
+      fail_unless (changed, "%s bank-size %u: no noise was added",
+          gst_video_format_to_string (formats[f]), bank_sizes[b]);
+
+      gst_buffer_unref (out);
+      gst_harness_teardown (h);
+    }
+  }
+}
+
+GST_END_TEST;
+
+/* Pushes a few mid grey frames with only @property set and checks that each
+ * row, or each column if @columns, stays a single value */
+static void
+check_constant_lines (const gchar * property, gboolean columns)
+{
+  guint f, b;
+  gint n;
+
+  for (f = 0; f < G_N_ELEMENTS (formats); f++) {
+    for (b = 0; b < G_N_ELEMENTS (bank_sizes); b++) {
+      GstHarness *h = gst_harness_new ("sfx3dnoise");
+      gint depth = formats[f] == GST_VIDEO_FORMAT_GRAY8 ? 8 : 16;
+      gint stride = get_stride (formats[f], WIDTH, 0);
+      guint mid = 1 << (depth - 1);
+
+      g_object_set (h->element, "bank-size", bank_sizes[b], property, 0.1,
+          NULL);
+      setup_harness (h, formats[f], WIDTH, HEIGHT);
+
+      for (n = 0; n < 4; n++) {
+        gboolean varies = FALSE;
+        GstBuffer *out;
+        GstMapInfo map;
+        gint x, y;
+
+        out = gst_harness_push_and_pull (h,
+            make_frame (formats[f], WIDTH, HEIGHT, 0, mid, NULL));
+        fail_unless (out != NULL);
+        fail_unless (gst_buffer_map (out, &map, GST_MAP_READ));
+
+        for (y = 0; y < HEIGHT; y++) {
+          for (x = 0; x < WIDTH; x++) {
+            guint v = get_pixel (map.data + y * stride, x, depth);
+            guint first = columns ? get_pixel (map.data, x, depth) :
+                get_pixel (map.data + y * stride, 0, depth);
+
+            if (v != first)
+              fail ("%s %s bank-size %u frame %d: pixel %d of line %d is "
+                  "%u, expected %u", property,
+                  gst_video_format_to_string (formats[f]), bank_sizes[b], n,
+                  x, y, v, first);
+            varies |= v != get_pixel (map.data, 0, depth);
+          }
+        }
+        gst_buffer_unmap (out, &map);
+
+        fail_unless (varies, "%s %s bank-size %u frame %d: lines are equal",
+            property, gst_video_format_to_string (formats[f]),
+            bank_sizes[b], n);
+        gst_buffer_unref (out);
+      }
+
+      gst_harness_teardown (h);
+    }
+  }
+}
+
+GST_START_TEST (test_sigma_tv_rows)
+{
+  check_constant_lines ("sigma-tv", FALSE);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_sigma_th_columns)
+{
+  check_constant_lines ("sigma-th", TRUE);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_sigma_tvh_std)
+{
+  const gint width = 320, height = 240;
+  const gdouble sigma = 0.01;
+  guint b;
+  gint n;
+
+  for (b = 0; b < G_N_ELEMENTS (bank_sizes); b++) {
+    GstHarness *h = gst_harness_new ("sfx3dnoise");
+
+    g_object_set (h->element, "bank-size", bank_sizes[b], "sigma-tvh", sigma,
+        NULL);
+    setup_harness (h, GST_VIDEO_FORMAT_GRAY16_LE, width, height);
+
+    for (n = 0; n < 4; n++) {
+      gdouble sum = 0.0, sum2 = 0.0, mean, std, expected;
+      GstBuffer *out;
+      GstMapInfo map;
+      gint i;
+
+      out = gst_harness_push_and_pull (h,
+          make_frame (GST_VIDEO_FORMAT_GRAY16_LE, width, height, 0, 32768,
+              NULL));
+      fail_unless (out != NULL);
+      fail_unless (gst_buffer_map (out, &map, GST_MAP_READ));
+
+      for (i = 0; i < width * height; i++) {
+        gdouble d = GST_READ_UINT16_LE (map.data + 2 * i) - 32768.0;
+
+        sum += d;
+        sum2 += d * d;
+      }
+      gst_buffer_unmap (out, &map);
+      gst_buffer_unref (out);
+
+      /* sigmas are a fraction of the full range less one code */
+      mean = sum / (width * height);
+      std = sqrt (sum2 / (width * height) - mean * mean);
+      expected = sigma * (G_MAXUINT16 - 1);
+      fail_unless (fabs (mean) < 0.05 * expected,
+          "bank-size %u frame %d: mean %f", bank_sizes[b], n, mean);
+      fail_unless (fabs (std - expected) < 0.03 * expected,
+          "bank-size %u frame %d: std %f, expected %f", bank_sizes[b], n,
+          std, expected);
+    }
+
+    gst_harness_teardown (h);
+  }
+}
+
+GST_END_TEST;
+
+/* xoshiro128** and splitmix64 as published by Blackman and Vigna, to check
+ * the lanes against */
+static guint32
+ref_rotl (guint32 x, gint k)
+{
+  return (x << k) | (x >> (32 - k));
+}
+
+static guint32
+ref_xoshiro128ss (guint32 s[4])
+{
+  guint32 result = ref_rotl (s[1] * 5, 7) * 9;
+  guint32 t = s[1] << 9;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = ref_rotl (s[3], 11);
+
+  return result;
+}
+
+static guint64
+ref_splitmix64 (guint64 * x)
+{
+  guint64 z = (*x += G_GUINT64_CONSTANT (0x9e3779b97f4a7c15));
+
+  z = (z ^ (z >> 30)) * G_GUINT64_CONSTANT (0xbf58476d1ce4e5b9);
+  z = (z ^ (z >> 27)) * G_GUINT64_CONSTANT (0x94d049bb133111eb);
+  return z ^ (z >> 31);
+}
+
+/* each lane takes two splitmix64 outputs, low word first */
+static void
+ref_init (guint32 s[GST_SFX_RANDOM_LANES][4], guint64 seed)
+{
+  gint l;
+
+  for (l = 0; l < GST_SFX_RANDOM_LANES; l++) {
+    guint64 a = ref_splitmix64 (&seed);
+    guint64 b = ref_splitmix64 (&seed);
+
+    s[l][0] = (guint32) a;
+    s[l][1] = (guint32) (a >> 32);
+    s[l][2] = (guint32) b;
+    s[l][3] = (guint32) (b >> 32);
+  }
+}
+
+#define RANDOM_COUNT (1 << 20)
+
+GST_START_TEST (test_random_xoshiro)
+{
+  guint32 ref[GST_SFX_RANDOM_LANES][4];
+  guint32 *values = g_new (guint32, 4 * 1000 + 3);
+  GstSfxRandom rand;
+  gint i, l;
+
+  /* single draws come from the first lane */
+  gst_sfx_random_init (&rand, 2023);
+  ref_init (ref, 2023);
+  for (i = 0; i < 1000; i++) {
+    guint32 expected = ref_xoshiro128ss (ref[0]);
+    guint32 v = gst_sfx_random_next (&rand);
+
+    if (v != expected)
+      fail ("draw %d is 0x%08x, expected 0x%08x", i, v, expected);
+  }
+
+  /* fills interleave the lanes, and a partial step drops the rest of it */
+  gst_sfx_random_init (&rand, 2023);
+  ref_init (ref, 2023);
+  gst_sfx_random_fill (&rand, values, 4 * 1000 + 3);
+  for (i = 0; i < 4 * 1000 + 3; i++) {
+    l = i % GST_SFX_RANDOM_LANES;
+    if (values[i] != ref_xoshiro128ss (ref[l]))
+      fail ("value %d of the fill is wrong", i);
+  }
+  fail_unless (gst_sfx_random_next (&rand) == ref_xoshiro128ss (ref[0]));
+
+  g_free (values);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_random_uniform)
+{
+  guint32 *values = g_new (guint32, RANDOM_COUNT);
+  gdouble sum = 0.0, sum2 = 0.0, mean, var;
+  GstSfxRandom rand;
+  gint i;
+
+  gst_sfx_random_init (&rand, 1);
+  gst_sfx_random_fill (&rand, values, RANDOM_COUNT);
+  for (i = 0; i < RANDOM_COUNT; i++) {
+    gdouble u = values[i] / 4294967296.0;
+
+    sum += u;
+    sum2 += u * u;
+  }
+
+  mean = sum / RANDOM_COUNT;
+  var = sum2 / RANDOM_COUNT - mean * mean;
+  fail_unless (fabs (mean - 0.5) < 0.002, "mean %f", mean);
+  fail_unless (fabs (var - 1.0 / 12) < 0.001, "variance %f", var);
+
+  g_free (values);
+}
+
+GST_END_TEST;
+
+/* checks the mean, variance and the share beyond three sigma, which only the
+ * ziggurat tail and wedge rejections reach */
+static void
+check_normal (const gfloat * values, gint n, gdouble sigma)
+{
+  gdouble sum = 0.0, sum2 = 0.0, mean, var;
+  gint i, tail = 0;
+
+  for (i = 0; i < n; i++) {
+    sum += values[i];
+    sum2 += (gdouble) values[i] * values[i];
+    if (fabs (values[i]) > 3.0 * sigma)
+      tail++;
+  }
+
+  mean = sum / n;
+  var = sum2 / n - mean * mean;
+  fail_unless (fabs (mean) < 0.01 * sigma, "sigma %f: mean %f", sigma, mean);
+  fail_unless (fabs (var / (sigma * sigma) - 1.0) < 0.01,
+      "sigma %f: variance %f", sigma, var);
+  fail_unless (fabs ((gdouble) tail / n - 0.0027) < 0.0005,
+      "sigma %f: %d of %d beyond three sigma", sigma, tail, n);
+}
+
+GST_START_TEST (test_random_normal)
+{
+  gfloat *values = g_new (gfloat, RANDOM_COUNT);
+  GstSfxRandom rand;
+  gint i;
+
+  gst_sfx_random_init (&rand, 1);
+  gst_sfx_random_fill_normal (&rand, values, RANDOM_COUNT, 1.0f);
+  check_normal (values, RANDOM_COUNT, 1.0);
+
+  gst_sfx_random_fill_normal (&rand, values, RANDOM_COUNT, 300.0f);
+  check_normal (values, RANDOM_COUNT, 300.0);
+
+  for (i = 0; i < RANDOM_COUNT; i++)
+    values[i] = gst_sfx_random_normal (&rand);
+  check_normal (values, RANDOM_COUNT, 1.0);
+
+  g_free (values);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_random_deterministic)
+{
+  gfloat *a = g_new (gfloat, 1000), *b = g_new (gfloat, 1000);
+  GstSfxRandom rand_a, rand_b;
+
+  gst_sfx_random_init (&rand_a, 42);
+  gst_sfx_random_init (&rand_b, 42);
+  gst_sfx_random_fill_normal (&rand_a, a, 1000, 1.0f);
+  gst_sfx_random_fill_normal (&rand_b, b, 1000, 1.0f);
+  fail_unless (memcmp (a, b, 1000 * sizeof (gfloat)) == 0);
+  fail_unless (gst_sfx_random_normal (&rand_a) ==
+      gst_sfx_random_normal (&rand_b));
+
+  gst_sfx_random_init (&rand_b, 43);
+  gst_sfx_random_init (&rand_a, 42);
+  gst_sfx_random_fill_normal (&rand_a, a, 1000, 1.0f);
+  gst_sfx_random_fill_normal (&rand_b, b, 1000, 1.0f);
+  fail_if (memcmp (a, b, 1000 * sizeof (gfloat)) == 0);
+
+  g_free (b);
+  g_free (a);
+}
+
+GST_END_TEST;
+
+static Suite *
+sfx3dnoise_suite (void)
+{
+  Suite *s = suite_create ("sfx3dnoise");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_zero_sigmas);
+  tcase_add_test (tc_chain, test_padding_untouched);
+  tcase_add_test (tc_chain, test_sigma_tv_rows);
+  tcase_add_test (tc_chain, test_sigma_th_columns);
+  tcase_add_test (tc_chain, test_sigma_tvh_std);
+  tcase_add_test (tc_chain, test_random_xoshiro);
+  tcase_add_test (tc_chain, test_random_uniform);
+  tcase_add_test (tc_chain, test_random_normal);
+  tcase_add_test (tc_chain, test_random_deterministic);
+
+  return s;
+}
+
+GST_CHECK_MAIN (sfx3dnoise);
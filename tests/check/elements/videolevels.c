@@ -0,0 +1,612 @@
+/* GStreamer
+ * Copyright (C) 2010 United States Government, Joshua M. Doe <oss@nvl.army.mil>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Checks videolevels on GRAY16_LE input: frame mapping with upstream strides,
+ * the proposed pool, asynchronous auto adjustment, histogram messages and
+ * adaptive mode */
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gstharness.h>
+#include <gst/video/video.h>
+
+#define WIDTH 61
+#define HEIGHT 7
+
+/* the padding of the padded stride frames */
+#define PADDING 38
+
+/* how long to wait for the auto adjustment thread */
+#define WAIT_TIMEOUT (5 * G_USEC_PER_SEC)
+
+static void
+setup_harness (GstHarness * h, gint width, gint height)
+{
+  GstVideoInfo info;
+
+  gst_video_info_set_format (&info, GST_VIDEO_FORMAT_GRAY16_LE, width,
+      height);
+  GST_VIDEO_INFO_FPS_N (&info) = 30;
+  GST_VIDEO_INFO_FPS_D (&info) = 1;
+  gst_harness_set_src_caps (h, gst_video_info_to_caps (&info));
+}
+
+/* Makes frame @n of @pixels, with @padding more bytes after each line than
+ * the default stride, described by a GstVideoMeta */
+static GstBuffer *
+make_frame (const guint16 * pixels, gint width, gint height, gint padding,
+    gint n)
+{
+  GstVideoInfo info;
+  GstBuffer *buf;
+  GstMapInfo map;
+  gsize offset[GST_VIDEO_MAX_PLANES] = { 0, };
+  gint stride[GST_VIDEO_MAX_PLANES] = { 0, };
+  gint x, y;
+
+  gst_video_info_set_format (&info, GST_VIDEO_FORMAT_GRAY16_LE, width,
+      height);
+  stride[0] = GST_VIDEO_INFO_PLANE_STRIDE (&info, 0) + padding;
+
+  buf = gst_buffer_new_allocate (NULL, stride[0] * height, NULL);
+  fail_unless (gst_buffer_map (buf, &map, GST_MAP_WRITE));
+  memset (map.data, 0xff, map.size);
+  for (y = 0; y < height; y++) {
+    for (x = 0; x < width; x++)
+      GST_WRITE_UINT16_LE (map.data + y * stride[0] + 2 * x,
+          pixels[y * width + x]);
+  }
+  gst_buffer_unmap (buf, &map);
+
+  if (padding)
+    gst_buffer_add_video_meta_full (buf, GST_VIDEO_FRAME_FLAG_NONE,
+        GST_VIDEO_FORMAT_GRAY16_LE, width, height, 1, offset, stride);
+
+  GST_BUFFER_PTS (buf) = gst_util_uint64_scale (n, GST_SECOND, 30);
+  GST_BUFFER_DURATION (buf) = GST_SECOND / 30;
+
+  return buf;
+}
+
+static guint16 *
+make_pixels (gint width, gint height, GRand * rand)
+{
+  guint16 *pixels = g_new (guint16, width * height);
+  gint i;
+
+  for (i = 0; i < width * height; i++)
+    pixels[i] = (guint16) g_rand_int_range (rand, 0, 65536);
+
+  return pixels;
+}
+
+/* Pushes @in and returns the GRAY8 output pixels */
+static guint8 *
+push_frame (GstHarness * h, GstBuffer * in, gint width, gint height)
+{
+  guint8 *pixels = g_new (guint8, width * height);
+  GstCaps *caps;
+  GstVideoInfo info;
+  GstVideoFrame frame;
+  GstBuffer *out;
+  gint y;
+
+  out = gst_harness_push_and_pull (h, in);
+  fail_unless (out != NULL);
+
+  caps = gst_pad_get_current_caps (h->sinkpad);
+  fail_unless (caps != NULL);
+  fail_unless (gst_video_info_from_caps (&info, caps));
+  gst_caps_unref (caps);
+  fail_unless_equals_int (GST_VIDEO_INFO_FORMAT (&info),
+      GST_VIDEO_FORMAT_GRAY8);
+
+  fail_unless (gst_video_frame_map (&frame, &info, out, GST_MAP_READ));
+  for (y = 0; y < height; y++) {
+    const guint8 *line = (const guint8 *)
+        GST_VIDEO_FRAME_PLANE_DATA (&frame, 0) +
+        y * GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0);
+
+    memcpy (pixels + y * width, line, width);
+  }
+  gst_video_frame_unmap (&frame);
+  gst_buffer_unref (out);
+
+  return pixels;
+}
+
+GST_START_TEST (test_padded_stride)
+{
+  /* shift, linear and table mappings */
+  static const gint levels[][2] = { {0, 65535}, {1000, 3000}, {3000, 1000} };
+  GRand *rand = g_rand_new_with_seed (22);
+  guint16 *pixels = make_pixels (WIDTH, HEIGHT, rand);
+  guint i;
+  gint x;
+
+  for (i = 0; i < G_N_ELEMENTS (levels); i++) {
+    GstHarness *h = gst_harness_new ("videolevels");
+    guint8 *packed, *padded;
+
+    g_object_set (h->element, "lower-input-level", levels[i][0],
+        "upper-input-level", levels[i][1], NULL);
+    setup_harness (h, WIDTH, HEIGHT);
+
+    packed = push_frame (h, make_frame (pixels, WIDTH, HEIGHT, 0, 0), WIDTH,
+        HEIGHT);
+    padded = push_frame (h, make_frame (pixels, WIDTH, HEIGHT, PADDING, 1),
+        WIDTH, HEIGHT);
+
+    for (x = 0; x < WIDTH * HEIGHT; x++) {
+      if (padded[x] != packed[x])
+        fail ("levels %d-%d: pixel %d of the padded frame is %u, expected "
+            "%u", levels[i][0], levels[i][1], x, padded[x], packed[x]);
+      if (i == 0 && packed[x] != pixels[x] >> 8)
+        fail ("pixel %d is %u, expected %u", x, packed[x], pixels[x] >> 8);
+    }
+
+    g_free (padded);
+    g_free (packed);
+    gst_harness_teardown (h);
+  }
+
+  g_free (pixels);
+  g_rand_free (rand);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_propose_allocation)
+{
+  GstHarness *h = gst_harness_new ("videolevels");
+  GRand *rand = g_rand_new_with_seed (22);
+  guint16 *pixels = make_pixels (WIDTH, HEIGHT, rand);
+  GstAllocationParams params;
+  GstAllocator *allocator;
+  GstVideoAlignment align;
+  GstBufferPool *pool;
+  GstStructure *config;
+  GstVideoMeta *meta;
+  GstQuery *query;
+  GstCaps *caps;
+  GstBuffer *buf;
+  guint size, i;
+
+  setup_harness (h, WIDTH, HEIGHT);
+
+  /* the pool is only proposed once the output side is negotiated */
+  g_free (push_frame (h, make_frame (pixels, WIDTH, HEIGHT, 0, 0), WIDTH,
+          HEIGHT));
+
+  caps = gst_pad_get_current_caps (h->srcpad);
+  fail_unless (caps != NULL);
+  query = gst_query_new_allocation (caps, TRUE);
+  gst_caps_unref (caps);
+  fail_unless (gst_pad_peer_query (h->srcpad, query));
+
+  fail_unless (gst_query_find_allocation_meta (query,
+          GST_VIDEO_META_API_TYPE, NULL));
+  fail_unless (gst_query_get_n_allocation_pools (query) > 0);
+  gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, NULL, NULL);
+  fail_unless (pool != NULL);
+
+  config = gst_buffer_pool_get_config (pool);
+  fail_unless (gst_buffer_pool_config_get_allocator (config, &allocator,
+          &params));
+  fail_unless_equals_int (params.align, 31);
+  fail_unless (gst_buffer_pool_config_has_option (config,
+          GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT));
+  fail_unless (gst_buffer_pool_config_get_video_alignment (config, &align));
+  fail_unless_equals_int (align.stride_align[0], 31);
+  gst_structure_free (config);
+
+  /* buffers from it start and have every line on a 32 byte boundary */
+  fail_unless (gst_buffer_pool_set_active (pool, TRUE));
+  for (i = 0; i < 2; i++) {
+    GstMapInfo map;
+
+    fail_unless_equals_int (gst_buffer_pool_acquire_buffer (pool, &buf,
+            NULL), GST_FLOW_OK);
+    meta = gst_buffer_get_video_meta (buf);
+    fail_unless (meta != NULL);
+    fail_unless_equals_int (meta->stride[0] % 32, 0);
+    fail_unless (meta->stride[0] >= 2 * WIDTH);
+
+    fail_unless (gst_buffer_map (buf, &map, GST_MAP_READ));
+    fail_unless_equals_int (((guintptr) map.data + meta->offset[0]) % 32, 0);
+    gst_buffer_unmap (buf, &map);
+    gst_buffer_unref (buf);
+  }
+  fail_unless (gst_buffer_pool_set_active (pool, FALSE));
+
+  gst_object_unref (pool);
+  gst_query_unref (query);
+  g_free (pixels);
+  g_rand_free (rand);
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+/* a frame of values evenly spread over [AUTO_LOW, AUTO_HIGH) */
+#define AUTO_LOW 10000
+#define AUTO_HIGH 20000
+
+static guint16 *
+make_auto_pixels (void)
+{
+  guint16 *pixels = g_new (guint16, WIDTH * HEIGHT);
+  gint i;
+
+  for (i = 0; i < WIDTH * HEIGHT; i++)
+    pixels[i] = AUTO_LOW + (gint64) i * (AUTO_HIGH - AUTO_LOW) /
+        (WIDTH * HEIGHT);
+
+  return pixels;
+}
+
+/* Waits for the auto adjustment thread to change the input levels from
+ * @lower and @upper */
+static void
+wait_for_levels (GstHarness * h, gint * lower, gint * upper)
+{
+  gint64 end = g_get_monotonic_time () + WAIT_TIMEOUT;
+  gint l, u;
+
+  do {
+    g_object_get (h->element, "lower-input-level", &l, "upper-input-level",
+        &u, NULL);
+    if (l != *lower && u != *upper) {
+      *lower = l;
+      *upper = u;
+      return;
+    }
+    g_usleep (1000);
+  } while (g_get_monotonic_time () < end);
+
+  fail ("levels stayed at %d-%d", l, u);
+}
+
+GST_START_TEST (test_auto_continuous)
+{
+  GstHarness *h = gst_harness_new ("videolevels");
+  guint16 *pixels = make_auto_pixels ();
+  /* one percent saturates on either end, binned to 16 values */
+  const gint low = AUTO_LOW + (AUTO_HIGH - AUTO_LOW) / 100;
+  const gint high = AUTO_HIGH - (AUTO_HIGH - AUTO_LOW) / 100;
+  gint lower = 0, upper = 65535;
+  guint8 *out;
+  gint x;
+
+  gst_util_set_object_arg (G_OBJECT (h->element), "auto", "continuous");
+  setup_harness (h, WIDTH, HEIGHT);
+
+  g_free (push_frame (h, make_frame (pixels, WIDTH, HEIGHT, 0, 0), WIDTH,
+          HEIGHT));
+  wait_for_levels (h, &lower, &upper);
+  fail_unless (ABS (lower - low) < 32, "lower level %d, expected %d", lower,
+      low);
+  fail_unless (ABS (upper - high) < 32, "upper level %d, expected %d", upper,
+      high);
+
+  /* the new levels are applied from the next frame on */
+  out = push_frame (h, make_frame (pixels, WIDTH, HEIGHT, 0, 1), WIDTH,
+      HEIGHT);
+  for (x = 0; x < WIDTH * HEIGHT; x++) {
+    gint expected = CLAMP ((pixels[x] - lower) * 255 / (upper - lower), 0,
+        255);
+
+    if (ABS (out[x] - expected) > 1)
+      fail ("pixel %d is %u, expected %d", x, out[x], expected);
+  }
+  g_free (out);
+
+  g_free (pixels);
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_auto_smoothing)
+{
+  GstHarness *h = gst_harness_new ("videolevels");
+  guint16 *pixels = make_auto_pixels ();
+  const gint low = AUTO_LOW + (AUTO_HIGH - AUTO_LOW) / 100;
+  const gint high = AUTO_HIGH - (AUTO_HIGH - AUTO_LOW) / 100;
+  gdouble expected_lower = 0.0, expected_upper = 65535.0;
+  gint lower = 0, upper = 65535;
+  gint n;
+
+  /* adjust on every frame, each one moving halfway */
+  g_object_set (h->element, "interval", (guint64) 1, "smoothing", 0.5, NULL);
+  gst_util_set_object_arg (G_OBJECT (h->element), "auto", "continuous");
+  setup_harness (h, WIDTH, HEIGHT);
+
+  for (n = 0; n < 5; n++) {
+    g_free (push_frame (h, make_frame (pixels, WIDTH, HEIGHT, 0, n), WIDTH,
+            HEIGHT));
+    wait_for_levels (h, &lower, &upper);
+
+    expected_lower = 0.5 * expected_lower + 0.5 * low;
+    expected_upper = 0.5 * expected_upper + 0.5 * high;
+    fail_unless (ABS (lower - expected_lower) < 32,
+        "frame %d: lower level %d, expected %f", n, lower, expected_lower);
+    fail_unless (ABS (upper - expected_upper) < 32,
+        "frame %d: upper level %d, expected %f", n, upper, expected_upper);
+  }
+
+  g_free (pixels);
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+/* Returns the next "videolevels-histogram" message on @bus, or NULL if none
+ * is posted within @timeout */
+static GstStructure *
+pop_histogram (GstBus * bus, GstClockTime timeout)
+{
+  GstMessage *msg;
+  GstStructure *st;
+
+  msg = gst_bus_timed_pop_filtered (bus, timeout, GST_MESSAGE_ELEMENT);
+  if (msg == NULL)
+    return NULL;
+
+  fail_unless (gst_message_has_name (msg, "videolevels-histogram"));
+  st = gst_structure_copy (gst_message_get_structure (msg));
+  gst_message_unref (msg);
+
+  return st;
+}
+
+/* Checks that @st holds the histogram of a frame of @pixels */
+static void
+check_histogram (const GstStructure * st, const guint16 * pixels,
+    GstClockTime timestamp)
+{
+  gint *expected = g_new0 (gint, 4096);
+  const GValue *array;
+  GstClockTime ts;
+  gint bin_width, i;
+
+  fail_unless (gst_structure_get_clock_time (st, "timestamp", &ts));
+  fail_unless (ts == timestamp);
+  fail_unless (gst_structure_get_int (st, "bin-width", &bin_width));
+  fail_unless_equals_int (bin_width, 16);
+
+  for (i = 0; i < WIDTH * HEIGHT; i++)
+    expected[pixels[i] >> 4]++;
+
+  array = gst_structure_get_value (st, "histogram");
+  fail_unless (array != NULL && GST_VALUE_HOLDS_ARRAY (array));
+  fail_unless_equals_int (gst_value_array_get_size (array), 4096);
+  for (i = 0; i < 4096; i++) {
+    gint count = g_value_get_int (gst_value_array_get_value (array, i));
+
+    if (count != expected[i])
+      fail ("bin %d holds %d, expected %d", i, count, expected[i]);
+  }
+
+  g_free (expected);
+}
+
+GST_START_TEST (test_histogram_message)
+{
+  GstHarness *h = gst_harness_new ("videolevels");
+  GstBus *bus = gst_bus_new ();
+  GRand *rand = g_rand_new_with_seed (21);
+  guint16 *pixels = make_pixels (WIDTH, HEIGHT, rand);
+  GstStructure *st;
+  gint lower, upper, level;
+
+  gst_element_set_bus (h->element, bus);
+  g_object_set (h->element, "histogram-interval", 0, NULL);
+  gst_util_set_object_arg (G_OBJECT (h->element), "post-histogram",
+      "always");
+  setup_harness (h, WIDTH, HEIGHT);
+
+  /* without auto adjustment it comes from the worker thread */
+  g_free (push_frame (h, make_frame (pixels, WIDTH, HEIGHT, 0, 0), WIDTH,
+          HEIGHT));
+  st = pop_histogram (bus, 5 * GST_SECOND);
+  fail_unless (st != NULL);
+  check_histogram (st, pixels, 0);
+  fail_unless (gst_structure_get_int (st, "lower-input-level", &level));
+  fail_unless_equals_int (level, 0);
+  fail_unless (gst_structure_get_int (st, "upper-input-level", &level));
+  fail_unless_equals_int (level, 65535);
+  gst_structure_free (st);
+
+  /* and carries the levels it was used for when auto adjusting */
+  gst_util_set_object_arg (G_OBJECT (h->element), "post-histogram", "auto");
+  gst_util_set_object_arg (G_OBJECT (h->element), "auto", "single");
+  g_free (push_frame (h, make_frame (pixels, WIDTH, HEIGHT, 0, 1), WIDTH,
+          HEIGHT));
+  st = pop_histogram (bus, 0);
+  fail_unless (st != NULL);
+  check_histogram (st, pixels, GST_SECOND / 30);
+  g_object_get (h->element, "lower-input-level", &lower,
+      "upper-input-level", &upper, NULL);
+  fail_unless (gst_structure_get_int (st, "lower-input-level", &level));
+  fail_unless_equals_int (level, lower);
+  fail_unless (gst_structure_get_int (st, "upper-input-level", &level));
+  fail_unless_equals_int (level, upper);
+  gst_structure_free (st);
+
+  gst_element_set_bus (h->element, NULL);
+  gst_object_unref (bus);
+  g_free (pixels);
+  g_rand_free (rand);
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+/* single auto adjustment runs on the streaming thread, so whether a message
+ * is posted is known as soon as the frame comes out */
+GST_START_TEST (test_histogram_rate_limit)
+{
+  GstHarness *h = gst_harness_new ("videolevels");
+  GstBus *bus = gst_bus_new ();
+  GRand *rand = g_rand_new_with_seed (21);
+  guint16 *pixels = make_pixels (WIDTH, HEIGHT, rand);
+  GstStructure *st;
+  gint n;
+
+  gst_element_set_bus (h->element, bus);
+  g_object_set (h->element, "histogram-interval", 60 * 1000, NULL);
+  gst_util_set_object_arg (G_OBJECT (h->element), "post-histogram", "auto");
+  setup_harness (h, WIDTH, HEIGHT);
+
+  for (n = 0; n < 3; n++) {
+    gst_util_set_object_arg (G_OBJECT (h->element), "auto", "single");
+    g_free (push_frame (h, make_frame (pixels, WIDTH, HEIGHT, 0, n), WIDTH,
+            HEIGHT));
+
+    st = pop_histogram (bus, 0);
+    if (n == 0) {
+      fail_unless (st != NULL, "first histogram wasn't posted");
+      gst_structure_free (st);
+    } else {
+      fail_unless (st == NULL, "histogram %d posted within the interval", n);
+    }
+  }
+
+  /* no adjustment, no message */
+  g_object_set (h->element, "histogram-interval", 0, NULL);
+  g_free (push_frame (h, make_frame (pixels, WIDTH, HEIGHT, 0, n), WIDTH,
+          HEIGHT));
+  fail_unless (pop_histogram (bus, 0) == NULL);
+
+  gst_util_set_object_arg (G_OBJECT (h->element), "auto", "single");
+  g_free (push_frame (h, make_frame (pixels, WIDTH, HEIGHT, 0, n + 1), WIDTH,
+          HEIGHT));
+  st = pop_histogram (bus, 0);
+  fail_unless (st != NULL, "histogram wasn't posted without an interval");
+  gst_structure_free (st);
+
+  gst_element_set_bus (h->element, NULL);
+  gst_object_unref (bus);
+  g_free (pixels);
+  g_rand_free (rand);
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+/* a horizontal ramp of 256 columns, each landing in its own bin */
+#define RAMP_WIDTH 256
+#define RAMP_HEIGHT 16
+
+/* Equalizes columns @x0 to @x1 of the ramp, as one tile without clipping */
+static guint8
+ramp_equalized (gint x, gint x0, gint x1)
+{
+  const gdouble scale = 255.0 / ((x1 - x0) * RAMP_HEIGHT);
+
+  return (guint8) ((x - x0 + 1) * RAMP_HEIGHT * scale + 0.5);
+}
+
+static guint8 *
+push_ramp (gint tiles_x)
+{
+  GstHarness *h = gst_harness_new ("videolevels");
+  guint16 *pixels = g_new (guint16, RAMP_WIDTH * RAMP_HEIGHT);
+  guint8 *out;
+  gint i;
+
+  for (i = 0; i < RAMP_WIDTH * RAMP_HEIGHT; i++)
+    pixels[i] = (i % RAMP_WIDTH) << 8;
+
+  gst_util_set_object_arg (G_OBJECT (h->element), "mode", "adaptive");
+  g_object_set (h->element, "tiles-x", tiles_x, "tiles-y", 1, "clip-limit",
+      0.0, NULL);
+  setup_harness (h, RAMP_WIDTH, RAMP_HEIGHT);
+
+  out = push_frame (h, make_frame (pixels, RAMP_WIDTH, RAMP_HEIGHT, 0, 0),
+      RAMP_WIDTH, RAMP_HEIGHT);
+
+  g_free (pixels);
+  gst_harness_teardown (h);
+
+  return out;
+}
+
+GST_START_TEST (test_adaptive_ramp)
+{
+  guint8 *out;
+  gint x, y;
+
+  /* a single tile without clipping is plain histogram equalization */
+  out = push_ramp (1);
+  for (y = 0; y < RAMP_HEIGHT; y++) {
+    for (x = 0; x < RAMP_WIDTH; x++) {
+      guint8 expected = ramp_equalized (x, 0, RAMP_WIDTH);
+
+      if (out[y * RAMP_WIDTH + x] != expected)
+        fail ("1 tile: pixel %d of line %d is %u, expected %u", x, y,
+            out[y * RAMP_WIDTH + x], expected);
+    }
+  }
+  g_free (out);
+
+  /* with four tiles, columns outside of the outer tile centers only use
+   * their tile, which stretches its quarter of the ramp to the full range */
+  out = push_ramp (4);
+  for (y = 0; y < RAMP_HEIGHT; y++) {
+    for (x = 0; x < RAMP_WIDTH; x++) {
+      guint8 expected;
+
+      if (x < RAMP_WIDTH / 8)
+        expected = ramp_equalized (x, 0, RAMP_WIDTH / 4);
+      else if (x >= RAMP_WIDTH - RAMP_WIDTH / 8)
+        expected = ramp_equalized (x, RAMP_WIDTH - RAMP_WIDTH / 4,
+            RAMP_WIDTH);
+      else
+        continue;
+
+      if (out[y * RAMP_WIDTH + x] != expected)
+        fail ("4 tiles: pixel %d of line %d is %u, expected %u", x, y,
+            out[y * RAMP_WIDTH + x], expected);
+    }
+  }
+  g_free (out);
+}
+
+GST_END_TEST;
+
+static Suite *
+videolevels_suite (void)
+{
+  Suite *s = suite_create ("videolevels");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_padded_stride);
+  tcase_add_test (tc_chain, test_propose_allocation);
+  tcase_add_test (tc_chain, test_auto_continuous);
+  tcase_add_test (tc_chain, test_auto_smoothing);
+  tcase_add_test (tc_chain, test_histogram_message);
+  tcase_add_test (tc_chain, test_histogram_rate_limit);
+  tcase_add_test (tc_chain, test_adaptive_ramp);
+
+  return s;
+}
+
+GST_CHECK_MAIN (videolevels);
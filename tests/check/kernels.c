@@ -0,0 +1,397 @@
+/* GStreamer
+ * Copyright (C) 2010 United States Government, Joshua M. Doe <oss@nvl.army.mil>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Runs the line kernels picked for this CPU against their scalar references,
+ * for every width up to 64, random longer widths, unaligned buffers and both
+ * byte orders. On machines without SIMD kernels this compares the scalar
+ * code with itself. */
+
+#include <string.h>
+
+#include <gst/check/gstcheck.h>
+#include <gst/video/video.h>
+
+#include "gst/misb/gstmisbkernels.h"
+#include "gst/videoadjust/gstvideolevelskernels.h"
+
+#define MAX_WIDTH 2048
+#define RANDOM_WIDTHS 64
+#define ITERATIONS 4
+/* bytes past the end of each output that must be left untouched */
+#define GUARD 64
+#define GUARD_BYTE 0xa5
+
+static GRand *rng;
+
+static gint
+get_width (gint i)
+{
+  return i < 64 ? i + 1 : g_rand_int_range (rng, 65, MAX_WIDTH + 1);
+}
+
+static void
+fill_random (gpointer data, gsize size)
+{
+  guint8 *bytes = data;
+  gsize i;
+
+  for (i = 0; i < size; i++)
+    bytes[i] = (guint8) g_rand_int (rng);
+}
+
+static void
+check_outputs (const guint8 * ref, const guint8 * out, gsize size,
+    const gchar * kernel, gint width)
+{
+  gsize i;
+
+  for (i = 0; i < size; i++) {
+    if (ref[i] != out[i])
+      fail ("%s width %d: byte %" G_GSIZE_FORMAT " is 0x%02x, expected 0x%02x",
+          kernel, width, i, out[i], ref[i]);
+  }
+  for (i = size; i < size + GUARD; i++) {
+    if (out[i] != GUARD_BYTE)
+      fail ("%s width %d: wrote past the end of the line", kernel, width);
+  }
+}
+
+static void
+setup (void)
+{
+  rng = g_rand_new_with_seed (0x0402);
+}
+
+static void
+teardown (void)
+{
+  g_rand_free (rng);
+  rng = NULL;
+}
+
+GST_START_TEST (test_misb_pack)
+{
+  guint8 *src = g_malloc (2 * MAX_WIDTH + 16);
+  guint8 *ref = g_malloc (4 * (MAX_WIDTH + 16) + GUARD);
+  guint8 *out = g_malloc (4 * (MAX_WIDTH + 16) + GUARD);
+  GstMisbIrPackLineFunc pack;
+  const gchar *name;
+  gint i, n;
+
+  pack = gst_misb_ir_pack_get_line_func (&name);
+  GST_INFO ("pack kernel: %s", name);
+
+  for (i = 0; i < 64 + RANDOM_WIDTHS; i++) {
+    for (n = 0; n < ITERATIONS; n++) {
+      const gint width = get_width (i);
+      const guint offset = g_rand_int_range (rng, 0, 1024);
+      const guint16 *s = (const guint16 *) (src +
+          2 * g_rand_int_range (rng, 0, 8));
+      /* two words per group of three pixels, including the tail */
+      const gsize size = 8 * ((width + 2) / 3);
+      const gsize dst_off = 4 * g_rand_int_range (rng, 0, 4);
+
+      fill_random (src, 2 * MAX_WIDTH + 16);
+      memset (ref, GUARD_BYTE, size + GUARD);
+      memset (out + dst_off, GUARD_BYTE, size + GUARD);
+
+      gst_misb_ir_pack_line_scalar ((guint32 *) ref, s, width, offset);
+      pack ((guint32 *) (out + dst_off), s, width, offset);
+      check_outputs (ref, out + dst_off, size, name, width);
+    }
+  }
+
+  g_free (out);
+  g_free (ref);
+  g_free (src);
+}
+
+GST_END_TEST;
+
+static void
+random_unpack_params (GstMisbIrUnpackParams * params, guint variant)
+{
+  params->offset = (guint16) g_rand_int (rng);
+  params->swap = (variant & 1) != 0;
+  if (variant & 2) {
+    params->shift = 8;
+    params->luma_mask = params->chroma_mask = 0xff;
+  } else {
+    params->shift = g_rand_int_range (rng, 0, 16);
+    params->luma_mask = (guint16) g_rand_int (rng);
+    params->chroma_mask = (guint16) g_rand_int (rng);
+  }
+}
+
+static void
+check_unpack (GstVideoFormat format)
+{
+  const gsize src_size = MAX (((MAX_WIDTH + 47) / 48) * 128, 2 * MAX_WIDTH);
+  guint8 *src = g_malloc (src_size + 16);
+  guint8 *ref = g_malloc (2 * (MAX_WIDTH + 8) + GUARD);
+  guint8 *out = g_malloc (2 * (MAX_WIDTH + 8) + GUARD);
+  GstMisbIrUnpackParams params;
+  GstMisbIrUnpackLineFunc unpack, scalar;
+  const gchar *name;
+  guint variant;
+  gint i, n;
+
+  for (variant = 0; variant < 4; variant++) {
+    for (i = 0; i < 64 + RANDOM_WIDTHS; i++) {
+      for (n = 0; n < ITERATIONS; n++) {
+        const gint width = get_width (i);
+        const gsize size = 2 * width;
+        const gsize dst_off = 2 * g_rand_int_range (rng, 0, 8);
+        const guint8 *s;
+
+        random_unpack_params (&params, variant);
+        if (format == GST_VIDEO_FORMAT_v210) {
+          unpack = gst_misb_ir_unpack_get_v210_line_func (&params, &name);
+          scalar = gst_misb_ir_unpack_v210_line_scalar;
+          /* v210 is read a word at a time */
+          s = src + 4 * g_rand_int_range (rng, 0, 4);
+        } else {
+          unpack = gst_misb_ir_unpack_get_uyvy_line_func (&params, &name);
+          scalar = gst_misb_ir_unpack_uyvy_line_scalar;
+          s = src + g_rand_int_range (rng, 0, 16);
+        }
+
+        fill_random (src, src_size + 16);
+        memset (ref, GUARD_BYTE, size + GUARD);
+        memset (out + dst_off, GUARD_BYTE, size + GUARD);
+
+        scalar ((guint16 *) ref, s, width, &params);
+        unpack ((guint16 *) (out + dst_off), s, width, &params);
+        check_outputs (ref, out + dst_off, size, name, width);
+
+        /* UYVY frames are unpacked in place when the buffer is writable */
+        if (format == GST_VIDEO_FORMAT_UYVY) {
+          memcpy (out + dst_off, s, size);
+          unpack ((guint16 *) (out + dst_off), out + dst_off, width, &params);
+          check_outputs (ref, out + dst_off, size, name, width);
+        }
+      }
+    }
+  }
+
+  g_free (out);
+  g_free (ref);
+  g_free (src);
+}
+
+GST_START_TEST (test_misb_unpack_v210)
+{
+  check_unpack (GST_VIDEO_FORMAT_v210);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_misb_unpack_uyvy)
+{
+  check_unpack (GST_VIDEO_FORMAT_UYVY);
+}
+
+GST_END_TEST;
+
+/* Parameters as gst_videolevels_calculate_lut () sets them up, the SIMD
+ * kernels rely on the same range guarantees */
+static void
+random_levels_params (GstVideoLevelsParams * params, guint8 * lut,
+    GstVideoLevelsMapping mapping)
+{
+  const guint bpp = g_rand_int_range (rng, 9, 17);
+  const guint max_in = (1 << bpp) - 1;
+
+  memset (params, 0, sizeof (*params));
+  params->mapping = mapping;
+  params->swap = g_rand_boolean (rng);
+  params->mask = max_in;
+  params->lut = lut;
+
+  if (mapping == GST_VIDEOLEVELS_MAPPING_LINEAR) {
+    guint low_in, high_in, low_out, high_out;
+
+    do {
+      low_in = g_rand_int_range (rng, 0, max_in + 1);
+      high_in = g_rand_int_range (rng, 0, max_in + 1);
+      low_out = g_rand_int_range (rng, 0, 256);
+      high_out = g_rand_int_range (rng, low_out, 256);
+    } while (low_in >= high_in || high_out - low_out >= high_in - low_in);
+
+    params->low_in = low_in;
+    params->range_in = high_in - low_in;
+    params->scale = (guint16) ((((guint64) (high_out - low_out) << 16) +
+            params->range_in - 1) / params->range_in);
+    params->low_out = low_out;
+  } else if (mapping == GST_VIDEOLEVELS_MAPPING_SHIFT) {
+    const guint bits = g_rand_int_range (rng, 8, bpp + 1);
+
+    params->high_in = (1 << bits) - 1;
+    params->shift = bits - 8;
+  } else {
+    fill_random (lut, max_in + 1);
+  }
+}
+
+static void
+check_levels (GstVideoLevelsMapping mapping)
+{
+  guint8 *src = g_malloc (2 * MAX_WIDTH + 16);
+  guint8 *ref = g_malloc (MAX_WIDTH + GUARD);
+  guint8 *out = g_malloc (MAX_WIDTH + 16 + GUARD);
+  guint8 *lut = g_malloc (65536);
+  GstVideoLevelsParams params;
+  GstVideoLevelsLineFunc func;
+  const gchar *name;
+  gint i, n;
+
+  for (i = 0; i < 64 + RANDOM_WIDTHS; i++) {
+    for (n = 0; n < ITERATIONS; n++) {
+      const gint width = get_width (i);
+      const guint16 *s = (const guint16 *) (src +
+          2 * g_rand_int_range (rng, 0, 8));
+      const gsize dst_off = g_rand_int_range (rng, 0, 16);
+
+      random_levels_params (&params, lut, mapping);
+      func = gst_videolevels_get_line_func (&params, &name);
+
+      fill_random (src, 2 * MAX_WIDTH + 16);
+      memset (ref, GUARD_BYTE, width + GUARD);
+      memset (out + dst_off, GUARD_BYTE, width + GUARD);
+
+      gst_videolevels_line_scalar (ref, s, width, &params);
+      func (out + dst_off, s, width, &params);
+      check_outputs (ref, out + dst_off, width, name, width);
+    }
+  }
+
+  g_free (lut);
+  g_free (out);
+  g_free (ref);
+  g_free (src);
+}
+
+GST_START_TEST (test_videolevels_linear)
+{
+  check_levels (GST_VIDEOLEVELS_MAPPING_LINEAR);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_videolevels_shift)
+{
+  check_levels (GST_VIDEOLEVELS_MAPPING_SHIFT);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_videolevels_lut)
+{
+  check_levels (GST_VIDEOLEVELS_MAPPING_LUT);
+}
+
+GST_END_TEST;
+
+#define TILES 4
+
+GST_START_TEST (test_videolevels_tile)
+{
+  guint8 *src = g_malloc (2 * MAX_WIDTH + 16);
+  guint8 *ref = g_malloc (MAX_WIDTH + GUARD);
+  guint8 *out = g_malloc (MAX_WIDTH + 16 + GUARD);
+  guint8 *tables = g_malloc (2 * TILES * 4096);
+  guint32 *x1 = g_new (guint32, MAX_WIDTH);
+  guint32 *x2 = g_new (guint32, MAX_WIDTH);
+  guint16 *wx = g_new (guint16, MAX_WIDTH);
+  GstVideoLevelsTileLineFunc func;
+  GstVideoLevelsTileRow row;
+  const gchar *name;
+  gint i, n, c;
+
+  func = gst_videolevels_get_tile_line_func (&name);
+  GST_INFO ("tile kernel: %s", name);
+
+  for (i = 0; i < 64 + RANDOM_WIDTHS; i++) {
+    for (n = 0; n < ITERATIONS; n++) {
+      const gint width = get_width (i);
+      const guint bpp = g_rand_int_range (rng, 9, 17);
+      const guint bins_bits = g_rand_int_range (rng, 1, MIN (bpp, 12) + 1);
+      const guint nbins = 1 << bins_bits;
+      const guint16 *s = (const guint16 *) (src +
+          2 * g_rand_int_range (rng, 0, 8));
+      const gsize dst_off = g_rand_int_range (rng, 0, 16);
+
+      row.swap = g_rand_boolean (rng);
+      row.mask = (1 << bpp) - 1;
+      row.shift = bpp - bins_bits;
+      row.top = tables;
+      row.bottom = tables + TILES * nbins;
+      row.wy = g_rand_int_range (rng, 0, 257);
+      row.x1 = x1;
+      row.x2 = x2;
+      row.wx = wx;
+
+      fill_random (tables, 2 * TILES * nbins);
+      for (c = 0; c < width; c++) {
+        x1[c] = g_rand_int_range (rng, 0, TILES) * nbins;
+        x2[c] = g_rand_int_range (rng, 0, TILES) * nbins;
+        wx[c] = g_rand_int_range (rng, 0, 257);
+      }
+
+      fill_random (src, 2 * MAX_WIDTH + 16);
+      memset (ref, GUARD_BYTE, width + GUARD);
+      memset (out + dst_off, GUARD_BYTE, width + GUARD);
+
+      gst_videolevels_tile_line_scalar (ref, s, width, &row);
+      func (out + dst_off, s, width, &row);
+      check_outputs (ref, out + dst_off, width, name, width);
+    }
+  }
+
+  g_free (wx);
+  g_free (x2);
+  g_free (x1);
+  g_free (tables);
+  g_free (out);
+  g_free (ref);
+  g_free (src);
+}
+
+GST_END_TEST;
+
+static Suite *
+kernels_suite (void)
+{
+  Suite *s = suite_create ("kernels");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_checked_fixture (tc_chain, setup, teardown);
+  tcase_add_test (tc_chain, test_misb_pack);
+  tcase_add_test (tc_chain, test_misb_unpack_v210);
+  tcase_add_test (tc_chain, test_misb_unpack_uyvy);
+  tcase_add_test (tc_chain, test_videolevels_linear);
+  tcase_add_test (tc_chain, test_videolevels_shift);
+  tcase_add_test (tc_chain, test_videolevels_lut);
+  tcase_add_test (tc_chain, test_videolevels_tile);
+
+  return s;
+}
+
+GST_CHECK_MAIN (kernels);
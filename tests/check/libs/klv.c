@@ -0,0 +1,617 @@
+/* GStreamer
+ * Copyright (C) 2010 United States Government, Joshua M. Doe <oss@nvl.army.mil>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Checks the klv library against a published MISB ST 0601 example packet
+ * and against references computed here */
+
+#include <math.h>
+#include <string.h>
+
+#include <gst/check/gstcheck.h>
+
+#include "klv.h"
+#include "klvst0601.h"
+
+/* a published UAS Datalink Local Set example, time stamped 2009-06-17
+ * 16:53:05.099653 UTC, whose checksum is 0x1C5F */
+static const guint8 st0601_example[] = {
+  0x06, 0x0E, 0x2B, 0x34, 0x02, 0x0B, 0x01, 0x01,
+  0x0E, 0x01, 0x03, 0x01, 0x01, 0x00, 0x00, 0x00,
+  0x81, 0x91,
+  0x02, 0x08, 0x00, 0x04, 0x6C, 0x8E, 0x20, 0x03, 0x83, 0x85,
+  0x41, 0x01, 0x01,
+  0x05, 0x02, 0x3D, 0x3B,
+  0x06, 0x02, 0x15, 0x80,
+  0x07, 0x02, 0x01, 0x52,
+  0x0B, 0x03, 0x45, 0x4F, 0x4E,
+  0x0C, 0x0E, 0x47, 0x65, 0x6F, 0x64, 0x65, 0x74, 0x69, 0x63, 0x20, 0x57,
+  0x47, 0x53, 0x38, 0x34,
+  0x0D, 0x04, 0x4D, 0xC4, 0xDC, 0xBB,
+  0x0E, 0x04, 0xB1, 0xA8, 0x6C, 0xFE,
+  0x0F, 0x02, 0x1F, 0x4A,
+  0x10, 0x02, 0x00, 0x85,
+  0x11, 0x02, 0x00, 0x4B,
+  0x12, 0x04, 0x20, 0xC8, 0xD2, 0x7D,
+  0x13, 0x04, 0xFC, 0xDD, 0x02, 0xD8,
+  0x14, 0x04, 0xFE, 0xB8, 0xCB, 0x61,
+  0x15, 0x04, 0x00, 0x8F, 0x3E, 0x61,
+  0x16, 0x04, 0x00, 0x00, 0x01, 0xC9,
+  0x17, 0x04, 0x4D, 0xDD, 0x8C, 0x2A,
+  0x18, 0x04, 0xB1, 0xBE, 0x9E, 0xF4,
+  0x19, 0x02, 0x0B, 0x85,
+  0x28, 0x04, 0x4D, 0xDD, 0x8C, 0x2A,
+  0x29, 0x04, 0xB1, 0xBE, 0x9E, 0xF4,
+  0x2A, 0x02, 0x0B, 0x85,
+  0x38, 0x01, 0x2E,
+  0x39, 0x04, 0x00, 0x8D, 0xD4, 0x29,
+  0x01, 0x02, 0x1C, 0x5F
+};
+
+/* where the local set starts in st0601_example, after key and BER length */
+#define ST0601_EXAMPLE_SET 18
+
+/* the mapped values of st0601_example in engineering units */
+static const struct
+{
+  guint tag;
+  gsize length;
+  gdouble value;
+} st0601_example_values[] = {
+  {5, 2, 86.10666056305791},    /* platform heading, 0..360 */
+  {6, 2, 3.359477523117771},    /* platform pitch, +-20 */
+  {7, 2, 0.5157628101443525},   /* platform roll, +-50 */
+  {13, 4, 54.681323284600545},  /* sensor latitude, +-90 */
+  {14, 4, -110.1685597701783},  /* sensor longitude, +-180 */
+  {15, 2, 1532.272831311513},   /* sensor altitude, -900..19000 */
+  {16, 2, 0.3653009842069123},
+  {17, 2, 0.20599679560540168},
+  {18, 4, 46.10314941175821},
+  {19, 4, -4.41094972398642},
+  {20, 4, 358.2026063087868},
+  {21, 4, 10928.624544974562},
+  {23, 4, 54.749123451648806},
+  {24, 4, -110.0466381153309},
+  {25, 2, -4.52277409018086},
+  {40, 4, 54.749123451648806},
+  {41, 4, -110.0466381153309},
+  {42, 2, -4.52277409018086},
+  {57, 4, 10820.674945325747}
+};
+
+/* CRC-16-CCITT one bit at a time */
+static guint16
+crc16_reference (const guint8 * data, gsize size)
+{
+  guint16 crc = 0xffff;
+  gsize i;
+  gint j;
+
+  for (i = 0; i < size; i++) {
+    crc ^= data[i] << 8;
+    for (j = 0; j < 8; j++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+
+  return crc;
+}
+
+GST_START_TEST (test_crc16_ccitt)
+{
+  GRand *rand = g_rand_new_with_seed (601);
+  guint8 data[1030];
+  gsize offset, size, split;
+
+  /* the CRC-16/CCITT-FALSE check value */
+  fail_unless_equals_int (gst_klv_crc16_ccitt ((const guint8 *) "123456789",
+          9), 0x29b1);
+  fail_unless_equals_int (gst_klv_crc16_ccitt (NULL, 0), 0xffff);
+
+  for (size = 0; size < sizeof (data); size++)
+    data[size] = (guint8) g_rand_int (rand);
+
+  /* every tail length after the 8-byte blocks, at every alignment */
+  for (offset = 0; offset < 8; offset++) {
+    for (size = 0; size <= 64; size++) {
+      fail_unless_equals_int (gst_klv_crc16_ccitt (data + offset, size),
+          crc16_reference (data + offset, size));
+    }
+  }
+  fail_unless_equals_int (gst_klv_crc16_ccitt (data + 3, 1024),
+      crc16_reference (data + 3, 1024));
+
+  /* continuing a CRC gives the same result as computing it in one go */
+  for (split = 0; split <= 100; split += 7) {
+    fail_unless_equals_int (gst_klv_crc16_ccitt_update
+        (gst_klv_crc16_ccitt (data, split), data + split, 100 - split),
+        crc16_reference (data, 100));
+  }
+
+  g_rand_free (rand);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_st0601_checksum)
+{
+  guint8 packet[sizeof (st0601_example)];
+  gsize size = sizeof (packet);
+
+  fail_unless_equals_int (gst_klv_st0601_checksum (st0601_example, size - 2),
+      0x1c5f);
+  fail_unless (gst_klv_st0601_validate_checksum (st0601_example, size));
+
+  /* a single changed bit in the key, a value or the checksum itself */
+  memcpy (packet, st0601_example, size);
+  packet[8] ^= 0x01;
+  fail_if (gst_klv_st0601_validate_checksum (packet, size));
+
+  memcpy (packet, st0601_example, size);
+  packet[60] ^= 0x80;
+  fail_if (gst_klv_st0601_validate_checksum (packet, size));
+  fail_unless (gst_klv_st0601_update_checksum (packet, size));
+  fail_unless (gst_klv_st0601_validate_checksum (packet, size));
+  fail_unless_equals_int (GST_READ_UINT16_BE (packet + size - 2),
+      gst_klv_st0601_checksum (packet, size - 2));
+
+  memcpy (packet, st0601_example, size);
+  packet[size - 1] ^= 0x01;
+  fail_if (gst_klv_st0601_validate_checksum (packet, size));
+
+  /* the sum, not a CRC, is what ST 0601 asks for */
+  fail_unless (gst_klv_crc16_ccitt (st0601_example, size - 2) != 0x1c5f);
+
+  /* truncated, or without the checksum as last item */
+  fail_if (gst_klv_st0601_validate_checksum (st0601_example, size - 1));
+  memcpy (packet, st0601_example, size);
+  packet[size - 4] = 0x02;
+  fail_if (gst_klv_st0601_validate_checksum (packet, size));
+  fail_if (gst_klv_st0601_update_checksum (packet, size));
+}
+
+GST_END_TEST;
+
+static void
+assert_close (gdouble value, gdouble expected, gdouble tolerance)
+{
+  fail_unless (fabs (value - expected) <= tolerance,
+      "%.17g differs from %.17g by more than %g", value, expected, tolerance);
+}
+
+/* engineering units per step of the integer encoding */
+static gdouble
+st0601_step (guint tag)
+{
+  const GstKLVST0601TagInfo *info = gst_klv_st0601_get_tag_info (tag);
+  gdouble range = ldexp (1.0, 8 * info->length);
+
+  if (info->type == GST_KLV_ST0601_TYPE_IMAPPED)
+    return info->max / (range / 2 - 1);
+
+  return (info->max - info->min) / (range - 1);
+}
+
+GST_START_TEST (test_st0601_decode)
+{
+  const guint8 *set = st0601_example + ST0601_EXAMPLE_SET;
+  gsize size = sizeof (st0601_example) - ST0601_EXAMPLE_SET;
+  GValue value = G_VALUE_INIT;
+  gdouble result;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (st0601_example_values); i++) {
+    guint tag = st0601_example_values[i].tag;
+
+    fail_unless (gst_klv_st0601_get_double (set, size, tag, &result),
+        "tag %u", tag);
+    assert_close (result, st0601_example_values[i].value, 1e-9);
+  }
+
+  fail_unless (gst_klv_st0601_get_value (set, size, 2, &value));
+  fail_unless (G_VALUE_HOLDS (&value, G_TYPE_UINT64));
+  fail_unless_equals_uint64 (g_value_get_uint64 (&value),
+      G_GUINT64_CONSTANT (1245257585099653));
+  g_value_unset (&value);
+
+  fail_unless (gst_klv_st0601_get_value (set, size, 12, &value));
+  fail_unless_equals_string (g_value_get_string (&value), "Geodetic WGS84");
+  g_value_unset (&value);
+
+  /* not numeric, or not in the packet */
+  fail_if (gst_klv_st0601_get_double (set, size, 12, &result));
+  fail_if (gst_klv_st0601_get_double (set, size, 3, &result));
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_st0601_encode)
+{
+  const guint8 *set = st0601_example + ST0601_EXAMPLE_SET;
+  gsize size = sizeof (st0601_example) - ST0601_EXAMPLE_SET;
+  guint8 data[8];
+  guint i;
+
+  /* the engineering values encode back to the bytes of the example */
+  for (i = 0; i < G_N_ELEMENTS (st0601_example_values); i++) {
+    guint tag = st0601_example_values[i].tag;
+    gsize length = st0601_example_values[i].length;
+    const guint8 *expected;
+    gsize expected_length;
+
+    fail_unless (gst_klv_local_set_find (set, size, tag, &expected,
+            &expected_length));
+    fail_unless_equals_int (expected_length, length);
+    fail_unless (gst_klv_st0601_item_set_double (tag,
+            st0601_example_values[i].value, data, length), "tag %u", tag);
+    fail_unless (memcmp (data, expected, length) == 0, "tag %u", tag);
+  }
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_st0601_round_trip)
+{
+  /* 2 and 4 byte fields, signed and unsigned, with and without offset */
+  static const guint tags[] = { 5, 6, 13, 14, 15, 18, 19, 21, 26 };
+  GRand *rand = g_rand_new_with_seed (601);
+  guint8 data[8];
+  guint i, n;
+
+  for (i = 0; i < G_N_ELEMENTS (tags); i++) {
+    const GstKLVST0601TagInfo *info = gst_klv_st0601_get_tag_info (tags[i]);
+    gdouble step = st0601_step (tags[i]);
+
+    for (n = 0; n < 1000; n++) {
+      gdouble value, result;
+
+      /* the ends of the range, then random values in between */
+      if (n < 2)
+        value = n == 0 ? info->min : info->max;
+      else
+        value = g_rand_double_range (rand, info->min, info->max);
+
+      fail_unless (gst_klv_st0601_item_set_double (tags[i], value, data,
+              info->length));
+      fail_unless (gst_klv_st0601_item_get_double (tags[i], data,
+              info->length, &result));
+      assert_close (result, value, step / 2 + 1e-12 * fabs (value));
+    }
+  }
+
+  /* 4 bytes give a latitude to about 4 mm, 2 bytes a heading to 0.0055 deg */
+  fail_unless (st0601_step (13) < 5e-8);
+  assert_close (st0601_step (5), 360.0 / 65535, 1e-15);
+
+  g_rand_free (rand);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_st0601_out_of_range)
+{
+  static const guint8 error_4[] = { 0x80, 0x00, 0x00, 0x00 };
+  static const guint8 error_2[] = { 0x80, 0x00 };
+  guint8 data[4];
+  gdouble result;
+
+  /* signed mapped values out of range encode as the reserved most negative
+   * value, which doesn't decode */
+  fail_unless (gst_klv_st0601_item_set_double (13, 90.000001, data, 4));
+  fail_unless (memcmp (data, error_4, 4) == 0);
+  fail_if (gst_klv_st0601_item_get_double (13, data, 4, &result));
+  fail_unless (gst_klv_st0601_item_set_double (14, -180.5, data, 4));
+  fail_unless (memcmp (data, error_4, 4) == 0);
+  fail_unless (gst_klv_st0601_item_set_double (13, NAN, data, 4));
+  fail_unless (memcmp (data, error_4, 4) == 0);
+  fail_unless (gst_klv_st0601_item_set_double (6, 20.5, data, 2));
+  fail_unless (memcmp (data, error_2, 2) == 0);
+  fail_if (gst_klv_st0601_item_get_double (6, data, 2, &result));
+
+  /* the ends of the range are one step inside the reserved value */
+  fail_unless (gst_klv_st0601_item_set_double (13, -90.0, data, 4));
+  fail_unless_equals_int (GST_READ_UINT32_BE (data), 0x80000001);
+  fail_unless (gst_klv_st0601_item_get_double (13, data, 4, &result));
+  assert_close (result, -90.0, 1e-12);
+  fail_unless (gst_klv_st0601_item_set_double (13, 90.0, data, 4));
+  fail_unless_equals_int (GST_READ_UINT32_BE (data), 0x7fffffff);
+
+  /* unsigned mapped values have no reserved value and are clamped */
+  fail_unless (gst_klv_st0601_item_set_double (15, 20000.0, data, 2));
+  fail_unless_equals_int (GST_READ_UINT16_BE (data), 0xffff);
+  fail_unless (gst_klv_st0601_item_get_double (15, data, 2, &result));
+  assert_close (result, 19000.0, 1e-9);
+  fail_unless (gst_klv_st0601_item_set_double (15, -1000.0, data, 2));
+  fail_unless_equals_int (GST_READ_UINT16_BE (data), 0x0000);
+  fail_unless (gst_klv_st0601_item_get_double (15, data, 2, &result));
+  assert_close (result, -900.0, 1e-9);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_st0601_field_length)
+{
+  guint8 data[8] = { 0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0 };
+  gdouble result;
+
+  /* a 4-byte latitude is neither written nor read as 2 bytes, and the other
+   * way round for a 2-byte altitude */
+  fail_if (gst_klv_st0601_item_set_double (13, 45.0, data, 2));
+  fail_if (gst_klv_st0601_item_get_double (13, data, 2, &result));
+  fail_if (gst_klv_st0601_item_set_double (15, 100.0, data, 4));
+  fail_if (gst_klv_st0601_item_get_double (15, data, 4, &result));
+  fail_unless_equals_int (GST_READ_UINT32_BE (data), 0x12345678);
+
+  /* a thousandth of a degree is lost in a 2-byte heading, but kept in a
+   * 4-byte azimuth over the same range */
+  fail_unless (gst_klv_st0601_item_set_double (5, 0.001, data, 2));
+  fail_unless_equals_int (GST_READ_UINT16_BE (data), 0);
+  fail_unless (gst_klv_st0601_item_set_double (18, 0.001, data, 4));
+  fail_unless_equals_int (GST_READ_UINT32_BE (data), 11930);
+
+  /* not numeric */
+  fail_if (gst_klv_st0601_item_set_double (3, 1.0, data, 4));
+  fail_if (gst_klv_st0601_item_set_double (GST_KLV_ST0601_MAX_TAG + 1, 1.0,
+          data, 4));
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_ber_length)
+{
+  static const gsize lengths[] = { 0, 1, 127, 128, 255, 256, 65535, 65536,
+    G_MAXUINT32, G_MAXSIZE
+  };
+  static const guint8 long_1[] = { 0x81, 0x80 };
+  static const guint8 long_2[] = { 0x82, 0x01, 0x00 };
+  static const guint8 long_padded[] = { 0x84, 0x00, 0x00, 0x00, 0x05 };
+  static const guint8 indefinite[] = { 0x80, 0x00 };
+  static const guint8 too_long[] = { 0x89, 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+  guint8 data[9];
+  gsize length;
+  guint consumed, i;
+
+  fail_unless (gst_klv_parse_ber_length (long_1, 2, &length, &consumed));
+  fail_unless_equals_int (length, 128);
+  fail_unless_equals_int (consumed, 2);
+  fail_unless (gst_klv_parse_ber_length (long_2, 3, &length, &consumed));
+  fail_unless_equals_int (length, 256);
+  fail_unless_equals_int (consumed, 3);
+
+  /* the long form doesn't have to be minimal */
+  fail_unless (gst_klv_parse_ber_length (long_padded, 5, &length,
+          &consumed));
+  fail_unless_equals_int (length, 5);
+  fail_unless_equals_int (consumed, 5);
+
+  fail_if (gst_klv_parse_ber_length (indefinite, 2, &length, &consumed));
+  fail_if (gst_klv_parse_ber_length (too_long, 10, &length, &consumed));
+
+  /* truncated long forms */
+  fail_if (gst_klv_parse_ber_length (long_1, 0, &length, &consumed));
+  fail_if (gst_klv_parse_ber_length (long_1, 1, &length, &consumed));
+  fail_if (gst_klv_parse_ber_length (long_2, 2, &length, &consumed));
+  fail_if (gst_klv_parse_ber_length (long_padded, 4, &length, &consumed));
+
+  /* the encoder uses the short form or the shortest long form */
+  for (i = 0; i < G_N_ELEMENTS (lengths); i++) {
+    guint n = gst_klv_encode_ber_length (lengths[i], data);
+    guint expected = 1;
+
+    if (lengths[i] >= 128) {
+      for (length = lengths[i]; length > 0; length >>= 8)
+        expected++;
+    }
+
+    fail_unless_equals_int (n, expected);
+    fail_unless_equals_int (gst_klv_encode_ber_length (lengths[i], NULL), n);
+    fail_unless (gst_klv_parse_ber_length (data, n, &length, &consumed));
+    fail_unless (length == lengths[i]);
+    fail_unless_equals_int (consumed, n);
+  }
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_ber_oid)
+{
+  static const struct
+  {
+    guint tag;
+    guint size;
+  } tags[] = {
+    {0, 1}, {1, 1}, {127, 1}, {128, 2}, {16383, 2}, {16384, 3}, {2097151, 3},
+    {2097152, 4}, {268435455, 4}, {268435456, 5}, {G_MAXUINT32, 5}
+  };
+  static const guint8 two_bytes[] = { 0x81, 0x00 };
+  static const guint8 six_bytes[] = { 0x80, 0x80, 0x80, 0x80, 0x81, 0x01 };
+  static const guint8 over_32_bits[] = { 0x90, 0x80, 0x80, 0x80, 0x00 };
+  static const guint8 max_32_bits[] = { 0x8f, 0xff, 0xff, 0xff, 0x7f };
+  guint8 data[5];
+  guint tag, consumed, i;
+
+  fail_unless (gst_klv_parse_ber_oid (two_bytes, 2, &tag, &consumed));
+  fail_unless_equals_int (tag, 128);
+  fail_unless_equals_int (consumed, 2);
+
+  fail_unless (gst_klv_parse_ber_oid (max_32_bits, 5, &tag, &consumed));
+  fail_unless (tag == G_MAXUINT32);
+  fail_unless_equals_int (consumed, 5);
+
+  /* past five bytes, past 32 bits, or truncated */
+  fail_if (gst_klv_parse_ber_oid (six_bytes, 6, &tag, &consumed));
+  fail_if (gst_klv_parse_ber_oid (over_32_bits, 5, &tag, &consumed));
+  fail_if (gst_klv_parse_ber_oid (two_bytes, 1, &tag, &consumed));
+  fail_if (gst_klv_parse_ber_oid (two_bytes, 0, &tag, &consumed));
+
+  /* whatever the encoder writes, the parser reads back */
+  for (i = 0; i < G_N_ELEMENTS (tags); i++) {
+    guint n = gst_klv_encode_ber_oid (tags[i].tag, data);
+
+    fail_unless_equals_int (n, tags[i].size);
+    fail_unless_equals_int (gst_klv_encode_ber_oid (tags[i].tag, NULL), n);
+    fail_unless (gst_klv_parse_ber_oid (data, n, &tag, &consumed),
+        "tag %u", tags[i].tag);
+    fail_unless (tag == tags[i].tag);
+    fail_unless_equals_int (consumed, n);
+  }
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_reader_truncated)
+{
+  const guint8 *set = st0601_example + ST0601_EXAMPLE_SET;
+  gsize set_size = sizeof (st0601_example) - ST0601_EXAMPLE_SET;
+  GstKLVReader reader;
+  const guint8 *key, *value;
+  gsize length, size, end;
+  guint tag, n_items;
+  guint8 packet[sizeof (st0601_example)];
+
+  /* the example uses the long form packet length 0x81 0x91 */
+  gst_klv_reader_init (&reader, st0601_example, sizeof (st0601_example));
+  fail_unless (gst_klv_reader_next_packet (&reader, &key, &value, &length));
+  fail_unless (key == st0601_example);
+  fail_unless (value == set);
+  fail_unless_equals_int (length, set_size);
+  fail_if (gst_klv_reader_next_packet (&reader, &key, &value, &length));
+
+  n_items = 0;
+  gst_klv_reader_init (&reader, set, set_size);
+  while (gst_klv_reader_next_item (&reader, &tag, &value, &length))
+    n_items++;
+  fail_unless_equals_int (n_items, 26);
+  fail_unless_equals_int (reader.pos, set_size);
+
+  /* a packet cut anywhere is rejected as a whole */
+  for (size = 0; size < sizeof (st0601_example); size++) {
+    gst_klv_reader_init (&reader, st0601_example, size);
+    fail_if (gst_klv_reader_next_packet (&reader, &key, &value, &length),
+        "size %" G_GSIZE_FORMAT, size);
+    fail_unless_equals_int (reader.pos, 0);
+  }
+
+  /* a local set cut anywhere yields the complete items before the cut */
+  for (size = 0; size < set_size; size++) {
+    gst_klv_reader_init (&reader, set, size);
+    end = 0;
+    while (gst_klv_reader_next_item (&reader, &tag, &value, &length)) {
+      fail_unless (value + length <= set + size);
+      end = reader.pos;
+    }
+    fail_unless (end <= size);
+    fail_unless (size - end < 16, "size %" G_GSIZE_FORMAT, size);
+  }
+
+  /* a packet without a Universal Label key */
+  memcpy (packet, st0601_example, sizeof (packet));
+  packet[3] = 0x35;
+  gst_klv_reader_init (&reader, packet, sizeof (packet));
+  fail_if (gst_klv_reader_next_packet (&reader, &key, &value, &length));
+
+  /* an item with a tag longer than any 32-bit tag */
+  memset (packet, 0x80, 6);
+  packet[6] = 0x01;
+  packet[7] = 0x00;
+  gst_klv_reader_init (&reader, packet, 8);
+  fail_if (gst_klv_reader_next_item (&reader, &tag, &value, &length));
+  fail_if (gst_klv_local_set_find (packet, 8, 1, &value, &length));
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_builder_round_trip)
+{
+  const guint8 *set = st0601_example + ST0601_EXAMPLE_SET;
+  gsize set_size = sizeof (st0601_example) - ST0601_EXAMPLE_SET;
+  static const guint tags[] = { 1, 127, 128, 300, 16384, G_MAXUINT32 };
+  GstKLVBuilder *builder;
+  GstKLVReader reader;
+  const guint8 *data, *value;
+  gsize size, length;
+  guint tag, i;
+  gint item = -1;
+
+  /* rebuilding the example item by item gives the same bytes */
+  builder = gst_klv_builder_new (gst_klv_st0601_get_key ());
+  gst_klv_reader_init (&reader, set, set_size);
+  while (gst_klv_reader_next_item (&reader, &tag, &value, &length))
+    item = gst_klv_builder_add_item (builder, tag, value, length);
+  data = gst_klv_builder_get_data (builder, &size);
+  fail_unless_equals_int (size, sizeof (st0601_example));
+  fail_unless (memcmp (data, st0601_example, size) == 0);
+
+  /* so does patching the checksum back in */
+  fail_unless (gst_klv_builder_set_item_uint (builder, item, 0));
+  fail_if (gst_klv_st0601_validate_checksum (data, size));
+  fail_unless (gst_klv_st0601_builder_set_checksum (builder, item));
+  fail_unless (memcmp (data, st0601_example, size) == 0);
+  gst_klv_builder_free (builder);
+
+  /* tags of every BER-OID size, and a set that needs a long form length */
+  builder = gst_klv_builder_new (gst_klv_st0601_get_key ());
+  for (i = 0; i < G_N_ELEMENTS (tags); i++)
+    gst_klv_builder_add_item (builder, tags[i], NULL, 40 * i);
+  for (i = 0; i < G_N_ELEMENTS (tags); i++) {
+    fail_unless (gst_klv_builder_get_item_data (builder, i, &length) != NULL);
+    fail_unless_equals_int (length, 40 * i);
+    memset (gst_klv_builder_get_item_data (builder, i, NULL), i, length);
+  }
+
+  data = gst_klv_builder_get_data (builder, &size);
+  gst_klv_reader_init (&reader, data, size);
+  fail_unless (gst_klv_reader_next_packet (&reader, NULL, &value, &length));
+  fail_unless (length > 255);
+  fail_unless_equals_int (value - data, 16 + 3);
+
+  gst_klv_reader_init (&reader, value, length);
+  for (i = 0; i < G_N_ELEMENTS (tags); i++) {
+    fail_unless (gst_klv_reader_next_item (&reader, &tag, &value, &length));
+    fail_unless (tag == tags[i]);
+    fail_unless_equals_int (length, 40 * i);
+    fail_unless (length == 0 || (value[0] == i && value[length - 1] == i));
+  }
+  fail_if (gst_klv_reader_next_item (&reader, &tag, &value, &length));
+  gst_klv_builder_free (builder);
+}
+
+GST_END_TEST;
+
+static Suite *
+klv_suite (void)
+{
+  Suite *s = suite_create ("klv");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_crc16_ccitt);
+  tcase_add_test (tc_chain, test_st0601_checksum);
+  tcase_add_test (tc_chain, test_st0601_decode);
+  tcase_add_test (tc_chain, test_st0601_encode);
+  tcase_add_test (tc_chain, test_st0601_round_trip);
+  tcase_add_test (tc_chain, test_st0601_out_of_range);
+  tcase_add_test (tc_chain, test_st0601_field_length);
+  tcase_add_test (tc_chain, test_ber_length);
+  tcase_add_test (tc_chain, test_ber_oid);
+  tcase_add_test (tc_chain, test_reader_truncated);
+  tcase_add_test (tc_chain, test_builder_round_trip);
+
+  return s;
+}
+
+GST_CHECK_MAIN (klv);